@@ -0,0 +1,249 @@
+/* batchAnalysis.h Defines structures and declares functions used in offline analysis of audio files
+ * Copyright (c) 2017 Jay Biernat
+ * Copyright (c) 2017 University of Rochester
+ *
+ * This file is part of Musical Mood Detector and Visualizer
+ *
+ * Musical Mood Detector and Visualizer is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Musical Mood Detector and Visualizer is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even
+ * the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Musical Mood Detector and Visualizer.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BATCHANALYSIS_H_INCLUDED
+#define BATCHANALYSIS_H_INCLUDED
+
+#include <windows.h>
+#include "featureExtraction.h"
+#include "moodRecognition.h"
+
+#define BA_MAX_PATH 512         /* Maximum characters in a path of an input or output file */
+#define BA_MAX_THREADS 64       /* Maximum number of worker threads */
+#define BA_SEGMENT_SECONDS 60   /* Default length of audio analysed by one task when long files are split */
+
+/** Sample formats supported by the audio file reader */
+typedef enum
+{
+    BA_SAMPLE_INT16,
+    BA_SAMPLE_FLOAT32
+}
+ba_sample_t;
+
+/******************** Structures **********************/
+
+/** A memory-mapped WAV or raw PCM file */
+typedef struct
+{
+    HANDLE                  file;
+    HANDLE                  mapping;
+    const unsigned char     *view;          /* Start of the mapped file */
+    LONGLONG                size;           /* Size of the mapped file in bytes */
+
+    const unsigned char     *samples;       /* First sample of the interleaved PCM data */
+    ba_sample_t             sample_type;
+    int                     channels;
+    int                     fs;
+    LONGLONG                num_frames;     /* Number of samples per channel */
+
+    int                     init_success;   /* 1 on successful initialization, 0 otherwise */
+}
+ba_audio_file;
+
+/** Options given on the command line for batch analysis */
+typedef struct
+{
+    int             raw;                /* 1 if the input files are headerless PCM, 0 if they are WAV files */
+    ba_sample_t     raw_sample_type;    /* Format, channels and sampling frequency of raw files */
+    int             raw_channels;
+    int             raw_fs;
+
+    int             predict_every;      /* Number of frames between predictions once the first window is full */
+    const char      *output_directory;  /* Directory for the output files, NULL to write them next to the input */
+
+    int             num_threads;        /* Number of worker threads */
+    float           segment_seconds;    /* Files longer than two segments are split into tasks of this length */
+}
+ba_options;
+
+/** A unit of work: the predictions [first_prediction, end_prediction) of one file.  first_prediction == -1 marks
+    a file that has not been opened yet; the worker that opens it splits it into segments */
+typedef struct
+{
+    int     file_index;
+    long    first_prediction;
+    long    end_prediction;
+}
+ba_task;
+
+/** Double-ended queue of tasks owned by one worker.  The owner pushes and pops at the bottom, other workers
+    steal from the top */
+typedef struct
+{
+    ba_task             *tasks;
+    int                 capacity;
+    int                 top;        /* Index of the oldest task */
+    int                 bottom;     /* Index one past the newest task */
+    CRITICAL_SECTION    lock;
+}
+ba_deque;
+
+/** State of one input file shared by the tasks analysing it */
+typedef struct
+{
+    const char      *path;
+    ba_audio_file   audio_file;         /* Mapped by the worker that opens the file, closed by the last task */
+    long            num_predictions;
+    float           *arousal;           /* Predictions filled in by the tasks */
+    float           *valence;
+    volatile LONG   tasks_remaining;    /* Tasks of this file that have not finished */
+}
+ba_file_job;
+
+struct ba_scheduler_s;
+
+/** A worker thread with its own extraction state, FFTW plan and block of feature vectors */
+typedef struct
+{
+    int                         index;
+    struct ba_scheduler_s       *scheduler;
+    fe_extraction_thread_data   extraction_data;
+    float                       *features;
+    ba_deque                    deque;
+
+    double                      audio_seconds;  /* Length of the files opened by this worker */
+    int                         tasks_done;
+    int                         steals;         /* Tasks taken from other workers */
+}
+ba_worker;
+
+/** A pool of workers analysing a list of files.  The models are shared read-only between the workers */
+typedef struct ba_scheduler_s
+{
+    ba_worker           *workers;
+    int                 num_workers;
+    ba_file_job         *jobs;
+    int                 num_jobs;
+
+    const mr_model      *arousal_mdl;
+    const mr_model      *valence_mdl;
+    ba_options          *options;
+
+    volatile LONG       tasks_pending;  /* Tasks queued or running, the workers exit when it reaches zero */
+    HANDLE              work;           /* Semaphore released for each segment queued and, by the task that brings
+                                           tasks_pending to zero, once per worker.  Idle workers wait on it */
+    volatile LONG       files_failed;
+}
+ba_scheduler;
+
+/************************** Functions ************************/
+
+/** @brief Runs the batch analysis mode.  Called by main() for "MMDaV -batch [options] files..."
+
+    @param argc Number of arguments following "-batch"
+    @param argv Arguments following "-batch"
+    @return 0 if every file was analysed, nonzero otherwise
+*/
+int ba_run( int argc, char *argv[] );
+
+/** @brief Memory-maps an audio file and locates its sample data.  ba_close_audio_file() must be called after
+    a successful call
+
+    @param path Path to a WAV file (16-bit PCM or 32-bit float) or to a raw PCM file
+    @param options Pointer to the batch options giving the format of raw files
+    @return A ba_audio_file structure with init_success set to 1 on success and 0 on failure
+*/
+ba_audio_file ba_open_audio_file( const char *path, ba_options *options );
+
+/** @brief Unmaps and closes a file opened by ba_open_audio_file() */
+void ba_close_audio_file( ba_audio_file *audio_file );
+
+/** @brief Averages the channels of a section of an audio file and applies a window
+
+    @param audio_file Pointer to an opened ba_audio_file
+    @param start Index of the first frame (sample per channel) to read
+    @param length Number of frames to read
+    @param audio Pointer to an array of length floats where the windowed mono signal will be stored
+    @param window Pointer to an array of length floats holding the window
+    @param downmix Kernel used for stereo float files, see fe_select_downmix_kernel()
+*/
+void ba_read_frame( ba_audio_file *audio_file, LONGLONG start, int length, float *audio, float *window, fe_downmix_kernel downmix );
+
+/** @brief Analyses the frames of an audio file needed for the predictions [first_prediction, end_prediction).
+    Segments that do not start at the beginning of the file are warmed up with the frames_in_window frames before
+    their first prediction (and the frame before those, for the spectral flux), and the timbre matrix column is
+    aligned with the position it would have in a pass over the whole file, so the results do not depend on how
+    the file was split
+
+    @param audio_file Pointer to an opened ba_audio_file
+    @param first_prediction Index of the first prediction to compute
+    @param end_prediction Index one past the last prediction to compute
+    @param predict_every Number of frames between predictions
+    @param extraction_data Pointer to an initialized fe_extraction_thread_data structure used for the analysis
+    @param arousal_mdl Pointer to the arousal SVR model
+    @param valence_mdl Pointer to the valence SVR model
+    @param features Pointer to an array large enough to hold MR_BATCH_ROWS SVR feature vectors, the predictions
+    are made MR_BATCH_ROWS at a time with mr_predict_batch()
+    @param arousal Pointer to the array of predictions for the whole file where arousal will be stored
+    @param valence Pointer to the array of predictions for the whole file where valence will be stored
+*/
+void ba_analyze_segment( ba_audio_file *audio_file,
+                         long first_prediction,
+                         long end_prediction,
+                         int predict_every,
+                         fe_extraction_thread_data *extraction_data,
+                         const mr_model *arousal_mdl,
+                         const mr_model *valence_mdl,
+                         float *features,
+                         float *arousal,
+                         float *valence );
+
+/** @brief Writes the arousal/valence time series of a file as comma separated values to <file>.mood.csv
+
+    @param job Pointer to a ba_file_job whose predictions have all been computed
+    @param options Pointer to the batch options
+    @param info Pointer to the fe_extraction_info used in the analysis
+    @return 1 on success, 0 on failure
+*/
+int ba_write_results( ba_file_job *job, ba_options *options, fe_extraction_info *info );
+
+/** @brief Analyses a list of files with a pool of worker threads.  Files are dealt out to the workers, a worker
+    that runs out of tasks steals from the others, and long files are split into segments that other workers
+    can steal
+
+    @param paths Array of paths of the files to analyse
+    @param num_paths Number of paths
+    @param options Pointer to the batch options, options->num_threads workers are used
+    @param info Pointer to an initialized fe_extraction_info structure
+    @param arousal_mdl Pointer to the arousal SVR model
+    @param valence_mdl Pointer to the valence SVR model
+    @param audio_seconds Pointer to a double where the total length of the analysed audio will be stored
+    @param steals Pointer to an int where the number of stolen tasks will be stored
+    @return The number of files that could not be analysed, or -1 if the workers could not be started
+*/
+int ba_run_scheduler( char **paths,
+                      int num_paths,
+                      ba_options *options,
+                      fe_extraction_info *info,
+                      const mr_model *arousal_mdl,
+                      const mr_model *valence_mdl,
+                      double *audio_seconds,
+                      int *steals );
+
+/** @brief The callback function used by the batch worker threads
+
+    @param lpArg A pointer cast as LPVOID that points to a ba_worker structure
+*/
+unsigned int __stdcall ba_workerRoutine( void *lpArg );
+
+#endif // BATCHANALYSIS_H_INCLUDED
@@ -0,0 +1,209 @@
+/* benchmark.h Declares the benchmarks that can be run from the command line
+ * Copyright (c) 2017 Jay Biernat
+ * Copyright (c) 2017 University of Rochester
+ *
+ * This file is part of Musical Mood Detector and Visualizer
+ *
+ * Musical Mood Detector and Visualizer is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Musical Mood Detector and Visualizer is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even
+ * the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Musical Mood Detector and Visualizer.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BENCHMARK_H_INCLUDED
+#define BENCHMARK_H_INCLUDED
+
+#include <windows.h>
+
+#define BM_DEFAULT_ITERATIONS 2000
+
+/** Largest arousal or valence deviation from the fp32 model that "MMDaV -bench precision" accepts for a reduced
+    precision format.  Arousal and valence span about [-1, 1], so this is well below what the display can show */
+#define BM_PRECISION_TOLERANCE 0.01f
+
+/** Largest relative error of the running timbre statistics accepted by "MMDaV -bench stats" */
+#define BM_STATS_TOLERANCE 1e-4
+
+/** Largest error of an autocorrelation method, relative to lag zero, accepted by "MMDaV -bench autocorrelation" */
+#define BM_AC_TOLERANCE 1e-4
+
+/** Largest difference of the log contrast features from the qsort reference accepted by "MMDaV -bench contrast" */
+#define BM_CONTRAST_TOLERANCE 1e-4
+
+/** Largest relative difference of the fused spectral descriptors accepted by "MMDaV -bench descriptors" */
+#define BM_DESCRIPTOR_TOLERANCE 1e-5
+
+/** Largest relative difference of the running timbre sums between single and batched transforms accepted by
+    "MMDaV -bench hop" */
+#define BM_HOP_TOLERANCE 1e-5
+
+/** Largest difference of an 8-bit color channel between the texture update from the transfer tables and pow() per
+    pixel accepted by "MMDaV -bench display" */
+#define BM_DISPLAY_TOLERANCE 1
+
+/** @brief Runs the benchmark named by the first argument.  Called by main() for "MMDaV -bench <name> [args]"
+
+    @param argc Number of arguments following "-bench"
+    @param argv Arguments following "-bench", argv[0] is the name of the benchmark
+    @return 0 on success, nonzero if the benchmark could not be run or a validation check failed
+*/
+int bm_run( int argc, char *argv[] );
+
+/** @brief Returns the number of seconds between two QueryPerformanceCounter() readings */
+double bm_seconds( LARGE_INTEGER start, LARGE_INTEGER end );
+
+/** @brief Compares the cost of the PortAudio callback when it runs the whole feature extraction against the cost
+    of the callback that only pushes samples into the ring buffer
+
+    @param iterations Number of callbacks timed for each version
+    @return 0 on success, nonzero on failure
+*/
+int bm_callback( int iterations );
+
+/** @brief Times mr_predict() with every SIMD kernel the processor supports against the double precision
+    reference loop and checks that each kernel stays within MR_KERNEL_TOLERANCE of it
+
+    @param iterations Number of passes over the set of test feature vectors
+    @return 0 on success, 1 if a kernel was out of tolerance, -1 if the models could not be loaded
+*/
+int bm_predict( int iterations );
+
+/** @brief Compares mr_predict_batch() at several block sizes against calling mr_predict() for each feature vector,
+    after checking the batch predictions against mr_predict_scalar()
+
+    @param iterations Number of passes over the 4096 test feature vectors is iterations / 100 (at least one)
+    @return 0 on success, 1 if the batch predictions were out of tolerance, -1 if the models could not be loaded
+*/
+int bm_predict_batch( int iterations );
+
+/** @brief Compares loading each model from its text directory with mapping the same model from a binary model
+    file, and checks that both give identical predictions
+
+    @param iterations Number of loads timed for each format is iterations / 100 (at least one)
+    @return 0 on success, 1 if the predictions differed, -1 if the models could not be loaded or written
+*/
+int bm_load( int iterations );
+
+/** @brief Compares the fp16 and int8 support vector formats with fp32: reports the largest arousal and valence
+    deviation over a reference feature set, the prediction time and the size of the support vectors, and names the
+    smallest format within BM_PRECISION_TOLERANCE.  Also checks that mr_predict_batch() agrees with mr_predict() in
+    every format
+
+    @param iterations Number of passes over the reference feature set for the timings is iterations / 10 (at least one)
+    @param path Reference feature set in the format read by mr_fill_array(), one feature vector per row, or NULL
+                for feature vectors drawn around the training distribution
+    @return 0 on success, 1 if no reduced format is within tolerance, 2 if mr_predict_batch() disagrees with
+            mr_predict() in some format, -1 if the models or features could not be loaded
+*/
+int bm_precision( int iterations, const char *path );
+
+/** @brief Reports the accuracy and speed of the Random Fourier Features approximation (mr_approximate_model()) for
+    several numbers of components, against the exact mr_predict() of each model, and checks that mr_predict_batch()
+    agrees with mr_predict() for each of them
+
+    @param iterations Number of passes over the reference feature set for the timings is iterations / 10 (at least one)
+    @param path Reference feature set as for bm_precision(), or NULL for feature vectors drawn around the training distribution
+    @return 0 on success, 1 if mr_predict_batch() disagrees with mr_predict(), -1 if the models or features could not
+            be loaded
+*/
+int bm_rff( int iterations, const char *path );
+
+/** @brief Times the timbre statistics from the running sums (fe_timbre_stats_running()) against recomputing them from
+    the timbre matrix (fe_timbre_stats()) after every frame of a synthetic signal, and checks both against an exact
+    double precision recomputation, including across the periodic resynchronization of the sums
+
+    @param iterations Number of frames processed
+    @return 0 on success, 1 if the statistics differed by more than BM_STATS_TOLERANCE, -1 on failure
+*/
+int bm_stats( int iterations );
+
+/** @brief Times the FE_AC_DIRECT, FE_AC_FFT and FE_AC_INCREMENTAL autocorrelation methods for rhythm windows of
+    increasing length.  Each frame replaces one sample of a synthetic rectified flux signal, updates the state and
+    computes the autocorrelation, as the analysis and mood threads do, and the final result of each method is checked
+    against a double precision direct computation
+
+    @param iterations Number of frames timed for the 3 s window, fewer for longer windows
+    @return 0 on success, 1 if a method was off by more than BM_AC_TOLERANCE, -1 on failure
+*/
+int bm_autocorrelation( int iterations );
+
+/** @brief Times fe_spectral_contrast() against the qsort reference fe_spectral_contrast_sort() on noise spectra, and
+    checks that they agree on noise, sorted, reversed and heavily tied spectra
+
+    @param iterations Number of spectra timed
+    @return 0 on success, 1 if the features differed by more than BM_CONTRAST_TOLERANCE, -1 on failure
+*/
+int bm_contrast( int iterations );
+
+/** @brief Times fe_spectral_descriptors() against the separate fe_spectral_centroid(), fe_spectral_flux() (both
+    kinds) and fe_spectral_rolloff() passes on noise spectra and checks that they agree
+
+    @param iterations Number of frames timed
+    @return 0 on success, 1 if a descriptor differed by more than BM_DESCRIPTOR_TOLERANCE, -1 on failure
+*/
+int bm_descriptors( int iterations );
+
+/** @brief Checks that every downmix, window and magnitude kernel the processor supports gives bit for bit the
+    result of the scalar kernel, on lengths that leave a remainder, and times them on a frame
+
+    @param iterations Number of frames timed
+    @return 0 on success, 1 if a kernel differed from the scalar kernel, -1 on failure
+*/
+int bm_frontend( int iterations );
+
+/** @brief Streams a synthetic signal through paCallBack() in BUFFER_LENGTH sample buffers and analyses it with
+    fe_analyse_pending() at hops of one, one half and one quarter of a frame.  The ring is drained once every
+    FE_FFT_BATCH hops, as when the analysis thread wakes late, with single transforms and with the batched plan, and
+    the two are checked against each other
+
+    @param iterations Number of frames analysed at each hop
+    @return 0 on success, 1 if the batched analysis differed by more than BM_HOP_TOLERANCE, -1 on failure
+*/
+int bm_hop( int iterations );
+
+/** @brief Measures the memory of multi-stream engines (ms_engine) of 1 to 64 streams, and how the analysis scales
+    with the number of streams on one pool of worker threads.  Every stream is fed the same synthetic signal as fast
+    as the workers take it, and their final predictions are checked against the single stream engine's
+
+    @param iterations Number of frames analysed per stream is iterations / 10 (at least one)
+    @return 0 on success, 1 if a stream's prediction differed, -1 on failure
+*/
+int bm_streams( int iterations );
+
+/** @brief Times the texture update from the per-update transfer tables (id_modulate_pixels()) against pow() per
+    pixel on synthetic images from 640x480 to 3840x2160, and checks the pixels of both at several arousals and
+    valences
+
+    @param iterations Number of updates timed is iterations / 200 for a 640x480 image, fewer for larger images
+    @return 0 on success, 1 if a channel differed by more than BM_DISPLAY_TOLERANCE, -1 on failure
+*/
+int bm_display( int iterations );
+
+/** @brief Checks that every HSV to RGB conversion kernel the processor supports packs bit for bit the pixels of
+    HSVtoRGB() and SDL_MapRGB() in the ARGB8888, XRGB8888 and ABGR8888 layouts, and times them on a 1931x1080 image
+
+    @param iterations Number of updates timed for each kernel is iterations / 100 (at least one)
+    @return 0 on success, 1 if a kernel differed from the reference, -1 on failure
+*/
+int bm_convert( int iterations );
+
+/** @brief Reports the texture updates per second and the resident memory of the HSV planes at 1080p, 4K and 8K with
+    tile pools (id_tile_pool) of 1 to one worker per processor, and checks the tiled updates against updating the whole image on one thread
+
+    @param iterations Number of updates timed is iterations / 20 at 1080p, fewer for larger images (at least two)
+    @return 0 on success, 1 if a tiled update differed, -1 on failure
+*/
+int bm_tiles( int iterations );
+
+#endif // BENCHMARK_H_INCLUDED
@@ -21,19 +21,37 @@
  *
  */
 
+#include <windows.h>
 #include <fftw3.h>
 #include <portaudio.h>
+#include "featureExtractionKernels.h"
 
 #ifndef FEATUREEXTRACTION_H_INCLUDED
 #define FEATUREEXTRACTION_H_INCLUDED
 
 #define N_SAMPS 2048    /* samples per frame */
+#define HOP_LENGTH N_SAMPS  /* samples between the starts of consecutive frames, frames overlap below N_SAMPS.  The mood
+                               models were trained on frames that do not overlap, see fe_set_hop_length() */
+#define BUFFER_LENGTH 512   /* samples per PortAudio buffer, independent of the frame and hop lengths */
+#define FE_FFT_BATCH 4      /* most pending frames transformed together by one batched FFTW plan */
 #define FS 44100
 #define NUM_CHANNELS 2
 #define ROLLOFF 0.85    /* Ratio for spectral rolloff */
 #define BANDS 7
+#define NEIGHBORHOOD 0.2    /* Fraction of a band averaged into its spectral contrast peak and valley */
 #define NUM_TIMBRE_FEATURES 24  /* Number of timbre and onset features used in SVR prediction */
 #define NUM_ONSET_FEATURES 4
+#define RING_LENGTH (N_SAMPS*16)    /* samples held between the audio callback and analysis thread, must be a power of two */
+#define STATS_RESYNC_FRAMES 1024    /* frames between exact recomputations of the running timbre sums */
+
+#define FE_PLANNER_EFFORT FFTW_MEASURE    /* FFTW planner effort: FFTW_ESTIMATE, FFTW_MEASURE or FFTW_PATIENT */
+#define FE_WISDOM_PREFIX "fftw_wisdom"  /* Wisdom files are named <prefix>_<frame length>_<processor>.txt */
+#define FE_MAX_WISDOM_PATH 160
+
+#define FE_AC_DIRECT 0          /* Autocorrelation methods of the rectified flux, see fe_autocorrelation_compute() */
+#define FE_AC_FFT 1
+#define FE_AC_INCREMENTAL 2
+#define FE_AUTOCORRELATION FE_AC_INCREMENTAL    /* Method used by the analysis */
 
 /** An enumberated type used as an argument in the function fe_spectral_flux() to indicate which type of
     spectral flux should be calculated
@@ -48,40 +66,141 @@ fe_spec_flux_t;
 
 /******************** Structures **********************/
 
+/** Tables that only depend on the fe_extraction_info, built once by fe_initialize_extraction_info() so the per
+    frame analysis does no transcendental math on them.  The arrays are allocated with fftwf_malloc() (SIMD aligned)
+    and are only read after initialization, so every thread analysing with the same information shares them */
+typedef struct
+{
+    float   *bin_frequency;     /* Frequency of each DFT bin in Hz, dft_length floats */
+    float   bin_width;          /* fs / frame_length */
+    float   *window;            /* Hamming window, frame_length floats */
+    int     *band_boundary;     /* First bin of each spectral contrast band and the end of the last, bands+1 ints */
+    int     *band_neighborhood; /* Number of bins averaged into each band's peak and valley, bands ints */
+}
+fe_plan;
+
 /** Structure holding relevant information needed to do feature extraction on audio */
 typedef struct
 {
     int     fs;             /* sampling frequency of the signal */
     int     frame_length;   /* number of samples in a frame */
+    int     hop_length;     /* number of samples between the starts of consecutive frames, at most frame_length */
+    int     buffer_length;  /* number of samples in each buffer PortAudio passes to paCallBack() */
     int     dft_length;     /* number of points in calculated dft (positive part of frequency spectrum) */
 
     float   window_length;      /* length (in seconds) of audio chunk used in mood prediction */
-    int     frames_in_window;   /* number of frames that fit inside the length of the mood prediction window */
+    int     frames_in_window;   /* number of hops that fit inside the length of the mood prediction window */
 
     int     bands;          /* number of bands used to calculate spectral contrast features */
     float   rolloff;        /* rolloff (float b/w zero and one) used to calculate spectral rolloff */
 
     int     num_timbre_features;    /* number of timbre features extracted from window */
     int     num_onset_features;     /* number of onset features extracted from window */
+
+    fe_plan plan;           /* Tables derived from the values above */
+
+    /* FFTW planning, shared by every plan made with this information (see fe_plan_r2c()) */
+    unsigned int    planner_effort;         /* FE_PLANNER_EFFORT unless changed before the thread data is initialized */
+    char            wisdom_path[FE_MAX_WISDOM_PATH];    /* Wisdom file for the frame length and processor */
+    int             wisdom_loaded;          /* 1 if the wisdom file was read by fe_initialize_extraction_info() */
+    int             wisdom_changed;         /* 1 if a plan was measured since the wisdom file was read or written */
+    double          wisdom_seconds;         /* Time spent reading and writing the wisdom file */
+    double          planning_seconds;       /* Time spent creating plans */
+    int             num_plans;              /* Plans created, and how many of them came from wisdom */
+    int             num_plans_from_wisdom;
+
+    int     init_success;   /* 1 on structure's successful initialization, 0 otherwise */
 }
 fe_extraction_info;
 
-/** Structure to be passed via a void pointer to the paCallback function */
+/** Lock-free single-producer/single-consumer ring buffer of mono samples.  The PortAudio callback is the only
+    writer and the analysis thread is the only reader, so the two counters are each changed by one side only
+
+    @see fe_ring_write_space()
+    @see fe_ring_read()
+*/
 typedef struct
 {
-    float           *audio;         /* A frame of audio */
-    float           *hamm_win;      /* Hamming window */
-    fftwf_complex   *dft;           /* The DFT of a frame of audio */
+    float                   *samples;
+    unsigned int            length;         /* Number of samples the ring holds (a power of two) */
+    unsigned int            mask;           /* length-1, used to wrap the counters into the array */
+    volatile unsigned int   write_count;    /* Total samples written (only changed by the producer) */
+    volatile unsigned int   read_count;     /* Total samples read (only changed by the consumer) */
+}
+fe_ring_buffer;
+
+/** State of the circular autocorrelation of the rectified flux buffer for one of the FE_AC_* methods
+
+    @see fe_autocorrelation_init()
+    @see fe_autocorrelation_compute()
+*/
+typedef struct
+{
+    int             method;     /* FE_AC_DIRECT, FE_AC_FFT or FE_AC_INCREMENTAL */
+    int             length;     /* Length N of the circular signal */
+    int             lags;       /* Number of lags computed, N/2 rounded down */
+    float           *result;    /* The latest autocorrelation, lags floats */
+
+    float           *fft_signal;    /* FE_AC_FFT: aligned buffers and plans of the real transforms of length N, */
+    fftwf_complex   *fft_power;     /* created once by fe_autocorrelation_init() */
+    float           *fft_lags;
+    fftwf_plan      forward;
+    fftwf_plan      inverse;
+
+    double          *running;   /* FE_AC_INCREMENTAL: every lag, kept up to date by fe_autocorrelation_update() */
+    int             updates;    /* Updates since the lags were recomputed by fe_autocorrelation_resync() */
+}
+fe_autocorrelation;
+
+/** Structure to be passed via a void pointer to the paCallback function and the analysis thread */
+typedef struct
+{
+    float           *audio;         /* FE_FFT_BATCH frames of audio, frame_length samples apart */
+    float           *hamm_win;      /* Hamming window, the shared one of info->plan */
+    fftwf_complex   *dft;           /* The DFT of each frame of audio, dft_stride complex numbers apart */
+    int             dft_stride;     /* dft_length rounded up so every DFT of the batch is SIMD aligned */
     float           *magnitude;     /* The magnitude of the DFT */
     float           *prev_mag;
+    float           *prefix_sum;    /* Cumulative magnitude used by fe_spectral_descriptors() to find the rolloff */
+    float           *contrast_scratch;  /* Copy of the magnitude reordered by fe_spectral_contrast() */
     float           *rectified_flux_buffer;
     float           *timbre_matrix;
 
+    double          *timbre_sum;        /* Running sum and sum of squares of each row of the timbre matrix, kept */
+    double          *timbre_sum_sq;     /* up to date by fe_process_spectrum() as it replaces a column */
+    volatile LONG   stats_sequence;     /* Odd while the running sums, the flux buffer and the lags of the
+                                           autocorrelation are written, see fe_read_window_stats() */
+    float           *old_column;        /* The column being replaced, num_timbre_features floats */
+    int             stats_frames;       /* Frames since the running sums were recomputed by fe_resync_timbre_stats() */
+
+    fe_autocorrelation  autocorrelation;    /* Autocorrelation of the rectified flux buffer, FE_AUTOCORRELATION method */
+
     int             columnPtr;  /* Column index counter */
 
     fe_extraction_info  *info;
     fftwf_plan          fftPlan;    /* Plan used by FFTW API to calculate Fourier Transform */
+    fftwf_plan          batchPlan;  /* Plan of the transforms of all FE_FFT_BATCH frames at once */
+    int                 owns_plans; /* 0 if both plans are borrowed from another thread data, see
+                                       fe_initialize_extraction_thread_data_shared() */
+
+    fe_downmix_kernel   downmix_kernel;     /* Fastest front end kernels the processor supports, chosen at initialization */
+    fe_window_kernel    window_kernel;
+    fe_magnitude_kernel magnitude_kernel;
 
+    fe_ring_buffer  ring;           /* Downmixed samples waiting to be analysed */
+    HANDLE          samples_ready;  /* Auto-reset event signaled by the callback after writing to the ring */
+
+    volatile LONG   frames_completed;   /* Frames analysed by fe_analysisRoutine(), incremented after each frame */
+    volatile LONG   frame_ticks;        /* Low 32 bits of the performance counter when the latest frame completed */
+    HANDLE          frame_ready;        /* Auto-reset event signaled after each frame, waited on by the mood thread */
+
+    volatile unsigned long  overruns;           /* Callback buffers dropped because the ring was full */
+    volatile unsigned long  input_overflows;    /* Callbacks flagged with paInputOverflow by PortAudio */
+    unsigned long           callback_count;     /* Number of callbacks and their cost in performance counter ticks */
+    LONGLONG                callback_ticks;
+    LONGLONG                callback_max_ticks;
+
+    volatile int    terminate_thread;       /* Flag for analysis thread termination */
     int     boolOutputDevice;       /* 1 if output device will be used, 0 otherwise */
     int     init_success;           /* 1 on structure's successful initialization, 0 otherwise */
 }
@@ -90,10 +209,20 @@ fe_extraction_thread_data;
 /************************** Functions ************************/
 
 /** @brief The callback function used for qsort
-    @see fe_spectral_contrast()
+    @see fe_spectral_contrast_sort()
 */
 int fe_compare( const void *a, const void *b);     /* Callback function for qsort */
 
+/** @brief Partially orders an array of floats so the element at index k is the one a full sort would put there,
+    with no greater element before it and no smaller element after it.  Introselect: quickselect with a median of
+    three pivot, falling back to qsort on the remaining range if the partitions stay unbalanced
+
+    @param values Pointer to the array of floats, reordered in place
+    @param num Number of floats in the array
+    @param k Index of the element to place, 0 <= k < num
+*/
+void fe_select( float *values, int num, int k );
+
 /** @brief Returns the mean of an array of floats
 
     @param values Pointer to an array of floats
@@ -135,6 +264,60 @@ void fe_compute_magnitude( fftwf_complex *fft, float *magnitude, int N );
 */
 void fe_autocorrelate( float *flux_buffer, float *ac, int N );
 
+/** @brief Initializes the autocorrelation state of a circular signal for one method.  FE_AC_FFT creates its FFTW
+    plans and aligned buffers here so none are made per call, FE_AC_INCREMENTAL starts from an all zero signal
+
+    @param ac Pointer to the fe_autocorrelation to initialize, free with fe_autocorrelation_free()
+    @param N Length of the circular signal
+    @param method FE_AC_DIRECT, FE_AC_FFT or FE_AC_INCREMENTAL
+    @param info Pointer to the fe_extraction_info whose planner settings and wisdom are used for FE_AC_FFT
+    @return 1 on success, 0 on failure
+*/
+int fe_autocorrelation_init( fe_autocorrelation *ac, int N, int method, fe_extraction_info *info );
+
+/** @brief Frees the buffers and plans of an autocorrelation state
+
+    @param ac Pointer to the fe_autocorrelation to free
+*/
+void fe_autocorrelation_free( fe_autocorrelation *ac );
+
+/** @brief Same result as fe_autocorrelate() as the inverse FFT of the power spectrum, in O(N log N)
+
+    @param ac Pointer to a fe_autocorrelation initialized with FE_AC_FFT
+    @param x Pointer to the N floats of the signal
+    @param out Pointer to an array of N/2 floats where the autocorrelation will be placed
+*/
+void fe_autocorrelate_fft( fe_autocorrelation *ac, const float *x, float *out );
+
+/** @brief Updates the lags of a FE_AC_INCREMENTAL autocorrelation after one sample of the signal was replaced, in
+    O(N).  Every STATS_RESYNC_FRAMES updates the lags are recomputed instead so rounding errors cannot accumulate.
+    Does nothing for the other methods
+
+    @param ac Pointer to an initialized fe_autocorrelation
+    @param x Pointer to the N floats of the signal, already holding the new sample
+    @param position Index of the replaced sample
+    @param old_value Value the sample had before it was replaced
+*/
+void fe_autocorrelation_update( fe_autocorrelation *ac, const float *x, int position, float old_value );
+
+/** @brief Recomputes the lags of a FE_AC_INCREMENTAL autocorrelation from the signal.  Does nothing for the other
+    methods
+
+    @param ac Pointer to an initialized fe_autocorrelation
+    @param x Pointer to the N floats of the signal
+*/
+void fe_autocorrelation_resync( fe_autocorrelation *ac, const float *x );
+
+/** @brief Computes the autocorrelation of a circular signal with the method of the state: FE_AC_DIRECT with
+    fe_autocorrelate(), FE_AC_FFT with fe_autocorrelate_fft(), FE_AC_INCREMENTAL by reading the lags kept by
+    fe_autocorrelation_update()
+
+    @param ac Pointer to an initialized fe_autocorrelation
+    @param x Pointer to the N floats of the signal
+    @return Pointer to ac->result, holding the N/2 lags
+*/
+const float *fe_autocorrelation_compute( fe_autocorrelation *ac, const float *x );
+
 /** @brief Calculates the mean and standard deviation of a matrix of timbre features where the first two floats
     are the mean and stadard deviation of the first timbre feature, the next two floats are the mean and stadard
     deviation of the second timbre feature, etc.
@@ -146,6 +329,38 @@ void fe_autocorrelate( float *flux_buffer, float *ac, int N );
 */
 void fe_timbre_stats( float *feature_array, float *stat_array, fe_extraction_info *info );
 
+/** @brief Same result as fe_timbre_stats() from the running sums of the timbre matrix rows, in O(num_timbre_features)
+    instead of O(num_timbre_features x frames_in_window)
+
+    @param timbre_sum Pointer to the sum of each row of the timbre matrix
+    @param timbre_sum_sq Pointer to the sum of squares of each row of the timbre matrix
+    @param stat_array Pointer to an array of floats where the feature statistics will be placed, as in fe_timbre_stats()
+    @param info Pointer to an initialized fe_extraction_info structure
+*/
+void fe_timbre_stats_running( const double *timbre_sum, const double *timbre_sum_sq, float *stat_array, fe_extraction_info *info );
+
+/** @brief Copies the running sums of the timbre matrix rows, the rectified flux buffer and the running lags of its
+    autocorrelation while the analysis thread may be updating them.  They are published with a sequence counter as
+    ms_prediction is, so the copy is of one window: it is retried until no update began or finished during it
+
+    @param thread_data Pointer to the fe_extraction_thread_data holding the sums
+    @param timbre_sum Pointer to num_timbre_features doubles where the sums will be copied
+    @param timbre_sum_sq Pointer to num_timbre_features doubles where the sums of squares will be copied
+    @param flux_buffer Pointer to frames_in_window floats where the rectified flux buffer will be copied
+    @param ac Pointer to an autocorrelation state initialized with the method of the analysis thread's, which receives
+              the running lags for FE_AC_INCREMENTAL.  fe_autocorrelation_compute() on it and flux_buffer then gives
+              the autocorrelation of the copied window
+*/
+void fe_read_window_stats( fe_extraction_thread_data *thread_data, double *timbre_sum, double *timbre_sum_sq,
+                           float *flux_buffer, fe_autocorrelation *ac );
+
+/** @brief Recomputes the running sums of the timbre matrix rows from the matrix.  Called by fe_process_spectrum() every
+    STATS_RESYNC_FRAMES frames so the rounding errors of the updates cannot accumulate
+
+    @param thread_data Pointer to the fe_extraction_thread_data holding the timbre matrix and its sums
+*/
+void fe_resync_timbre_stats( fe_extraction_thread_data *thread_data );
+
 /** @brief Calculates spectral rolloff of a frequency spectrum
 
     @param magnitude Pointer to an array of floats holding the magnitude of a frequency spectrum
@@ -170,9 +385,19 @@ float fe_spectral_centroid( float *magnitude, fe_extraction_info *info );
         first [bands] elements in the column are the peaks from each band
         second [bands] elements in the column are the valleys from each band
         third [bands] elements in the column are the contrasts of each band
+    @param scratch Pointer to info->dft_length floats of scratch space
+    @param info Pointer to an initilaized fe_extraction_info structure
+*/
+void fe_spectral_contrast( float *magnitude, float *contrast_features, float *scratch, fe_extraction_info *info );
+
+/** @brief Same result as fe_spectral_contrast() (up to the order the neighborhoods are summed in) by sorting each band
+    with qsort.  Kept as the reference for "MMDaV -bench contrast"
+
+    @param magnitude Pointer to an array of floats holding the magnitude of a frequency spectrum
+    @param contrast_features Pointer to the first element of the contrast features, as in fe_spectral_contrast()
     @param info Pointer to an initilaized fe_extraction_info structure
 */
-void fe_spectral_contrast( float *magnitude, float *contrast_features, fe_extraction_info *info );
+void fe_spectral_contrast_sort( float *magnitude, float *contrast_features, fe_extraction_info *info );
 
 /** @brief Calculates spectral flux between two frequency spectrums
 
@@ -188,23 +413,190 @@ float fe_spectral_flux( float *mag_cur,
                         fe_spec_flux_t fluxType,
                         fe_extraction_info *info );
 
+/** @brief Calculates the spectral centroid, unrectified flux, rolloff and rectified flux of a frame in one pass
+    over the magnitude spectra, with the same results as fe_spectral_centroid(), fe_spectral_flux() and
+    fe_spectral_rolloff().  The cumulative magnitude is kept during the pass so the rolloff is found by a binary
+    search instead of a second pass
+
+    @param magnitude Pointer to array of the current frame's frequency spectrum magnitude
+    @param prev_mag Pointer to array of the previous frame's frequency spectrum magnitude
+    @param column Pointer to the frame's column of the timbre matrix, receives the centroid, flux and rolloff rows
+    @param rectified_flux Pointer to the float receiving the rectified flux
+    @param prefix_sum Pointer to info->dft_length floats of scratch space
+    @param info Pointer to an initilaized fe_extraction_info structure
+*/
+void fe_spectral_descriptors( const float *magnitude, const float *prev_mag, float *column, float *rectified_flux,
+                              float *prefix_sum, fe_extraction_info *info );
+
 /** @brief Calculates rhythmic features: onsets per second
                                          average height of onsets
                                          average autocorrelation peak
                                          average autocorrelation valley
 
     @param flux_buffer Pointer to a buffer of previous rectified spectral flux values
+    @param ac Pointer to the autocorrelation state of the flux buffer, info->frames_in_window long
     @param rhythm_features Pointer to the starting element in the feature vector where the rhythm
     features will be stored
     @param info Pointer to an initilaized fe_extraction_info structure
 */
-void fe_rhythmic_features( float *flux_buffer, float *rhythm_features, fe_extraction_info *info );
+void fe_rhythmic_features( float *flux_buffer, fe_autocorrelation *ac, float *rhythm_features, fe_extraction_info *info );
+
+/** @brief Allocates the sample array of a ring buffer and resets its counters
+
+    @param ring Pointer to the fe_ring_buffer to initialize
+    @param length Number of samples the ring will hold, must be a power of two
+    @return 1 on success, 0 on failure
+*/
+int fe_ring_init( fe_ring_buffer *ring, unsigned int length );
+
+/** @brief Frees the sample array of a ring buffer initialized by fe_ring_init() */
+void fe_ring_free( fe_ring_buffer *ring );
+
+/** @brief Returns the number of samples the producer can write without overwriting unread samples */
+unsigned int fe_ring_write_space( fe_ring_buffer *ring );
+
+/** @brief Publishes samples the producer has placed at ring->samples[ (write_count + i) & mask ]
+
+    @param ring Pointer to the fe_ring_buffer written to
+    @param num Number of samples written, must not exceed fe_ring_write_space()
+*/
+void fe_ring_commit( fe_ring_buffer *ring, unsigned int num );
+
+/** @brief Returns the number of samples available to the consumer */
+unsigned int fe_ring_read_available( fe_ring_buffer *ring );
+
+/** @brief Copies samples out of the ring buffer and releases their space to the producer
+
+    @param ring Pointer to the fe_ring_buffer read from
+    @param dest Pointer to an array of at least num floats
+    @param num Number of samples to read, must not exceed fe_ring_read_available()
+*/
+void fe_ring_read( fe_ring_buffer *ring, float *dest, unsigned int num );
+
+/** @brief Copies samples out of the ring buffer without releasing them, so overlapping frames can be read again
+
+    @param ring Pointer to the fe_ring_buffer read from
+    @param dest Pointer to an array of at least num floats
+    @param offset Number of unread samples skipped before the copy
+    @param num Number of samples to copy, offset+num must not exceed fe_ring_read_available()
+*/
+void fe_ring_peek( fe_ring_buffer *ring, float *dest, unsigned int offset, unsigned int num );
+
+/** @brief Releases the oldest unread samples of the ring buffer to the producer
+
+    @param ring Pointer to the fe_ring_buffer read from
+    @param num Number of samples released, must not exceed fe_ring_read_available()
+*/
+void fe_ring_consume( fe_ring_buffer *ring, unsigned int num );
+
+/** @brief Computes the DFT of the first num windowed frames of thread_data->audio into thread_data->dft, with the
+    batched plan when num is FE_FFT_BATCH and frame by frame otherwise
+
+    @param thread_data Pointer to an initialized fe_extraction_thread_data structure
+    @param num Number of frames, 1 to FE_FFT_BATCH
+*/
+void fe_transform_frames( fe_extraction_thread_data *thread_data, int num );
+
+/** @brief Analyses the DFT of one frame: computes its magnitude, fills the current column of the timbre matrix and
+    rectified flux buffer, then advances the column index
+
+    @param thread_data Pointer to an initialized fe_extraction_thread_data structure
+    @param dft Pointer to the dft_length complex numbers of the frame's DFT
+*/
+void fe_process_spectrum( fe_extraction_thread_data *thread_data, fftwf_complex *dft );
+
+/** @brief Analyses the windowed frame in thread_data->audio: computes the DFT and its magnitude, fills the current
+    column of the timbre matrix and rectified flux buffer, then advances the column index
+
+    @param thread_data Pointer to an initialized fe_extraction_thread_data structure
+*/
+void fe_process_frame( fe_extraction_thread_data *thread_data );
+
+/** @brief Analyses the frames complete in the ring buffer, up to max_batch at a time.  Each frame starts hop_length
+    samples after the previous one, so only hop_length samples are released per frame and the overlap stays in the
+    ring for the next frame.  Every frame analysed is counted in frames_completed, then frame_ready is signaled
 
-/** @brief Initialize the fe_extraction_info structure passed to it by pointer. Must call
-    fe_clean_extraction_thread_data() to free memory from it
+    @param thread_data Pointer to an initialized fe_extraction_thread_data structure
+    @param max_batch Most frames transformed together, 1 to FE_FFT_BATCH
+    @return Number of frames analysed, 0 if a whole frame is not available
+*/
+int fe_analyse_pending( fe_extraction_thread_data *thread_data, int max_batch );
+/** @brief Initialize the fe_extraction_info structure passed to it by pointer, builds its fe_plan and reads the
+    FFTW wisdom file for the frame length and processor if there is one.  The init_success member is set to 1 on
+    success and 0 on failure.  Must call fe_clean_extraction_info() to free
+    memory from it, after every fe_extraction_thread_data using it has been cleaned
 */
 void fe_initialize_extraction_info( fe_extraction_info *info );
 
+/** @brief Frees the fe_plan of an fe_extraction_info initialized by fe_initialize_extraction_info() */
+void fe_clean_extraction_info( fe_extraction_info *info );
+
+/** @brief Changes the hop length of an initialized fe_extraction_info and the number of frames in the mood window
+    that follows from it.  Must be called before any fe_extraction_thread_data is initialized with the information.
+    The rhythm features count frames, and the models were trained with a hop of one frame length, so shorter hops
+    give finer time resolution at the cost of predictions the models were not trained for
+
+    @param info Pointer to an initialized fe_extraction_info
+    @param hop_length Samples between the starts of consecutive frames, 1 to frame_length
+    @return 1 on success, 0 if hop_length is out of range
+*/
+int fe_set_hop_length( fe_extraction_info *info, int hop_length );
+
+/** @brief Reads an FFTW planner effort name
+
+    @param name "estimate", "measure" or "patient"
+    @param effort Pointer to where the matching FFTW flag will be stored
+    @return 1 on success, 0 if the name is not recognized
+*/
+int fe_parse_planner_effort( const char *name, unsigned int *effort );
+
+/** @brief Returns the name of an FFTW planner effort flag, as read by fe_parse_planner_effort() */
+const char *fe_planner_effort_name( unsigned int effort );
+
+/** @brief Creates a real to complex FFTW plan with the planner effort of the extraction information.  The plan is
+    first looked up in the loaded wisdom, and only measured if it is not there, in which case wisdom_changed is set
+    so fe_save_wisdom() writes it out.  The time taken is added to planning_seconds
+
+    @param info Pointer to an initialized fe_extraction_info
+    @param n Length of the transform
+    @param in Pointer to the n input floats, overwritten while measuring
+    @param out Pointer to the n/2+1 output complex numbers
+    @return The plan, NULL on failure
+*/
+fftwf_plan fe_plan_r2c( fe_extraction_info *info, int n, float *in, fftwf_complex *out );
+
+/** @brief Creates a plan of howmany real to complex transforms done together, as fe_plan_r2c() does for one
+
+    @param info Pointer to an initialized fe_extraction_info
+    @param n Length of each transform
+    @param howmany Number of transforms
+    @param in Pointer to the inputs, idist floats apart, overwritten while measuring
+    @param idist Distance between the starts of consecutive inputs, in floats
+    @param out Pointer to the outputs of n/2+1 complex numbers each
+    @param odist Distance between the starts of consecutive outputs, in complex numbers
+    @return The plan, NULL on failure
+*/
+fftwf_plan fe_plan_many_r2c( fe_extraction_info *info, int n, int howmany, float *in, int idist, fftwf_complex *out, int odist );
+
+/** @brief Creates a complex to real FFTW plan, as fe_plan_r2c() does for real to complex
+
+    @param info Pointer to an initialized fe_extraction_info
+    @param n Length of the transform
+    @param in Pointer to the n/2+1 input complex numbers, overwritten while measuring
+    @param out Pointer to the n output floats
+    @return The plan, NULL on failure
+*/
+fftwf_plan fe_plan_c2r( fe_extraction_info *info, int n, fftwf_complex *in, float *out );
+
+/** @brief Writes the FFTW wisdom to info->wisdom_path if a plan was measured since it was read, so the next start
+    with the same frame length on the same processor skips the measurements.  Called by
+    fe_initialize_extraction_thread_data() once its plans are made
+
+    @param info Pointer to an initialized fe_extraction_info
+    @return 1 if the file was written or did not need to be, 0 if it could not be written
+*/
+int fe_save_wisdom( fe_extraction_info *info );
+
 /** @brief Initializes a fe_extraction_thread_data structure for use by the paCallback function
 
     @param info Pointer to an initilaized fe_extraction_info structure. The init_success member
@@ -212,10 +604,36 @@ void fe_initialize_extraction_info( fe_extraction_info *info );
 */
 fe_extraction_thread_data fe_initialize_extraction_thread_data( fe_extraction_info *info );
 
+/** @brief Initializes a fe_extraction_thread_data structure that executes the FFTW plans of another one instead of
+    making its own.  The plans are only read when executed with new arrays, so threads may share them, and the
+    owner must be cleaned after every structure that borrows its plans
+
+    @param info Pointer to the initialized fe_extraction_info the owner was initialized with
+    @param owner Pointer to the initialized fe_extraction_thread_data whose plans are used, or NULL to make new ones
+    @return The structure, its init_success member set to 1 on success and 0 on failure
+*/
+fe_extraction_thread_data fe_initialize_extraction_thread_data_shared( fe_extraction_info *info, const fe_extraction_thread_data *owner );
+
+/** @brief Returns an initialized fe_extraction_thread_data structure to the state it had before any audio was analysed
+    (previous magnitude, rectified flux buffer and timbre matrix zeroed, column index at the first column)
+
+    @param thread_data Pointer to the fe_extraction_thread_data structure to reset
+*/
+void fe_reset_extraction_thread_data( fe_extraction_thread_data *thread_data );
+
 /** @brief Frees memory from the fe_extraction_thread_data passed to it by pointer */
 void fe_clean_extraction_thread_data( fe_extraction_thread_data *thread_data );
 
-/** @brief Callback function to be used by the PortAudio API in handling audio */
+/** @brief The callback function used by the analysis thread.  Waits on samples written to the ring buffer
+    by paCallBack() and analyses the complete frames with fe_analyse_pending(), FE_FFT_BATCH at a time when the
+    thread has fallen behind
+
+    @param lpArg A pointer cast as LPVOID that points to a fe_extraction_thread_data structure
+*/
+unsigned int __stdcall fe_analysisRoutine( void *lpArg );
+
+/** @brief Callback function to be used by the PortAudio API in handling audio.  Only downmixes the input into
+    the ring buffer (and copies it to the output device), all analysis is done by fe_analysisRoutine() */
 int paCallBack( const void                        *inputBuffer,
                 void                              *outputBuffer,
                 unsigned long                     framesPerBuffer,
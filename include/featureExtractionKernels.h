@@ -0,0 +1,110 @@
+/* featureExtractionKernels.h Declares the SIMD kernels used in the audio front end of feature extraction
+ * Copyright (c) 2017 Jay Biernat
+ * Copyright (c) 2017 University of Rochester
+ *
+ * This file is part of Musical Mood Detector and Visualizer
+ *
+ * Musical Mood Detector and Visualizer is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Musical Mood Detector and Visualizer is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even
+ * the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Musical Mood Detector and Visualizer.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FEATUREEXTRACTIONKERNELS_H_INCLUDED
+#define FEATUREEXTRACTIONKERNELS_H_INCLUDED
+
+#include <fftw3.h>
+
+/* Every SIMD kernel gives bit for bit the result of the scalar one:
+ *
+ *  - the downmix adds the two channels and halves the sum, the same two roundings as ( left + right ) / 2, then
+ *    multiplies by the window
+ *  - the magnitude squares and adds the real and imaginary parts in double, where the squares are exact, and takes
+ *    the square root in double before rounding to float, like sqrt( pow(a,2) + pow(b,2) ) did
+ *
+ * "MMDaV -bench frontend" checks this for every kernel the processor supports.
+ */
+
+/** Signature of a downmix kernel: averages the two channels of interleaved stereo samples into mono and multiplies
+    the result by a window
+
+    @param stereo Pointer to 2*num interleaved left and right samples
+    @param window Pointer to num floats of window, or NULL for no window
+    @param mono Pointer to num floats where the mono signal will be stored
+    @param num Number of samples per channel
+*/
+typedef void (*fe_downmix_kernel)( const float *stereo, const float *window, float *mono, int num );
+
+/** Signature of a window kernel: multiplies samples by a window in place
+
+    @param samples Pointer to num floats
+    @param window Pointer to num floats of window
+    @param num Number of samples
+*/
+typedef void (*fe_window_kernel)( float *samples, const float *window, int num );
+
+/** Signature of a magnitude kernel: computes the magnitude of complex numbers
+
+    @param dft Pointer to num complex numbers
+    @param magnitude Pointer to num floats where the magnitudes will be stored
+    @param num Number of complex numbers
+*/
+typedef void (*fe_magnitude_kernel)( const fftwf_complex *dft, float *magnitude, int num );
+
+/** @brief Plain C kernels used when the processor has no supported SIMD extension */
+void fe_downmix_scalar( const float *stereo, const float *window, float *mono, int num );
+void fe_window_scalar( float *samples, const float *window, int num );
+void fe_magnitude_scalar( const fftwf_complex *dft, float *magnitude, int num );
+
+/** @brief SSE2 kernels, 4 samples or 4 complex numbers at a time */
+void fe_downmix_sse2( const float *stereo, const float *window, float *mono, int num );
+void fe_window_sse2( float *samples, const float *window, int num );
+void fe_magnitude_sse2( const fftwf_complex *dft, float *magnitude, int num );
+
+/** @brief AVX2 kernels, 8 samples or 4 complex numbers at a time */
+void fe_downmix_avx2( const float *stereo, const float *window, float *mono, int num );
+void fe_window_avx2( float *samples, const float *window, int num );
+void fe_magnitude_avx2( const fftwf_complex *dft, float *magnitude, int num );
+
+/** @brief AVX-512 kernels, 16 samples or 8 complex numbers at a time */
+void fe_downmix_avx512( const float *stereo, const float *window, float *mono, int num );
+void fe_window_avx512( float *samples, const float *window, int num );
+void fe_magnitude_avx512( const fftwf_complex *dft, float *magnitude, int num );
+
+/** @brief Returns the widest instruction set supported by the processor (checked with CPUID)
+
+    @return 3 for AVX-512, 2 for AVX2, 1 for SSE2, 0 for none
+*/
+int fe_simd_level( void );
+
+/** @brief Selects the fastest downmix kernel supported by the processor
+
+    @param name Pointer to a string pointer where the name of the selected instruction set will be stored, may be NULL
+    @return The selected kernel
+*/
+fe_downmix_kernel fe_select_downmix_kernel( const char **name );
+
+/** @brief Selects the fastest window kernel supported by the processor
+
+    @return The selected kernel
+*/
+fe_window_kernel fe_select_window_kernel( void );
+
+/** @brief Selects the fastest magnitude kernel supported by the processor
+
+    @return The selected kernel
+*/
+fe_magnitude_kernel fe_select_magnitude_kernel( void );
+
+#endif // FEATUREEXTRACTIONKERNELS_H_INCLUDED
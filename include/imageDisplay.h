@@ -38,6 +38,7 @@
 #include <SDL.h>
 #include <windows.h>
 #include "moodRecognition.h"
+#include "imageDisplayKernels.h"
 
 
 /********************** Defines *****************************/
@@ -50,18 +51,74 @@
 */
 #define LAMBDA 0.5
 
+/** Number of rows of pixels in a tile of a texture update.  Tile t is always updated by worker t % num_threads of
+    the tile pool, the worker that converted the tile's HSV pixels and so first touched their memory
+
+    @see id_run_tiles
+*/
+#define ID_TILE_ROWS 16
+
+/** Maximum number of worker threads in a tile pool */
+#define ID_MAX_THREADS 64
+
 
 /*********************** Structures *************************/
 
 
-/** Contains hue, saturation, and value (brightness) values for a single pixel */
+/** How the pixels of the textures are written: with a conversion kernel packing straight into the texture's layout,
+    or with SDL_MapRGB() for a format the kernels do not pack
+
+    @see id_initialize_pixel_packer
+*/
+typedef struct
+{
+    id_convert_kernel   convert;    /* Fastest kernel the processor supports, NULL to use SDL_MapRGB() */
+    id_pixel_layout     layout;     /* Channel positions for the kernel */
+    SDL_PixelFormat     *format;    /* The textures' pixel format, for SDL_MapRGB() */
+}
+id_pixel_packer;
+
+/** Signature of the work done on one tile by id_run_tiles()
+
+    @param job Pointer to the job's data, shared by every tile
+    @param first_row First row of the tile
+    @param num_rows Number of rows in the tile, ID_TILE_ROWS except for the last tile
+*/
+typedef void (*id_tile_function)( void *job, int first_row, int num_rows );
+
+struct id_tile_pool_s;
+
+/** A worker thread of an id_tile_pool, started for each job by its own event */
 typedef struct
 {
-    float h;
-    float s;
-    float v;
+    struct id_tile_pool_s   *pool;
+    int                     index;      /* Updates tiles index, index + num_threads, ... */
+    HANDLE                  start;      /* Auto-reset event set once per job */
+    HANDLE                  thread;
 }
-id_hsvPixel;
+id_tile_worker;
+
+/** Persistent worker threads that split each texture update into tiles of ID_TILE_ROWS rows.  The threads sleep on
+    their events between jobs
+
+    @see id_initialize_tile_pool
+*/
+typedef struct id_tile_pool_s
+{
+    int                 init_success;   /* 1 on successful initialization, 0 otherwise */
+
+    int                 num_threads;
+    id_tile_worker      workers[ID_MAX_THREADS];
+    HANDLE              done;           /* Auto-reset event set by the last worker to finish a job */
+    volatile LONG       workers_remaining;
+    volatile int        terminate_threads;
+
+    /* The current job, written by id_run_tiles() before the workers are started */
+    id_tile_function    function;
+    void                *job;
+    int                 num_rows;
+}
+id_tile_pool;
 
 /** Contains pointer to a texture and relevant information needed for processing and updating the texture */
 typedef struct
@@ -75,6 +132,22 @@ typedef struct
 }
 id_texture_info;
 
+/** Hands each updated texture from the texture updating thread to the main thread.  The four textures rotate: the
+    updating thread owns texture_updating and, while the mailbox is empty, texture_waiting; the main thread owns the
+    foreground and background and, while the mailbox is full, texture_waiting.  full is only changed with Interlocked
+    operations, and each side sleeps on the other's event instead of polling it
+
+    @see id_initialize_texture_mailbox
+*/
+typedef struct
+{
+    volatile LONG   full;       /* 1 from id_publish_texture() until id_take_texture() */
+    volatile LONG   stopped;    /* Set by id_stop_texture_mailbox(), ends the updating thread's wait */
+    HANDLE          published;  /* Auto-reset event set when a texture is published */
+    HANDLE          taken;      /* Auto-reset event set when the texture is taken or the mailbox stopped */
+}
+id_texture_mailbox;
+
 /** Contains data relevant to displaying and processing the image/texutres on screen */
 typedef struct
 {
@@ -87,20 +160,22 @@ typedef struct
     id_texture_info texture_foreground;     /* Foreground texture */
     id_texture_info texture_background;     /* Background texture */
 
-    id_hsvPixel        *hsvPixelData;          /* Pointer to a the pixel data from the original,
-                                                unmodified image */
+    id_hsv_planes      hsvPixelData;           /* The pixel data from the original, unmodified image */
+    id_pixel_packer    packer;                 /* Converts the pixels into the textures' format */
+    id_tile_pool       *pool;                  /* Worker threads that update the texture in tiles, allocated so
+                                                the workers' pointers to it stay valid */
+    id_texture_mailbox mailbox;                /* Hands texture_waiting to the main thread */
 }
 id_imageDisplay_data;
 
 /** Pointer to this data structure to be passed to the texture updating thread upon thread's creation
 
-    terminate_thread and updatedTexture are used to flag the thread to terminate or update and are
-    changed by the process's main thread
+    terminate_thread is set by the process's main thread, which then stops the display's mailbox so the thread
+    wakes to see it
 */
 typedef struct
 {
-    int                     terminate_thread;   /* Flag for thread termination */
-    int                     updatedTexture;     /* Flag to signal thread to update the texture */
+    volatile int            terminate_thread;   /* Flag for thread termination */
     id_imageDisplay_data    *imageDisplayData;  /* Data structure needed for texture updating and dispaly */
 
     float                   *arousal;           /* Pointer to current arousal (used to determine saturation */
@@ -136,17 +211,212 @@ void id_clean_imageDisplay_data( id_imageDisplay_data *display_data );
     provided valence and arousal values.
 
     @param texture Pointer to the id_texture_info structure of the texture to be updated
-    @param format Pointer to the SDL_PixelFormat of the window returned by SDL_GetWindowSurface()
-    @param hsvPtr Pointer to the HSV pixel data of the original, unmodified image
+    @param packer Pointer to the id_pixel_packer of the texture's format
+    @param pool Pointer to the id_tile_pool that updates the texture
+    @param planes Pointer to the HSV planes of the original, unmodified image
     @param arousal Floating point value between -1 and 1 used in determining image saturation
     @param valence Floating point value between -1 and 1 used in determining image value/brightness
 */
 void id_updateTexture( id_texture_info *texture,
-                       const struct SDL_PixelFormat *format,
-                       id_hsvPixel *hsvPtr,
+                       const id_pixel_packer *packer,
+                       id_tile_pool *pool,
+                       const id_hsv_planes *planes,
                        float arousal,
                        float valence );
 
+/** @brief Chooses how pixels of a format are written: ARGB8888, RGB888 (XRGB8888) and ABGR8888 are packed by the
+    fastest conversion kernel the processor supports, other formats go through SDL_MapRGB()
+
+    @param packer Pointer to the id_pixel_packer to initialize
+    @param format A pixel format (specified by the SDL library)
+    @param name Pointer to a string pointer where the name of the selected kernel will be stored, may be NULL
+    @return 1 on success, 0 if the format could not be allocated
+*/
+int id_initialize_pixel_packer( id_pixel_packer *packer, Uint32 format, const char **name );
+
+/** @brief Frees the SDL_PixelFormat of an id_pixel_packer initialized by id_initialize_pixel_packer()
+
+    @param packer Pointer to the id_pixel_packer to clean up
+*/
+void id_clean_pixel_packer( id_pixel_packer *packer );
+
+/** @brief Returns the saturation and value exponents used by id_updateTexture() for an arousal and valence
+
+    @param arousal Floating point value between -1 and 1 used in determining image saturation
+    @param valence Floating point value between -1 and 1 used in determining image value/brightness
+    @param beta Pointer to where the saturation exponent is stored
+    @param gamma Pointer to where the value exponent is stored
+*/
+void id_modulation_exponents( float arousal, float valence, float *beta, float *gamma );
+
+/** @brief Fills a transfer table with the saturation levels raised to beta and the value levels raised to gamma
+
+    @param lut Pointer to the id_transfer_lut to fill
+    @param beta Saturation exponent
+    @param gamma Value exponent
+*/
+void id_build_transfer_lut( id_transfer_lut *lut, float beta, float gamma );
+
+/** @brief Allocates the HSV planes of a w by h image as one block whose rows start on ID_HSV_ALIGNMENT byte
+    boundaries.  The memory is not touched, so the pages are placed by whichever thread first writes them
+
+    @param planes Pointer to the id_hsv_planes to allocate
+    @param w Width of the image (in pixels)
+    @param h Height of the image (in pixels)
+    @return 1 on success, 0 if there is not enough memory
+*/
+int id_allocate_hsv_planes( id_hsv_planes *planes, int w, int h );
+
+/** @brief Frees HSV planes allocated by id_allocate_hsv_planes().  Does nothing if their memory is NULL
+
+    @param planes Pointer to the id_hsv_planes to free
+*/
+void id_free_hsv_planes( id_hsv_planes *planes );
+
+/** @brief Stores a pixel converted by RGBtoHSV() in HSV planes, quantizing its hue, saturation and value to levels
+
+    @param planes Pointer to the id_hsv_planes to store the pixel in
+    @param index Index of the pixel in the planes, row * stride + column
+    @param h Hue of the pixel, [0,360], or -1 when s == 0
+    @param s Saturation of the pixel, [0,1]
+    @param v Value of the pixel, [0,1]
+*/
+void id_quantize_hsv( id_hsv_planes *planes, int index, float h, float s, float v );
+
+/** @brief Converts the original pixels to RGB with their saturation and value looked up in a transfer table, and
+    writes a band of their rows to an image of the same size in the given format.  Used by id_updateTexture() on a
+    locked texture
+
+    @param pixels Pointer to the first pixel of the image
+    @param pitch Length of a row of the image in bytes
+    @param packer Pointer to the id_pixel_packer of the pixels' format
+    @param planes Pointer to the HSV planes of the original, unmodified image
+    @param first_row First row of the band
+    @param num_rows Number of rows in the band
+    @param lut Pointer to the transfer table of the update
+*/
+void id_modulate_pixels( Uint32 *pixels,
+                         int pitch,
+                         const id_pixel_packer *packer,
+                         const id_hsv_planes *planes,
+                         int first_row,
+                         int num_rows,
+                         const id_transfer_lut *lut );
+
+/** @brief Updates every row of an image as id_modulate_pixels() does, split into tiles across the workers of a pool
+
+    @param pool Pointer to an initialized id_tile_pool
+    @see id_modulate_pixels for the other parameters
+*/
+void id_modulate_pixels_tiled( id_tile_pool *pool,
+                               Uint32 *pixels,
+                               int pitch,
+                               const id_pixel_packer *packer,
+                               const id_hsv_planes *planes,
+                               const id_transfer_lut *lut );
+
+/** @brief Converts the pixels of an image to HSV with RGBtoHSV() and id_quantize_hsv(), split into tiles across the
+    workers of a pool.  Run on newly allocated HSV planes, each worker first touches the memory of the tiles it later
+    updates, which places it on the worker's node on NUMA systems
+
+    @param pool Pointer to an initialized id_tile_pool
+    @param pixels Pointer to the image's pixels
+    @param pitch Length of a row of the image in bytes
+    @param format Pointer to the SDL_PixelFormat of the image
+    @param planes Pointer to the id_hsv_planes, allocated for the image's size, where the converted image will be
+                  stored
+*/
+void id_convert_to_hsv_tiled( id_tile_pool *pool,
+                              const Uint32 *pixels,
+                              int pitch,
+                              const struct SDL_PixelFormat *format,
+                              id_hsv_planes *planes );
+
+/** @brief Starts the worker threads of a tile pool
+
+    @param pool Pointer to the id_tile_pool to initialize.  Its init_success member is set to 1 on success and 0 on
+                failure
+    @param num_threads Number of worker threads, 1 to ID_MAX_THREADS
+*/
+void id_initialize_tile_pool( id_tile_pool *pool, int num_threads );
+
+/** @brief Stops the worker threads of a tile pool initialized by id_initialize_tile_pool() and frees its events
+
+    @param pool Pointer to the id_tile_pool to clean up
+*/
+void id_clean_tile_pool( id_tile_pool *pool );
+
+/** @brief Calls a function on every tile of ID_TILE_ROWS rows, tile t on worker t % num_threads, and returns when
+    every tile is done.  Only one thread may run jobs on a pool
+
+    @param pool Pointer to an initialized id_tile_pool
+    @param function Function called for each tile
+    @param job Pointer passed to every call of function
+    @param num_rows Number of rows to split into tiles
+*/
+void id_run_tiles( id_tile_pool *pool, id_tile_function function, void *job, int num_rows );
+
+/** @brief Creates the events of an empty texture mailbox
+
+    @param mailbox Pointer to the id_texture_mailbox to initialize
+    @return 1 on success, 0 if an event could not be created
+*/
+int id_initialize_texture_mailbox( id_texture_mailbox *mailbox );
+
+/** @brief Frees the events of a texture mailbox.  Neither thread may be using it
+
+    @param mailbox Pointer to the id_texture_mailbox to clean up
+*/
+void id_clean_texture_mailbox( id_texture_mailbox *mailbox );
+
+/** @brief Called by the texture updating thread once texture_waiting holds a new texture: hands it to the main thread
+
+    @param mailbox Pointer to an empty id_texture_mailbox
+*/
+void id_publish_texture( id_texture_mailbox *mailbox );
+
+/** @brief Called by the texture updating thread before it replaces texture_waiting: sleeps until the main thread has
+    taken the last texture published
+
+    @param mailbox Pointer to an initialized id_texture_mailbox
+    @return 1 once the mailbox is empty, 0 if it was stopped
+*/
+int id_wait_until_taken( id_texture_mailbox *mailbox );
+
+/** @brief Called by the main thread: returns whether a published texture is waiting in texture_waiting.  Does not
+    wait
+
+    @param mailbox Pointer to an initialized id_texture_mailbox
+    @return 1 if the mailbox is full, 0 otherwise
+*/
+int id_texture_published( id_texture_mailbox *mailbox );
+
+/** @brief Called by the main thread after it has swapped the published texture out of texture_waiting: empties the
+    mailbox and wakes the texture updating thread
+
+    @param mailbox Pointer to a full id_texture_mailbox
+*/
+void id_take_texture( id_texture_mailbox *mailbox );
+
+/** @brief Called by the main thread when it has nothing left to draw: sleeps until a texture is published or a
+    window message arrives, so the events can be handled
+
+    @param mailbox Pointer to an initialized id_texture_mailbox
+*/
+void id_wait_for_texture( id_texture_mailbox *mailbox );
+
+/** @brief Wakes the texture updating thread for good, so it can see terminate_thread and exit
+
+    @param mailbox Pointer to an initialized id_texture_mailbox
+*/
+void id_stop_texture_mailbox( id_texture_mailbox *mailbox );
+
+/** @brief The callback function used by the worker threads of a tile pool
+
+    @param lpArg A pointer cast as LPVOID that points to an id_tile_worker structure
+*/
+unsigned int __stdcall id_tileWorkerRoutine( void *lpArg );
+
 /** @brief The callback funtion used by the texture updating thread
 
     @param lpArg A pointer cast as LPVOID that points to a id_textureThreadStruct structure
@@ -0,0 +1,143 @@
+/* imageDisplayKernels.h Declares the SIMD kernels used to convert the displayed image to RGB
+ * Copyright (c) 2017 Jay Biernat
+ * Copyright (c) 2017 University of Rochester
+ *
+ * This file is part of Musical Mood Detector and Visualizer
+ *
+ * Musical Mood Detector and Visualizer is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Musical Mood Detector and Visualizer is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even
+ * the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Musical Mood Detector and Visualizer.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef IMAGEDISPLAYKERNELS_H_INCLUDED
+#define IMAGEDISPLAYKERNELS_H_INCLUDED
+
+#include <SDL.h>
+
+/* Every SIMD kernel gives bit for bit the pixels of the scalar one: the sector, p, q and t are computed with the
+ * same float operations as HSVtoRGB() on the stored hue, and instead of branching on the sector every lane computes
+ * all three and selects them with masks.  Channels are clamped to [0,255] and packed with the shifts of the texture's
+ * layout, so no SDL_MapRGB() call is made per pixel.  "MMDaV -bench convert" checks this for every kernel the processor
+ * supports.
+ */
+
+/** Number of levels the saturation of the original image is stored with.  The value of a pixel of an 8-bit image is
+    always one of 256 levels, so it is stored exactly with ID_VALUE_LEVELS.  Each texture update raises every level
+    to the update's exponent once (id_build_transfer_lut()) instead of raising the saturation and value of every pixel
+
+    Saturation is kept in 16 bits: with 256 levels the brightest and dullest moods move channels by up to 6 levels
+    from pow() on the exact saturation ("MMDaV -bench display"), with 4096 by at most one
+
+    @see id_updateTexture
+*/
+#define ID_SATURATION_LEVELS 4096
+#define ID_VALUE_LEVELS 256
+
+/** Hue is stored as a fixed point number of 60 degree sectors with ID_HUE_BITS fractional bits, so the sector and
+    its fractional part come from a shift and a mask, and are exactly the h / 60 of HSVtoRGB() on the stored hue */
+#define ID_HUE_BITS 13
+#define ID_HUE_STEPS ( 1 << ID_HUE_BITS )
+
+/** Alignment of the HSV planes and of each of their rows, in bytes and pixels (a cache line) */
+#define ID_HSV_ALIGNMENT 64
+
+/** Hue, saturation, and value (brightness) of the original image, in separate planes so the conversion kernels load
+    whole registers of each.  Pixel (row, column) is at index row * stride + column of every plane, see
+    id_quantize_hsv()
+
+    @see id_allocate_hsv_planes
+*/
+typedef struct
+{
+    Uint16  *hue;           /* Hue / 60 * ID_HUE_STEPS, rounded; 0 for grey pixels (undefined hue) */
+    Uint16  *saturation;    /* Saturation times ID_SATURATION_LEVELS - 1, rounded */
+    Uint8   *value;         /* Value times ID_VALUE_LEVELS - 1, rounded */
+    int     width;
+    int     height;
+    int     stride;         /* Pixels from the start of a row to the next, a multiple of ID_HSV_ALIGNMENT */
+    void    *memory;        /* The one aligned allocation holding the three planes */
+}
+id_hsv_planes;
+
+/** Saturation and value of every level raised to the exponents of one texture update */
+typedef struct
+{
+    float s[ID_SATURATION_LEVELS];
+    float v[ID_VALUE_LEVELS];
+}
+id_transfer_lut;
+
+/** Position of the channels in a packed 32-bit pixel */
+typedef struct
+{
+    int     r_shift;
+    int     g_shift;
+    int     b_shift;
+    Uint32  alpha;      /* Bits set in every pixel, opaque alpha or zero for an unused byte */
+}
+id_pixel_layout;
+
+/** Signature of a conversion kernel: looks the saturation and value of HSV pixels up in a transfer table, converts
+    them to RGB and packs them into a layout
+
+    @param pixels Pointer to num pixels where the packed pixels will be stored
+    @param hue Pointer to num hues of an id_hsv_planes
+    @param saturation Pointer to num saturations of an id_hsv_planes
+    @param value Pointer to num values of an id_hsv_planes
+    @param lut Pointer to the transfer table of the update
+    @param layout Pointer to the layout of the packed pixels
+    @param num Number of pixels
+*/
+typedef void (*id_convert_kernel)( Uint32 *pixels,
+                                   const Uint16 *hue,
+                                   const Uint16 *saturation,
+                                   const Uint8 *value,
+                                   const id_transfer_lut *lut,
+                                   const id_pixel_layout *layout,
+                                   int num );
+
+/** @brief Plain C kernel, used when the processor has no supported SIMD extension */
+void id_convert_scalar( Uint32 *pixels, const Uint16 *hue, const Uint16 *saturation, const Uint8 *value,
+                        const id_transfer_lut *lut, const id_pixel_layout *layout, int num );
+
+/** @brief SSE2 kernel, 4 pixels at a time */
+void id_convert_sse2( Uint32 *pixels, const Uint16 *hue, const Uint16 *saturation, const Uint8 *value,
+                      const id_transfer_lut *lut, const id_pixel_layout *layout, int num );
+
+/** @brief AVX2 kernel, 8 pixels at a time with gathered table lookups */
+void id_convert_avx2( Uint32 *pixels, const Uint16 *hue, const Uint16 *saturation, const Uint8 *value,
+                      const id_transfer_lut *lut, const id_pixel_layout *layout, int num );
+
+/** @brief AVX-512 kernel, 16 pixels at a time with gathered table lookups */
+void id_convert_avx512( Uint32 *pixels, const Uint16 *hue, const Uint16 *saturation, const Uint8 *value,
+                        const id_transfer_lut *lut, const id_pixel_layout *layout, int num );
+
+/** @brief Selects the fastest conversion kernel supported by the processor (see fe_simd_level())
+
+    @param name Pointer to a string pointer where the name of the selected instruction set will be stored, may be NULL
+    @return The selected kernel
+*/
+id_convert_kernel id_select_convert_kernel( const char **name );
+
+/** @brief Returns the layout of a pixel format
+
+    @param format A pixel format (specified by the SDL library)
+    @param layout Pointer to where the layout will be stored
+    @return 1 for ARGB8888, RGB888 (XRGB8888) and ABGR8888, 0 for a format the kernels do not pack
+*/
+int id_pixel_layout_of( Uint32 format, id_pixel_layout *layout );
+
+#endif // IMAGEDISPLAYKERNELS_H_INCLUDED
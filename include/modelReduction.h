@@ -0,0 +1,84 @@
+/* modelReduction.h Declares the functions of the offline support vector reduction tool
+ * Copyright (c) 2017 Jay Biernat
+ * Copyright (c) 2017 University of Rochester
+ *
+ * This file is part of Musical Mood Detector and Visualizer
+ *
+ * Musical Mood Detector and Visualizer is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Musical Mood Detector and Visualizer is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even
+ * the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Musical Mood Detector and Visualizer.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MODELREDUCTION_H_INCLUDED
+#define MODELREDUCTION_H_INCLUDED
+
+#include "moodRecognition.h"
+
+#define RD_CALIBRATION_VECTORS 2048     /* Number of calibration feature vectors drawn when no calibration file is given */
+#define RD_RIDGE 1e-6                   /* Regularization of the alpha refit, relative to the mean diagonal of the normal equations */
+
+/** A reduced model: the support vectors kept, in order of importance, and their weights */
+typedef struct
+{
+    int     num_kept;       /* Number of support vectors kept */
+    int     *kept;          /* Indices into the original model of the kept support vectors */
+    double  *alpha;         /* Weights of the kept support vectors */
+    int     refit;          /* 1 if alpha was refit on the calibration set, 0 if it is the original alpha */
+    double  max_error;      /* Largest prediction error over the calibration set */
+}
+rd_reduction;
+
+/** @brief Reduces a model to the fewest support vectors whose predictions stay within an error budget on a set of
+    calibration feature vectors.  The support vectors are ranked by |alpha| times the RMS of their kernel over the
+    calibration set; for each candidate number kept, the weights of the kept support vectors are refit by ridge
+    regularized least squares to the full model's predictions on the even calibration vectors, and the smaller of
+    the refit and the plain pruning error over all calibration vectors is compared with the budget
+
+    @param mdl Pointer to the model to reduce
+    @param x Pointer to the calibration feature vectors, num_vectors x mdl->num_features
+    @param num_vectors Number of calibration feature vectors
+    @param budget Largest prediction error allowed on any calibration vector
+    @param reduction Pointer to the structure that receives the reduced model, free with rd_free_reduction()
+
+    @return 1 on success, 0 if memory could not be allocated
+*/
+int rd_reduce_model( const mr_model *mdl, const float *x, int num_vectors, double budget, rd_reduction *reduction );
+
+/** @brief Frees the arrays of a reduction
+
+    @param reduction Pointer to the reduction to free
+*/
+void rd_free_reduction( rd_reduction *reduction );
+
+/** @brief Writes a reduced model as a text model directory that mr_create_model() can read
+
+    @param mdl Pointer to the model that was reduced
+    @param reduction Pointer to the reduction
+    @param directory Path of the directory to write, created if it does not exist
+
+    @return 1 on success, 0 on failure
+*/
+int rd_write_model( const mr_model *mdl, const rd_reduction *reduction, const char *directory );
+
+/** @brief Runs the reduction tool.  Called by main() for "MMDaV -reduce <model directory> <output directory>
+    <error budget> [calibration feature file]"
+
+    @param argc Number of arguments following "-reduce"
+    @param argv Arguments following "-reduce"
+    @return 0 on success, nonzero on failure
+*/
+int rd_run( int argc, char *argv[] );
+
+#endif // MODELREDUCTION_H_INCLUDED
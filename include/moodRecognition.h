@@ -26,6 +26,43 @@
 
 #include <windows.h>
 #include "featureExtraction.h"
+#include "moodRecognitionKernels.h"
+
+#define MR_AROUSAL_MODEL_DIRECTORY "..\\assets\\arousal.info"
+#define MR_VALENCE_MODEL_DIRECTORY "..\\assets\\valence.info"
+
+/* Binary versions of the models written by "MMDaV -convert", used instead of the text directories when present */
+#define MR_AROUSAL_MODEL_FILE "..\\assets\\arousal.mdl"
+#define MR_VALENCE_MODEL_FILE "..\\assets\\valence.mdl"
+
+#define MR_BINARY_MAGIC "MMDaVSVR"      /* First 8 bytes of a binary model file */
+#define MR_BINARY_VERSION 3             /* Incremented whenever the layout of the file changes */
+
+/* Largest model dimensions accepted from a binary model file, far above any trained model, so no size computed from
+   a header can overflow */
+#define MR_MAX_FEATURES 4096
+#define MR_MAX_SV 1048576
+
+/* Storage format of the support vectors used by the live mood detection thread, one of the MR_PRECISION_ formats
+   in moodRecognitionKernels.h.  Check the deviation of a reduced format with "MMDaV -bench precision" first */
+#define MR_SV_PRECISION MR_PRECISION_FP32
+
+/* Number of Random Fourier Features used by the live mood detection thread in place of the support vectors, 0 for
+   the exact kernel sum.  "MMDaV -bench rff" reports the accuracy and speed of several sizes */
+#define MR_RFF_COMPONENTS 0
+#define MR_RFF_SEED 1                   /* Seed of the random frequencies, so an approximation can be reproduced */
+
+/* Number of feature vectors drawn by mr_reference_features() to check a reduced model against fp32 */
+#define MR_REFERENCE_VECTORS 256
+
+/* The mood detection thread makes a prediction after every MR_PREDICTION_CADENCE frames completed by the analysis
+   thread (one frame every hop_length samples, about 46 ms by default) */
+#define MR_PREDICTION_CADENCE 1
+
+/** mr_predict_batch() normalizes MR_BATCH_ROWS feature vectors at a time and runs them against MR_BATCH_SV columns
+    of the transposed support vectors at a time, so both blocks stay in the L1/L2 cache while they are reused */
+#define MR_BATCH_ROWS 64
+#define MR_BATCH_SV 128
 
 /******************* Structures *******************/
 
@@ -43,10 +80,74 @@ typedef struct
     float   scale;         /* For Gaussian kernel and predictor function */
     float   bias;
     float   *alpha;
-    float   *support_vectors;
+    float   *support_vectors;   /* num_sv x num_features, as trained */
+
+    /* Compiled form of the model used by the kernels, built once by mr_create_model() (see moodRecognitionKernels.h) */
+    int     padded_features;    /* num_features rounded up to a multiple of MR_PAD_FLOATS */
+    int     padded_sv;          /* num_sv rounded up to a multiple of MR_TILE_SV */
+    float   *x_scale;           /* 1 / ( sigma * scale ), padded_features floats, zero in the padding */
+    float   *x_offset;          /* -mu / ( sigma * scale ), padded_features floats, zero in the padding */
+    float   *sv_compiled;       /* padded_features x padded_sv, 2 * support vector / scale, feature-major */
+    float   *sv_bias;           /* -||support vector / scale||^2, padded_sv floats */
+    float   *alpha_padded;      /* alpha followed by zeros for the padding support vectors */
+    int     precision;          /* MR_PRECISION_ format of the support vectors used by mr_predict() */
+    void    *sv_quantized;      /* sv_compiled as half floats or bytes, built by mr_quantize_model(), or NULL */
+    float   *sv_dequant;        /* int8 only: scale of each feature of sv_quantized, padded_features floats */
+    float   *sv_bias_quantized; /* sv_bias recomputed from sv_quantized, padded_sv floats */
+    mr_rbf_kernel kernel;       /* Kernels selected for the processor at load time */
+    mr_rbf_tile_kernel tile_kernel;
+
+    /* Random Fourier Features approximation built by mr_approximate_model(), used by mr_predict() when rff_components > 0 */
+    int     rff_components;     /* D, a multiple of MR_TILE_SV */
+    float   *rff_weights;       /* padded_features x rff_components random frequencies, feature-major */
+    float   *rff_phase;         /* rff_components random phases in [0, 2pi) */
+    float   *rff_beta;          /* rff_components weights of the cosines */
+    mr_rff_kernel rff_kernel;
+
+    HANDLE      file;           /* Binary model file and its mapping when loaded by mr_map_model(), the arrays */
+    HANDLE      mapping;        /* then point into the view instead of being allocated */
+    const void  *view;
 }
 mr_model;
 
+/** Sections of a binary model file, in the order they are stored.  Each holds the mr_model array of the same name */
+enum
+{
+    MR_SECTION_MU,                  /* num_features floats */
+    MR_SECTION_SIGMA,               /* num_features floats */
+    MR_SECTION_ALPHA,               /* num_sv floats */
+    MR_SECTION_SUPPORT_VECTORS,     /* num_sv x num_features floats */
+    MR_SECTION_X_SCALE,             /* padded_features floats */
+    MR_SECTION_X_OFFSET,            /* padded_features floats */
+    MR_SECTION_ALPHA_PADDED,        /* padded_sv floats */
+    MR_SECTION_SV_BIAS,             /* padded_sv floats */
+    MR_SECTION_SV_COMPILED,         /* padded_features x padded_sv floats */
+    MR_NUM_SECTIONS
+};
+
+/** Header at the start of a binary model file (little endian, as written by mr_write_binary_model()).  Each
+    section starts at a multiple of MR_ALIGNMENT bytes from the start of the file so it can be used in place from
+    a mapped view, which is page aligned.  The compiled arrays are stored too, so a mapped model needs no work
+    before its first prediction */
+typedef struct
+{
+    char            magic[8];       /* MR_BINARY_MAGIC, not null terminated */
+    unsigned int    version;        /* MR_BINARY_VERSION */
+    unsigned int    header_size;    /* sizeof(mr_binary_header) */
+    unsigned int    file_size;      /* Size of the whole file in bytes */
+    unsigned int    checksum;       /* FNV-1a hash of the 32-bit words of the whole file, this field read as 0 */
+
+    int             num_features;
+    int             padded_features;
+    int             num_sv;
+    int             padded_sv;
+    float           scale;
+    float           bias;
+
+    unsigned int    section_offset[MR_NUM_SECTIONS];    /* Byte offsets of the sections from the start of the file */
+}
+mr_binary_header;
+
 /** Contains pointer to and dimensions of a two-dimensional float array */
 typedef struct
 {
@@ -64,15 +165,29 @@ typedef struct
 
     fe_extraction_info *extraction_info;    /* Pointer to structure containing feature extraction information */
 
-    float   *timbre_matrix;     /* Two dimensional array where each row is a timbre feature and each column is a frame of audio */
-    float   *rec_flux_buffer;   /* Circular buffer holding past frame's rectified spectral flux values */
+    double  *timbre_sum;        /* Copy of the running sum and sum of squares of each timbre feature over the window */
+    double  *timbre_sum_sq;     /* kept by the analysis thread, taken with fe_read_window_stats() for each prediction */
+    float   *rec_flux_buffer;   /* Copy of the analysis thread's circular buffer of past rectified spectral flux values */
+    fe_autocorrelation autocorrelation;     /* Autocorrelation state of the copy, its running lags copied as well */
     float   *features;          /* Feature vector used by SVR model */
 
+    fe_extraction_thread_data *extraction_data;     /* Analysis thread data, counts and signals completed frames */
+    int     prediction_cadence;     /* Number of completed frames between predictions, MR_PREDICTION_CADENCE by default */
+
     mr_model arousal_mdl;       /* Trained SVR models used to predict arousal and valence of a section of audio */
     mr_model valence_mdl;
 
     float   arousal_prediction;
     float   valence_prediction;
+
+    /* Statistics kept by MoodDetectionRoutine(), valid after the thread has exited */
+    unsigned long   num_predictions;
+    unsigned long   frames_skipped;     /* Frames that completed while a prediction was running, beyond the cadence */
+    LONGLONG        predict_ticks;      /* Performance counter ticks spent computing features and predicting */
+    LONGLONG        latency_ticks;      /* Ticks from the completion of a frame to the prediction made after it */
+    LONGLONG        latency_max_ticks;
+    double          cpu_seconds;        /* User and kernel time of the thread, including waiting overhead */
+    double          run_seconds;        /* Wall time the thread ran */
 }
 mr_detection_thread_data;
 
@@ -81,13 +196,36 @@ mr_detection_thread_data;
 /** @brief Initializes and returns the data structure to be passed to the mood recognition thread
 
     @param extractionInfo An initialized fe_extraction_info structure initialized by fe_initialize_extrantion_info()
-    @param poartAudioData The initialized fe_initialize_extraction_thread_data to be used by the port audio callback function
+    @param portAudioData Pointer to the initialized fe_extraction_thread_data of the analysis thread, which must stay at
+    the same address while the mood recognition thread runs
 
     @return A mr_detection_thread_data structure to be passed (via a void pointer) to the mood recognition thread.  Strucutre
     member init_success is set to 0 on failure of initialization and 1 on success.
 
 */
-mr_detection_thread_data mr_initialize_mood_detection_data( fe_extraction_info *extractionInfo , fe_extraction_thread_data portAudioData );
+mr_detection_thread_data mr_initialize_mood_detection_data( fe_extraction_info *extractionInfo , fe_extraction_thread_data *portAudioData );
+
+/** @brief Loads the arousal and valence models used for live input, in the MR_SV_PRECISION format and with
+    MR_RFF_COMPONENTS Random Fourier Features.  A reduced model is kept only if it deviates from fp32 by at most
+    BM_PRECISION_TOLERANCE on the mr_reference_features() vectors, otherwise it stays fp32 and a message is printed
+    on stderr.  Batch analysis loads the same models, so files and live input are predicted alike.  The models are only read by mr_predict() and mr_predict_batch(), so any number of threads may
+    predict with them at once
+
+    @param arousal_mdl Pointer to where the arousal model is stored, free with mr_destroy() even on failure
+    @param valence_mdl Pointer to where the valence model is stored, free with mr_destroy() even on failure
+    @return 1 if both models were loaded, 0 otherwise
+*/
+int mr_load_live_models( mr_model *arousal_mdl, mr_model *valence_mdl );
+
+/** @brief Draws feature vectors around the training distribution of a model, mu + sigma * (uniform noise in
+    [-2, 2]) for each feature.  rand() is seeded with 1 first, so every call returns the same vectors
+
+    @param mdl Pointer to an initialized model
+    @param num_vectors Number of feature vectors to draw
+
+    @return Pointer to num_vectors x num_features floats, free with free(), or NULL if memory could not be allocated
+*/
+float *mr_reference_features( const mr_model *mdl, int num_vectors );
 
 /** @brief Frees memory in a mr_detection_thread_data structure initalized by mr_initialize_mood_detection_data().
     Must be before the end of the program when a successful call to mr_initialize_mood_detection_data() has
@@ -124,22 +262,135 @@ void mr_free_array( mr_array *thisArray );
 */
 mr_model mr_create_model( const char *directory );
 
-/** @brief Frees memory allocated in a mr_model structure
+/** @brief Maps a binary model file written by mr_write_binary_model() and uses its arrays in place, without any
+    parsing or copying.  The header, section bounds and checksum are checked before the model is used.
+    mr_destroy() must be called after a successful call to mr_map_model()
+
+    @param path Path to the binary model file
+
+    @return An mr_model structure pointing into the mapped file.  Structure member init_success is set to 0 on
+    failure of initialization and 1 on success.
+*/
+mr_model mr_map_model( const char *path );
+
+/** @brief Loads a model from its binary file if that file exists, otherwise from its text directory
+
+    @param path Path to the binary model file
+    @param directory Path to the directory of text files used when there is no binary file
+
+    @return An mr_model structure, see mr_map_model() and mr_create_model()
+*/
+mr_model mr_load_model( const char *path, const char *directory );
+
+/** @brief Writes a model loaded by mr_create_model() to a binary model file that can be loaded by mr_map_model()
+
+    @param mdl Pointer to the model to write
+    @param path Path of the binary model file to create
+
+    @return 1 on success, 0 on failure
+*/
+int mr_write_binary_model( const mr_model *mdl, const char *path );
+
+/** @brief Converts models from text directories to binary model files.  Called by main() for "MMDaV -convert [args]"
+
+    @param argc Number of arguments following "-convert", 0 to convert both default models or 2 for a single model
+    @param argv Arguments following "-convert": the model directory and the binary model file to write
+    @return 0 on success, nonzero on failure
+*/
+int mr_run_convert( int argc, char *argv[] );
+
+/** @brief Switches mr_predict() to reduced-precision support vectors built from the compiled model, or back to
+    fp32.  Works on created and mapped models alike, the quantized arrays are always allocated.  mr_predict_batch()
+    predicts one vector at a time with mr_predict() while the model is not fp32
+
+    @param mdl Pointer to the model to quantize
+    @param precision MR_PRECISION_FP32, MR_PRECISION_FP16 or MR_PRECISION_INT8
+
+    @return 1 on success, 0 on failure
+*/
+int mr_quantize_model( mr_model *mdl, int precision );
+
+/** @brief Replaces the kernel sum of mr_predict() with a Random Fourier Features approximation, or switches back to
+    the exact sum.  exp( -||x' - sv||^2 ) is the expected value of 2 cos( w.x' + b ) cos( w.sv + b ) for w drawn
+    from N(0, 2I) and b uniform in [0, 2pi), so with D such pairs (w_d, b_d) the model becomes
+        f(x) = sum over d of beta[d] * cos( w_d.x' + b_d ) + bias,  beta[d] = 2/D * sum over i of alpha[i] * cos( w_d.sv_i + b_d )
+    which costs D x num_features multiply-adds and D cosines whatever the number of support vectors.  The error
+    falls as 1 / sqrt(D) and grows with the sum of |alpha|.  mr_predict_batch() predicts one vector at a time with
+    mr_predict() while the approximation is in use
+
+    @param mdl Pointer to the model to approximate
+    @param num_components Number of random features D, rounded up to a multiple of MR_TILE_SV, or 0 for the exact sum
+    @param seed Seed of the random frequencies and phases
+
+    @return 1 on success, 0 on failure
+*/
+int mr_approximate_model( mr_model *mdl, int num_components, unsigned int seed );
+
+/** @brief Frees memory allocated in a mr_model structure, or unmaps the file of a model loaded by mr_map_model()
 
     @param mdl Pointer to the mr_model to free allocated memory from
 */
 void mr_destroy( mr_model *mdl );
 
-/** @brief Makes a prediction given an array of features and a trained SVR model
+/** @brief Makes a prediction given an array of features and a trained SVR model.  The Gaussian kernel sum is
+    evaluated by the SIMD kernel selected in mr_create_model() and matches mr_predict_scalar() within
+    MR_KERNEL_TOLERANCE (see moodRecognitionKernels.h) when the model is fp32
 
     @param x Pointer to an array of floats that are the features to be used for the SVR prediction
-    @param mdl An SVR model used in the prediction
+    @param mdl Pointer to the SVR model used in the prediction
 
     @return The predicted value returned by the SVR
 */
-float mr_predict( float *x, mr_model mdl );
+float mr_predict( float *x, const mr_model *mdl );
+
+/** @brief Reference implementation of mr_predict() that evaluates the kernel one element at a time in double
+    precision.  Used to validate the SIMD kernels
+
+    @param x Pointer to an array of floats that are the features to be used for the SVR prediction
+    @param mdl Pointer to the SVR model used in the prediction
+
+    @return The predicted value returned by the SVR
+*/
+float mr_predict_scalar( float *x, const mr_model *mdl );
+
+/** @brief Makes arousal and valence predictions for a block of feature vectors.  Faster than calling mr_predict()
+    for each vector: the kernel distances are expanded as ||x||^2 + ||sv||^2 - 2 x.sv and the dot products are
+    computed as a cache blocked matrix multiply, so every support vector is loaded once per MR_BATCH_ROWS vectors.
+    The blocked kernels are fp32 only: a model with reduced precision support vectors or Random Fourier Features is
+    run through mr_predict() for each vector, so batch and single predictions never differ by more than
+    MR_KERNEL_TOLERANCE
+
+    @param x Pointer to num_vectors feature vectors stored one after another (num_vectors x num_features)
+    @param num_vectors Number of feature vectors
+    @param arousal_mdl Pointer to the arousal SVR model
+    @param valence_mdl Pointer to the valence SVR model, must have the same number of features as arousal_mdl
+    @param arousal Pointer to an array of num_vectors floats where the arousal predictions will be stored
+    @param valence Pointer to an array of num_vectors floats where the valence predictions will be stored
+*/
+void mr_predict_batch( const float *x,
+                       int num_vectors,
+                       const mr_model *arousal_mdl,
+                       const mr_model *valence_mdl,
+                       float *arousal,
+                       float *valence );
+
+/** @brief Fills the feature vector used by the SVR models: the mean and standard deviation of each timbre feature
+    followed by the rhythmic features
+
+    @param features Pointer to an array of (info->num_timbre_features * 2 + info->num_onset_features) floats
+    @param timbre_sum Pointer to the running sums of the timbre matrix rows kept by fe_process_spectrum(), or a
+                      consistent copy of them taken by fe_read_window_stats()
+    @param timbre_sum_sq Pointer to the running sums of squares of the timbre matrix rows
+    @param rec_flux_buffer Pointer to the rectified flux buffer filled by fe_process_frame()
+    @param autocorrelation Pointer to the autocorrelation state of the flux buffer
+    @param info Pointer to an initialized fe_extraction_info structure
+*/
+void mr_compute_features( float *features, const double *timbre_sum, const double *timbre_sum_sq, float *rec_flux_buffer,
+                          fe_autocorrelation *autocorrelation, fe_extraction_info *info );
 
-/** @brief The callback funtion used by the texture updating thread
+/** @brief The callback funtion used by the mood detection thread.  Sleeps on the frame_ready event of the analysis
+    thread and makes a prediction after every prediction_cadence completed frames, once the first window of frames
+    is complete.  Set terminate_thread and signal frame_ready to stop it
 
     @param lpArg A pointer cast as LPVOID that points to a mr_detection_thread_data structure
 */
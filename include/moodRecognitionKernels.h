@@ -0,0 +1,222 @@
+/* moodRecognitionKernels.h Declares the SIMD kernels used in SVR prediction
+ * Copyright (c) 2017 Jay Biernat
+ * Copyright (c) 2017 University of Rochester
+ *
+ * This file is part of Musical Mood Detector and Visualizer
+ *
+ * Musical Mood Detector and Visualizer is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Musical Mood Detector and Visualizer is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even
+ * the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Musical Mood Detector and Visualizer.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MOODRECOGNITIONKERNELS_H_INCLUDED
+#define MOODRECOGNITIONKERNELS_H_INCLUDED
+
+/* The kernels work on a model compiled by mr_create_model() or mapped by mr_map_model():
+ *
+ *  - the feature normalization and the kernel scale are folded into one multiply-add per feature,
+ *    x'[j] = x[j] * x_scale[j] + x_offset[j] = ( x[j] - mu[j] ) / ( sigma[j] * scale )
+ *  - the support vectors are stored feature-major (structure of arrays), sv[j][i] = 2 * sv_i[j] / scale, so
+ *    consecutive support vectors of one feature are contiguous and a register holds one feature of several
+ *    support vectors
+ *  - sv_bias[i] = -||sv_i / scale||^2
+ *
+ * so that the Gaussian kernel of support vector i is
+ *    exp( -||x' - sv_i/scale||^2 ) = exp( sv_bias[i] + x'.sv[.][i] - ||x'||^2 )
+ * which is one fused multiply-add per feature and support vector followed by one exp, with no division.
+ */
+
+/** Feature vectors are padded with zeros to a multiple of this many floats (one 64-byte cache line, one
+    AVX-512 register) so the kernels never need a remainder loop over the features */
+#define MR_PAD_FLOATS 16
+
+/** Alignment in bytes of the compiled support vectors and compiled feature vectors */
+#define MR_ALIGNMENT 64
+
+/** The compiled support vectors are padded to a multiple of MR_TILE_SV with zero support vectors of zero weight.
+    A call of a tile kernel in mr_predict_batch() handles MR_TILE_ROWS feature vectors */
+#define MR_TILE_ROWS 4
+#define MR_TILE_SV 64
+
+/** Documented accuracy of the SIMD kernels.  The vectorized exp is within a few ulp of expf, but the expanded
+    squared distance ||x'||^2 + ||sv||^2 - 2 x'.sv loses some precision to cancellation, so for every kernel
+        | mr_predict() - mr_predict_scalar() | <= MR_KERNEL_TOLERANCE * ( 1 + sum of |alpha| )
+    The benchmarks "MMDaV -bench predict" and "MMDaV -bench batch" check this bound for every kernel the
+    processor supports
+*/
+#define MR_KERNEL_TOLERANCE 1e-5f
+
+/** Storage formats of the compiled support vectors.  The quantized formats keep sv_bias, alpha and the feature
+    vector in fp32 and only store sv[j][i] with fewer bits, the kernels convert them back to fp32 in registers:
+     - MR_PRECISION_FP16: IEEE half floats, 11 significant bits
+     - MR_PRECISION_INT8: signed bytes with one scale per feature, sv[j][i] = sv_dequant[j] * q[j][i] with
+       |q| <= 127.  The kernels take x'[j] * sv_dequant[j] as the feature vector, see mr_predict()
+    In both cases sv_bias is recomputed from the stored values, so the kernel remains the exact Gaussian of a
+    slightly moved support vector and never exceeds 1 */
+#define MR_PRECISION_FP32 0
+#define MR_PRECISION_FP16 1
+#define MR_PRECISION_INT8 2
+
+/** Signature of a kernel sum for one compiled feature vector: returns the sum over support vectors i of
+    alpha[i] * exp( min( 0, sv_bias[i] + x.sv[.][i] - x_norm ) )
+
+    @param x Pointer to the compiled feature vector, padded with zeros to padded_features
+    @param x_norm Squared norm of x
+    @param sv Pointer to the padded_features x num_sv compiled support vectors, MR_ALIGNMENT aligned, stored as
+              floats, half floats or bytes depending on the kernel
+    @param sv_bias Pointer to the num_sv support vector biases, MR_ALIGNMENT aligned
+    @param alpha Pointer to the num_sv support vector weights, MR_ALIGNMENT aligned
+    @param num_sv Number of (padded) support vectors, a multiple of MR_TILE_SV
+    @param padded_features Length of a padded feature vector, a multiple of MR_PAD_FLOATS
+*/
+typedef float (*mr_rbf_kernel)( const float *x,
+                                float x_norm,
+                                const void *sv,
+                                const float *sv_bias,
+                                const float *alpha,
+                                int num_sv,
+                                int padded_features );
+
+/** Signature of a tile kernel used by mr_predict_batch(): for each of the MR_TILE_ROWS rows r of x, adds to sums[r]
+    the sum over support vectors n of alpha[n] * exp( min( 0, sv_bias[n] + x[r].sv[.][n] - x_norms[r] ) )
+
+    @param x Pointer to MR_TILE_ROWS compiled feature vectors, each padded to padded_features
+    @param x_norms Pointer to the MR_TILE_ROWS squared norms of the rows of x
+    @param sv Pointer to the first column to use in the (padded_features x ld_sv) compiled support vectors
+    @param ld_sv Distance between rows of the compiled support vectors, a multiple of MR_TILE_SV
+    @param sv_bias Pointer to the support vector biases, starting at the first column used
+    @param alpha Pointer to the support vector weights, starting at the first column used
+    @param num_sv Number of support vectors (columns) to use, a multiple of MR_TILE_SV
+    @param padded_features Length of a padded feature vector, a multiple of MR_PAD_FLOATS
+    @param sums Pointer to the MR_TILE_ROWS sums to accumulate into
+*/
+typedef void (*mr_rbf_tile_kernel)( const float *x,
+                                    const float *x_norms,
+                                    const float *sv,
+                                    int ld_sv,
+                                    const float *sv_bias,
+                                    const float *alpha,
+                                    int num_sv,
+                                    int padded_features,
+                                    float *sums );
+
+/** Signature of a Random Fourier Features kernel (see mr_approximate_model()): returns the sum over components d of
+    beta[d] * cos( phase[d] + x.weights[.][d] ), the same loop as mr_rbf_kernel with cos in place of exp
+
+    @param x Pointer to the compiled feature vector, padded with zeros to padded_features
+    @param weights Pointer to the padded_features x num_components random frequencies, MR_ALIGNMENT aligned
+    @param phase Pointer to the num_components random phases, MR_ALIGNMENT aligned
+    @param beta Pointer to the num_components weights of the cosines, MR_ALIGNMENT aligned
+    @param num_components Number of (padded) components, a multiple of MR_TILE_SV
+    @param padded_features Length of a padded feature vector, a multiple of MR_PAD_FLOATS
+*/
+typedef float (*mr_rff_kernel)( const float *x,
+                                const float *weights,
+                                const float *phase,
+                                const float *beta,
+                                int num_components,
+                                int padded_features );
+
+/** @brief Plain C kernel used when the processor has no supported SIMD extension */
+float mr_rbf_kernel_scalar( const float *x, float x_norm, const void *sv, const float *sv_bias, const float *alpha, int num_sv, int padded_features );
+
+/** @brief SSE2 kernel, 32 support vectors in registers */
+float mr_rbf_kernel_sse2( const float *x, float x_norm, const void *sv, const float *sv_bias, const float *alpha, int num_sv, int padded_features );
+
+/** @brief AVX2/FMA kernel, 64 support vectors in registers */
+float mr_rbf_kernel_avx2( const float *x, float x_norm, const void *sv, const float *sv_bias, const float *alpha, int num_sv, int padded_features );
+
+/** @brief AVX-512F kernel, 64 support vectors in registers */
+float mr_rbf_kernel_avx512( const float *x, float x_norm, const void *sv, const float *sv_bias, const float *alpha, int num_sv, int padded_features );
+
+/** @brief Plain C kernel for half float support vectors */
+float mr_rbf_kernel_scalar_fp16( const float *x, float x_norm, const void *sv, const float *sv_bias, const float *alpha, int num_sv, int padded_features );
+
+/** @brief Plain C kernel for int8 support vectors */
+float mr_rbf_kernel_scalar_int8( const float *x, float x_norm, const void *sv, const float *sv_bias, const float *alpha, int num_sv, int padded_features );
+
+/** @brief AVX2/FMA kernel for half float support vectors, converted with F16C.  Only selected when the processor
+    reports F16C as well, otherwise the plain C kernel is used */
+float mr_rbf_kernel_avx2_fp16( const float *x, float x_norm, const void *sv, const float *sv_bias, const float *alpha, int num_sv, int padded_features );
+
+/** @brief AVX2/FMA kernel for int8 support vectors */
+float mr_rbf_kernel_avx2_int8( const float *x, float x_norm, const void *sv, const float *sv_bias, const float *alpha, int num_sv, int padded_features );
+
+/** @brief AVX-512F kernel for half float support vectors */
+float mr_rbf_kernel_avx512_fp16( const float *x, float x_norm, const void *sv, const float *sv_bias, const float *alpha, int num_sv, int padded_features );
+
+/** @brief AVX-512F kernel for int8 support vectors */
+float mr_rbf_kernel_avx512_int8( const float *x, float x_norm, const void *sv, const float *sv_bias, const float *alpha, int num_sv, int padded_features );
+
+/** @brief Plain C tile kernel */
+void mr_rbf_tile_scalar( const float *x, const float *x_norms, const float *sv, int ld_sv, const float *sv_bias,
+                         const float *alpha, int num_sv, int padded_features, float *sums );
+
+/** @brief SSE2 tile kernel, MR_TILE_ROWS x 8 dot products in registers */
+void mr_rbf_tile_sse2( const float *x, const float *x_norms, const float *sv, int ld_sv, const float *sv_bias,
+                       const float *alpha, int num_sv, int padded_features, float *sums );
+
+/** @brief AVX2/FMA tile kernel, MR_TILE_ROWS x 16 dot products in registers */
+void mr_rbf_tile_avx2( const float *x, const float *x_norms, const float *sv, int ld_sv, const float *sv_bias,
+                       const float *alpha, int num_sv, int padded_features, float *sums );
+
+/** @brief AVX-512F tile kernel, MR_TILE_ROWS x 32 dot products in registers */
+void mr_rbf_tile_avx512( const float *x, const float *x_norms, const float *sv, int ld_sv, const float *sv_bias,
+                         const float *alpha, int num_sv, int padded_features, float *sums );
+
+/** @brief Plain C Random Fourier Features kernel, also used with SSE2 */
+float mr_rff_kernel_scalar( const float *x, const float *weights, const float *phase, const float *beta, int num_components, int padded_features );
+
+/** @brief AVX2/FMA Random Fourier Features kernel */
+float mr_rff_kernel_avx2( const float *x, const float *weights, const float *phase, const float *beta, int num_components, int padded_features );
+
+/** @brief AVX-512F Random Fourier Features kernel */
+float mr_rff_kernel_avx512( const float *x, const float *weights, const float *phase, const float *beta, int num_components, int padded_features );
+
+/** @brief Converts a float to an IEEE half float, rounding to nearest
+
+    @param value The float to convert
+    @return The bits of the half float
+*/
+unsigned short mr_float_to_half( float value );
+
+/** @brief Converts an IEEE half float to a float
+
+    @param value The bits of the half float
+    @return The converted value
+*/
+float mr_half_to_float( unsigned short value );
+
+/** @brief Selects the fastest kernel supported by the processor (checked with CPUID)
+
+    @param precision Storage format of the support vectors, MR_PRECISION_FP32, MR_PRECISION_FP16 or MR_PRECISION_INT8
+    @param name Pointer to a string pointer where the name of the selected instruction set will be stored, may be NULL
+    @return The selected kernel
+*/
+mr_rbf_kernel mr_select_rbf_kernel( int precision, const char **name );
+
+/** @brief Selects the fastest tile kernel supported by the processor, the same instruction set as mr_select_rbf_kernel()
+
+    @return The selected tile kernel
+*/
+mr_rbf_tile_kernel mr_select_rbf_tile_kernel( void );
+
+/** @brief Selects the fastest Random Fourier Features kernel supported by the processor
+
+    @return The selected kernel
+*/
+mr_rff_kernel mr_select_rff_kernel( void );
+
+#endif // MOODRECOGNITIONKERNELS_H_INCLUDED
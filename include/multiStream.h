@@ -0,0 +1,159 @@
+/* multiStream.h Defines structures and declares functions used to analyse several audio inputs in one process
+ * Copyright (c) 2017 Jay Biernat
+ * Copyright (c) 2017 University of Rochester
+ *
+ * This file is part of Musical Mood Detector and Visualizer
+ *
+ * Musical Mood Detector and Visualizer is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Musical Mood Detector and Visualizer is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even
+ * the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Musical Mood Detector and Visualizer.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTISTREAM_H_INCLUDED
+#define MULTISTREAM_H_INCLUDED
+
+#include <windows.h>
+#include <portaudio.h>
+#include "featureExtraction.h"
+#include "moodRecognition.h"
+
+#define MS_MAX_STREAMS 256      /* Maximum number of streams in one engine */
+#define MS_MAX_THREADS 64       /* Maximum number of worker threads, the limit of WaitForMultipleObjects() */
+
+/******************** Structures **********************/
+
+/** The latest prediction of a stream, published by the worker that made it and read with ms_read_prediction().
+    sequence is odd while the prediction is being written, so a reader that sees the same even value before and
+    after copying it has a consistent copy */
+typedef struct
+{
+    volatile LONG   sequence;   /* Twice the number of predictions published, plus one during a write */
+    float           arousal;
+    float           valence;
+    LONG            frame;      /* frames_completed of the stream when the prediction was made */
+}
+ms_prediction;
+
+struct ms_engine_s;
+
+/** One audio input: its own ring buffer, extraction state and timbre matrix, analysed by whichever worker of the
+    engine claims it.  Only one worker analyses a stream at a time, so its frames stay in order */
+typedef struct
+{
+    fe_extraction_thread_data   extraction;     /* Borrows the FFTW plans of the engine's first stream */
+    float           *features;      /* Feature vector of the stream's predictions */
+    LONG            next_frame;     /* frames_completed at which the next prediction is due */
+    volatile LONG   busy;           /* 1 while a worker analyses the stream */
+    ms_prediction   prediction;
+    struct ms_engine_s *engine;     /* Engine the stream belongs to, for ms_callback() */
+}
+ms_stream;
+
+/** N streams sharing one fe_extraction_info, one pair of models and one set of FFTW plans, analysed by a fixed
+    pool of worker threads.  Each PortAudio callback (ms_callback()) pushes its samples into the stream's ring and
+    releases the work semaphore; a worker that wakes claims each stream with pending frames in turn, analyses one
+    batch of its frames and makes its prediction when one is due
+
+    @see ms_initialize_engine()
+*/
+typedef struct ms_engine_s
+{
+    fe_extraction_info  info;           /* Shared by every stream, read only once the streams are initialized */
+    mr_model            arousal_mdl;    /* Shared, only read by mr_predict() */
+    mr_model            valence_mdl;
+    int                 prediction_cadence;     /* Frames between the predictions of a stream, MR_PREDICTION_CADENCE */
+
+    int                 num_streams;
+    ms_stream           *streams;
+
+    int                 num_threads;
+    HANDLE              threads[MS_MAX_THREADS];
+    HANDLE              work;           /* Semaphore released once per callback, waited on by the workers */
+    volatile LONG       next_stream;    /* Start of the next worker's scan, so workers do not all favour stream 0 */
+    volatile int        terminate_threads;
+
+    int                 init_success;   /* 1 on successful initialization, 0 otherwise */
+}
+ms_engine;
+
+/****************** Functions ******************/
+
+/** @brief Initializes an engine of num_streams streams: the extraction information and models are made once, and
+    only the first stream makes FFTW plans.  The worker threads are started by ms_start_engine()
+
+    @param engine Pointer to the ms_engine to initialize, which must stay at the same address until it is cleaned.
+                  Its init_success member is set to 1 on success and 0 on failure
+    @param num_streams Number of streams, 1 to MS_MAX_STREAMS
+    @param num_threads Number of worker threads, 1 to MS_MAX_THREADS
+*/
+void ms_initialize_engine( ms_engine *engine, int num_streams, int num_threads );
+
+/** @brief Starts the worker threads of an initialized engine
+
+    @param engine Pointer to an initialized ms_engine
+    @return 1 on success, 0 if a thread could not be started (the ones that were are stopped)
+*/
+int ms_start_engine( ms_engine *engine );
+
+/** @brief Stops the worker threads started by ms_start_engine() and waits for them to exit
+
+    @param engine Pointer to a started ms_engine
+*/
+void ms_stop_engine( ms_engine *engine );
+
+/** @brief Frees the streams, models and extraction information of an engine whose workers are stopped
+
+    @param engine Pointer to an initialized ms_engine
+*/
+void ms_clean_engine( ms_engine *engine );
+
+/** @brief Returns the latest prediction of a stream without waiting on the worker that makes it
+
+    @param stream Pointer to a stream of an initialized ms_engine
+    @param arousal Pointer to where the arousal prediction is stored
+    @param valence Pointer to where the valence prediction is stored
+    @return Number of predictions the stream has published, 0 if arousal and valence are not predictions yet
+*/
+LONG ms_read_prediction( ms_stream *stream, float *arousal, float *valence );
+
+/** @brief The callback function used by the worker threads.  Waits on the work semaphore and analyses the
+    streams with pending frames until none are left
+
+    @param lpArg A pointer cast as LPVOID that points to a started ms_engine
+*/
+unsigned int __stdcall ms_workerRoutine( void *lpArg );
+
+/** @brief Callback function used by PortAudio for each stream of an engine: pushes the input into the stream's
+    ring buffer with paCallBack() and wakes a worker
+
+    @param userData Pointer to the ms_stream of the input
+*/
+int ms_callback( const void                        *inputBuffer,
+                 void                              *outputBuffer,
+                 unsigned long                     framesPerBuffer,
+                 const PaStreamCallbackTimeInfo*   timeInfo,
+                 PaStreamCallbackFlags             statusFlags,
+                 void                              *userData );
+
+/** @brief Runs one engine on several input devices and prints every stream's prediction once a second.  Called by
+    main() for "MMDaV -streams [-threads N] [-seconds N] device..."
+
+    @param argc Number of arguments following "-streams"
+    @param argv Arguments following "-streams"
+    @return 0 on success, nonzero on failure
+*/
+int ms_run( int argc, char *argv[] );
+
+#endif // MULTISTREAM_H_INCLUDED
@@ -0,0 +1,953 @@
+/* batchAnalysis.c Contains definitions of functions used in offline analysis of audio files
+ * Copyright (c) 2017 Jay Biernat
+ * Copyright (c) 2017 University of Rochester
+ *
+ * This file is part of Musical Mood Detector and Visualizer
+ *
+ * Musical Mood Detector and Visualizer is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Musical Mood Detector and Visualizer is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even
+ * the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Musical Mood Detector and Visualizer.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+#include <process.h>
+#include "featureExtraction.h"
+#include "moodRecognition.h"
+#include "batchAnalysis.h"
+#include "benchmark.h"
+
+/* WAV format tags */
+#define BA_WAVE_FORMAT_PCM          0x0001
+#define BA_WAVE_FORMAT_IEEE_FLOAT   0x0003
+#define BA_WAVE_FORMAT_EXTENSIBLE   0xFFFE
+
+static unsigned int ba_read_u16( const unsigned char *p )
+{
+    return (unsigned int)p[0] | ( (unsigned int)p[1] << 8 );
+}
+
+static unsigned long ba_read_u32( const unsigned char *p )
+{
+    return (unsigned long)p[0] | ( (unsigned long)p[1] << 8 ) | ( (unsigned long)p[2] << 16 ) | ( (unsigned long)p[3] << 24 );
+}
+
+/* Appends a copy of path to a growing array of paths, returns 0 if out of memory */
+static int ba_add_path( char ***paths, int *num_paths, int *max_paths, const char *path )
+{
+    char **newPaths;
+
+    if( *num_paths == *max_paths )
+    {
+        *max_paths = ( *max_paths == 0 ) ? 64 : 2 * *max_paths;
+        newPaths = (char**)realloc( *paths, sizeof(char*) * *max_paths );
+        if( newPaths == NULL )
+        {
+            fprintf( stderr, "Error: Not enough memory for file list\n" );
+            return 0;
+        }
+        *paths = newPaths;
+    }
+
+    *( *paths + *num_paths ) = (char*)malloc( strlen( path ) + 1 );
+    if( *( *paths + *num_paths ) == NULL )
+    {
+        fprintf( stderr, "Error: Not enough memory for file list\n" );
+        return 0;
+    }
+    strcpy( *( *paths + *num_paths ), path );
+    (*num_paths)++;
+
+    return 1;
+}
+
+/******************************************************/
+
+int ba_run( int argc, char *argv[] )
+{
+    const int                   scalingThreads[] = { 1, 2, 4, 8, 16 };
+    fe_extraction_info          extraction_info;
+    mr_model                    arousal_mdl;
+    mr_model                    valence_mdl;
+    ba_options                  options;
+    SYSTEM_INFO                 systemInfo;
+    int                         scaling = 0;
+    int                         steals;
+    double                      baseline = 0;
+    unsigned int                planner_effort = FE_PLANNER_EFFORT;
+    int                         hop_length = 0;
+
+    char            **paths = NULL;
+    int             num_paths = 0;
+    int             max_paths = 0;
+    char            line[BA_MAX_PATH];
+    FILE            *listFile;
+
+    LARGE_INTEGER   t_start, t_end;
+    double          audio_seconds;
+    double          elapsed;
+    int             num_failed = 0;
+    int             status = -1;
+    int             i, j;
+
+    GetSystemInfo( &systemInfo );
+
+    /* The plan is freed at exit, which the argument errors reach before it is built */
+    extraction_info.plan.bin_frequency =        NULL;
+    extraction_info.plan.window =               NULL;
+    extraction_info.plan.band_boundary =        NULL;
+    extraction_info.plan.band_neighborhood =    NULL;
+
+    options.raw =               0;
+    options.raw_sample_type =   BA_SAMPLE_FLOAT32;
+    options.raw_channels =      NUM_CHANNELS;
+    options.raw_fs =            FS;
+    options.predict_every =     0;      /* Set to frames_in_window below unless given */
+    options.output_directory =  NULL;
+    options.num_threads =       ( systemInfo.dwNumberOfProcessors < BA_MAX_THREADS ) ? (int)systemInfo.dwNumberOfProcessors : BA_MAX_THREADS;
+    options.segment_seconds =   BA_SEGMENT_SECONDS;
+
+    /* Parse options and gather input paths */
+    for( i=0; i<argc; i++ )
+    {
+        if( strcmp( argv[i], "-raw-f32" ) == 0 )
+        {
+            options.raw = 1;
+            options.raw_sample_type = BA_SAMPLE_FLOAT32;
+        }
+        else if( strcmp( argv[i], "-raw-s16" ) == 0 )
+        {
+            options.raw = 1;
+            options.raw_sample_type = BA_SAMPLE_INT16;
+        }
+        else if( strcmp( argv[i], "-channels" ) == 0 && i+1 < argc )
+            options.raw_channels = atoi( argv[++i] );
+        else if( strcmp( argv[i], "-fs" ) == 0 && i+1 < argc )
+            options.raw_fs = atoi( argv[++i] );
+        else if( strcmp( argv[i], "-every" ) == 0 && i+1 < argc )
+            options.predict_every = atoi( argv[++i] );
+        else if( strcmp( argv[i], "-o" ) == 0 && i+1 < argc )
+            options.output_directory = argv[++i];
+        else if( strcmp( argv[i], "-threads" ) == 0 && i+1 < argc )
+            options.num_threads = atoi( argv[++i] );
+        else if( strcmp( argv[i], "-segment" ) == 0 && i+1 < argc )
+            options.segment_seconds = atof( argv[++i] );
+        else if( strcmp( argv[i], "-planner" ) == 0 && i+1 < argc && fe_parse_planner_effort( argv[i+1], &planner_effort ) )
+            i++;
+        else if( strcmp( argv[i], "-hop" ) == 0 && i+1 < argc )
+            hop_length = atoi( argv[++i] );
+        else if( strcmp( argv[i], "-scaling" ) == 0 )
+            scaling = 1;
+        else if( strcmp( argv[i], "-list" ) == 0 && i+1 < argc )
+        {
+            listFile = fopen( argv[++i], "r" );
+            if( listFile == NULL )
+            {
+                fprintf( stderr, "Error: Could not open file list %s\n", argv[i] );
+                goto exit;
+            }
+            while( fgets( line, BA_MAX_PATH, listFile ) != NULL )
+            {
+                line[ strcspn( line, "\r\n" ) ] = '\0';
+                if( *line != '\0' && !ba_add_path( &paths, &num_paths, &max_paths, line ) )
+                {
+                    fclose( listFile );
+                    goto exit;
+                }
+            }
+            fclose( listFile );
+        }
+        else if( argv[i][0] != '-' )
+        {
+            if( !ba_add_path( &paths, &num_paths, &max_paths, argv[i] ) )
+                goto exit;
+        }
+        else
+        {
+            fprintf( stderr, "Unknown or incomplete option: %s\n", argv[i] );
+            goto usage;
+        }
+    }
+
+    if( num_paths == 0 )
+        goto usage;
+
+    /* Initialize the same feature extraction and models used for live input */
+    fe_initialize_extraction_info( &extraction_info );
+    if( !extraction_info.init_success )
+    {
+        fprintf( stderr, "There was a problem initializing the feature extraction process\n" );
+        goto exit;
+    }
+    extraction_info.planner_effort = planner_effort;
+    if( hop_length != 0 && !fe_set_hop_length( &extraction_info, hop_length ) )
+    {
+        fprintf( stderr, "Hop length must be between 1 and %d samples\n", extraction_info.frame_length );
+        goto exit;
+    }
+    if( options.predict_every <= 0 )
+        options.predict_every = extraction_info.frames_in_window;
+
+    if( options.num_threads < 1 || options.num_threads > BA_MAX_THREADS )
+    {
+        fprintf( stderr, "Number of threads must be between 1 and %d\n", BA_MAX_THREADS );
+        goto exit;
+    }
+
+    /* The models of live input, so a file is predicted as it would be when played */
+    if( !mr_load_live_models( &arousal_mdl, &valence_mdl ) )
+    {
+        fprintf( stderr, "There was a problem initializing the mood detection models\n" );
+        mr_destroy( &arousal_mdl );
+        mr_destroy( &valence_mdl );
+        goto exit;
+    }
+
+    /* Analyse every file as fast as possible, once or at each thread count of the scaling table */
+    if( scaling )
+        printf( "threads   seconds   files/sec   real-time   speedup   efficiency   steals\n" );
+    for( i=0; i < ( scaling ? (int)( sizeof(scalingThreads) / sizeof(int) ) : 1 ); i++ )
+    {
+        if( scaling )
+            options.num_threads = scalingThreads[i];
+
+        QueryPerformanceCounter( &t_start );
+        num_failed = ba_run_scheduler( paths, num_paths, &options, &extraction_info, &arousal_mdl, &valence_mdl, &audio_seconds, &steals );
+        QueryPerformanceCounter( &t_end );
+        elapsed = bm_seconds( t_start, t_end );
+
+        if( num_failed < 0 )
+        {
+            fprintf( stderr, "There was a problem starting the worker threads\n" );
+            break;
+        }
+
+        if( scaling )
+        {
+            if( i == 0 )
+                baseline = elapsed;
+            printf( "%7d %9.2f %11.2f %10.1fx %8.2fx %11.0f%% %8d\n",
+                    options.num_threads, elapsed,
+                    ( elapsed > 0 ) ? (double)( num_paths - num_failed ) / elapsed : 0.0,
+                    ( elapsed > 0 ) ? audio_seconds / elapsed : 0.0,
+                    ( elapsed > 0 ) ? baseline / elapsed : 0.0,
+                    ( elapsed > 0 ) ? 100.0 * baseline / elapsed / options.num_threads : 0.0,
+                    steals );
+        }
+        else
+        {
+            printf( "Analysed %d of %d files (%.1f s of audio) in %.2f s with %d threads\n",
+                    num_paths - num_failed, num_paths, audio_seconds, elapsed, options.num_threads );
+            printf( "  %.2f files/sec   real-time factor %.1fx   stolen tasks %d\n",
+                    ( elapsed > 0 ) ? (double)( num_paths - num_failed ) / elapsed : 0.0,
+                    ( elapsed > 0 ) ? audio_seconds / elapsed : 0.0,
+                    steals );
+        }
+    }
+
+    mr_destroy( &arousal_mdl );
+    mr_destroy( &valence_mdl );
+    status = ( num_failed == 0 ) ? 0 : -1;
+
+exit:
+    for( j=0; j<num_paths; j++ )
+        free( *(paths + j) );
+    free( paths );
+    fe_clean_extraction_info( &extraction_info );
+
+    return status;
+
+usage:
+    fprintf( stderr, "Usage: MMDaV -batch [-raw-f32 | -raw-s16] [-channels N] [-fs N] [-every N] [-o dir] [-list file]\n"
+                     "                    [-threads N] [-segment seconds] [-hop N] [-planner effort] [-scaling] files...\n"
+                     "  -raw-f32, -raw-s16  Inputs are headerless float or 16-bit PCM (default: WAV files)\n"
+                     "  -channels, -fs      Channels and sampling frequency of raw inputs (default: %d, %d)\n"
+                     "  -every              Frames between predictions (default: one prediction per window)\n"
+                     "  -o                  Directory for the .mood.csv outputs (default: next to each input)\n"
+                     "  -list               File with one input path per line\n"
+                     "  -threads            Number of worker threads (default: one per processor)\n"
+                     "  -segment            Length of the pieces long files are split into (default: %d s)\n"
+                     "  -hop                Samples between the starts of consecutive frames (default: %d)\n"
+                     "  -planner            FFTW planner effort: estimate, measure or patient (default: %s)\n"
+                     "  -scaling            Analyse the files with 1, 2, 4, 8 and 16 threads and print a table\n",
+                     NUM_CHANNELS, FS, BA_SEGMENT_SECONDS, HOP_LENGTH, fe_planner_effort_name( FE_PLANNER_EFFORT ) );
+    goto exit;
+}
+
+/******************************************************/
+
+ba_audio_file ba_open_audio_file( const char *path, ba_options *options )
+{
+    ba_audio_file   audio_file;
+    LARGE_INTEGER   fileSize;
+    const unsigned char *chunk;
+    const unsigned char *end;
+    unsigned long   chunkSize;
+    LONGLONG        chunkLeft;      /* Bytes of the file after the chunk header */
+    unsigned int    formatTag = 0;
+    unsigned int    bitsPerSample = 0;
+    LONGLONG        dataSize = 0;
+    int             bytesPerSample;
+
+    audio_file.init_success = 0;
+    audio_file.file =       INVALID_HANDLE_VALUE;
+    audio_file.mapping =    NULL;
+    audio_file.view =       NULL;
+    audio_file.samples =    NULL;
+
+    audio_file.file = CreateFile( path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+    if( audio_file.file == INVALID_HANDLE_VALUE )
+    {
+        fprintf( stderr, "Error: Could not open file %s\n", path );
+        goto exit;
+    }
+    if( !GetFileSizeEx( audio_file.file, &fileSize ) || fileSize.QuadPart == 0 )
+    {
+        fprintf( stderr, "Error: Empty or unreadable file %s\n", path );
+        goto exit;
+    }
+    audio_file.size = fileSize.QuadPart;
+
+    audio_file.mapping = CreateFileMapping( audio_file.file, NULL, PAGE_READONLY, 0, 0, NULL );
+    if( audio_file.mapping == NULL )
+    {
+        fprintf( stderr, "Error: Could not map file %s\n", path );
+        goto exit;
+    }
+    audio_file.view = (const unsigned char*)MapViewOfFile( audio_file.mapping, FILE_MAP_READ, 0, 0, 0 );
+    if( audio_file.view == NULL )
+    {
+        fprintf( stderr, "Error: Could not map file %s\n", path );
+        goto exit;
+    }
+
+    if( options->raw )
+    {
+        audio_file.sample_type =    options->raw_sample_type;
+        audio_file.channels =       options->raw_channels;
+        audio_file.fs =             options->raw_fs;
+        audio_file.samples =        audio_file.view;
+        dataSize =                  audio_file.size;
+    }
+    else
+    {
+        /* RIFF header followed by chunks, the "fmt " chunk must come before the "data" chunk */
+        if( audio_file.size < 12 ||
+            memcmp( audio_file.view, "RIFF", 4 ) ||
+            memcmp( audio_file.view + 8, "WAVE", 4 ) )
+        {
+            fprintf( stderr, "Error: %s is not a WAV file\n", path );
+            goto exit;
+        }
+
+        /* Sizes read from the file are compared with the bytes left rather than added to pointers, which a corrupt
+           size could wrap past the end of the mapping */
+        chunk = audio_file.view + 12;
+        end = audio_file.view + audio_file.size;
+        while( end - chunk >= 8 )
+        {
+            chunkSize = ba_read_u32( chunk + 4 );
+            chunkLeft = (LONGLONG)( end - chunk - 8 );
+
+            if( !memcmp( chunk, "fmt ", 4 ) && chunkSize >= 16 && chunkLeft >= 16 )
+            {
+                formatTag =             ba_read_u16( chunk + 8 );
+                audio_file.channels =   ba_read_u16( chunk + 10 );
+                audio_file.fs =         ba_read_u32( chunk + 12 );
+                bitsPerSample =         ba_read_u16( chunk + 22 );
+
+                /* Extensible format keeps the real format tag in the first two bytes of the sub-format GUID */
+                if( formatTag == BA_WAVE_FORMAT_EXTENSIBLE && chunkSize >= 26 && chunkLeft >= 26 )
+                    formatTag = ba_read_u16( chunk + 8 + 24 );
+            }
+            else if( !memcmp( chunk, "data", 4 ) )
+            {
+                audio_file.samples = chunk + 8;
+                dataSize = ( (LONGLONG)chunkSize > chunkLeft ) ? chunkLeft : (LONGLONG)chunkSize;   /* Truncated file or streaming header */
+                break;
+            }
+
+            if( (LONGLONG)chunkSize > chunkLeft )
+            {
+                fprintf( stderr, "Error: %s has a chunk that runs past the end of the file\n", path );
+                goto exit;
+            }
+            chunk += 8 + chunkSize;
+            if( ( chunkSize & 1 ) && chunk < end )      /* Chunks are padded to an even size */
+                chunk++;
+        }
+
+        if( formatTag == BA_WAVE_FORMAT_PCM && bitsPerSample == 16 )
+            audio_file.sample_type = BA_SAMPLE_INT16;
+        else if( formatTag == BA_WAVE_FORMAT_IEEE_FLOAT && bitsPerSample == 32 )
+            audio_file.sample_type = BA_SAMPLE_FLOAT32;
+        else
+        {
+            fprintf( stderr, "Error: %s is not 16-bit PCM or 32-bit float\n", path );
+            goto exit;
+        }
+
+        if( audio_file.samples == NULL )
+        {
+            fprintf( stderr, "Error: %s has no data chunk\n", path );
+            goto exit;
+        }
+    }
+
+    if( audio_file.channels < 1 )
+    {
+        fprintf( stderr, "Error: %s has no channels\n", path );
+        goto exit;
+    }
+    if( audio_file.fs != FS )   /* Features and models assume the live sampling frequency */
+    {
+        fprintf( stderr, "Error: %s is sampled at %d Hz, only %d Hz is supported\n", path, audio_file.fs, FS );
+        goto exit;
+    }
+
+    bytesPerSample = ( audio_file.sample_type == BA_SAMPLE_INT16 ) ? 2 : 4;
+    audio_file.num_frames = dataSize / ( bytesPerSample * audio_file.channels );
+    audio_file.init_success = 1;
+
+exit:
+    if( audio_file.init_success == 0 )
+        ba_close_audio_file( &audio_file );
+
+    return audio_file;
+}
+
+/******************************************************/
+
+void ba_close_audio_file( ba_audio_file *audio_file )
+{
+    if( audio_file->view != NULL )
+        UnmapViewOfFile( audio_file->view );
+    if( audio_file->mapping != NULL )
+        CloseHandle( audio_file->mapping );
+    if( audio_file->file != INVALID_HANDLE_VALUE )
+        CloseHandle( audio_file->file );
+
+    audio_file->view =      NULL;
+    audio_file->mapping =   NULL;
+    audio_file->file =      INVALID_HANDLE_VALUE;
+    audio_file->samples =   NULL;
+}
+
+/******************************************************/
+
+void ba_read_frame( ba_audio_file *audio_file, LONGLONG start, int length, float *audio, float *window, fe_downmix_kernel downmix )
+{
+    int     i, c;
+    int     channels = audio_file->channels;
+    float   sum;
+
+    if( audio_file->sample_type == BA_SAMPLE_FLOAT32 )
+    {
+        const float *in = (const float*)audio_file->samples + start * channels;
+
+        if( channels == 2 )
+            downmix( in, window, audio, length );
+        else
+        {
+            for( i=0; i<length; i++ )
+            {
+                sum = 0;
+                for( c=0; c<channels; c++ )
+                    sum += *(in + i*channels + c);
+                *(audio+i) = sum / (float)channels * *(window+i);
+            }
+        }
+    }
+    else
+    {
+        const short *in = (const short*)audio_file->samples + start * channels;
+
+        for( i=0; i<length; i++ )
+        {
+            sum = 0;
+            for( c=0; c<channels; c++ )
+                sum += (float)*(in + i*channels + c);
+            *(audio+i) = sum / ( 32768.0f * (float)channels ) * *(window+i);
+        }
+    }
+}
+
+/******************************************************/
+
+void ba_analyze_segment( ba_audio_file *audio_file,
+                         long first_prediction,
+                         long end_prediction,
+                         int predict_every,
+                         fe_extraction_thread_data *extraction_data,
+                         const mr_model *arousal_mdl,
+                         const mr_model *valence_mdl,
+                         float *features,
+                         float *arousal,
+                         float *valence )
+{
+    fe_extraction_info  *info = extraction_data->info;
+    LONGLONG            batch, frame, first_frame, last_frame;     /* Times hop_length these pass 2^31 samples */
+    long                prediction;
+    int                 num, j;
+    long                block_first = first_prediction;
+    int                 num_features = info->num_timbre_features * 2 + info->num_onset_features;
+    int                 block_rows = 0;
+
+    if( first_prediction >= end_prediction )
+        return;
+
+    /* Prediction p is made after frame (frames_in_window-1 + p*predict_every).  A segment starts one frame before
+       the window of its first prediction, so that frame's magnitude is the previous magnitude of the window's
+       first frame; its own column is overwritten when the window wraps around */
+    first_frame =   ( first_prediction == 0 ) ? 0 : (LONGLONG)first_prediction * predict_every - 1;
+    last_frame =    info->frames_in_window - 1 + (LONGLONG)( end_prediction - 1 ) * predict_every;
+
+    fe_reset_extraction_thread_data( extraction_data );
+    extraction_data->columnPtr = (int)( first_frame % info->frames_in_window );
+
+    /* Same per-frame processing as the analysis thread, without any waiting between frames.  Frames are transformed
+       FE_FFT_BATCH at a time, then analysed in order */
+    for( batch=first_frame; batch<=last_frame; batch+=num )
+    {
+        num = ( last_frame - batch + 1 >= FE_FFT_BATCH ) ? FE_FFT_BATCH : 1;
+        for( j=0; j<num; j++ )
+            ba_read_frame( audio_file, ( batch + j ) * info->hop_length, info->frame_length, extraction_data->audio + j*info->frame_length,
+                           extraction_data->hamm_win, extraction_data->downmix_kernel );
+        fe_transform_frames( extraction_data, num );
+
+        for( j=0; j<num; j++ )
+        {
+            frame = batch + j;
+            fe_process_spectrum( extraction_data, extraction_data->dft + j*extraction_data->dft_stride );
+
+            if( frame+1 >= info->frames_in_window && ( frame+1 - info->frames_in_window ) % predict_every == 0 )
+            {
+                prediction = (long)( ( frame+1 - info->frames_in_window ) / predict_every );
+                if( prediction >= first_prediction )
+                {
+                    /* Collect feature vectors and predict them a block at a time */
+                    if( block_rows == 0 )
+                        block_first = prediction;
+                    mr_compute_features( features + block_rows*num_features, extraction_data->timbre_sum,
+                                         extraction_data->timbre_sum_sq, extraction_data->rectified_flux_buffer,
+                                         &extraction_data->autocorrelation, info );
+                    block_rows++;
+                    if( block_rows == MR_BATCH_ROWS || prediction == end_prediction-1 )
+                    {
+                        mr_predict_batch( features, block_rows, arousal_mdl, valence_mdl, arousal + block_first, valence + block_first );
+                        block_rows = 0;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/******************************************************/
+
+int ba_write_results( ba_file_job *job, ba_options *options, fe_extraction_info *info )
+{
+    FILE        *outFile;
+    char        outPath[BA_MAX_PATH];
+    const char  *baseName;
+    const char  *c;
+    long        i;
+
+    /* Output goes next to the input, or into the output directory under the input's base name */
+    baseName = job->path;
+    if( options->output_directory != NULL )
+    {
+        for( c=job->path; *c != '\0'; c++ )
+            if( *c == '\\' || *c == '/' )
+                baseName = c+1;
+    }
+    if( snprintf( outPath, BA_MAX_PATH, "%s%s%s.mood.csv",
+                  ( options->output_directory != NULL ) ? options->output_directory : "",
+                  ( options->output_directory != NULL ) ? "\\" : "",
+                  baseName ) >= BA_MAX_PATH )
+    {
+        fprintf( stderr, "Error: Output path for %s is too long\n", job->path );
+        return 0;
+    }
+
+    outFile = fopen( outPath, "w" );
+    if( outFile == NULL )
+    {
+        fprintf( stderr, "Error: Could not open file %s\n", outPath );
+        return 0;
+    }
+
+    /* Time stamp is the end of the last frame of the window each prediction was made from, in 64 bits since the
+       sample index passes 2^31 after about 13 hours at 44.1 kHz */
+    fprintf( outFile, "time,arousal,valence\n" );
+    for( i=0; i<job->num_predictions; i++ )
+        fprintf( outFile, "%.3f,%f,%f\n",
+                 (double)( ( info->frames_in_window - 1 + (LONGLONG)i * options->predict_every ) * info->hop_length + info->frame_length ) / info->fs,
+                 *(job->arousal + i),
+                 *(job->valence + i) );
+
+    if( fclose( outFile ) )
+    {
+        fprintf( stderr, "Error: Could not close file %s\n", outPath );
+        return 0;
+    }
+
+    return 1;
+}
+
+/******************************************************/
+
+/* Deque operations, each takes the deque's lock.  Push returns 0 if out of memory, pop and steal return 0 if empty */
+static int ba_deque_push( ba_deque *deque, ba_task task )
+{
+    ba_task *newTasks;
+    int     success = 1;
+
+    EnterCriticalSection( &deque->lock );
+    if( deque->bottom == deque->capacity )
+    {
+        if( deque->top > 0 )    /* Reuse the space freed by steals */
+        {
+            memmove( deque->tasks, deque->tasks + deque->top, sizeof(ba_task) * ( deque->bottom - deque->top ) );
+            deque->bottom -= deque->top;
+            deque->top = 0;
+        }
+        else
+        {
+            newTasks = (ba_task*)realloc( deque->tasks, sizeof(ba_task) * 2 * deque->capacity );
+            if( newTasks == NULL )
+                success = 0;
+            else
+            {
+                deque->tasks = newTasks;
+                deque->capacity *= 2;
+            }
+        }
+    }
+    if( success )
+        *( deque->tasks + deque->bottom++ ) = task;
+    LeaveCriticalSection( &deque->lock );
+
+    return success;
+}
+
+static int ba_deque_pop( ba_deque *deque, ba_task *task )
+{
+    int found = 0;
+
+    EnterCriticalSection( &deque->lock );
+    if( deque->bottom > deque->top )
+    {
+        *task = *( deque->tasks + --deque->bottom );
+        found = 1;
+    }
+    LeaveCriticalSection( &deque->lock );
+
+    return found;
+}
+
+static int ba_deque_steal( ba_deque *deque, ba_task *task )
+{
+    int found = 0;
+
+    EnterCriticalSection( &deque->lock );
+    if( deque->bottom > deque->top )
+    {
+        *task = *( deque->tasks + deque->top++ );
+        found = 1;
+    }
+    LeaveCriticalSection( &deque->lock );
+
+    return found;
+}
+
+/******************************************************/
+
+/* Counts a task as finished, and wakes every idle worker to exit when it was the last one */
+static void ba_finish_task( ba_scheduler *scheduler )
+{
+    if( InterlockedDecrement( &scheduler->tasks_pending ) == 0 )
+        ReleaseSemaphore( scheduler->work, scheduler->num_workers, NULL );
+}
+
+/******************************************************/
+
+/* Opens a file on its first task, allocates its results and queues the segments after the first one on the
+   worker's own deque.  Returns 0 if the file could not be opened */
+static int ba_open_job( ba_worker *worker, ba_task *task )
+{
+    ba_scheduler        *scheduler = worker->scheduler;
+    ba_file_job         *job = scheduler->jobs + task->file_index;
+    fe_extraction_info  *info = worker->extraction_data.info;
+    ba_task             segment;
+    LONGLONG            num_frames;
+    long                segment_predictions;
+    long                num_segments;
+    long                i;
+
+    job->audio_file = ba_open_audio_file( job->path, scheduler->options );
+    if( !job->audio_file.init_success )
+        return 0;
+
+    worker->audio_seconds += (double)job->audio_file.num_frames / job->audio_file.fs;
+
+    /* Frames start hop_length apart and must end inside the file */
+    num_frames = ( job->audio_file.num_frames >= info->frame_length ) ?
+                 ( job->audio_file.num_frames - info->frame_length ) / info->hop_length + 1 : 0;
+    job->num_predictions = ( num_frames >= info->frames_in_window ) ?
+                           (long)( ( num_frames - info->frames_in_window ) / scheduler->options->predict_every + 1 ) : 0;
+
+    job->arousal = (float*)malloc( sizeof(float) * ( job->num_predictions + 1 ) );
+    job->valence = (float*)malloc( sizeof(float) * ( job->num_predictions + 1 ) );
+    if( job->arousal == NULL || job->valence == NULL )
+    {
+        fprintf( stderr, "Error: Not enough memory for the results of %s\n", job->path );
+        free( job->arousal );
+        free( job->valence );
+        job->arousal = NULL;
+        job->valence = NULL;
+        ba_close_audio_file( &job->audio_file );
+        return 0;
+    }
+
+    /* Split files longer than two segments when other workers could take the pieces */
+    segment_predictions = (long)( scheduler->options->segment_seconds * info->fs / info->hop_length ) / scheduler->options->predict_every;
+    if( segment_predictions < 1 )
+        segment_predictions = 1;
+    if( scheduler->num_workers > 1 && job->num_predictions > 2 * segment_predictions )
+        num_segments = ( job->num_predictions + segment_predictions - 1 ) / segment_predictions;
+    else
+    {
+        num_segments = 1;
+        segment_predictions = job->num_predictions;
+    }
+
+    /* Count every segment before queueing any so the last one to finish is the one that writes the results */
+    job->tasks_remaining = num_segments;
+    task->first_prediction = 0;
+    task->end_prediction = segment_predictions;
+
+    segment.file_index = task->file_index;
+    for( i=num_segments-1; i>0; i-- )
+    {
+        segment.first_prediction = i * segment_predictions;
+        segment.end_prediction = ( (i+1) * segment_predictions < job->num_predictions ) ? (i+1) * segment_predictions : job->num_predictions;
+
+        InterlockedIncrement( &scheduler->tasks_pending );
+        if( !ba_deque_push( &worker->deque, segment ) )
+        {
+            /* Analyse the segment here instead of queueing it */
+            InterlockedDecrement( &scheduler->tasks_pending );
+            ba_analyze_segment( &job->audio_file, segment.first_prediction, segment.end_prediction, scheduler->options->predict_every,
+                                &worker->extraction_data, scheduler->arousal_mdl, scheduler->valence_mdl, worker->features,
+                                job->arousal, job->valence );
+            InterlockedDecrement( &job->tasks_remaining );
+        }
+        else
+            ReleaseSemaphore( scheduler->work, 1, NULL );   /* An idle worker may steal it */
+    }
+
+    return 1;
+}
+
+/******************************************************/
+
+unsigned int __stdcall ba_workerRoutine( void *lpArg )
+{
+    ba_worker       *worker = (ba_worker*)lpArg;
+    ba_scheduler    *scheduler = worker->scheduler;
+    ba_file_job     *job;
+    ba_task         task;
+    int             found;
+    int             i, victim;
+
+    while( scheduler->tasks_pending > 0 )
+    {
+        /* Newest task of our own first, otherwise the oldest task of another worker */
+        found = ba_deque_pop( &worker->deque, &task );
+        for( i=1; !found && i<scheduler->num_workers; i++ )
+        {
+            victim = ( worker->index + i ) % scheduler->num_workers;
+            found = ba_deque_steal( &( scheduler->workers + victim )->deque, &task );
+            if( found )
+                worker->steals++;
+        }
+        if( !found )
+        {
+            /* Tasks are still running elsewhere and may queue more segments.  A segment queued after the search
+               has already released the semaphore, so the wait cannot miss it; a release whose segment was taken
+               by its owner only costs one more search */
+            WaitForSingleObject( scheduler->work, INFINITE );
+            continue;
+        }
+
+        job = scheduler->jobs + task.file_index;
+        if( task.first_prediction < 0 && !ba_open_job( worker, &task ) )
+        {
+            fprintf( stderr, "  Skipped %s\n", job->path );
+            InterlockedIncrement( &scheduler->files_failed );
+            ba_finish_task( scheduler );
+            continue;
+        }
+
+        ba_analyze_segment( &job->audio_file, task.first_prediction, task.end_prediction, scheduler->options->predict_every,
+                            &worker->extraction_data, scheduler->arousal_mdl, scheduler->valence_mdl, worker->features,
+                            job->arousal, job->valence );
+        worker->tasks_done++;
+
+        /* The last task of a file writes its results and releases it */
+        if( InterlockedDecrement( &job->tasks_remaining ) == 0 )
+        {
+            if( !ba_write_results( job, scheduler->options, worker->extraction_data.info ) )
+                InterlockedIncrement( &scheduler->files_failed );
+            ba_close_audio_file( &job->audio_file );
+            free( job->arousal );
+            free( job->valence );
+            job->arousal = NULL;
+            job->valence = NULL;
+        }
+
+        ba_finish_task( scheduler );
+    }
+
+    _endthreadex( 0 );
+    return 0;
+}
+
+/******************************************************/
+
+int ba_run_scheduler( char **paths,
+                      int num_paths,
+                      ba_options *options,
+                      fe_extraction_info *info,
+                      const mr_model *arousal_mdl,
+                      const mr_model *valence_mdl,
+                      double *audio_seconds,
+                      int *steals )
+{
+    ba_scheduler    scheduler;
+    ba_worker       *worker;
+    HANDLE          handles[BA_MAX_THREADS];
+    unsigned        threadId;
+    ba_task         task;
+    int             num_initialized = 0;
+    int             num_started = 0;
+    int             result = -1;
+    int             i;
+
+    scheduler.num_workers =     options->num_threads;
+    scheduler.num_jobs =        num_paths;
+    scheduler.arousal_mdl =     arousal_mdl;
+    scheduler.valence_mdl =     valence_mdl;
+    scheduler.options =         options;
+    scheduler.tasks_pending =   num_paths;
+    scheduler.files_failed =    0;
+
+    *audio_seconds = 0;
+    *steals = 0;
+
+    scheduler.work = CreateSemaphore( NULL, 0, 0x7FFFFFFF, NULL );
+    scheduler.jobs = (ba_file_job*)malloc( sizeof(ba_file_job) * num_paths );
+    scheduler.workers = (ba_worker*)malloc( sizeof(ba_worker) * scheduler.num_workers );
+    if( scheduler.work == NULL || scheduler.jobs == NULL || scheduler.workers == NULL )
+        goto exit;
+
+    for( i=0; i<num_paths; i++ )
+    {
+        ( scheduler.jobs + i )->path =      *(paths + i);
+        ( scheduler.jobs + i )->arousal =   NULL;
+        ( scheduler.jobs + i )->valence =   NULL;
+    }
+
+    /* Workers are initialized here rather than in their threads because the FFTW planner is not thread safe */
+    for( i=0; i<scheduler.num_workers; i++ )
+    {
+        worker = scheduler.workers + i;
+        worker->index =         i;
+        worker->scheduler =     &scheduler;
+        worker->audio_seconds = 0;
+        worker->tasks_done =    0;
+        worker->steals =        0;
+
+        worker->extraction_data = fe_initialize_extraction_thread_data( info );
+        if( !worker->extraction_data.init_success )
+            goto exit;
+        worker->features = (float*)malloc( sizeof(float) * MR_BATCH_ROWS * ( info->num_timbre_features * 2 + info->num_onset_features ) );
+        worker->deque.capacity = num_paths / scheduler.num_workers + 16;
+        worker->deque.tasks = (ba_task*)malloc( sizeof(ba_task) * worker->deque.capacity );
+        worker->deque.top = 0;
+        worker->deque.bottom = 0;
+        InitializeCriticalSection( &worker->deque.lock );
+        num_initialized++;
+
+        if( worker->features == NULL || worker->deque.tasks == NULL )
+            goto exit;
+    }
+
+    /* Deal the files out round-robin, unopened (first_prediction == -1) */
+    for( i=0; i<num_paths; i++ )
+    {
+        task.file_index = i;
+        task.first_prediction = -1;
+        task.end_prediction = -1;
+        if( !ba_deque_push( &( scheduler.workers + i % scheduler.num_workers )->deque, task ) )
+            goto exit;
+    }
+
+    for( i=0; i<scheduler.num_workers; i++ )
+    {
+        handles[i] = (HANDLE)_beginthreadex( NULL, 0, ba_workerRoutine, scheduler.workers + i, 0, &threadId );
+        if( handles[i] == 0 )
+        {
+            /* Workers that did start will finish every task on their own, including the ones dealt to this worker */
+            break;
+        }
+        num_started++;
+    }
+
+    for( i=0; i<num_started; i++ )
+    {
+        WaitForSingleObject( handles[i], INFINITE );
+        CloseHandle( handles[i] );
+    }
+
+    if( num_started > 0 )
+    {
+        for( i=0; i<scheduler.num_workers; i++ )
+        {
+            *audio_seconds += ( scheduler.workers + i )->audio_seconds;
+            *steals += ( scheduler.workers + i )->steals;
+        }
+        result = scheduler.files_failed;
+    }
+
+exit:
+    for( i=0; i<num_initialized; i++ )
+    {
+        worker = scheduler.workers + i;
+        fe_clean_extraction_thread_data( &worker->extraction_data );
+        free( worker->features );
+        free( worker->deque.tasks );
+        DeleteCriticalSection( &worker->deque.lock );
+    }
+    free( scheduler.workers );
+    free( scheduler.jobs );
+    if( scheduler.work != NULL )
+        CloseHandle( scheduler.work );
+
+    return result;
+}
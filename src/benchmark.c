@@ -0,0 +1,2023 @@
+/* benchmark.c Contains benchmarks used to measure the cost of the processing stages
+ * Copyright (c) 2017 Jay Biernat
+ * Copyright (c) 2017 University of Rochester
+ *
+ * This file is part of Musical Mood Detector and Visualizer
+ *
+ * Musical Mood Detector and Visualizer is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Musical Mood Detector and Visualizer is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even
+ * the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Musical Mood Detector and Visualizer.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <windows.h>
+#include <psapi.h>
+#include "featureExtraction.h"
+#include "moodRecognition.h"
+#include "multiStream.h"
+#include "imageDisplay.h"
+#include "benchmark.h"
+
+#ifndef PI
+#define PI 3.1415926536
+#endif // PI
+
+int bm_run( int argc, char *argv[] )
+{
+    int iterations = BM_DEFAULT_ITERATIONS;
+
+    if( argc < 1 )
+    {
+        fprintf( stderr, "Usage: MMDaV -bench <name> [iterations] [feature file]\n"
+                         "  Benchmarks: callback, predict, batch, load, precision, rff, stats, autocorrelation, contrast, descriptors, frontend, hop, streams, display, convert, tiles\n" );
+        return -1;
+    }
+    if( argc > 1 && atoi( argv[1] ) > 0 )
+        iterations = atoi( argv[1] );
+
+    if( strcmp( argv[0], "callback" ) == 0 )
+        return bm_callback( iterations );
+    if( strcmp( argv[0], "predict" ) == 0 )
+        return bm_predict( iterations );
+    if( strcmp( argv[0], "batch" ) == 0 )
+        return bm_predict_batch( iterations );
+    if( strcmp( argv[0], "load" ) == 0 )
+        return bm_load( iterations );
+    if( strcmp( argv[0], "precision" ) == 0 )
+        return bm_precision( iterations, argc > 2 ? argv[2] : NULL );
+    if( strcmp( argv[0], "rff" ) == 0 )
+        return bm_rff( iterations, argc > 2 ? argv[2] : NULL );
+    if( strcmp( argv[0], "stats" ) == 0 )
+        return bm_stats( iterations );
+    if( strcmp( argv[0], "autocorrelation" ) == 0 )
+        return bm_autocorrelation( iterations );
+    if( strcmp( argv[0], "contrast" ) == 0 )
+        return bm_contrast( iterations );
+    if( strcmp( argv[0], "descriptors" ) == 0 )
+        return bm_descriptors( iterations );
+    if( strcmp( argv[0], "frontend" ) == 0 )
+        return bm_frontend( iterations );
+    if( strcmp( argv[0], "hop" ) == 0 )
+        return bm_hop( iterations );
+    if( strcmp( argv[0], "streams" ) == 0 )
+        return bm_streams( iterations );
+    if( strcmp( argv[0], "display" ) == 0 )
+        return bm_display( iterations );
+    if( strcmp( argv[0], "convert" ) == 0 )
+        return bm_convert( iterations );
+    if( strcmp( argv[0], "tiles" ) == 0 )
+        return bm_tiles( iterations );
+
+    fprintf( stderr, "Unknown benchmark: %s\n", argv[0] );
+    return -1;
+}
+
+/******************************************************/
+
+double bm_seconds( LARGE_INTEGER start, LARGE_INTEGER end )
+{
+    LARGE_INTEGER frequency;
+
+    QueryPerformanceFrequency( &frequency );
+
+    return (double)( end.QuadPart - start.QuadPart ) / (double)frequency.QuadPart;
+}
+
+/******************************************************/
+
+int bm_callback( int iterations )
+{
+    fe_extraction_info          info;
+    fe_extraction_thread_data   data;
+    LARGE_INTEGER               t_start, t_end, frequency;
+    double                      total, max, cost;
+    double                      inline_mean, inline_max;
+    float                       *input;
+    int                         i, j;
+
+    fe_initialize_extraction_info( &info );
+    data = fe_initialize_extraction_thread_data( &info );
+    input = (float*)malloc( sizeof(float) * NUM_CHANNELS * info.frame_length );
+    if( !data.init_success || input == NULL )
+    {
+        fprintf( stderr, "Error: Could not initialize callback benchmark\n" );
+        free( input );
+        if( data.init_success )
+            fe_clean_extraction_thread_data( &data );
+        fe_clean_extraction_info( &info );
+        return -1;
+    }
+
+    /* Synthetic stereo input: two tones plus a little noise */
+    srand( 1 );
+    for( i=0; i<info.frame_length; i++ )
+    {
+        *(input + 2*i) =    0.5 * sin( 2*PI*440*i/info.fs ) + 0.01 * ( (float)rand()/RAND_MAX - 0.5 );
+        *(input + 2*i+1) =  0.5 * sin( 2*PI*660*i/info.fs ) + 0.01 * ( (float)rand()/RAND_MAX - 0.5 );
+    }
+
+    /* Feature extraction inside the callback, as it was done before the analysis thread */
+    total = 0;
+    max = 0;
+    for( i=0; i<iterations; i++ )
+    {
+        QueryPerformanceCounter( &t_start );
+        for( j=0; j<info.frame_length; j++ )
+            *(data.audio + j) = ( *(input + 2*j) + *(input + 2*j+1) ) / 2 * *(data.hamm_win + j);
+        fe_process_frame( &data );
+        QueryPerformanceCounter( &t_end );
+
+        cost = bm_seconds( t_start, t_end );
+        total += cost;
+        if( cost > max )
+            max = cost;
+    }
+    inline_mean = total / iterations;
+    inline_max = max;
+
+    /* Callback that only pushes into the ring buffer, drained here (untimed) in place of the analysis thread */
+    for( i=0; i<iterations; i++ )
+    {
+        paCallBack( input, NULL, info.frame_length, NULL, 0, &data );
+        fe_ring_read( &data.ring, data.audio, fe_ring_read_available( &data.ring ) );
+    }
+    QueryPerformanceFrequency( &frequency );
+
+    printf( "Callback cost over %d buffers of %d frames (%.1f ms of audio each)\n",
+            iterations, info.frame_length, 1000.0 * info.frame_length / info.fs );
+    printf( "  extraction in callback:  mean %9.2f us   max %9.2f us\n", 1e6 * inline_mean, 1e6 * inline_max );
+    printf( "  ring buffer push only:   mean %9.2f us   max %9.2f us\n",
+            1e6 * (double)data.callback_ticks / data.callback_count / frequency.QuadPart,
+            1e6 * (double)data.callback_max_ticks / frequency.QuadPart );
+    printf( "  reduction:               %.1fx (mean)\n",
+            inline_mean / ( (double)data.callback_ticks / data.callback_count / frequency.QuadPart ) );
+    printf( "  overruns: %lu\n", data.overruns );
+
+    free( input );
+    fe_clean_extraction_thread_data( &data );
+    fe_clean_extraction_info( &info );
+
+    return 0;
+}
+
+/******************************************************/
+
+int bm_predict( int iterations )
+{
+    const char      *names[4] = { "scalar", "SSE2", "AVX2", "AVX-512" };
+    mr_rbf_kernel   kernels[4] = { mr_rbf_kernel_scalar, mr_rbf_kernel_sse2, mr_rbf_kernel_avx2, mr_rbf_kernel_avx512 };
+    int             supported[4];
+    const char      *selected_name;
+    mr_model        models[2];
+    const char      *model_names[2] = { "arousal", "valence" };
+    mr_rbf_kernel   selected;
+    LARGE_INTEGER   t_start, t_end;
+    float           *x = NULL;
+    float           *reference = NULL;
+    float           error, max_error, bound, alpha_sum;
+    volatile float  sink = 0;
+    double          seconds, reference_seconds;
+    int             num_vectors = 256;
+    int             i, k, m, v;
+    int             status = 0;
+
+    models[0] = mr_load_model( MR_AROUSAL_MODEL_FILE, MR_AROUSAL_MODEL_DIRECTORY );
+    models[1] = mr_load_model( MR_VALENCE_MODEL_FILE, MR_VALENCE_MODEL_DIRECTORY );
+    if( !models[0].init_success || !models[1].init_success || models[0].num_features != models[1].num_features )
+    {
+        fprintf( stderr, "Error: Could not load the SVR models\n" );
+        status = -1;
+        goto exit;
+    }
+    selected = models[0].kernel;
+    mr_select_rbf_kernel( MR_PRECISION_FP32, &selected_name );
+
+    __builtin_cpu_init();
+    supported[0] = 1;
+    supported[1] = __builtin_cpu_supports( "sse2" );
+    supported[2] = __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" );
+    supported[3] = __builtin_cpu_supports( "avx512f" );
+
+    /* Feature vectors spread around the training distribution */
+    x = mr_reference_features( &models[0], num_vectors );
+    reference = (float*)malloc( sizeof(float) * num_vectors );
+    if( x == NULL || reference == NULL )
+    {
+        fprintf( stderr, "Error: Could not allocate memory for the prediction benchmark\n" );
+        status = -1;
+        goto exit;
+    }
+
+    printf( "Kernel selected by CPUID: %s\n", selected_name );
+    for( m=0; m<2; m++ )
+    {
+        alpha_sum = 0;
+        for( i=0; i<models[m].num_sv; i++ )
+            alpha_sum += fabsf( *(models[m].alpha + i) );
+        bound = MR_KERNEL_TOLERANCE * ( 1 + alpha_sum );
+
+        printf( "%s model: %d support vectors, %d features (padded to %d), tolerance %g\n", model_names[m],
+                models[m].num_sv, models[m].num_features, models[m].padded_features, bound );
+
+        QueryPerformanceCounter( &t_start );
+        for( k=0; k<iterations; k++ )
+            for( v=0; v<num_vectors; v++ )
+                *(reference + v) = mr_predict_scalar( x + v*models[m].num_features, &models[m] );
+        QueryPerformanceCounter( &t_end );
+        reference_seconds = bm_seconds( t_start, t_end ) / ( (double)iterations * num_vectors );
+        printf( "  %-22s %9.2f us/prediction\n", "double pow/exp loop", 1e6 * reference_seconds );
+
+        for( k=0; k<4; k++ )
+        {
+            if( !supported[k] )
+            {
+                printf( "  %-22s not supported by this processor\n", names[k] );
+                continue;
+            }
+            models[m].kernel = kernels[k];
+
+            max_error = 0;
+            for( v=0; v<num_vectors; v++ )
+            {
+                error = fabsf( mr_predict( x + v*models[m].num_features, &models[m] ) - *(reference + v) );
+                if( error > max_error )
+                    max_error = error;
+            }
+
+            QueryPerformanceCounter( &t_start );
+            for( i=0; i<iterations; i++ )
+                for( v=0; v<num_vectors; v++ )
+                    sink += mr_predict( x + v*models[m].num_features, &models[m] );
+            QueryPerformanceCounter( &t_end );
+            seconds = bm_seconds( t_start, t_end ) / ( (double)iterations * num_vectors );
+
+            printf( "  %-22s %9.2f us/prediction  %6.1fx  max error %.3g %s\n", names[k], 1e6 * seconds,
+                    reference_seconds / seconds, max_error, max_error <= bound ? "" : "(OUT OF TOLERANCE)" );
+            if( max_error > bound )
+                status = 1;
+        }
+        models[m].kernel = selected;
+    }
+
+exit:
+    free( x );
+    free( reference );
+    mr_destroy( &models[0] );
+    mr_destroy( &models[1] );
+
+    return status;
+}
+
+/******************************************************/
+
+int bm_predict_batch( int iterations )
+{
+    int             block_sizes[4] = { 1, 16, 256, 4096 };
+    mr_model        arousal_mdl, valence_mdl;
+    LARGE_INTEGER   t_start, t_end;
+    float           *x = NULL;
+    float           *arousal = NULL;
+    float           *valence = NULL;
+    float           error, max_error, bound, alpha_sum;
+    double          loop_seconds, batch_seconds;
+    int             num_vectors = 4096;
+    int             num_features;
+    int             passes;
+    int             i, k, b, v;
+    int             status = 0;
+
+    arousal_mdl = mr_load_model( MR_AROUSAL_MODEL_FILE, MR_AROUSAL_MODEL_DIRECTORY );
+    valence_mdl = mr_load_model( MR_VALENCE_MODEL_FILE, MR_VALENCE_MODEL_DIRECTORY );
+    if( !arousal_mdl.init_success || !valence_mdl.init_success || arousal_mdl.num_features != valence_mdl.num_features )
+    {
+        fprintf( stderr, "Error: Could not load the SVR models\n" );
+        status = -1;
+        goto exit;
+    }
+    num_features = arousal_mdl.num_features;
+
+    x =         mr_reference_features( &arousal_mdl, num_vectors );
+    arousal =   (float*)malloc( sizeof(float) * num_vectors );
+    valence =   (float*)malloc( sizeof(float) * num_vectors );
+    if( x == NULL || arousal == NULL || valence == NULL )
+    {
+        fprintf( stderr, "Error: Could not allocate memory for the batch prediction benchmark\n" );
+        status = -1;
+        goto exit;
+    }
+
+    /* Accuracy against the double precision reference */
+    mr_predict_batch( x, num_vectors, &arousal_mdl, &valence_mdl, arousal, valence );
+    alpha_sum = 0;
+    for( i=0; i<arousal_mdl.num_sv; i++ )
+        alpha_sum += fabsf( *(arousal_mdl.alpha + i) );
+    for( i=0; i<valence_mdl.num_sv; i++ )
+        alpha_sum += fabsf( *(valence_mdl.alpha + i) );
+    bound = MR_KERNEL_TOLERANCE * ( 1 + alpha_sum );
+    max_error = 0;
+    for( v=0; v<num_vectors; v++ )
+    {
+        error = fabsf( *(arousal + v) - mr_predict_scalar( x + v*num_features, &arousal_mdl ) );
+        if( error > max_error )
+            max_error = error;
+        error = fabsf( *(valence + v) - mr_predict_scalar( x + v*num_features, &valence_mdl ) );
+        if( error > max_error )
+            max_error = error;
+    }
+    printf( "Batch prediction of arousal and valence (%d + %d support vectors, %d features)\n",
+            arousal_mdl.num_sv, valence_mdl.num_sv, num_features );
+    printf( "  max error against reference: %.3g (tolerance %g) %s\n", max_error, bound,
+            max_error <= bound ? "" : "OUT OF TOLERANCE" );
+    if( max_error > bound )
+        status = 1;
+
+    /* The per-vector loop, timed over all vectors */
+    passes = iterations / 100 > 0 ? iterations / 100 : 1;
+    QueryPerformanceCounter( &t_start );
+    for( k=0; k<passes; k++ )
+        for( v=0; v<num_vectors; v++ )
+        {
+            *(arousal + v) = mr_predict( x + v*num_features, &arousal_mdl );
+            *(valence + v) = mr_predict( x + v*num_features, &valence_mdl );
+        }
+    QueryPerformanceCounter( &t_end );
+    loop_seconds = bm_seconds( t_start, t_end ) / ( (double)passes * num_vectors );
+    printf( "  %-28s %9.2f us/vector\n", "mr_predict per vector", 1e6 * loop_seconds );
+
+    for( b=0; b<4; b++ )
+    {
+        QueryPerformanceCounter( &t_start );
+        for( k=0; k<passes; k++ )
+            for( v=0; v<num_vectors; v+=block_sizes[b] )
+                mr_predict_batch( x + v*num_features, block_sizes[b], &arousal_mdl, &valence_mdl, arousal + v, valence + v );
+        QueryPerformanceCounter( &t_end );
+        batch_seconds = bm_seconds( t_start, t_end ) / ( (double)passes * num_vectors );
+        printf( "  mr_predict_batch, %4d rows   %9.2f us/vector  %5.2fx\n", block_sizes[b], 1e6 * batch_seconds,
+                loop_seconds / batch_seconds );
+    }
+
+exit:
+    free( x );
+    free( arousal );
+    free( valence );
+    mr_destroy( &arousal_mdl );
+    mr_destroy( &valence_mdl );
+
+    return status;
+}
+
+/******************************************************/
+
+int bm_load( int iterations )
+{
+    const char      *directories[2] = { MR_AROUSAL_MODEL_DIRECTORY, MR_VALENCE_MODEL_DIRECTORY };
+    const char      *model_names[2] = { "arousal", "valence" };
+    const char      *path = "bm_load.mdl";
+    mr_model        text_mdl, binary_mdl;
+    LARGE_INTEGER   t_start, t_end;
+    double          text_seconds, binary_seconds;
+    float           *x = NULL;
+    float           error, max_error;
+    int             passes = iterations / 100 > 0 ? iterations / 100 : 1;
+    int             k, m, v;
+    int             status = 0;
+
+    for( m=0; m<2; m++ )
+    {
+        /* Text directory, parsed with fscanf */
+        QueryPerformanceCounter( &t_start );
+        for( k=0; k<passes; k++ )
+        {
+            text_mdl = mr_create_model( directories[m] );
+            if( k < passes-1 )
+                mr_destroy( &text_mdl );
+        }
+        QueryPerformanceCounter( &t_end );
+        text_seconds = bm_seconds( t_start, t_end ) / passes;
+        if( !text_mdl.init_success )
+        {
+            fprintf( stderr, "Error: Could not load the model in %s\n", directories[m] );
+            return -1;
+        }
+
+        /* The same model converted to a binary file and mapped, including the checksum */
+        if( !mr_write_binary_model( &text_mdl, path ) )
+        {
+            mr_destroy( &text_mdl );
+            return -1;
+        }
+        QueryPerformanceCounter( &t_start );
+        for( k=0; k<passes; k++ )
+        {
+            binary_mdl = mr_map_model( path );
+            if( k < passes-1 )
+                mr_destroy( &binary_mdl );
+        }
+        QueryPerformanceCounter( &t_end );
+        binary_seconds = bm_seconds( t_start, t_end ) / passes;
+        if( !binary_mdl.init_success )
+        {
+            fprintf( stderr, "Error: Could not map %s\n", path );
+            mr_destroy( &text_mdl );
+            remove( path );
+            return -1;
+        }
+
+        /* Both must give identical predictions */
+        max_error = 0;
+        x = mr_reference_features( &text_mdl, MR_REFERENCE_VECTORS );
+        if( x != NULL )
+        {
+            for( v=0; v<MR_REFERENCE_VECTORS; v++ )
+            {
+                error = fabsf( mr_predict( x + v*text_mdl.num_features, &text_mdl ) - mr_predict( x + v*text_mdl.num_features, &binary_mdl ) );
+                if( error > max_error )
+                    max_error = error;
+            }
+            free( x );
+        }
+
+        printf( "%s model (%d support vectors, %d features), mean of %d loads\n", model_names[m],
+                text_mdl.num_sv, text_mdl.num_features, passes );
+        printf( "  text directory:  %9.3f ms\n", 1e3 * text_seconds );
+        printf( "  binary mapped:   %9.3f ms  %6.1fx  prediction difference %g\n", 1e3 * binary_seconds,
+                text_seconds / binary_seconds, max_error );
+        if( x == NULL || max_error != 0 )
+            status = 1;
+
+        mr_destroy( &text_mdl );
+        mr_destroy( &binary_mdl );
+        remove( path );
+    }
+
+    return status;
+}
+
+/******************************************************/
+
+/* Reads the reference feature set of bm_precision() and bm_rff() from path, or when path is NULL draws the
+   MR_REFERENCE_VECTORS vectors of mr_reference_features(), which mr_load_live_models() checks too.  Returns the
+   malloc'd vectors and their number, or NULL */
+static float *bm_reference_features( const mr_model *mdl, const char *path, int *num_vectors )
+{
+    mr_array    features;
+
+    if( path != NULL )
+    {
+        features = mr_fill_array( path );
+        if( features.data_ptr == NULL || features.N != mdl->num_features || features.M < 1 )
+        {
+            fprintf( stderr, "Error: %s is not a set of feature vectors of length %d\n", path, mdl->num_features );
+            mr_free_array( &features );
+            return NULL;
+        }
+        *num_vectors = features.M;
+        return features.data_ptr;
+    }
+
+    *num_vectors = MR_REFERENCE_VECTORS;
+
+    return mr_reference_features( mdl, MR_REFERENCE_VECTORS );
+}
+
+/******************************************************/
+
+/* Checks that mr_predict_batch() agrees with mr_predict() on every vector for the models as they are, within
+   MR_KERNEL_TOLERANCE * ( 1 + sum of |alpha| ).  Stores the largest difference, returns 1 if it is within the
+   bound, 0 if not and -1 if memory could not be allocated */
+static int bm_batch_agrees( const float *x, int num_vectors, const mr_model *arousal_mdl, const mr_model *valence_mdl, float *difference )
+{
+    float   *batch;
+    float   error, bound, alpha_sum = 0;
+    int     i, v;
+
+    batch = (float*)malloc( sizeof(float) * 2 * num_vectors );
+    if( batch == NULL )
+        return -1;
+    mr_predict_batch( x, num_vectors, arousal_mdl, valence_mdl, batch, batch + num_vectors );
+
+    *difference = 0;
+    for( v=0; v<num_vectors; v++ )
+    {
+        error = fabsf( *(batch + v) - mr_predict( (float*)( x + v*arousal_mdl->num_features ), arousal_mdl ) );
+        if( error > *difference )
+            *difference = error;
+        error = fabsf( *(batch + num_vectors + v) - mr_predict( (float*)( x + v*valence_mdl->num_features ), valence_mdl ) );
+        if( error > *difference )
+            *difference = error;
+    }
+    free( batch );
+
+    for( i=0; i<arousal_mdl->num_sv; i++ )
+        alpha_sum += fabsf( *(arousal_mdl->alpha + i) );
+    for( i=0; i<valence_mdl->num_sv; i++ )
+        alpha_sum += fabsf( *(valence_mdl->alpha + i) );
+    bound = MR_KERNEL_TOLERANCE * ( 1 + alpha_sum );
+
+    return *difference <= bound;
+}
+
+/******************************************************/
+
+int bm_precision( int iterations, const char *path )
+{
+    const char      *names[3] = { "fp32", "fp16", "int8" };
+    int             element_size[3] = { sizeof(float), sizeof(unsigned short), sizeof(signed char) };
+    mr_model        arousal_mdl, valence_mdl;
+    LARGE_INTEGER   t_start, t_end;
+    float           *x = NULL;
+    float           *arousal = NULL;
+    float           *valence = NULL;
+    float           error, max_arousal, max_valence, batch_difference;
+    double          sum_error, seconds, fp32_seconds = 0;
+    volatile float  sink = 0;
+    const char      *kernel_name;
+    int             num_vectors;
+    int             num_features, passes, bytes, agrees;
+    int             batch_mismatch = 0;
+    int             cheapest = -1;
+    int             k, p, v;
+    int             status = 0;
+
+    arousal_mdl = mr_load_model( MR_AROUSAL_MODEL_FILE, MR_AROUSAL_MODEL_DIRECTORY );
+    valence_mdl = mr_load_model( MR_VALENCE_MODEL_FILE, MR_VALENCE_MODEL_DIRECTORY );
+    if( !arousal_mdl.init_success || !valence_mdl.init_success || arousal_mdl.num_features != valence_mdl.num_features )
+    {
+        fprintf( stderr, "Error: Could not load the SVR models\n" );
+        status = -1;
+        goto exit;
+    }
+    num_features = arousal_mdl.num_features;
+    passes = iterations / 10 > 0 ? iterations / 10 : 1;
+
+    x = bm_reference_features( &arousal_mdl, path, &num_vectors );
+    arousal = (float*)malloc( sizeof(float) * num_vectors );
+    valence = (float*)malloc( sizeof(float) * num_vectors );
+    if( x == NULL || arousal == NULL || valence == NULL )
+    {
+        fprintf( stderr, "Error: Could not set up the reference feature vectors\n" );
+        status = -1;
+        goto exit;
+    }
+
+    /* fp32 predictions are the reference */
+    for( v=0; v<num_vectors; v++ )
+    {
+        *(arousal + v) = mr_predict( x + v*num_features, &arousal_mdl );
+        *(valence + v) = mr_predict( x + v*num_features, &valence_mdl );
+    }
+
+    printf( "%d reference feature vectors (%s), arousal %d / valence %d support vectors, tolerance %g\n",
+            num_vectors, path != NULL ? path : "synthetic", arousal_mdl.num_sv, valence_mdl.num_sv, BM_PRECISION_TOLERANCE );
+    for( p=MR_PRECISION_FP32; p<=MR_PRECISION_INT8; p++ )
+    {
+        if( !mr_quantize_model( &arousal_mdl, p ) || !mr_quantize_model( &valence_mdl, p ) )
+        {
+            fprintf( stderr, "Error: Could not build the %s support vectors\n", names[p] );
+            status = -1;
+            goto exit;
+        }
+        mr_select_rbf_kernel( p, &kernel_name );
+
+        max_arousal = 0;
+        max_valence = 0;
+        sum_error = 0;
+        for( v=0; v<num_vectors; v++ )
+        {
+            error = fabsf( mr_predict( x + v*num_features, &arousal_mdl ) - *(arousal + v) );
+            sum_error += error;
+            if( error > max_arousal )
+                max_arousal = error;
+            error = fabsf( mr_predict( x + v*num_features, &valence_mdl ) - *(valence + v) );
+            sum_error += error;
+            if( error > max_valence )
+                max_valence = error;
+        }
+        agrees = bm_batch_agrees( x, num_vectors, &arousal_mdl, &valence_mdl, &batch_difference );
+        if( agrees < 0 )
+        {
+            fprintf( stderr, "Error: Could not allocate memory for the batch predictions\n" );
+            status = -1;
+            goto exit;
+        }
+
+        QueryPerformanceCounter( &t_start );
+        for( k=0; k<passes; k++ )
+            for( v=0; v<num_vectors; v++ )
+            {
+                sink += mr_predict( x + v*num_features, &arousal_mdl );
+                sink += mr_predict( x + v*num_features, &valence_mdl );
+            }
+        QueryPerformanceCounter( &t_end );
+        seconds = bm_seconds( t_start, t_end ) / ( (double)passes * num_vectors );
+        if( p == MR_PRECISION_FP32 )
+            fp32_seconds = seconds;
+
+        bytes = element_size[p] * arousal_mdl.padded_features * ( arousal_mdl.padded_sv + valence_mdl.padded_sv );
+        printf( "  %s (%s): support vectors %7.1f KiB, %7.2f us/prediction pair %5.2fx, max deviation arousal %.3g valence %.3g, mean %.3g %s\n",
+                names[p], kernel_name, bytes / 1024.0, 1e6 * seconds, fp32_seconds / seconds, max_arousal, max_valence,
+                sum_error / ( 2.0 * num_vectors ),
+                ( max_arousal <= BM_PRECISION_TOLERANCE && max_valence <= BM_PRECISION_TOLERANCE ) ? "" : "(OUT OF TOLERANCE)" );
+        printf( "      mr_predict_batch against mr_predict: max difference %.3g %s\n", batch_difference,
+                agrees ? "" : "(BATCH MISMATCH)" );
+        if( !agrees )
+            batch_mismatch = 1;
+
+        if( max_arousal <= BM_PRECISION_TOLERANCE && max_valence <= BM_PRECISION_TOLERANCE )
+            cheapest = p;
+    }
+
+    if( cheapest > MR_PRECISION_FP32 )
+        printf( "Smallest format within tolerance: %s (set MR_SV_PRECISION in moodRecognition.h)\n", names[cheapest] );
+    else
+    {
+        printf( "No reduced precision format is within tolerance, keep fp32\n" );
+        status = 1;
+    }
+    if( batch_mismatch )
+        status = 2;
+
+exit:
+    free( x );
+    free( arousal );
+    free( valence );
+    mr_destroy( &arousal_mdl );
+    mr_destroy( &valence_mdl );
+
+    return status;
+}
+
+/******************************************************/
+
+int bm_rff( int iterations, const char *path )
+{
+    int             sizes[7] = { 64, 128, 256, 512, 1024, 2048, 4096 };
+    mr_model        models[2];
+    const char      *model_names[2] = { "arousal", "valence" };
+    LARGE_INTEGER   t_start, t_end;
+    float           *x = NULL;
+    float           *exact = NULL;
+    float           error, max_error, batch_difference;
+    double          sum_error, seconds, exact_seconds, build_seconds;
+    volatile float  sink = 0;
+    int             num_vectors = 0;
+    int             num_features, passes, agrees;
+    int             i, k, m, v;
+    int             status = 0;
+
+    models[0] = mr_load_model( MR_AROUSAL_MODEL_FILE, MR_AROUSAL_MODEL_DIRECTORY );
+    models[1] = mr_load_model( MR_VALENCE_MODEL_FILE, MR_VALENCE_MODEL_DIRECTORY );
+    if( !models[0].init_success || !models[1].init_success || models[0].num_features != models[1].num_features )
+    {
+        fprintf( stderr, "Error: Could not load the SVR models\n" );
+        status = -1;
+        goto exit;
+    }
+    num_features = models[0].num_features;
+    passes = iterations / 10 > 0 ? iterations / 10 : 1;
+
+    x = bm_reference_features( &models[0], path, &num_vectors );
+    exact = (float*)malloc( sizeof(float) * num_vectors );
+    if( x == NULL || exact == NULL )
+    {
+        fprintf( stderr, "Error: Could not set up the reference feature vectors\n" );
+        status = -1;
+        goto exit;
+    }
+
+    printf( "%d reference feature vectors (%s)\n", num_vectors, path != NULL ? path : "synthetic" );
+    for( m=0; m<2; m++ )
+    {
+        for( v=0; v<num_vectors; v++ )
+            *(exact + v) = mr_predict( x + v*num_features, &models[m] );
+
+        QueryPerformanceCounter( &t_start );
+        for( k=0; k<passes; k++ )
+            for( v=0; v<num_vectors; v++ )
+                sink += mr_predict( x + v*num_features, &models[m] );
+        QueryPerformanceCounter( &t_end );
+        exact_seconds = bm_seconds( t_start, t_end ) / ( (double)passes * num_vectors );
+
+        printf( "%s model: %d support vectors, %d features\n", model_names[m], models[m].num_sv, num_features );
+        printf( "  %-10s %9.2f us/prediction\n", "exact", 1e6 * exact_seconds );
+
+        for( i=0; i<7; i++ )
+        {
+            QueryPerformanceCounter( &t_start );
+            if( !mr_approximate_model( &models[m], sizes[i], MR_RFF_SEED ) )
+            {
+                fprintf( stderr, "Error: Could not build %d random features\n", sizes[i] );
+                status = -1;
+                goto exit;
+            }
+            QueryPerformanceCounter( &t_end );
+            build_seconds = bm_seconds( t_start, t_end );
+
+            max_error = 0;
+            sum_error = 0;
+            for( v=0; v<num_vectors; v++ )
+            {
+                error = fabsf( mr_predict( x + v*num_features, &models[m] ) - *(exact + v) );
+                sum_error += error;
+                if( error > max_error )
+                    max_error = error;
+            }
+            agrees = bm_batch_agrees( x, num_vectors, &models[0], &models[1], &batch_difference );
+            if( agrees < 0 )
+            {
+                fprintf( stderr, "Error: Could not allocate memory for the batch predictions\n" );
+                status = -1;
+                goto exit;
+            }
+
+            QueryPerformanceCounter( &t_start );
+            for( k=0; k<passes; k++ )
+                for( v=0; v<num_vectors; v++ )
+                    sink += mr_predict( x + v*num_features, &models[m] );
+            QueryPerformanceCounter( &t_end );
+            seconds = bm_seconds( t_start, t_end ) / ( (double)passes * num_vectors );
+
+            printf( "  D = %-6d %9.2f us/prediction  %5.2fx  max error %.3g  mean error %.3g  built in %.1f ms  batch difference %.3g%s\n",
+                    sizes[i], 1e6 * seconds, exact_seconds / seconds, max_error, sum_error / num_vectors, 1e3 * build_seconds,
+                    batch_difference, agrees ? "" : " (BATCH MISMATCH)" );
+            if( !agrees )
+                status = 1;
+        }
+        mr_approximate_model( &models[m], 0, MR_RFF_SEED );
+    }
+
+exit:
+    free( x );
+    free( exact );
+    mr_destroy( &models[0] );
+    mr_destroy( &models[1] );
+
+    return status;
+}
+
+/******************************************************/
+
+/** @brief Recomputes the timbre statistics from the timbre matrix in double precision, two pass, as the reference
+    for bm_stats()
+*/
+static void bm_exact_timbre_stats( const float *feature_array, double *stat_array, fe_extraction_info *info )
+{
+    int     i, j;
+    int     columns = info->frames_in_window;
+    double  mean, sum;
+
+    for( i=0; i<info->num_timbre_features; i++ )
+    {
+        for( j=0, sum=0; j<columns; j++ )
+            sum += *(feature_array + i*columns + j);
+        mean = sum / columns;
+        for( j=0, sum=0; j<columns; j++ )
+            sum += ( *(feature_array + i*columns + j) - mean ) * ( *(feature_array + i*columns + j) - mean );
+
+        *(stat_array + 2*i) =       mean;
+        *(stat_array + 2*i + 1) =   sqrt( sum / ( columns - 1 ) );
+    }
+}
+
+/******************************************************/
+
+/** @brief Largest difference of a set of statistics from the exact ones, relative to the size of each statistic with
+    a floor for statistics that are close to zero
+*/
+static double bm_stats_difference( const float *stats, const double *exact, int num )
+{
+    int     i;
+    double  difference, max_difference = 0;
+
+    for( i=0; i<num; i++ )
+    {
+        difference = fabs( *(stats+i) - *(exact+i) ) / ( fabs( *(exact+i) ) > 1e-3 ? fabs( *(exact+i) ) : 1e-3 );
+        if( difference > max_difference )
+            max_difference = difference;
+    }
+
+    return max_difference;
+}
+
+/******************************************************/
+
+int bm_stats( int iterations )
+{
+    fe_extraction_info          info;
+    fe_extraction_thread_data   data;
+    LARGE_INTEGER               t_start, t_end;
+    double                      full_seconds = 0;
+    double                      running_seconds = 0;
+    double                      difference;
+    double                      max_full = 0;
+    double                      max_running = 0;
+    double                      *exact = NULL;
+    float                       *full = NULL;
+    float                       *running = NULL;
+    float                       amplitude;
+    int                         j, k;
+    int                         status = 0;
+
+    fe_initialize_extraction_info( &info );
+    data = fe_initialize_extraction_thread_data( &info );
+    full = (float*)malloc( sizeof(float) * 2 * info.num_timbre_features );
+    running = (float*)malloc( sizeof(float) * 2 * info.num_timbre_features );
+    exact = (double*)malloc( sizeof(double) * 2 * info.num_timbre_features );
+    if( !data.init_success || full == NULL || running == NULL || exact == NULL )
+    {
+        fprintf( stderr, "Error: Could not initialize the statistics benchmark\n" );
+        status = -1;
+        goto exit;
+    }
+
+    /* A tone whose pitch and level drift from frame to frame, plus noise, so every timbre feature keeps changing */
+    srand( 1 );
+    for( k=0; k<iterations; k++ )
+    {
+        amplitude = 0.1 + 0.4 * (float)rand()/RAND_MAX;
+        for( j=0; j<info.frame_length; j++ )
+            *(data.audio + j) = ( amplitude * sin( 2*PI*( 220 + (k % 97) * 10 )*j/info.fs ) +
+                                  0.01 * ( (float)rand()/RAND_MAX - 0.5 ) ) * *(data.hamm_win + j);
+        fe_process_frame( &data );
+
+        QueryPerformanceCounter( &t_start );
+        fe_timbre_stats( data.timbre_matrix, full, &info );
+        QueryPerformanceCounter( &t_end );
+        full_seconds += bm_seconds( t_start, t_end );
+
+        QueryPerformanceCounter( &t_start );
+        fe_timbre_stats_running( data.timbre_sum, data.timbre_sum_sq, running, &info );
+        QueryPerformanceCounter( &t_end );
+        running_seconds += bm_seconds( t_start, t_end );
+
+        bm_exact_timbre_stats( data.timbre_matrix, exact, &info );
+        difference = bm_stats_difference( full, exact, 2*info.num_timbre_features );
+        if( difference > max_full )
+            max_full = difference;
+        difference = bm_stats_difference( running, exact, 2*info.num_timbre_features );
+        if( difference > max_running )
+            max_running = difference;
+    }
+
+    printf( "Timbre statistics over %d frames (%d features x %d frames in the window, sums recomputed every %d frames)\n",
+            iterations, info.num_timbre_features, info.frames_in_window, STATS_RESYNC_FRAMES );
+    printf( "                               time/frame  speedup  max relative error\n" );
+    printf( "  recomputed from the matrix: %9.3f us            %.3g\n", 1e6 * full_seconds / iterations, max_full );
+    printf( "  from the running sums:      %9.3f us  %6.1fx    %.3g %s\n", 1e6 * running_seconds / iterations,
+            full_seconds / running_seconds, max_running, max_running <= BM_STATS_TOLERANCE ? "" : "(OUT OF TOLERANCE)" );
+    if( max_running > BM_STATS_TOLERANCE )
+        status = 1;
+
+exit:
+    free( full );
+    free( running );
+    free( exact );
+    if( data.init_success )
+        fe_clean_extraction_thread_data( &data );
+    fe_clean_extraction_info( &info );
+
+    return status;
+}
+
+/******************************************************/
+
+int bm_autocorrelation( int iterations )
+{
+    static const char   *names[3] = { "direct", "fft", "incremental" };
+    fe_extraction_info  info;
+    fe_autocorrelation  ac;
+    LARGE_INTEGER       t_start, t_end;
+    const float         *result;
+    float               *signal = NULL;
+    float               *values = NULL;
+    double              *exact = NULL;
+    double              sum, error, max_error;
+    float               old_value;
+    int                 lengths[6];
+    int                 N, passes, position;
+    int                 i, j, m, n;
+    int                 status = 0;
+
+    /* Window lengths in frames from the 3 s window up to 32 times longer */
+    fe_initialize_extraction_info( &info );
+    for( n=0; n<6; n++ )
+        lengths[n] = info.frames_in_window << n;
+
+    printf( "Autocorrelation of the rectified flux per frame (update and compute), error relative to lag zero\n" );
+    printf( "  window  frames" );
+    for( m=0; m<3; m++ )
+        printf( "  %11s us   error  ", names[m] );
+    printf( "\n" );
+
+    for( n=0; n<6; n++ )
+    {
+        N = lengths[n];
+        passes = (int)( (double)iterations * lengths[0] / N );
+        if( passes < 1 )
+            passes = 1;
+
+        signal = (float*)malloc( sizeof(float) * N );
+        values = (float*)malloc( sizeof(float) * passes );
+        exact = (double*)malloc( sizeof(double) * (N/2) );
+        if( signal == NULL || values == NULL || exact == NULL )
+        {
+            fprintf( stderr, "Error: Could not allocate memory for the autocorrelation benchmark\n" );
+            status = -1;
+            goto exit;
+        }
+
+        printf( "  %5.1fs  %6d", (float)N * info.hop_length / info.fs, N );
+        for( m=0; m<3; m++ )
+        {
+            /* The same signal for every method: a beat every 11 frames over noise, never negative like the flux */
+            srand( n + 1 );
+            for( i=0; i<N; i++ )
+                *(signal+i) = ( i % 11 == 0 ? 1.0f : 0.0f ) + 0.2f * (float)rand()/RAND_MAX;
+            for( i=0; i<passes; i++ )
+                *(values+i) = ( i % 11 == 0 ? 1.0f : 0.0f ) + 0.2f * (float)rand()/RAND_MAX;
+
+            if( !fe_autocorrelation_init( &ac, N, m, &info ) )
+            {
+                fprintf( stderr, "Error: Could not initialize the %s autocorrelation\n", names[m] );
+                status = -1;
+                goto exit;
+            }
+            fe_autocorrelation_resync( &ac, signal );
+
+            QueryPerformanceCounter( &t_start );
+            for( i=0; i<passes; i++ )
+            {
+                position = i % N;
+                old_value = *(signal + position);
+                *(signal + position) = *(values + i);
+                fe_autocorrelation_update( &ac, signal, position, old_value );
+                result = fe_autocorrelation_compute( &ac, signal );
+            }
+            QueryPerformanceCounter( &t_end );
+
+            /* Compare the last result with the exact autocorrelation of the final signal */
+            for( i=0; i<N/2; i++ )
+            {
+                sum = 0;
+                for( j=0; j<N; j++ )
+                    sum += (double)*(signal+j) * *( signal + (i+j) % N );
+                *(exact+i) = sum;
+            }
+            max_error = 0;
+            for( i=0; i<N/2; i++ )
+            {
+                error = fabs( *(result+i) - *(exact+i) ) / *exact;
+                if( error > max_error )
+                    max_error = error;
+            }
+            if( max_error > BM_AC_TOLERANCE )
+                status = 1;
+
+            printf( "  %14.3f %9.2g%s", 1e6 * bm_seconds( t_start, t_end ) / passes, max_error,
+                    max_error > BM_AC_TOLERANCE ? "!" : " " );
+            fe_autocorrelation_free( &ac );
+        }
+        printf( "\n" );
+
+        free( signal );
+        free( values );
+        free( exact );
+        signal = NULL;
+        values = NULL;
+        exact = NULL;
+    }
+    if( status == 1 )
+        printf( "  ! error above %g\n", BM_AC_TOLERANCE );
+
+exit:
+    free( signal );
+    free( values );
+    free( exact );
+    fe_clean_extraction_info( &info );
+
+    return status;
+}
+
+/******************************************************/
+
+/** @brief Fills a magnitude spectrum for bm_contrast(): 0 noise falling with frequency, 1 increasing, 2 decreasing,
+    3 noise quantized to a few levels so most bins tie
+*/
+static void bm_contrast_spectrum( float *magnitude, int length, int kind )
+{
+    int     i;
+    float   u;
+
+    for( i=0; i<length; i++ )
+    {
+        u = ( rand() + 1.0f ) / ( RAND_MAX + 2.0f );
+        switch( kind )
+        {
+            case 1:     *(magnitude+i) = 1 + i;                                 break;
+            case 2:     *(magnitude+i) = length - i;                            break;
+            case 3:     *(magnitude+i) = 1 + (int)( 4*u );                      break;
+            default:    *(magnitude+i) = -log( u ) * 100 / ( 1 + 0.05f*i );     break;
+        }
+    }
+}
+
+/******************************************************/
+
+int bm_contrast( int iterations )
+{
+    static const char   *kinds[4] = { "noise", "increasing", "decreasing", "tied" };
+    fe_extraction_info  info;
+    LARGE_INTEGER       t_start, t_end;
+    double              sort_seconds = 0;
+    double              select_seconds = 0;
+    double              difference, max_difference = 0;
+    float               *spectra = NULL;
+    float               *sorted = NULL;
+    float               *selected = NULL;
+    float               *scratch = NULL;
+    int                 num_spectra = 64;
+    int                 features;
+    int                 i, k, n;
+    int                 status = 0;
+
+    fe_initialize_extraction_info( &info );
+    features = 3 * info.bands;
+
+    /* Contrast features go down a column of the timbre matrix, frames_in_window apart */
+    spectra = (float*)malloc( sizeof(float) * num_spectra * info.dft_length );
+    sorted = (float*)malloc( sizeof(float) * features * info.frames_in_window );
+    selected = (float*)malloc( sizeof(float) * features * info.frames_in_window );
+    scratch = (float*)malloc( sizeof(float) * info.dft_length );
+    if( !info.init_success || spectra == NULL || sorted == NULL || selected == NULL || scratch == NULL )
+    {
+        fprintf( stderr, "Error: Could not allocate memory for the contrast benchmark\n" );
+        status = -1;
+        goto exit;
+    }
+
+    printf( "Spectral contrast, %d bands of %d bins\n", info.bands, info.dft_length );
+
+    /* Agreement on each kind of spectrum */
+    srand( 1 );
+    for( k=0; k<4; k++ )
+    {
+        for( n=0; n<num_spectra; n++ )
+        {
+            bm_contrast_spectrum( spectra, info.dft_length, k );
+            fe_spectral_contrast_sort( spectra, sorted, &info );
+            fe_spectral_contrast( spectra, selected, scratch, &info );
+            for( i=0; i<features; i++ )
+            {
+                difference = fabs( *( sorted + i*info.frames_in_window ) - *( selected + i*info.frames_in_window ) );
+                if( difference > max_difference )
+                    max_difference = difference;
+            }
+        }
+        printf( "  %-10s spectra: max difference of the log features %.3g\n", kinds[k], max_difference );
+        if( max_difference > BM_CONTRAST_TOLERANCE )
+            status = 1;
+        max_difference = 0;
+    }
+
+    /* Timing on noise spectra, cycling through a set so the branch predictors cannot learn one spectrum */
+    for( n=0; n<num_spectra; n++ )
+        bm_contrast_spectrum( spectra + n*info.dft_length, info.dft_length, 0 );
+
+    QueryPerformanceCounter( &t_start );
+    for( i=0; i<iterations; i++ )
+        fe_spectral_contrast_sort( spectra + (i % num_spectra)*info.dft_length, sorted, &info );
+    QueryPerformanceCounter( &t_end );
+    sort_seconds = bm_seconds( t_start, t_end ) / iterations;
+
+    QueryPerformanceCounter( &t_start );
+    for( i=0; i<iterations; i++ )
+        fe_spectral_contrast( spectra + (i % num_spectra)*info.dft_length, selected, scratch, &info );
+    QueryPerformanceCounter( &t_end );
+    select_seconds = bm_seconds( t_start, t_end ) / iterations;
+
+    printf( "  qsort:     %8.3f us/frame\n", 1e6 * sort_seconds );
+    printf( "  selection: %8.3f us/frame  %5.2fx\n", 1e6 * select_seconds, sort_seconds / select_seconds );
+    if( status == 1 )
+        printf( "  Features differ by more than %g\n", BM_CONTRAST_TOLERANCE );
+
+exit:
+    free( spectra );
+    free( sorted );
+    free( selected );
+    free( scratch );
+    fe_clean_extraction_info( &info );
+
+    return status;
+}
+
+/******************************************************/
+
+int bm_descriptors( int iterations )
+{
+    static const char   *names[4] = { "centroid", "flux", "rolloff", "rectified flux" };
+    fe_extraction_info  info;
+    LARGE_INTEGER       t_start, t_end;
+    double              separate_seconds, fused_seconds;
+    double              difference, max_difference[4] = { 0, 0, 0, 0 };
+    float               *spectra = NULL;
+    float               *prefix = NULL;
+    float               *column = NULL;
+    float               separate[4], fused[4];
+    float               *cur, *prev;
+    int                 num_spectra = 64;
+    int                 i, n;
+    int                 status = 0;
+
+    fe_initialize_extraction_info( &info );
+
+    spectra = (float*)malloc( sizeof(float) * num_spectra * info.dft_length );
+    prefix = (float*)malloc( sizeof(float) * info.dft_length );
+    column = (float*)malloc( sizeof(float) * 3 * info.frames_in_window );
+    if( !info.init_success || spectra == NULL || prefix == NULL || column == NULL )
+    {
+        fprintf( stderr, "Error: Could not allocate memory for the descriptor benchmark\n" );
+        status = -1;
+        goto exit;
+    }
+
+    srand( 1 );
+    for( n=0; n<num_spectra; n++ )
+        bm_contrast_spectrum( spectra + n*info.dft_length, info.dft_length, 0 );
+
+    /* Consecutive spectra of the set stand for the current and previous frames */
+    for( n=0; n<num_spectra; n++ )
+    {
+        cur = spectra + n*info.dft_length;
+        prev = spectra + ( (n+1) % num_spectra )*info.dft_length;
+
+        *(separate) =   fe_spectral_centroid( cur, &info );
+        *(separate+1) = fe_spectral_flux( cur, prev, FE_SPEC_FLUX_UNRECTIFIED, &info );
+        *(separate+2) = fe_spectral_rolloff( cur, &info );
+        *(separate+3) = fe_spectral_flux( cur, prev, FE_SPEC_FLUX_RECTIFIED, &info );
+
+        fe_spectral_descriptors( cur, prev, column, fused+3, prefix, &info );
+        *(fused) =      *(column);
+        *(fused+1) =    *(column + info.frames_in_window);
+        *(fused+2) =    *(column + 2*info.frames_in_window);
+
+        for( i=0; i<4; i++ )
+        {
+            difference = fabs( *(fused+i) - *(separate+i) ) / fabs( *(separate+i) );
+            if( difference > max_difference[i] )
+                max_difference[i] = difference;
+        }
+    }
+
+    QueryPerformanceCounter( &t_start );
+    for( i=0; i<iterations; i++ )
+    {
+        cur = spectra + (i % num_spectra)*info.dft_length;
+        prev = spectra + ( (i+1) % num_spectra )*info.dft_length;
+        *(column) =                             fe_spectral_centroid( cur, &info );
+        *(column + info.frames_in_window) =     fe_spectral_flux( cur, prev, FE_SPEC_FLUX_UNRECTIFIED, &info );
+        *(column + 2*info.frames_in_window) =   fe_spectral_rolloff( cur, &info );
+        *(separate+3) =                         fe_spectral_flux( cur, prev, FE_SPEC_FLUX_RECTIFIED, &info );
+    }
+    QueryPerformanceCounter( &t_end );
+    separate_seconds = bm_seconds( t_start, t_end ) / iterations;
+
+    QueryPerformanceCounter( &t_start );
+    for( i=0; i<iterations; i++ )
+    {
+        cur = spectra + (i % num_spectra)*info.dft_length;
+        prev = spectra + ( (i+1) % num_spectra )*info.dft_length;
+        fe_spectral_descriptors( cur, prev, column, fused+3, prefix, &info );
+    }
+    QueryPerformanceCounter( &t_end );
+    fused_seconds = bm_seconds( t_start, t_end ) / iterations;
+
+    printf( "Spectral centroid, flux, rolloff and rectified flux of %d bins\n", info.dft_length );
+    printf( "  separate passes: %8.3f us/frame\n", 1e6 * separate_seconds );
+    printf( "  fused pass:      %8.3f us/frame  %5.2fx\n", 1e6 * fused_seconds, separate_seconds / fused_seconds );
+    for( i=0; i<4; i++ )
+    {
+        printf( "  %-15s max relative difference %.3g\n", names[i], max_difference[i] );
+        if( max_difference[i] > BM_DESCRIPTOR_TOLERANCE )
+            status = 1;
+    }
+    if( status == 1 )
+        printf( "  Descriptors differ by more than %g\n", BM_DESCRIPTOR_TOLERANCE );
+
+exit:
+    free( spectra );
+    free( prefix );
+    free( column );
+    fe_clean_extraction_info( &info );
+
+    return status;
+}
+
+/******************************************************/
+
+int bm_frontend( int iterations )
+{
+    static const char   *names[4] = { "scalar", "SSE2", "AVX2", "AVX-512" };
+    fe_downmix_kernel   downmix[4] =    { fe_downmix_scalar, fe_downmix_sse2, fe_downmix_avx2, fe_downmix_avx512 };
+    fe_window_kernel    window[4] =     { fe_window_scalar, fe_window_sse2, fe_window_avx2, fe_window_avx512 };
+    fe_magnitude_kernel magnitude[4] =  { fe_magnitude_scalar, fe_magnitude_sse2, fe_magnitude_avx2, fe_magnitude_avx512 };
+    fe_extraction_info  info;
+    LARGE_INTEGER       t_start, t_end;
+    double              seconds[3];
+    float               *stereo = NULL;
+    float               *win = NULL;
+    float               *dft = NULL;
+    float               *reference = NULL;
+    float               *result = NULL;
+    int                 level = fe_simd_level();
+    int                 length, mismatches;
+    int                 i, k, m;
+    int                 status = 0;
+
+    fe_initialize_extraction_info( &info );
+    length = info.frame_length + 13;    /* Room for the remainder tests */
+
+    stereo =    (float*)malloc( sizeof(float) * 2 * length );
+    win =       (float*)malloc( sizeof(float) * length );
+    dft =       (float*)malloc( sizeof(float) * 2 * length );
+    reference = (float*)malloc( sizeof(float) * length );
+    result =    (float*)malloc( sizeof(float) * length );
+    if( stereo == NULL || win == NULL || dft == NULL || reference == NULL || result == NULL )
+    {
+        fprintf( stderr, "Error: Could not allocate memory for the front end benchmark\n" );
+        status = -1;
+        goto exit;
+    }
+
+    srand( 1 );
+    for( i=0; i<2*length; i++ )
+    {
+        *(stereo+i) =   2 * (float)rand()/RAND_MAX - 1;
+        *(dft+i) =      ( 2 * (float)rand()/RAND_MAX - 1 ) * 100;
+    }
+    fe_hamming_win( win, length );
+
+    printf( "Front end kernels, %d samples and %d bins per frame\n", info.frame_length, info.dft_length );
+    printf( "  %-8s  downmix+window us  window us  magnitude us  bit exact\n", "" );
+    for( k=0; k<=level; k++ )
+    {
+        /* Every length from a frame to the frame plus 13 so each kernel runs its remainder loop */
+        mismatches = 0;
+        for( m=info.frame_length; m<length; m++ )
+        {
+            fe_downmix_scalar( stereo, win, reference, m );
+            downmix[k]( stereo, win, result, m );
+            mismatches += memcmp( reference, result, sizeof(float) * m ) != 0;
+
+            fe_downmix_scalar( stereo, NULL, reference, m );
+            downmix[k]( stereo, NULL, result, m );
+            mismatches += memcmp( reference, result, sizeof(float) * m ) != 0;
+
+            memcpy( reference, stereo, sizeof(float) * m );
+            memcpy( result, stereo, sizeof(float) * m );
+            fe_window_scalar( reference, win, m );
+            window[k]( result, win, m );
+            mismatches += memcmp( reference, result, sizeof(float) * m ) != 0;
+
+            fe_magnitude_scalar( (fftwf_complex*)dft, reference, m );
+            magnitude[k]( (fftwf_complex*)dft, result, m );
+            mismatches += memcmp( reference, result, sizeof(float) * m ) != 0;
+        }
+        if( mismatches > 0 )
+            status = 1;
+
+        QueryPerformanceCounter( &t_start );
+        for( i=0; i<iterations; i++ )
+            downmix[k]( stereo, win, result, info.frame_length );
+        QueryPerformanceCounter( &t_end );
+        seconds[0] = bm_seconds( t_start, t_end ) / iterations;
+
+        /* Windowing the same samples over and over would run into denormals, a unit window costs the same */
+        for( i=0; i<info.frame_length; i++ )
+            *(reference+i) = 1;
+        QueryPerformanceCounter( &t_start );
+        for( i=0; i<iterations; i++ )
+            window[k]( result, reference, info.frame_length );
+        QueryPerformanceCounter( &t_end );
+        seconds[1] = bm_seconds( t_start, t_end ) / iterations;
+
+        QueryPerformanceCounter( &t_start );
+        for( i=0; i<iterations; i++ )
+            magnitude[k]( (fftwf_complex*)dft, result, info.dft_length );
+        QueryPerformanceCounter( &t_end );
+        seconds[2] = bm_seconds( t_start, t_end ) / iterations;
+
+        printf( "  %-8s  %16.3f  %9.3f  %12.3f  %s\n", names[k], 1e6 * seconds[0], 1e6 * seconds[1], 1e6 * seconds[2],
+                mismatches == 0 ? "yes" : "NO" );
+    }
+    if( status == 1 )
+        printf( "  A kernel does not match the scalar kernel\n" );
+
+exit:
+    free( stereo );
+    free( win );
+    free( dft );
+    free( reference );
+    free( result );
+    fe_clean_extraction_info( &info );
+
+    return status;
+}
+
+/******************************************************/
+
+int bm_hop( int iterations )
+{
+    static const int            divisors[3] = { 1, 2, 4 };
+    static const int            batches[2] = { 1, FE_FFT_BATCH };
+    fe_extraction_info          info;
+    fe_extraction_thread_data   data[2];
+    LARGE_INTEGER               t_start, t_end;
+    double                      seconds[2];
+    double                      difference, max_difference;
+    float                       *input = NULL;
+    long                        length, position;
+    int                         frames[2];
+    int                         d, b, i;
+    int                         status = 0;
+
+    data[0].init_success = 0;
+    data[1].init_success = 0;
+
+    fe_initialize_extraction_info( &info );
+    if( !info.init_success )
+    {
+        fprintf( stderr, "Error: Could not initialize the hop benchmark\n" );
+        status = -1;
+        goto exit;
+    }
+
+    /* Enough samples for the frames at the smallest hop, rounded up to whole buffers */
+    length = (long)( iterations + FE_FFT_BATCH ) * info.frame_length + info.frame_length + info.buffer_length;
+    input = (float*)malloc( sizeof(float) * NUM_CHANNELS * length );
+    if( input == NULL )
+    {
+        fprintf( stderr, "Error: Could not allocate memory for the hop benchmark\n" );
+        status = -1;
+        goto exit;
+    }
+
+    /* A tone sweeping up and down, plus noise, so the flux and contrast features keep changing */
+    srand( 1 );
+    for( i=0; i<length; i++ )
+    {
+        *(input + 2*i) =    0.5 * sin( 2*PI*( 220 + 200 * sin( 2*PI*0.5*i/info.fs ) )*i/info.fs ) +
+                            0.01 * ( (float)rand()/RAND_MAX - 0.5 );
+        *(input + 2*i+1) =  *(input + 2*i);
+    }
+
+    printf( "Overlapping frames of %d samples, device buffers of %d samples, ring drained every %d hops\n",
+            info.frame_length, info.buffer_length, FE_FFT_BATCH );
+    printf( "     hop  frames/s  resolution   single us/frame  batched us/frame  speedup  load  max difference\n" );
+    for( d=0; d<3; d++ )
+    {
+        fe_set_hop_length( &info, info.frame_length / divisors[d] );
+
+        for( b=0; b<2; b++ )
+        {
+            data[b] = fe_initialize_extraction_thread_data( &info );
+            if( !data[b].init_success )
+            {
+                fprintf( stderr, "Error: Could not initialize the hop benchmark\n" );
+                status = -1;
+                goto exit;
+            }
+
+            /* Only the analysis is timed, the callbacks stand in for the audio device */
+            seconds[b] = 0;
+            frames[b] = 0;
+            for( position=0; frames[b] < iterations && position + info.buffer_length <= length; position += info.buffer_length )
+            {
+                paCallBack( input + NUM_CHANNELS*position, NULL, info.buffer_length, NULL, 0, &data[b] );
+                if( fe_ring_read_available( &data[b].ring ) < (unsigned int)( info.frame_length + ( FE_FFT_BATCH-1 ) * info.hop_length ) )
+                    continue;
+
+                QueryPerformanceCounter( &t_start );
+                while( fe_analyse_pending( &data[b], batches[b] ) > 0 )
+                    ;
+                QueryPerformanceCounter( &t_end );
+                seconds[b] += bm_seconds( t_start, t_end );
+                frames[b] = data[b].frames_completed;
+            }
+        }
+
+        /* Both analysed the same frames, so their running sums should agree */
+        max_difference = 0;
+        for( i=0; i<info.num_timbre_features; i++ )
+        {
+            difference = fabs( *(data[0].timbre_sum + i) - *(data[1].timbre_sum + i) ) /
+                         ( fabs( *(data[0].timbre_sum + i) ) + 1e-12 );
+            if( difference > max_difference )
+                max_difference = difference;
+        }
+        if( frames[0] != frames[1] || max_difference > BM_HOP_TOLERANCE )
+            status = 1;
+
+        printf( "  %6d  %8.1f  %7.1f ms  %16.2f  %16.2f  %6.2fx  %3.0f%%  %.3g %s\n",
+                info.hop_length, (double)info.fs / info.hop_length, 1000.0 * info.hop_length / info.fs,
+                1e6 * seconds[0] / frames[0], 1e6 * seconds[1] / frames[1], seconds[0] / seconds[1],
+                100.0 * seconds[1] / frames[1] * info.fs / info.hop_length, max_difference,
+                ( frames[0] != frames[1] || max_difference > BM_HOP_TOLERANCE ) ? "(OUT OF TOLERANCE)" : "" );
+
+        for( b=0; b<2; b++ )
+        {
+            fe_clean_extraction_thread_data( &data[b] );
+            data[b].init_success = 0;
+        }
+    }
+
+exit:
+    free( input );
+    for( b=0; b<2; b++ )
+        if( data[b].init_success )
+            fe_clean_extraction_thread_data( &data[b] );
+    fe_clean_extraction_info( &info );
+
+    return status;
+}
+
+/******************************************************/
+
+/** @brief Returns the private memory committed by the process, in bytes */
+static SIZE_T bm_private_bytes( void )
+{
+    PROCESS_MEMORY_COUNTERS_EX counters;
+
+    if( !GetProcessMemoryInfo( GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&counters, sizeof(counters) ) )
+        return 0;
+
+    return counters.PrivateUsage;
+}
+
+/** @brief Returns the process's working set, the memory resident in RAM, or 0 if it could not be read */
+static SIZE_T bm_working_set( void )
+{
+    PROCESS_MEMORY_COUNTERS counters;
+
+    if( !GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof(counters) ) )
+        return 0;
+
+    return counters.WorkingSetSize;
+}
+
+/******************************************************/
+
+int bm_streams( int iterations )
+{
+    static const int    counts[7] = { 1, 2, 4, 8, 16, 32, 64 };
+    const int           num_counts = sizeof(counts) / sizeof(int);
+    ms_engine           *engines = NULL;
+    ms_stream           *stream;
+    SYSTEM_INFO         systemInfo;
+    SIZE_T              memory[7];
+    SIZE_T              before;
+    LARGE_INTEGER       t_start, t_end;
+    double              seconds, audio_seconds;
+    float               *input = NULL;
+    float               reference[2] = { 0, 0 };    /* Prediction of the first stream of the first engine */
+    float               arousal, valence;
+    long                length, position;
+    int                 frames, expected;
+    int                 num_threads, num_engines = 0, mismatches;
+    int                 c, k, i;
+    int                 status = 0;
+
+    GetSystemInfo( &systemInfo );
+    num_threads = ( systemInfo.dwNumberOfProcessors < MS_MAX_THREADS ) ? (int)systemInfo.dwNumberOfProcessors : MS_MAX_THREADS;
+    frames = ( iterations / 10 > 0 ) ? iterations / 10 : 1;
+
+    engines = (ms_engine*)malloc( sizeof(ms_engine) * num_counts );
+    if( engines == NULL )
+    {
+        fprintf( stderr, "Error: Could not allocate memory for the streams benchmark\n" );
+        return -1;
+    }
+
+    /* Every engine stays allocated until the end, so the memory of one is not reused by the next */
+    for( c=0; c<num_counts; c++ )
+    {
+        before = bm_private_bytes();
+        ms_initialize_engine( engines + c, counts[c], num_threads );
+        memory[c] = bm_private_bytes() - before;
+        num_engines++;
+        if( !( engines + c )->init_success )
+        {
+            fprintf( stderr, "Error: Could not initialize an engine of %d streams\n", counts[c] );
+            status = -1;
+            goto exit;
+        }
+    }
+
+    /* The same tone sweep for every stream, in whole device buffers */
+    length = (long)frames * engines->info.hop_length + engines->info.frame_length;
+    length = ( length + engines->info.buffer_length - 1 ) / engines->info.buffer_length * engines->info.buffer_length;
+    input = (float*)malloc( sizeof(float) * NUM_CHANNELS * length );
+    if( input == NULL )
+    {
+        fprintf( stderr, "Error: Could not allocate memory for the streams benchmark\n" );
+        status = -1;
+        goto exit;
+    }
+    srand( 1 );
+    for( i=0; i<length; i++ )
+    {
+        *(input + 2*i) =    0.5 * sin( 2*PI*( 220 + 200 * sin( 2*PI*0.5*i/FS ) )*i/FS ) + 0.01 * ( (float)rand()/RAND_MAX - 0.5 );
+        *(input + 2*i+1) =  *(input + 2*i);
+    }
+    expected = ( length - engines->info.frame_length ) / engines->info.hop_length + 1;
+    audio_seconds = (double)length / engines->info.fs;
+
+    printf( "Multi-stream engines, models and FFTW plans shared, %d worker threads\n", num_threads );
+    printf( "  memory of the 1 stream engine:  %8.1f KB\n", memory[0] / 1024.0 );
+    printf( "  memory per additional stream:   %8.1f KB (from the %d stream engine)\n",
+            (double)( memory[num_counts-1] - memory[0] ) / ( counts[num_counts-1] - 1 ) / 1024.0, counts[num_counts-1] );
+    printf( "  %d frames (%.1f s of audio) per stream\n", expected, audio_seconds );
+    printf( "  streams  memory KB   seconds  frames/s  real-time  per stream  identical\n" );
+
+    for( c=0; c<num_counts; c++ )
+    {
+        if( !ms_start_engine( engines + c ) )
+        {
+            fprintf( stderr, "Error: Could not start the workers of the %d stream engine\n", counts[c] );
+            status = -1;
+            goto exit;
+        }
+
+        /* This thread plays every input device, waiting when a stream's ring is full */
+        QueryPerformanceCounter( &t_start );
+        for( position=0; position<length; position+=engines->info.buffer_length )
+        {
+            for( k=0; k<counts[c]; k++ )
+            {
+                stream = ( engines + c )->streams + k;
+                while( fe_ring_write_space( &stream->extraction.ring ) < (unsigned int)engines->info.buffer_length )
+                    Sleep( 0 );
+                ms_callback( input + NUM_CHANNELS*position, NULL, engines->info.buffer_length, NULL, 0, stream );
+            }
+        }
+        for( k=0; k<counts[c]; k++ )
+            while( ( ( engines + c )->streams + k )->extraction.frames_completed < expected ||
+                   ( ( engines + c )->streams + k )->busy )
+                Sleep( 1 );
+        QueryPerformanceCounter( &t_end );
+        seconds = bm_seconds( t_start, t_end );
+        ms_stop_engine( engines + c );
+
+        /* Every stream analysed the same samples, so its last prediction must be that of the first engine */
+        mismatches = 0;
+        for( k=0; k<counts[c]; k++ )
+        {
+            ms_read_prediction( ( engines + c )->streams + k, &arousal, &valence );
+            if( c == 0 && k == 0 )
+            {
+                reference[0] = arousal;
+                reference[1] = valence;
+            }
+            mismatches += ( arousal != reference[0] || valence != reference[1] );
+        }
+        if( mismatches > 0 )
+            status = 1;
+
+        printf( "  %7d  %9.1f  %8.2f  %8.0f  %8.1fx  %9.1fx  %s\n", counts[c], memory[c] / 1024.0, seconds,
+                counts[c] * expected / seconds, counts[c] * audio_seconds / seconds, audio_seconds / seconds,
+                mismatches == 0 ? "yes" : "NO" );
+    }
+
+exit:
+    free( input );
+    for( c=0; c<num_engines; c++ )
+        ms_clean_engine( engines + c );
+    free( engines );
+
+    return status;
+}
+
+/******************************************************/
+
+/** @brief The texture update before the transfer tables: both pow() calls for every pixel, from unquantized
+    saturation and value */
+static void bm_modulate_pow( Uint32 *pixels, int w, int h, const SDL_PixelFormat *format, const float *hsv,
+                             float arousal, float valence )
+{
+    float   beta, gamma;
+    float   s_temp, v_temp;
+    int     r, g, b;
+    int     i;
+
+    id_modulation_exponents( arousal, valence, &beta, &gamma );
+
+    for( i=0; i<w*h; i++ )
+    {
+        s_temp = (float)pow( (double)*(hsv + 3*i+1), (double)beta );
+        v_temp = (float)pow( (double)*(hsv + 3*i+2), (double)gamma );
+
+        HSVtoRGB( &r, &g, &b, *(hsv + 3*i), s_temp, v_temp );
+
+        r = (r > 255) ? 255 : r;
+        g = (g > 255) ? 255 : g;
+        b = (b > 255) ? 255 : b;
+
+        *(pixels + i) = SDL_MapRGB( format, (Uint8)r, (Uint8)g, (Uint8)b );
+    }
+
+    return;
+}
+
+/******************************************************/
+
+int bm_display( int iterations )
+{
+    static const int    sizes[4][2] = { { 640, 480 }, { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+    static const float  moods[5] = { -0.9f, -0.5f, 0.0f, 0.5f, 0.9f };
+    const int           num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+    const int           num_moods = sizeof(moods) / sizeof(float);
+    id_pixel_packer     packer;
+    id_hsv_planes       quantized;
+    id_transfer_lut     lut;
+    float               *hsv = NULL;
+    Uint32              *reference = NULL;
+    Uint32              *pixels = NULL;
+    LARGE_INTEGER       t_start, t_end;
+    double              pow_seconds, lut_seconds;
+    double              curve_error, max_curve_error = 0;
+    float               beta, gamma;
+    int                 w, h, updates;
+    int                 channel_error, max_channel_error = 0;
+    int                 c, k, a, v, i, j;
+    int                 status = 0;
+
+    packer.format = NULL;
+    quantized.memory = NULL;
+    id_initialize_pixel_packer( &packer, SDL_PIXELFORMAT_ARGB8888, NULL );
+    hsv = (float*)malloc( sizeof(float) * 3 * sizes[num_sizes-1][0] * sizes[num_sizes-1][1] );
+    reference = (Uint32*)malloc( sizeof(Uint32) * sizes[num_sizes-1][0] * sizes[num_sizes-1][1] );
+    pixels = (Uint32*)malloc( sizeof(Uint32) * sizes[num_sizes-1][0] * sizes[num_sizes-1][1] );
+    if( packer.format == NULL || hsv == NULL || reference == NULL || pixels == NULL )
+    {
+        fprintf( stderr, "Error: Could not allocate memory for the display benchmark\n" );
+        status = -1;
+        goto exit;
+    }
+
+    printf( "Texture update with per-update transfer tables (%d saturation, %d value levels) against pow() per pixel\n",
+            ID_SATURATION_LEVELS, ID_VALUE_LEVELS );
+    printf( "  HSV storage: %d bytes per pixel in planes (was %d)\n", (int)( 2 * sizeof(Uint16) + sizeof(Uint8) ),
+            (int)( 3 * sizeof(float) ) );
+    printf( "       size  updates   pow ms/update   table ms/update   speedup   max channel error\n" );
+
+    for( c=0; c<num_sizes; c++ )
+    {
+        w = sizes[c][0];
+        h = sizes[c][1];
+        id_free_hsv_planes( &quantized );
+        if( !id_allocate_hsv_planes( &quantized, w, h ) )
+        {
+            fprintf( stderr, "Error: Could not allocate the HSV planes of a %dx%d image\n", w, h );
+            status = -1;
+            goto exit;
+        }
+
+        /* Gradients of every hue, saturation and value with noise, so that every level is reached */
+        srand( 1 );
+        for( i=0; i<w*h; i++ )
+        {
+            RGBtoHSV( ( i % w ) * 255 / w,
+                      ( i / w ) * 255 / h,
+                      ( ( i % w ) + ( i / w ) + rand() % 64 ) % 256,
+                      hsv + 3*i, hsv + 3*i+1, hsv + 3*i+2 );
+            id_quantize_hsv( &quantized, ( i / w ) * quantized.stride + i % w,
+                             *(hsv + 3*i), *(hsv + 3*i+1), *(hsv + 3*i+2) );
+        }
+
+        /* The pixels of both updates and the transfer curves at the unquantized saturation and value, on both
+           diagonals of the arousal-valence plane */
+        channel_error = 0;
+        for( a=0; a<num_moods; a++ )
+        {
+            for( v=0; v<num_moods; v++ )
+            {
+                if( v != a && v != num_moods - 1 - a )
+                    continue;
+                id_modulation_exponents( moods[a], moods[v], &beta, &gamma );
+                id_build_transfer_lut( &lut, beta, gamma );
+                id_modulate_pixels( pixels, 4*w, &packer, &quantized, 0, h, &lut );
+                bm_modulate_pow( reference, w, h, packer.format, hsv, moods[a], moods[v] );
+
+                for( i=0; i<w*h; i++ )
+                {
+                    j = ( i / w ) * quantized.stride + i % w;
+                    for( k=0; k<24; k+=8 )
+                        if( abs( (int)( ( *(pixels + i) >> k ) & 0xFF ) - (int)( ( *(reference + i) >> k ) & 0xFF ) ) > channel_error )
+                            channel_error = abs( (int)( ( *(pixels + i) >> k ) & 0xFF ) - (int)( ( *(reference + i) >> k ) & 0xFF ) );
+
+                    curve_error = fabs( *(lut.s + *(quantized.saturation + j)) - pow( (double)*(hsv + 3*i+1), (double)beta ) );
+                    if( curve_error > max_curve_error )
+                        max_curve_error = curve_error;
+                    curve_error = fabs( *(lut.v + *(quantized.value + j)) - pow( (double)*(hsv + 3*i+2), (double)gamma ) );
+                    if( curve_error > max_curve_error )
+                        max_curve_error = curve_error;
+                }
+            }
+        }
+        if( channel_error > max_channel_error )
+            max_channel_error = channel_error;
+
+        /* About iterations / 200 updates of a 640x480 image, fewer for larger images */
+        updates = (int)( (double)iterations / 200 * 640 * 480 / ( (double)w * h ) );
+        if( updates < 1 )
+            updates = 1;
+
+        QueryPerformanceCounter( &t_start );
+        for( k=0; k<updates; k++ )
+            bm_modulate_pow( reference, w, h, packer.format, hsv, moods[k % num_moods], moods[( k / num_moods ) % num_moods] );
+        QueryPerformanceCounter( &t_end );
+        pow_seconds = bm_seconds( t_start, t_end ) / updates;
+
+        QueryPerformanceCounter( &t_start );
+        for( k=0; k<updates; k++ )
+        {
+            id_modulation_exponents( moods[k % num_moods], moods[( k / num_moods ) % num_moods], &beta, &gamma );
+            id_build_transfer_lut( &lut, beta, gamma );
+            id_modulate_pixels( pixels, 4*w, &packer, &quantized, 0, h, &lut );
+        }
+        QueryPerformanceCounter( &t_end );
+        lut_seconds = bm_seconds( t_start, t_end ) / updates;
+
+        printf( "  %4dx%-4d  %7d  %14.2f  %16.2f  %7.1fx   %17d\n", w, h, updates, 1000 * pow_seconds,
+                1000 * lut_seconds, pow_seconds / lut_seconds, channel_error );
+    }
+
+    printf( "  largest transfer curve error against pow(): %.2e\n", max_curve_error );
+    if( max_channel_error > BM_DISPLAY_TOLERANCE )
+    {
+        printf( "  FAILED: a channel differed by %d levels (tolerance %d)\n", max_channel_error, BM_DISPLAY_TOLERANCE );
+        status = 1;
+    }
+
+exit:
+    id_clean_pixel_packer( &packer );
+    free( hsv );
+    id_free_hsv_planes( &quantized );
+    free( reference );
+    free( pixels );
+
+    return status;
+}
+
+/******************************************************/
+
+int bm_convert( int iterations )
+{
+    static const Uint32 formats[3] = { SDL_PIXELFORMAT_ARGB8888, SDL_PIXELFORMAT_RGB888, SDL_PIXELFORMAT_ABGR8888 };
+    static const char   *format_names[3] = { "ARGB8888", "XRGB8888", "ABGR8888" };
+    static const float  moods[4][2] = { { 0.0f, 0.0f }, { -0.7f, 0.6f }, { 0.8f, -0.8f }, { 1.0f, 1.0f } };
+    const char          *names[4] = { "scalar", "SSE2", "AVX2", "AVX-512" };
+    id_convert_kernel   kernels[4] = { id_convert_scalar, id_convert_sse2, id_convert_avx2, id_convert_avx512 };
+    const int           w = 1931;   /* Not a multiple of 16, so every kernel runs its remainder loop */
+    const int           h = 1080;
+    id_pixel_packer     packer;
+    id_transfer_lut     lut;
+    id_hsv_planes       hsv;
+    Uint32              *reference = NULL;
+    Uint32              *pixels = NULL;
+    LARGE_INTEGER       t_start, t_end;
+    double              seconds;
+    float               beta, gamma;
+    int                 level = fe_simd_level();
+    int                 updates, mismatches;
+    int                 c, k, m, i, j;
+    int                 status = 0;
+
+    packer.format = NULL;
+    hsv.memory = NULL;
+    reference = (Uint32*)malloc( sizeof(Uint32) * w * h );
+    pixels = (Uint32*)malloc( sizeof(Uint32) * w * h );
+    if( !id_allocate_hsv_planes( &hsv, w, h ) || reference == NULL || pixels == NULL )
+    {
+        fprintf( stderr, "Error: Could not allocate memory for the convert benchmark\n" );
+        status = -1;
+        goto exit;
+    }
+
+    /* Random pixels, with the grey pixels (undefined hue) and the hue of 360 that RGBtoHSV() can give */
+    srand( 1 );
+    for( i=0; i<w*h; i++ )
+    {
+        j = ( i / w ) * hsv.stride + i % w;
+        if( i % 97 == 0 )
+            id_quantize_hsv( &hsv, j, -1, 0, (float)( rand() % 256 ) / 255 );
+        else
+            id_quantize_hsv( &hsv, j, ( i % 89 == 0 ) ? 360.0f : 360.0f * rand() / ( (float)RAND_MAX + 1 ),
+                             (float)rand() / RAND_MAX, (float)( rand() % 256 ) / 255 );
+    }
+    updates = ( iterations / 100 > 0 ) ? iterations / 100 : 1;
+
+    printf( "HSV to RGB conversion of a %dx%d image, %d updates timed per kernel\n", w, h, updates );
+    printf( "  %-8s  %-10s  ms/update  Mpixels/s  bit exact\n", "format", "kernel" );
+
+    for( c=0; c<3; c++ )
+    {
+        id_clean_pixel_packer( &packer );
+        if( !id_initialize_pixel_packer( &packer, formats[c], NULL ) )
+        {
+            fprintf( stderr, "Error: Could not allocate the %s pixel format\n", format_names[c] );
+            status = -1;
+            goto exit;
+        }
+
+        /* Every kernel against HSVtoRGB() and SDL_MapRGB() per pixel, at moods that include the zero saturation
+           exponent of full arousal */
+        mismatches = 0;
+        for( m=0; m<4; m++ )
+        {
+            id_modulation_exponents( moods[m][0], moods[m][1], &beta, &gamma );
+            id_build_transfer_lut( &lut, beta, gamma );
+
+            packer.convert = NULL;
+            id_modulate_pixels( reference, 4*w, &packer, &hsv, 0, h, &lut );
+            for( k=0; k<=level; k++ )
+            {
+                packer.convert = kernels[k];
+                id_modulate_pixels( pixels, 4*w, &packer, &hsv, 0, h, &lut );
+                mismatches += memcmp( reference, pixels, sizeof(Uint32) * w * h ) != 0;
+            }
+        }
+        if( mismatches > 0 )
+            status = 1;
+
+        /* kernel -1 is the SDL_MapRGB() reference */
+        for( k=-1; k<=level; k++ )
+        {
+            packer.convert = ( k < 0 ) ? NULL : kernels[k];
+
+            QueryPerformanceCounter( &t_start );
+            for( i=0; i<updates; i++ )
+                id_modulate_pixels( pixels, 4*w, &packer, &hsv, 0, h, &lut );
+            QueryPerformanceCounter( &t_end );
+            seconds = bm_seconds( t_start, t_end ) / updates;
+
+            printf( "  %-8s  %-10s  %9.2f  %9.1f  %s\n", format_names[c], ( k < 0 ) ? "SDL_MapRGB" : names[k],
+                    1000 * seconds, w * h / seconds / 1e6, ( k < 0 ) ? "-" : ( mismatches == 0 ? "yes" : "NO" ) );
+        }
+    }
+    if( status == 1 )
+        printf( "  A kernel does not match HSVtoRGB() and SDL_MapRGB()\n" );
+
+exit:
+    id_clean_pixel_packer( &packer );
+    id_free_hsv_planes( &hsv );
+    free( reference );
+    free( pixels );
+
+    return status;
+}
+
+/******************************************************/
+
+int bm_tiles( int iterations )
+{
+    static const int    sizes[3][2] = { { 1920, 1080 }, { 3840, 2160 }, { 7680, 4320 } };
+    static const char   *size_names[3] = { "1080p", "4K", "8K" };
+    const int           num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+    id_tile_pool        *pool = NULL;
+    id_pixel_packer     packer;
+    id_transfer_lut     lut;
+    id_hsv_planes       hsv;
+    SYSTEM_INFO         systemInfo;
+    Uint32              *image = NULL;
+    Uint32              *reference = NULL;
+    Uint32              *pixels = NULL;
+    LARGE_INTEGER       t_start, t_end;
+    double              rate, single_rate = 0;
+    SIZE_T              before, resident;
+    float               beta, gamma;
+    int                 max_threads, num_threads;
+    int                 w, h, updates, identical;
+    int                 c, k, i;
+    int                 status = 0;
+
+    GetSystemInfo( &systemInfo );
+    max_threads = ( systemInfo.dwNumberOfProcessors < ID_MAX_THREADS ) ? (int)systemInfo.dwNumberOfProcessors : ID_MAX_THREADS;
+
+    packer.format = NULL;
+    hsv.memory = NULL;
+    pool = (id_tile_pool*)malloc( sizeof(id_tile_pool) );
+    if( pool == NULL || !id_initialize_pixel_packer( &packer, SDL_PIXELFORMAT_ARGB8888, NULL ) )
+    {
+        fprintf( stderr, "Error: Could not allocate memory for the tiles benchmark\n" );
+        status = -1;
+        goto exit;
+    }
+    id_modulation_exponents( 0.3f, -0.4f, &beta, &gamma );
+    id_build_transfer_lut( &lut, beta, gamma );
+
+    printf( "Texture updates in tiles of %d rows on 1 to %d worker threads\n", ID_TILE_ROWS, max_threads );
+    printf( "  HSV storage: %d bytes per pixel in planes (was %d)\n", (int)( 2 * sizeof(Uint16) + sizeof(Uint8) ),
+            (int)( 3 * sizeof(float) ) );
+    printf( "  size   threads  HSV resident MB  updates/s  speedup  identical\n" );
+
+    for( c=0; c<num_sizes; c++ )
+    {
+        w = sizes[c][0];
+        h = sizes[c][1];
+        image =     (Uint32*)malloc( sizeof(Uint32) * w * h );
+        reference = (Uint32*)malloc( sizeof(Uint32) * w * h );
+        pixels =    (Uint32*)malloc( sizeof(Uint32) * w * h );
+        if( image == NULL || reference == NULL || pixels == NULL )
+        {
+            fprintf( stderr, "Error: Could not allocate memory for a %dx%d image\n", w, h );
+            status = -1;
+            goto exit;
+        }
+
+        srand( 1 );
+        for( i=0; i<w*h; i++ )
+            *(image + i) = 0xFF000000 | ( ( ( i % w ) * 255 / w ) << 16 ) | ( ( ( i / w ) * 255 / h ) << 8 ) | ( rand() % 256 );
+
+        /* About iterations / 20 updates at 1080p, fewer for larger images */
+        updates = (int)( (double)iterations / 20 * 1920 * 1080 / ( (double)w * h ) );
+        if( updates < 2 )
+            updates = 2;
+
+        /* 1, 2, 4, ... threads and one per processor */
+        for( num_threads=1; ; num_threads*=2 )
+        {
+            if( num_threads > max_threads )
+                num_threads = max_threads;
+
+            /* A new pool and HSV planes for each count, first touched by the pool's workers as in the live program.
+               The growth of the working set is the memory the planes keep resident */
+            id_initialize_tile_pool( pool, num_threads );
+            before = bm_working_set();
+            if( !pool->init_success || !id_allocate_hsv_planes( &hsv, w, h ) )
+            {
+                fprintf( stderr, "Error: Could not start %d tile workers\n", num_threads );
+                status = -1;
+                goto exit;
+            }
+            id_convert_to_hsv_tiled( pool, image, 4*w, packer.format, &hsv );
+            resident = bm_working_set() - before;
+
+            if( num_threads == 1 )
+                id_modulate_pixels( reference, 4*w, &packer, &hsv, 0, h, &lut );
+            id_modulate_pixels_tiled( pool, pixels, 4*w, &packer, &hsv, &lut );
+            identical = ( memcmp( reference, pixels, sizeof(Uint32) * w * h ) == 0 );
+            if( !identical )
+                status = 1;
+
+            QueryPerformanceCounter( &t_start );
+            for( k=0; k<updates; k++ )
+                id_modulate_pixels_tiled( pool, pixels, 4*w, &packer, &hsv, &lut );
+            QueryPerformanceCounter( &t_end );
+            rate = updates / bm_seconds( t_start, t_end );
+            if( num_threads == 1 )
+                single_rate = rate;
+
+            printf( "  %-5s  %7d  %15.1f  %9.1f  %6.2fx  %s\n", size_names[c], num_threads, resident / 1048576.0, rate,
+                    rate / single_rate, identical ? "yes" : "NO" );
+
+            id_clean_tile_pool( pool );
+            id_free_hsv_planes( &hsv );
+            if( num_threads == max_threads )
+                break;
+        }
+
+        free( image );
+        free( reference );
+        free( pixels );
+        image = reference = pixels = NULL;
+    }
+    if( status == 1 )
+        printf( "  A tiled update does not match the update of the whole image\n" );
+
+exit:
+    if( pool != NULL && pool->init_success )
+        id_clean_tile_pool( pool );
+    free( pool );
+    id_clean_pixel_packer( &packer );
+    id_free_hsv_planes( &hsv );
+    free( image );
+    free( reference );
+    free( pixels );
+
+    return status;
+}
@@ -22,9 +22,15 @@
  */
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <windows.h>
+#include <process.h>
 #include <fftw3.h>
 #include <math.h>
 #include <portaudio.h>
+#include <cpuid.h>
 #include "featureExtraction.h"
 
 #ifndef PI
@@ -38,6 +44,70 @@ int fe_compare( const void *a, const void *b )
 
 /******************************************************/
 
+static inline void fe_swap( float *a, float *b )
+{
+    float temp = *a;
+
+    *a = *b;
+    *b = temp;
+}
+
+/******************************************************/
+
+void fe_select( float *values, int num, int k )
+{
+    int     lo = 0;
+    int     hi = num - 1;
+    int     i, j, mid;
+    int     depth = 0;
+    float   pivot;
+
+    /* Allow about twice the partitions of balanced splits before giving up on quickselect */
+    for( i=num; i>1; i>>=1 )
+        depth += 2;
+
+    while( hi > lo )
+    {
+        if( depth-- == 0 )
+        {
+            qsort( values+lo, hi-lo+1, sizeof(float), fe_compare );
+            return;
+        }
+
+        /* Order the first, middle and last elements, the median is the pivot and the outer two stop the scans */
+        mid = lo + (hi-lo)/2;
+        if( *(values+mid) < *(values+lo) )
+            fe_swap( values+mid, values+lo );
+        if( *(values+hi) < *(values+lo) )
+            fe_swap( values+hi, values+lo );
+        if( *(values+hi) < *(values+mid) )
+            fe_swap( values+hi, values+mid );
+        pivot = *(values+mid);
+
+        i = lo;
+        j = hi;
+        while( i <= j )
+        {
+            while( *(values+i) < pivot )
+                i++;
+            while( *(values+j) > pivot )
+                j--;
+            if( i <= j )
+                fe_swap( values + i++, values + j-- );
+        }
+
+        /* values[lo..j] <= pivot <= values[i..hi], anything between equals the pivot */
+        if( k <= j )
+            hi = j;
+        else if( k >= i )
+            lo = i;
+        else
+            return;
+    }
+}
+
+/******************************************************/
+
 float fe_mean( float *values, int num )
 {
     int     i;
@@ -58,7 +128,7 @@ float fe_stdv( float *values, int num )
     float   mean = fe_mean( values, num );
 
     for( i=0; i<num; i++ )
-        sum += (float)pow( (double)( *(values+i) - mean ), 2 );
+        sum += ( *(values+i) - mean ) * ( *(values+i) - mean );
 
     return (float)sqrt( (double)( sum / (float)(num-1) ) );
 }
@@ -77,17 +147,7 @@ void fe_hamming_win( float *win, int N )
 
 void fe_compute_magnitude( fftwf_complex *fft, float *magnitude, int N )
 {
-    int     i;
-    float   a, b;
-
-    for( i=0; i<N; i++ )
-    {
-        a = *(*fft);     /* Dereferencing fft returns a pointer to a float (the real part of the fftwf_complex type) */
-        b = *(*fft+1);   /* Increment the pointer to the float to access the imaginary part of the fftwf_complex type */
-        *magnitude = (float)sqrt( (double)( pow((double)a,2) + pow((double)b,2) ) );
-        fft++;
-        magnitude++;
-    }
+    fe_magnitude_scalar( fft, magnitude, N );
 }
 
 /******************************************************/
@@ -100,15 +160,185 @@ void fe_autocorrelate( float *x, float *ac, int N )
     for( i=0; i<(int)(N/2); i++ )
     {
         sum = 0;
-        for( j=0; j<N; j++ )
+        for( j=0; j<N-i; j++ )      /* Split where x+j+i wraps around instead of testing every term */
+            sum += (*(x+j)) * (*(x+j+i));
+        for( ; j<N; j++ )
+            sum += (*(x+j)) * (*(x+j+i-N));
+        *(ac+i) = sum;
+    }
+}
+
+/******************************************************/
+
+int fe_autocorrelation_init( fe_autocorrelation *ac, int N, int method, fe_extraction_info *info )
+{
+    int i;
+
+    ac->method =        method;
+    ac->length =        N;
+    ac->lags =          (int)(N/2);
+    ac->fft_signal =    NULL;
+    ac->fft_power =     NULL;
+    ac->fft_lags =      NULL;
+    ac->forward =       NULL;
+    ac->inverse =       NULL;
+    ac->running =       NULL;
+    ac->updates =       0;
+
+    ac->result = (float*)malloc( sizeof(float) * ( ac->lags > 0 ? ac->lags : 1 ) );
+    if( ac->result == NULL )
+        goto error;
+
+    if( method == FE_AC_FFT )
+    {
+        ac->fft_signal =    (float*)fftwf_malloc( sizeof(float) * N );
+        ac->fft_power =     (fftwf_complex*)fftwf_malloc( sizeof(fftwf_complex) * (N/2+1) );
+        ac->fft_lags =      (float*)fftwf_malloc( sizeof(float) * N );
+        if( ac->fft_signal == NULL || ac->fft_power == NULL || ac->fft_lags == NULL )
+            goto error;
+
+        ac->forward = fe_plan_r2c( info, N, ac->fft_signal, ac->fft_power );
+        ac->inverse = fe_plan_c2r( info, N, ac->fft_power, ac->fft_lags );
+        if( ac->forward == NULL || ac->inverse == NULL )
         {
-            if( i+j < N )
-                sum += (*(x+j)) * (*(x+j+i));
-            else
-                sum += (*(x+j)) * (*(x+j+i-N));
+            printf( "Error: Could not create fftw plan\n" );
+            goto error;
         }
-        *(ac+i) = sum;
     }
+    else if( method == FE_AC_INCREMENTAL )
+    {
+        ac->running = (double*)malloc( sizeof(double) * ( ac->lags > 0 ? ac->lags : 1 ) );
+        if( ac->running == NULL )
+            goto error;
+        for( i=0; i<ac->lags; i++ )
+            *(ac->running + i) = 0;
+    }
+
+    return 1;
+
+error:
+    fe_autocorrelation_free( ac );
+    return 0;
+}
+
+/******************************************************/
+
+void fe_autocorrelation_free( fe_autocorrelation *ac )
+{
+    if( ac->forward != NULL )
+        fftwf_destroy_plan( ac->forward );
+    if( ac->inverse != NULL )
+        fftwf_destroy_plan( ac->inverse );
+    fftwf_free( ac->fft_signal );
+    fftwf_free( ac->fft_power );
+    fftwf_free( ac->fft_lags );
+    free( ac->running );
+    free( ac->result );
+
+    ac->forward =       NULL;
+    ac->inverse =       NULL;
+    ac->fft_signal =    NULL;
+    ac->fft_power =     NULL;
+    ac->fft_lags =      NULL;
+    ac->running =       NULL;
+    ac->result =        NULL;
+}
+
+/******************************************************/
+
+void fe_autocorrelate_fft( fe_autocorrelation *ac, const float *x, float *out )
+{
+    int     i;
+    float   a, b;
+    float   scale = 1.0f / ac->length;     /* FFTW's transforms are unnormalized */
+
+    memcpy( ac->fft_signal, x, sizeof(float) * ac->length );
+    fftwf_execute( ac->forward );
+
+    /* The circular autocorrelation is the inverse transform of the power spectrum */
+    for( i=0; i<ac->length/2+1; i++ )
+    {
+        a = *( *(ac->fft_power + i) );
+        b = *( *(ac->fft_power + i) + 1 );
+        *( *(ac->fft_power + i) ) =     a*a + b*b;
+        *( *(ac->fft_power + i) + 1 ) = 0;
+    }
+    fftwf_execute( ac->inverse );
+
+    for( i=0; i<ac->lags; i++ )
+        *(out+i) = *(ac->fft_lags + i) * scale;
+}
+
+/******************************************************/
+
+void fe_autocorrelation_update( fe_autocorrelation *ac, const float *x, int position, float old_value )
+{
+    int     k;
+    int     N = ac->length;
+    double  new_value = *(x + position);
+    double  change = new_value - old_value;
+
+    if( ac->method != FE_AC_INCREMENTAL || ac->lags == 0 )
+        return;
+
+    if( ++(ac->updates) >= STATS_RESYNC_FRAMES )
+    {
+        fe_autocorrelation_resync( ac, x );
+        return;
+    }
+
+    /* Lag k holds the products x[j]*x[j+k], the sample only appears in those with j = position and j+k = position */
+    *(ac->running) += new_value * new_value - (double)old_value * old_value;
+    for( k=1; k<ac->lags && position+k < N; k++ )
+        *(ac->running + k) += change * *(x + position + k);
+    for( ; k<ac->lags; k++ )
+        *(ac->running + k) += change * *(x + position + k - N);
+    for( k=1; k<ac->lags && k <= position; k++ )
+        *(ac->running + k) += change * *(x + position - k);
+    for( ; k<ac->lags; k++ )
+        *(ac->running + k) += change * *(x + position - k + N);
+}
+
+/******************************************************/
+
+void fe_autocorrelation_resync( fe_autocorrelation *ac, const float *x )
+{
+    int     i, j;
+    int     N = ac->length;
+    double  sum;
+
+    if( ac->method != FE_AC_INCREMENTAL )
+        return;
+
+    for( i=0; i<ac->lags; i++ )
+    {
+        sum = 0;
+        for( j=0; j<N-i; j++ )
+            sum += (double)*(x+j) * *(x+j+i);
+        for( ; j<N; j++ )
+            sum += (double)*(x+j) * *(x+j+i-N);
+        *(ac->running + i) = sum;
+    }
+    ac->updates = 0;
+}
+
+/******************************************************/
+
+const float *fe_autocorrelation_compute( fe_autocorrelation *ac, const float *x )
+{
+    int i;
+
+    if( ac->method == FE_AC_FFT )
+        fe_autocorrelate_fft( ac, x, ac->result );
+    else if( ac->method == FE_AC_INCREMENTAL )
+    {
+        for( i=0; i<ac->lags; i++ )
+            *(ac->result + i) = (float)*(ac->running + i);
+    }
+    else
+        fe_autocorrelate( (float*)x, ac->result, ac->length );
+
+    return ac->result;
 }
 
 /******************************************************/
@@ -129,6 +359,81 @@ void fe_timbre_stats( float *feature_array, float *stat_array, fe_extraction_inf
 
 /******************************************************/
 
+void fe_timbre_stats_running( const double *timbre_sum, const double *timbre_sum_sq, float *stat_array, fe_extraction_info *info )
+{
+    int     i;
+    int     columns = info->frames_in_window;
+    double  mean, variance;
+
+    for( i=0; i<info->num_timbre_features; i++ )
+    {
+        mean = *(timbre_sum+i) / columns;
+        variance = ( *(timbre_sum_sq+i) - *(timbre_sum+i) * mean ) / ( columns - 1 );
+
+        *(stat_array) =     (float)mean;
+        *(stat_array+1) =   ( variance > 0 ) ? (float)sqrt( variance ) : 0;    /* Rounding can leave a tiny negative */
+        stat_array += 2;
+    }
+}
+
+/******************************************************/
+
+void fe_read_window_stats( fe_extraction_thread_data *thread_data, double *timbre_sum, double *timbre_sum_sq,
+                           float *flux_buffer, fe_autocorrelation *ac )
+{
+    fe_autocorrelation  *source = &thread_data->autocorrelation;
+    size_t  bytes = sizeof(double) * thread_data->info->num_timbre_features;
+    LONG    before, after;
+
+    while( 1 )
+    {
+        before = __atomic_load_n( &thread_data->stats_sequence, __ATOMIC_ACQUIRE );
+        if( before & 1 )
+        {
+            /* An update or resynchronization is being written, it takes microseconds */
+            SwitchToThread();
+            continue;
+        }
+        memcpy( timbre_sum, thread_data->timbre_sum, bytes );
+        memcpy( timbre_sum_sq, thread_data->timbre_sum_sq, bytes );
+        memcpy( flux_buffer, thread_data->rectified_flux_buffer, sizeof(float) * thread_data->info->frames_in_window );
+        if( ac->method == FE_AC_INCREMENTAL && source->method == FE_AC_INCREMENTAL )
+            memcpy( ac->running, source->running, sizeof(double) * ac->lags );
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );     /* The copies finish before the sequence is read again */
+        after = thread_data->stats_sequence;
+        if( before == after )
+            return;
+    }
+}
+
+/******************************************************/
+
+void fe_resync_timbre_stats( fe_extraction_thread_data *thread_data )
+{
+    fe_extraction_info *info = thread_data->info;
+    float   *row;
+    double  sum, sum_sq;
+    int     i, j;
+
+    for( i=0; i<info->num_timbre_features; i++ )
+    {
+        row = thread_data->timbre_matrix + i*info->frames_in_window;
+        sum = 0;
+        sum_sq = 0;
+        for( j=0; j<info->frames_in_window; j++ )
+        {
+            sum +=      *(row+j);
+            sum_sq +=   (double)*(row+j) * *(row+j);
+        }
+        *(thread_data->timbre_sum + i) =    sum;
+        *(thread_data->timbre_sum_sq + i) = sum_sq;
+    }
+
+    thread_data->stats_frames = 0;
+}
+
+/******************************************************/
+
 float fe_spectral_rolloff( float *magnitude, fe_extraction_info *info )
 {
     if( info->rolloff<0 || info->rolloff>1 )
@@ -178,7 +483,54 @@ float fe_spectral_centroid( float *magnitude, fe_extraction_info *info )
 
 /******************************************************/
 
-void fe_spectral_contrast( float *magnitude, float *contrast_features, fe_extraction_info *info )
+void fe_spectral_contrast( float *magnitude, float *contrast_features, float *scratch, fe_extraction_info *info )
+{
+    int     i, j;
+    int     neighborhood;
+    int     length;
+    float   peak, valley;
+    float   *band = scratch;
+    const int *boundary = info->plan.band_boundary;
+
+    /* Copy array because we don't want to reorder the original magnitude array */
+    memcpy( scratch, magnitude, sizeof(float) * info->dft_length );
+
+    /* For each band */
+    for( i=0; i<info->bands; i++ )
+    {
+        /* Gather the lowest and highest neighborhood of the band at its ends, no need to sort the rest */
+        neighborhood = *(info->plan.band_neighborhood + i);     /* Number of points in neighborhood */
+        length = *(boundary+i+1) - *(boundary+i);
+        fe_select( band, length, neighborhood );
+        fe_select( band + neighborhood, length - neighborhood, length - 2*neighborhood );
+
+        /* Calculate valley, peak, and contrast */
+        peak = 0;
+        valley = 0;
+        for( j=0; j<neighborhood; j++ )
+        {
+            valley +=   *( band + j );
+            peak +=     *( band + (length-neighborhood) + j );
+        }
+        valley /=   (float)neighborhood;
+        peak /=     (float)neighborhood;
+
+        /* Store peak, valley, and contrast in contrast_features array */
+        *contrast_features =                                           (float)log( (double)peak );
+        *(contrast_features + info->bands*info->frames_in_window) =    (float)log( (double)valley );
+        *(contrast_features + info->bands*2*info->frames_in_window) =  (float)log( (double)(peak-valley) );
+        contrast_features += info->frames_in_window;
+
+        /* Move to start of next band */
+        band = scratch + *(boundary+i+1);
+    }
+
+    return;
+}
+
+/************************************************************************/
+
+void fe_spectral_contrast_sort( float *magnitude, float *contrast_features, fe_extraction_info *info )
 {
     int     i, j;
     float   a = 0.2;      /* Neighborhood factor */
@@ -238,20 +590,22 @@ float fe_spectral_flux( float               *mag_cur,
 {
     int     i;
     float   sum = 0;
+    float   flux;
 
     if( fluxType == FE_SPEC_FLUX_UNRECTIFIED )
     {
         for( i=0; i<info->dft_length; i++ )
-            sum += (float)pow( (double)(*(mag_cur+i) - *(mag_prev+i)) , 2 );
+        {
+            flux = *(mag_cur+i) - *(mag_prev+i);
+            sum += flux * flux;
+        }
 
     }else{
-        float flux;
-
         for( i=0; i<info->dft_length; i++ )
         {
             flux = *(mag_cur+i) - *(mag_prev+i);
             flux = ( flux + (float)fabs( (double)flux ) ) / 2;  /* zero if flux from prev line in negative */
-            sum += (float)pow( (double)flux, 2 );
+            sum += flux * flux;
         }
     }
 
@@ -260,7 +614,61 @@ float fe_spectral_flux( float               *mag_cur,
 
 /************************************************************/
 
-void fe_rhythmic_features( float *flux_buffer, float *rhythm_features, fe_extraction_info *info )
+void fe_spectral_descriptors( const float *magnitude, const float *prev_mag, float *column, float *rectified_flux,
+                              float *prefix_sum, fe_extraction_info *info )
+{
+    int     i, lo, hi, mid;
+    const float *bin_frequency = info->plan.bin_frequency;
+    float   mag_sum = 0;
+    float   scaled_mag_sum = 0;
+    float   flux_sum = 0;
+    float   rectified_sum = 0;
+    float   flux, rectified, threshold;
+
+    /* Independent accumulators with no branches, the running magnitude sum doubles as the rolloff prefix sum */
+    for( i=0; i<info->dft_length; i++ )
+    {
+        flux = *(magnitude+i) - *(prev_mag+i);
+        rectified = ( flux > 0 ) ? flux : 0;
+
+        mag_sum +=          *(magnitude+i);
+        scaled_mag_sum +=   *(bin_frequency+i) * *(magnitude+i);
+        flux_sum +=         flux * flux;
+        rectified_sum +=    rectified * rectified;
+        *(prefix_sum+i) =   mag_sum;
+    }
+
+    /* Spectral Centroid */
+    *column = scaled_mag_sum / mag_sum;
+    /* Spectral Flux */
+    *(column + info->frames_in_window) = flux_sum / (float)info->dft_length;
+    *rectified_flux = rectified_sum / (float)info->dft_length;
+
+    /* Spectral Rolloff: the number of bins up to the first one whose cumulative magnitude reaches the rolloff
+       ratio.  The prefix sum never decreases, and the bins are counted from one like fe_spectral_rolloff().  The
+       ratio is compared as a product so the search does no division */
+    if( info->rolloff<0 || info->rolloff>1 )
+        *(column + 2*info->frames_in_window) = -1;
+    else
+    {
+        threshold = info->rolloff * mag_sum;
+        lo = 0;
+        hi = info->dft_length - 1;
+        while( lo < hi )
+        {
+            mid = lo + (hi-lo)/2;
+            if( *(prefix_sum+mid) < threshold )
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        *(column + 2*info->frames_in_window) = (float)(lo+1) * info->plan.bin_width;
+    }
+}
+
+/************************************************************/
+
+void fe_rhythmic_features( float *flux_buffer, fe_autocorrelation *ac_state, float *rhythm_features, fe_extraction_info *info )
 {
     int     i, j;
     int     onset_counter = 0;
@@ -268,7 +676,7 @@ void fe_rhythmic_features( float *flux_buffer, float *rhythm_features, fe_extrac
     int     leftpoint, rightpoint;
     int     ac_length = (int)(info->frames_in_window / 2);
 
-    float   ac[ ac_length ];    /* holds autocorrelation curve */
+    const float *ac;            /* holds autocorrelation curve */
     float   sum_onset_amp = 0;
     float   sum_ac_peaks = 0;
     float   sum_ac_valleys = 0;
@@ -293,8 +701,8 @@ void fe_rhythmic_features( float *flux_buffer, float *rhythm_features, fe_extrac
     *(rhythm_features+1) =  sum_onset_amp / (float)onset_counter;
 
     /* Calculate average autocorrelation peak and valley strength */
-    fe_autocorrelate( flux_buffer, ac, info->frames_in_window );
-    threshold = fe_mean( (ac+1), ac_length-1 ) + fe_stdv( (ac+1), ac_length-1 );    /* Ignore very first large peak in ac */
+    ac = fe_autocorrelation_compute( ac_state, flux_buffer );
+    threshold = fe_mean( (float*)(ac+1), ac_length-1 ) + fe_stdv( (float*)(ac+1), ac_length-1 );    /* Ignore very first large peak in ac */
 
     for( i=2; i<ac_length-1; i++ )  /* Again ignoring first large peak */
     {
@@ -331,16 +739,408 @@ void fe_rhythmic_features( float *flux_buffer, float *rhythm_features, fe_extrac
 
 /*********************************************************/
 
+int fe_ring_init( fe_ring_buffer *ring, unsigned int length )
+{
+    ring->write_count = 0;
+    ring->read_count =  0;
+    ring->length =      length;
+    ring->mask =        length - 1;
+
+    if( length == 0 || ( length & (length-1) ) )   /* Counters are wrapped with a mask, so length must be a power of two */
+    {
+        ring->samples = NULL;
+        return 0;
+    }
+
+    ring->samples = (float*)malloc( sizeof(float) * length );
+
+    return ( ring->samples != NULL );
+}
+
+/*********************************************************/
+
+void fe_ring_free( fe_ring_buffer *ring )
+{
+    free( ring->samples );
+    ring->samples = NULL;
+    ring->length = 0;
+    ring->mask = 0;
+}
+
+/*********************************************************/
+
+unsigned int fe_ring_write_space( fe_ring_buffer *ring )
+{
+    /* Acquire pairs with the consumer's release so its reads of the samples finish before they are overwritten */
+    unsigned int read_count = __atomic_load_n( &ring->read_count, __ATOMIC_ACQUIRE );
+
+    return ring->length - ( ring->write_count - read_count );     /* Unsigned wrap-around keeps this correct */
+}
+
+/*********************************************************/
+
+void fe_ring_commit( fe_ring_buffer *ring, unsigned int num )
+{
+    /* Release makes the written samples visible before the consumer can see the new count */
+    __atomic_store_n( &ring->write_count, ring->write_count + num, __ATOMIC_RELEASE );
+}
+
+/*********************************************************/
+
+unsigned int fe_ring_read_available( fe_ring_buffer *ring )
+{
+    return __atomic_load_n( &ring->write_count, __ATOMIC_ACQUIRE ) - ring->read_count;
+}
+
+/*********************************************************/
+
+void fe_ring_read( fe_ring_buffer *ring, float *dest, unsigned int num )
+{
+    fe_ring_peek( ring, dest, 0, num );
+    fe_ring_consume( ring, num );
+}
+
+/*********************************************************/
+
+void fe_ring_peek( fe_ring_buffer *ring, float *dest, unsigned int offset, unsigned int num )
+{
+    unsigned int start = ( ring->read_count + offset ) & ring->mask;
+    unsigned int first = ring->length - start;
+
+    /* At most two contiguous pieces, split where the ring wraps around */
+    if( first > num )
+        first = num;
+    memcpy( dest, ring->samples + start, sizeof(float) * first );
+    memcpy( dest + first, ring->samples, sizeof(float) * ( num - first ) );
+}
+
+/*********************************************************/
+
+void fe_ring_consume( fe_ring_buffer *ring, unsigned int num )
+{
+    /* Release keeps the copies above from being reordered after the producer may overwrite the samples */
+    __atomic_store_n( &ring->read_count, ring->read_count + num, __ATOMIC_RELEASE );
+}
+
+/*********************************************************/
+
+void fe_transform_frames( fe_extraction_thread_data *data, int num )
+{
+    int j;
+
+    /* New array execution, the plans may have been made on the arrays of another thread data */
+    if( num == FE_FFT_BATCH )
+        fftwf_execute_dft_r2c( data->batchPlan, data->audio, data->dft );
+    else
+    {
+        /* Every frame and DFT of the batch has the alignment of the first, so the single frame plan can be reused */
+        for( j=0; j<num; j++ )
+            fftwf_execute_dft_r2c( data->fftPlan, data->audio + j*data->info->frame_length, data->dft + j*data->dft_stride );
+    }
+}
+
+/*********************************************************/
+
+void fe_process_frame( fe_extraction_thread_data *data )
+{
+    fftwf_execute_dft_r2c( data->fftPlan, data->audio, data->dft );
+    fe_process_spectrum( data, data->dft );
+}
+
+/*********************************************************/
+
+void fe_process_spectrum( fe_extraction_thread_data *data, fftwf_complex *dft )
+{
+    float   *column = data->timbre_matrix + data->columnPtr;
+    double  value;
+    float   old_flux = *( data->rectified_flux_buffer + data->columnPtr );
+    float   new_flux;
+    int     i;
+
+    /* Keep the column being replaced for the running sums */
+    for( i=0; i<data->info->num_timbre_features; i++ )
+        *(data->old_column + i) = *( column + i*data->info->frames_in_window );
+
+    data->magnitude_kernel( dft, data->magnitude, data->info->dft_length );
+
+    /* Fill current column of timbre matrix */
+    /* Spectral Centroid, Flux and Rolloff, and the rectified flux buffer for onset feature extraction */
+    fe_spectral_descriptors( data->magnitude, data->prev_mag, column, &new_flux, data->prefix_sum, data->info );
+    /* Spectral Contrast Features */
+    fe_spectral_contrast( data->magnitude, ( data->timbre_matrix + data->columnPtr + 3*data->info->frames_in_window ),
+                          data->contrast_scratch, data->info );
+
+    /* Store the new flux, update its autocorrelation and replace the old column by the new one in the running sums.
+       The sequence is odd while they are written, and the interlocked increments are full barriers around the
+       writes, so fe_read_window_stats() on another thread retries rather than pair values of different windows */
+    InterlockedIncrement( &data->stats_sequence );
+    *( data->rectified_flux_buffer + data->columnPtr ) = new_flux;
+    fe_autocorrelation_update( &data->autocorrelation, data->rectified_flux_buffer, data->columnPtr, old_flux );
+    if( ++(data->stats_frames) >= STATS_RESYNC_FRAMES )
+        fe_resync_timbre_stats( data );
+    else
+    {
+        for( i=0; i<data->info->num_timbre_features; i++ )
+        {
+            value = *( column + i*data->info->frames_in_window );
+            *(data->timbre_sum + i) +=      value - *(data->old_column + i);
+            *(data->timbre_sum_sq + i) +=   value * value - (double)*(data->old_column + i) * *(data->old_column + i);
+        }
+    }
+    InterlockedIncrement( &data->stats_sequence );
+
+    /* Switch pointers for magnitude and prev_mag */
+    float *temp = data->magnitude;
+    data->magnitude = data->prev_mag;
+    data->prev_mag = temp;
+
+    (data->columnPtr)++;
+    if( data->columnPtr == data->info->frames_in_window )
+        data->columnPtr = 0;
+}
+
+/*********************************************************/
+
+int fe_analyse_pending( fe_extraction_thread_data *data, int max_batch )
+{
+    fe_extraction_info  *info = data->info;
+    unsigned int        available = fe_ring_read_available( &data->ring );
+    LARGE_INTEGER       t_done;
+    int                 num, j;
+
+    if( available < (unsigned int)info->frame_length )
+        return 0;
+
+    /* Frames that start hop_length apart and end within the available samples */
+    num = ( available - info->frame_length ) / info->hop_length + 1;
+    if( num > max_batch )
+        num = max_batch;
+
+    for( j=0; j<num; j++ )
+    {
+        fe_ring_peek( &data->ring, data->audio + j*info->frame_length, j*info->hop_length, info->frame_length );
+        data->window_kernel( data->audio + j*info->frame_length, data->hamm_win, info->frame_length );
+    }
+    fe_ring_consume( &data->ring, num * info->hop_length );
+
+    fe_transform_frames( data, num );
+    for( j=0; j<num; j++ )
+    {
+        fe_process_spectrum( data, data->dft + j*data->dft_stride );
+
+        /* The interlocked increment is a full barrier, so a reader that sees the new count also sees frame_ticks */
+        QueryPerformanceCounter( &t_done );
+        data->frame_ticks = (LONG)t_done.QuadPart;
+        InterlockedIncrement( &data->frames_completed );
+    }
+    SetEvent( data->frame_ready );
+
+    return num;
+}
+
+/*********************************************************/
+
+/** @brief Stores the processor brand string, reduced to letters, digits and single underscores, in name */
+static void fe_processor_name( char *name, int size )
+{
+    unsigned int    regs[12];
+    const char      *brand = (const char*)regs;
+    int             i, length = 0;
+
+    if( __get_cpuid_max( 0x80000000, NULL ) < 0x80000004 ||
+        !__get_cpuid( 0x80000002, regs, regs+1, regs+2, regs+3 ) ||
+        !__get_cpuid( 0x80000003, regs+4, regs+5, regs+6, regs+7 ) ||
+        !__get_cpuid( 0x80000004, regs+8, regs+9, regs+10, regs+11 ) )
+    {
+        snprintf( name, size, "unknown" );
+        return;
+    }
+
+    for( i=0; i<48 && *(brand+i) != '\0' && length < size-1; i++ )
+    {
+        if( isalnum( (unsigned char)*(brand+i) ) )
+            *(name + length++) = *(brand+i);
+        else if( length > 0 && *(name + length-1) != '_' )
+            *(name + length++) = '_';
+    }
+    while( length > 0 && *(name + length-1) == '_' )
+        length--;
+    *(name + length) = '\0';
+
+    if( length == 0 )
+        snprintf( name, size, "unknown" );
+}
+
+/*********************************************************/
+
+/** @brief Sets info->wisdom_path and imports the FFTW wisdom it holds, if the file exists */
+static void fe_load_wisdom( fe_extraction_info *info )
+{
+    char            processor[64];
+    LARGE_INTEGER   t_start, t_end, frequency;
+
+    QueryPerformanceCounter( &t_start );
+
+    fe_processor_name( processor, sizeof(processor) );
+    snprintf( info->wisdom_path, FE_MAX_WISDOM_PATH, "%s_%d_%s.txt", FE_WISDOM_PREFIX, info->frame_length, processor );
+    info->wisdom_loaded = fftwf_import_wisdom_from_filename( info->wisdom_path );
+
+    QueryPerformanceCounter( &t_end );
+    QueryPerformanceFrequency( &frequency );
+    info->wisdom_seconds = (double)( t_end.QuadPart - t_start.QuadPart ) / frequency.QuadPart;
+}
+
+/*********************************************************/
+
+int fe_save_wisdom( fe_extraction_info *info )
+{
+    LARGE_INTEGER   t_start, t_end, frequency;
+    int             success;
+
+    /* Estimated plans are not worth keeping, and unchanged wisdom is already in the file */
+    if( !info->wisdom_changed || info->planner_effort == FFTW_ESTIMATE )
+        return 1;
+
+    QueryPerformanceCounter( &t_start );
+    success = fftwf_export_wisdom_to_filename( info->wisdom_path );
+    QueryPerformanceCounter( &t_end );
+    QueryPerformanceFrequency( &frequency );
+    info->wisdom_seconds += (double)( t_end.QuadPart - t_start.QuadPart ) / frequency.QuadPart;
+
+    if( success )
+        info->wisdom_changed = 0;
+    else
+        fprintf( stderr, "Warning: Could not write FFTW wisdom to %s\n", info->wisdom_path );
+
+    return success;
+}
+
+/*********************************************************/
+
+int fe_parse_planner_effort( const char *name, unsigned int *effort )
+{
+    if( strcmp( name, "estimate" ) == 0 )
+        *effort = FFTW_ESTIMATE;
+    else if( strcmp( name, "measure" ) == 0 )
+        *effort = FFTW_MEASURE;
+    else if( strcmp( name, "patient" ) == 0 )
+        *effort = FFTW_PATIENT;
+    else
+        return 0;
+
+    return 1;
+}
+
+/*********************************************************/
+
+const char *fe_planner_effort_name( unsigned int effort )
+{
+    if( effort == FFTW_ESTIMATE )
+        return "estimate";
+    if( effort == FFTW_PATIENT )
+        return "patient";
+
+    return "measure";
+}
+
+/*********************************************************/
+
+/* The transforms planned through fe_plan_transform(), which only differ in the FFTW planner called */
+typedef enum { FE_PLAN_R2C, FE_PLAN_MANY_R2C, FE_PLAN_C2R } fe_plan_kind;
+
+typedef struct
+{
+    fe_plan_kind    kind;
+    int             n;
+    int             howmany;        /* FE_PLAN_MANY_R2C only */
+    float           *signal;        /* Real input of r2c, real output of c2r */
+    int             signal_dist;    /* FE_PLAN_MANY_R2C only */
+    fftwf_complex   *spectrum;
+    int             spectrum_dist;  /* FE_PLAN_MANY_R2C only */
+}
+fe_plan_request;
+
+static fftwf_plan fe_call_planner( fe_plan_request *request, unsigned int flags )
+{
+    switch( request->kind )
+    {
+    case FE_PLAN_MANY_R2C:
+        return fftwf_plan_many_dft_r2c( 1, &request->n, request->howmany, request->signal, NULL, 1, request->signal_dist,
+                                        request->spectrum, NULL, 1, request->spectrum_dist, flags );
+    case FE_PLAN_C2R:
+        return fftwf_plan_dft_c2r_1d( request->n, request->spectrum, request->signal, flags );
+    default:
+        return fftwf_plan_dft_r2c_1d( request->n, request->signal, request->spectrum, flags );
+    }
+}
+
+/** @brief Plans a transform from wisdom alone if it can, otherwise with the planner effort of the information, and
+    counts the plan and its time in the information.  The wisdom policy of every fe_plan_*() function */
+static fftwf_plan fe_plan_transform( fe_extraction_info *info, fe_plan_request *request )
+{
+    fftwf_plan      plan;
+    LARGE_INTEGER   t_start, t_end, frequency;
+
+    QueryPerformanceCounter( &t_start );
+
+    plan = fe_call_planner( request, info->planner_effort | FFTW_WISDOM_ONLY );
+    if( plan != NULL )
+        info->num_plans_from_wisdom++;
+    else
+    {
+        plan = fe_call_planner( request, info->planner_effort );
+        info->wisdom_changed = 1;
+    }
+    info->num_plans++;
+
+    QueryPerformanceCounter( &t_end );
+    QueryPerformanceFrequency( &frequency );
+    info->planning_seconds += (double)( t_end.QuadPart - t_start.QuadPart ) / frequency.QuadPart;
+
+    return plan;
+}
+
+/*********************************************************/
+
+fftwf_plan fe_plan_r2c( fe_extraction_info *info, int n, float *in, fftwf_complex *out )
+{
+    fe_plan_request request = { FE_PLAN_R2C, n, 1, in, 0, out, 0 };
+
+    return fe_plan_transform( info, &request );
+}
+
+/*********************************************************/
+
+fftwf_plan fe_plan_many_r2c( fe_extraction_info *info, int n, int howmany, float *in, int idist, fftwf_complex *out, int odist )
+{
+    fe_plan_request request = { FE_PLAN_MANY_R2C, n, howmany, in, idist, out, odist };
+
+    return fe_plan_transform( info, &request );
+}
+
+/*********************************************************/
+
+fftwf_plan fe_plan_c2r( fe_extraction_info *info, int n, fftwf_complex *in, float *out )
+{
+    fe_plan_request request = { FE_PLAN_C2R, n, 1, out, 0, in, 0 };
+
+    return fe_plan_transform( info, &request );
+}
+
+/*********************************************************/
+
 void fe_initialize_extraction_info( fe_extraction_info *info )
 {
+    int i;
+
     info->fs =               FS;
     info->frame_length =     N_SAMPS;
+    info->hop_length =       HOP_LENGTH;
+    info->buffer_length =    BUFFER_LENGTH;
     info->dft_length =       (int)(N_SAMPS/2+1);
 
     info->window_length =    3.0;        /* In seconds */
-    info->frames_in_window = ( info->window_length*info->fs -
-                             ((int)info->window_length*info->fs % info->frame_length) ) /
-                             info->frame_length;
+    info->frames_in_window = (int)( info->window_length*info->fs ) / info->hop_length;
 
     info->rolloff =          ROLLOFF;
     info->bands =            BANDS;
@@ -348,14 +1148,85 @@ void fe_initialize_extraction_info( fe_extraction_info *info )
     info->num_timbre_features =  NUM_TIMBRE_FEATURES;
     info->num_onset_features =   NUM_ONSET_FEATURES;
 
+    /* Build the tables of the plan */
+    info->plan.bin_frequency =      (float*)fftwf_malloc( sizeof(float) * info->dft_length );
+    info->plan.window =             (float*)fftwf_malloc( sizeof(float) * info->frame_length );
+    info->plan.band_boundary =      (int*)malloc( sizeof(int) * (info->bands+1) );
+    info->plan.band_neighborhood =  (int*)malloc( sizeof(int) * info->bands );
+    if( info->plan.bin_frequency == NULL || info->plan.window == NULL ||
+        info->plan.band_boundary == NULL || info->plan.band_neighborhood == NULL )
+    {
+        fe_clean_extraction_info( info );
+        info->init_success = 0;
+        return;
+    }
+
+    info->plan.bin_width = (float)info->fs / (float)info->frame_length;
+    for( i=0; i<info->dft_length; i++ )
+        *(info->plan.bin_frequency + i) = (float)i * info->plan.bin_width;
+
+    fe_hamming_win( info->plan.window, info->frame_length );
+
+    /* Octave bands below frame_length/2, the lowest starting at bin zero */
+    *(info->plan.band_boundary) = 0;
+    for( i=1; i<(info->bands+1); i++ )
+        *(info->plan.band_boundary + i) = ( info->frame_length / pow( 2,(double)(info->bands-(i-1)) ) ) - 1;
+    for( i=0; i<info->bands; i++ )
+        *(info->plan.band_neighborhood + i) = (float)NEIGHBORHOOD *
+                                              ( *(info->plan.band_boundary + i+1) - *(info->plan.band_boundary + i) );
+
+    /* FFTW planning */
+    info->planner_effort =          FE_PLANNER_EFFORT;
+    info->wisdom_changed =          0;
+    info->planning_seconds =        0;
+    info->num_plans =               0;
+    info->num_plans_from_wisdom =   0;
+    fe_load_wisdom( info );
+
+    info->init_success = 1;
+
     return;
 }
 
 /*********************************************************/
 
+int fe_set_hop_length( fe_extraction_info *info, int hop_length )
+{
+    if( hop_length < 1 || hop_length > info->frame_length )
+        return 0;
+
+    info->hop_length =          hop_length;
+    info->frames_in_window =    (int)( info->window_length*info->fs ) / info->hop_length;
+
+    return 1;
+}
+
+/*********************************************************/
+
+void fe_clean_extraction_info( fe_extraction_info *info )
+{
+    fftwf_free( info->plan.bin_frequency );
+    fftwf_free( info->plan.window );
+    free( info->plan.band_boundary );
+    free( info->plan.band_neighborhood );
+
+    info->plan.bin_frequency =      NULL;
+    info->plan.window =             NULL;
+    info->plan.band_boundary =      NULL;
+    info->plan.band_neighborhood =  NULL;
+}
+
+/*********************************************************/
+
 fe_extraction_thread_data fe_initialize_extraction_thread_data( fe_extraction_info *info )
 {
-    int i;
+    return fe_initialize_extraction_thread_data_shared( info, NULL );
+}
+
+/**********************************************************/
+
+fe_extraction_thread_data fe_initialize_extraction_thread_data_shared( fe_extraction_info *info, const fe_extraction_thread_data *owner )
+{
     fe_extraction_thread_data thread_data;
 
     thread_data.info =                  info;    /* pointer to extraction info */
@@ -366,26 +1237,52 @@ fe_extraction_thread_data fe_initialize_extraction_thread_data( fe_extraction_in
     thread_data.dft = NULL;
     thread_data.magnitude = NULL;
     thread_data.prev_mag = NULL;
+    thread_data.prefix_sum = NULL;
+    thread_data.contrast_scratch = NULL;
     thread_data.rectified_flux_buffer = NULL;
     thread_data.timbre_matrix = NULL;
+    thread_data.timbre_sum = NULL;
+    thread_data.timbre_sum_sq = NULL;
+    thread_data.old_column = NULL;
     thread_data.fftPlan = NULL;
-
-    thread_data.audio = (float*)fftwf_malloc( sizeof(float) * info->frame_length );
-    if( thread_data.audio == NULL )
+    thread_data.batchPlan = NULL;
+    thread_data.owns_plans = ( owner == NULL );
+    thread_data.autocorrelation.result = NULL;
+    thread_data.ring.samples = NULL;
+    thread_data.samples_ready = NULL;
+    thread_data.frame_ready = NULL;
+    thread_data.frames_completed = 0;
+    thread_data.stats_sequence = 0;
+    thread_data.frame_ticks = 0;
+
+    thread_data.downmix_kernel =        fe_select_downmix_kernel( NULL );
+    thread_data.window_kernel =         fe_select_window_kernel();
+    thread_data.magnitude_kernel =      fe_select_magnitude_kernel();
+
+    thread_data.overruns =              0;
+    thread_data.input_overflows =       0;
+    thread_data.callback_count =        0;
+    thread_data.callback_ticks =        0;
+    thread_data.callback_max_ticks =    0;
+    thread_data.terminate_thread =      0;
+
+    if( !info->init_success )
     {
         thread_data.init_success = 0;
         goto exit;
     }
 
-    thread_data.hamm_win = (float*)malloc( sizeof(float) * info->frame_length );
-    if( thread_data.hamm_win == NULL )
+    thread_data.audio = (float*)fftwf_malloc( sizeof(float) * info->frame_length * FE_FFT_BATCH );
+    if( thread_data.audio == NULL )
     {
         thread_data.init_success = 0;
         goto exit;
     }
-    fe_hamming_win( thread_data.hamm_win, info->frame_length );   /* Fill hamming window array */
 
-    thread_data.dft = (fftwf_complex*)fftwf_malloc( sizeof(fftwf_complex) * info->dft_length );
+    thread_data.hamm_win = info->plan.window;     /* Shared, built with the extraction info */
+
+    thread_data.dft_stride = ( info->dft_length + 7 ) & ~7;  /* 64 bytes */
+    thread_data.dft = (fftwf_complex*)fftwf_malloc( sizeof(fftwf_complex) * thread_data.dft_stride * FE_FFT_BATCH );
     if( thread_data.dft == NULL )
     {
         thread_data.init_success = 0;
@@ -405,8 +1302,14 @@ fe_extraction_thread_data fe_initialize_extraction_thread_data( fe_extraction_in
         thread_data.init_success = 0;
         goto exit;
     }
-    for( i=0; i<info->dft_length; i++ )     /* Set initial previous magnitude to zero */
-        *(thread_data.magnitude + i) = 0;
+
+    thread_data.prefix_sum = (float*)malloc( sizeof(float) * info->dft_length );
+    thread_data.contrast_scratch = (float*)malloc( sizeof(float) * info->dft_length );
+    if( thread_data.prefix_sum == NULL || thread_data.contrast_scratch == NULL )
+    {
+        thread_data.init_success = 0;
+        goto exit;
+    }
 
     thread_data.rectified_flux_buffer = (float*)malloc( sizeof(float) * info->frames_in_window );
     if( thread_data.rectified_flux_buffer == NULL )
@@ -422,35 +1325,105 @@ fe_extraction_thread_data fe_initialize_extraction_thread_data( fe_extraction_in
         goto exit;
     }
 
-    thread_data.fftPlan = fftwf_plan_dft_r2c_1d( info->frame_length, thread_data.audio, thread_data.dft, FFTW_MEASURE );
-    if( thread_data.fftPlan == NULL )
+    thread_data.timbre_sum = (double*)malloc( sizeof(double) * info->num_timbre_features );
+    thread_data.timbre_sum_sq = (double*)malloc( sizeof(double) * info->num_timbre_features );
+    thread_data.old_column = (float*)malloc( sizeof(float) * info->num_timbre_features );
+    if( thread_data.timbre_sum == NULL || thread_data.timbre_sum_sq == NULL || thread_data.old_column == NULL )
+    {
+        thread_data.init_success = 0;
+        goto exit;
+    }
+
+    if( owner != NULL )
+    {
+        /* fftwf_malloc() gives every stream's arrays the alignment the owner's plans were made for */
+        thread_data.fftPlan = owner->fftPlan;
+        thread_data.batchPlan = owner->batchPlan;
+    }
+    else
+    {
+        thread_data.fftPlan = fe_plan_r2c( info, info->frame_length, thread_data.audio, thread_data.dft );
+        thread_data.batchPlan = fe_plan_many_r2c( info, info->frame_length, FE_FFT_BATCH, thread_data.audio, info->frame_length,
+                                                  thread_data.dft, thread_data.dft_stride );
+    }
+    if( thread_data.fftPlan == NULL || thread_data.batchPlan == NULL )
     {
         printf( "Error: Could not create fftw plan\n" );
         thread_data.init_success = 0;
         goto exit;
     }
 
+    if( !fe_autocorrelation_init( &thread_data.autocorrelation, info->frames_in_window, FE_AUTOCORRELATION, info ) )
+    {
+        thread_data.init_success = 0;
+        goto exit;
+    }
+
+    if( RING_LENGTH < info->frame_length + FE_FFT_BATCH * info->hop_length + info->buffer_length ||
+        !fe_ring_init( &thread_data.ring, RING_LENGTH ) )
+    {
+        thread_data.init_success = 0;
+        goto exit;
+    }
+
+    thread_data.samples_ready = CreateEvent( NULL, FALSE, FALSE, NULL );    /* Auto-reset, initially not signaled */
+    if( thread_data.samples_ready == NULL )
+    {
+        thread_data.init_success = 0;
+        goto exit;
+    }
+
+    thread_data.frame_ready = CreateEvent( NULL, FALSE, FALSE, NULL );
+    if( thread_data.frame_ready == NULL )
+    {
+        thread_data.init_success = 0;
+        goto exit;
+    }
+
+    fe_save_wisdom( info );     /* A failure to write only costs the measurements on the next start */
+
     thread_data.init_success = 1;
     thread_data.boolOutputDevice = 0;
+    fe_reset_extraction_thread_data( &thread_data );  /* Zero previous magnitude, flux buffer and timbre matrix */
 
 exit:
     if( thread_data.init_success == 0 )
     {
         free(thread_data.timbre_matrix);
+        free(thread_data.timbre_sum);
+        free(thread_data.timbre_sum_sq);
+        free(thread_data.old_column);
         fftwf_free(thread_data.audio);
-        free(thread_data.hamm_win);
         fftwf_free(thread_data.dft);
         free(thread_data.magnitude);
         free(thread_data.prev_mag);
+        free(thread_data.prefix_sum);
+        free(thread_data.contrast_scratch);
         free(thread_data.rectified_flux_buffer);
-
+        if( thread_data.autocorrelation.result != NULL )
+            fe_autocorrelation_free( &thread_data.autocorrelation );
+        fe_ring_free( &thread_data.ring );
+        if( thread_data.fftPlan != NULL && thread_data.owns_plans )
+            fftwf_destroy_plan( thread_data.fftPlan );
+        if( thread_data.batchPlan != NULL && thread_data.owns_plans )
+            fftwf_destroy_plan( thread_data.batchPlan );
+        if( thread_data.samples_ready != NULL )
+            CloseHandle( thread_data.samples_ready );
+
+        thread_data.fftPlan = NULL;
+        thread_data.batchPlan = NULL;
         thread_data.audio = NULL;
         thread_data.hamm_win = NULL;
         thread_data.dft = NULL;
         thread_data.magnitude = NULL;
         thread_data.prev_mag = NULL;
+        thread_data.prefix_sum = NULL;
+        thread_data.contrast_scratch = NULL;
         thread_data.rectified_flux_buffer = NULL;
         thread_data.timbre_matrix = NULL;
+        thread_data.timbre_sum = NULL;
+        thread_data.timbre_sum_sq = NULL;
+        thread_data.old_column = NULL;
     }
 
     return thread_data;
@@ -458,33 +1431,93 @@ exit:
 
 /**********************************************************/
 
+void fe_reset_extraction_thread_data( fe_extraction_thread_data *thread_data )
+{
+    fe_extraction_info *info = thread_data->info;
+    int i;
+
+    for( i=0; i<info->dft_length; i++ )
+        *(thread_data->prev_mag + i) = 0;
+
+    for( i=0; i<info->frames_in_window; i++ )
+        *(thread_data->rectified_flux_buffer + i) = 0;
+    fe_autocorrelation_resync( &thread_data->autocorrelation, thread_data->rectified_flux_buffer );
+
+    for( i=0; i<info->frames_in_window * info->num_timbre_features; i++ )
+        *(thread_data->timbre_matrix + i) = 0;
+    fe_resync_timbre_stats( thread_data );
+
+    thread_data->columnPtr = 0;
+}
+
+/**********************************************************/
+
 void fe_clean_extraction_thread_data( fe_extraction_thread_data *thread_data )
 {
-    fftwf_destroy_plan(thread_data->fftPlan);
+    if( thread_data->owns_plans )
+    {
+        fftwf_destroy_plan(thread_data->fftPlan);
+        fftwf_destroy_plan(thread_data->batchPlan);
+    }
 
     fftwf_free(thread_data->audio);
-    free(thread_data->hamm_win);
     fftwf_free(thread_data->dft);
     free(thread_data->magnitude);
     free(thread_data->prev_mag);
+    free(thread_data->prefix_sum);
+    free(thread_data->contrast_scratch);
     free(thread_data->rectified_flux_buffer);
     free(thread_data->timbre_matrix);
+    free(thread_data->timbre_sum);
+    free(thread_data->timbre_sum_sq);
+    free(thread_data->old_column);
+    fe_autocorrelation_free( &thread_data->autocorrelation );
+    fe_ring_free( &thread_data->ring );
+    if( thread_data->samples_ready != NULL )
+        CloseHandle( thread_data->samples_ready );
+    if( thread_data->frame_ready != NULL )
+        CloseHandle( thread_data->frame_ready );
 
     thread_data->fftPlan = NULL;
+    thread_data->batchPlan = NULL;
+    thread_data->samples_ready = NULL;
+    thread_data->frame_ready = NULL;
 
     thread_data->audio = NULL;
     thread_data->hamm_win = NULL;
     thread_data->dft = NULL;
     thread_data->magnitude = NULL;
     thread_data->prev_mag = NULL;
+    thread_data->prefix_sum = NULL;
+    thread_data->contrast_scratch = NULL;
     thread_data->rectified_flux_buffer = NULL;
     thread_data->timbre_matrix = NULL;
+    thread_data->timbre_sum = NULL;
+    thread_data->timbre_sum_sq = NULL;
+    thread_data->old_column = NULL;
 
     return;
 }
 
 /**********************************************************/
 
+unsigned int __stdcall fe_analysisRoutine( void *lpArg )
+{
+    fe_extraction_thread_data *data = (fe_extraction_thread_data*)lpArg;
+
+    while( !(data->terminate_thread) )
+    {
+        /* Timeout lets the thread notice termination even if the stream has stopped */
+        if( fe_analyse_pending( data, FE_FFT_BATCH ) == 0 )
+            WaitForSingleObject( data->samples_ready, 100 );
+    }
+
+    _endthreadex( 0 );
+    return 0;
+}
+
+/**********************************************************/
+
 int paCallBack( const void                        *inputBuffer,
                 void                              *outputBuffer,
                 unsigned long                     framesPerBuffer,
@@ -494,49 +1527,42 @@ int paCallBack( const void                        *inputBuffer,
 {
     /* Case data passed through stream to our structure */
     fe_extraction_thread_data *data = (fe_extraction_thread_data*)userData;
+    fe_ring_buffer *ring = &data->ring;
     float *in =     (float*)inputBuffer;
     float *out =    (float*)outputBuffer;
-    unsigned int     i;
+    unsigned int     start, first;
+    LARGE_INTEGER    t_start, t_end;
 
-    /* Output two input channels to two output channels and average channels to audio array */
-    for( i=0; i<framesPerBuffer; i++ )
-    {
-        if( data->boolOutputDevice == 1 )
-        {
-            *out++ = *in;
-            *out++ = *(in+1);
-        }
+    QueryPerformanceCounter( &t_start );
 
-        *(data->audio + i) = ( *in + *(in+1) ) / 2;
-        *(data->audio + i) *= *(data->hamm_win + i);    /* Apply hamming window */
-        in += 2;
-    }
+    if( statusFlags & paInputOverflow )
+        data->input_overflows++;
 
-    /* Perform fft plan and compute magnitude */
-    fftwf_execute( data->fftPlan );
-    fe_compute_magnitude( data->dft, data->magnitude, data->info->dft_length );
+    /* Output two input channels to two output channels */
+    if( data->boolOutputDevice == 1 )
+        memcpy( out, in, sizeof(float) * 2 * framesPerBuffer );
 
-    /* Fill current column of timbre matrix */
-    /* Spectral Centroid */
-    *( data->timbre_matrix + data->columnPtr ) = fe_spectral_centroid( data->magnitude, data->info );
-    /* Spectral Flux */
-    *( data->timbre_matrix + data->columnPtr + data->info->frames_in_window ) = fe_spectral_flux( data->magnitude, data->prev_mag, FE_SPEC_FLUX_UNRECTIFIED, data->info );
-    /* Spectral Rolloff */
-    *( data->timbre_matrix + data->columnPtr + 2*data->info->frames_in_window ) = fe_spectral_rolloff( data->magnitude, data->info );
-    /* Spectral Contrast Features */
-    fe_spectral_contrast( data->magnitude, ( data->timbre_matrix + data->columnPtr + 3*data->info->frames_in_window ), data->info );
-
-    /* Update rectified flux buffer for onset feature extraction*/
-    *( data->rectified_flux_buffer + data->columnPtr ) = fe_spectral_flux( data->magnitude, data->prev_mag, FE_SPEC_FLUX_RECTIFIED, data->info );
-
-    /* Switch pointers for magnitude and prev_mag */
-    float *temp = data->magnitude;
-    data->magnitude = data->prev_mag;
-    data->prev_mag = temp;
+    /* Average channels into the ring buffer, dropping the whole buffer if the analysis thread has fallen behind */
+    if( fe_ring_write_space( ring ) < framesPerBuffer )
+        data->overruns++;
+    else
+    {
+        /* Downmix into the free space in at most two contiguous pieces, split where it wraps around */
+        start = ring->write_count & ring->mask;
+        first = ring->length - start;
+        if( first > framesPerBuffer )
+            first = framesPerBuffer;
+        data->downmix_kernel( in, NULL, ring->samples + start, first );
+        data->downmix_kernel( in + 2*first, NULL, ring->samples, framesPerBuffer - first );
+        fe_ring_commit( ring, framesPerBuffer );
+        SetEvent( data->samples_ready );    /* Does not block, so it is safe to call from the callback */
+    }
 
-    (data->columnPtr)++;
-    if( data->columnPtr == data->info->frames_in_window )
-        data->columnPtr = 0;
+    QueryPerformanceCounter( &t_end );
+    data->callback_count++;
+    data->callback_ticks += t_end.QuadPart - t_start.QuadPart;
+    if( t_end.QuadPart - t_start.QuadPart > data->callback_max_ticks )
+        data->callback_max_ticks = t_end.QuadPart - t_start.QuadPart;
 
     return 0;
 }
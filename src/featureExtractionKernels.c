@@ -0,0 +1,320 @@
+/* featureExtractionKernels.c Contains the SIMD kernels used in the audio front end of feature extraction
+ * Copyright (c) 2017 Jay Biernat
+ * Copyright (c) 2017 University of Rochester
+ *
+ * This file is part of Musical Mood Detector and Visualizer
+ *
+ * Musical Mood Detector and Visualizer is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Musical Mood Detector and Visualizer is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even
+ * the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Musical Mood Detector and Visualizer.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* As in moodRecognitionKernels.c, each instruction set has its own function compiled with a target attribute and
+ * the choice between them is made at run time by the fe_select_*_kernel() functions.  Every kernel finishes the
+ * samples that do not fill a register with the scalar code, so no alignment or length is required.
+ */
+
+#include <stddef.h>
+#include <math.h>
+#include <immintrin.h>
+#include "featureExtractionKernels.h"
+
+/**************** Scalar kernels ****************/
+
+void fe_downmix_scalar( const float *stereo, const float *window, float *mono, int num )
+{
+    int i;
+
+    if( window == NULL )
+    {
+        for( i=0; i<num; i++ )
+            *(mono+i) = ( *(stereo + 2*i) + *(stereo + 2*i+1) ) / 2;
+    }
+    else
+    {
+        for( i=0; i<num; i++ )
+            *(mono+i) = ( *(stereo + 2*i) + *(stereo + 2*i+1) ) / 2 * *(window+i);
+    }
+}
+
+/******************************************************/
+
+void fe_window_scalar( float *samples, const float *window, int num )
+{
+    int i;
+
+    for( i=0; i<num; i++ )
+        *(samples+i) *= *(window+i);
+}
+
+/******************************************************/
+
+void fe_magnitude_scalar( const fftwf_complex *dft, float *magnitude, int num )
+{
+    int     i;
+    double  a, b;
+
+    for( i=0; i<num; i++ )
+    {
+        a = *( *(dft+i) );          /* Dereferencing dft returns a pointer to the real part */
+        b = *( *(dft+i) + 1 );      /* and the imaginary part follows it */
+        *(magnitude+i) = (float)sqrt( a*a + b*b );
+    }
+}
+
+/****************** SSE2 kernels ******************/
+
+__attribute__((target("sse2")))
+void fe_downmix_sse2( const float *stereo, const float *window, float *mono, int num )
+{
+    __m128  a, b, sum;
+    __m128  half = _mm_set1_ps( 0.5f );
+    int     i;
+
+    for( i=0; i+4<=num; i+=4 )
+    {
+        a = _mm_loadu_ps( stereo + 2*i );
+        b = _mm_loadu_ps( stereo + 2*i + 4 );
+        sum = _mm_add_ps( _mm_shuffle_ps( a, b, _MM_SHUFFLE( 2, 0, 2, 0 ) ),      /* left + right */
+                          _mm_shuffle_ps( a, b, _MM_SHUFFLE( 3, 1, 3, 1 ) ) );
+        sum = _mm_mul_ps( sum, half );
+        if( window != NULL )
+            sum = _mm_mul_ps( sum, _mm_loadu_ps( window + i ) );
+        _mm_storeu_ps( mono + i, sum );
+    }
+
+    fe_downmix_scalar( stereo + 2*i, window == NULL ? NULL : window + i, mono + i, num - i );
+}
+
+/******************************************************/
+
+__attribute__((target("sse2")))
+void fe_window_sse2( float *samples, const float *window, int num )
+{
+    int i;
+
+    for( i=0; i+4<=num; i+=4 )
+        _mm_storeu_ps( samples + i, _mm_mul_ps( _mm_loadu_ps( samples + i ), _mm_loadu_ps( window + i ) ) );
+
+    fe_window_scalar( samples + i, window + i, num - i );
+}
+
+/******************************************************/
+
+/* Squared magnitudes of the two complex numbers in v, in double */
+__attribute__((target("sse2")))
+static inline __m128d fe_power_sse2( __m128 v )
+{
+    __m128d lo = _mm_cvtps_pd( v );                     /* re0 im0 */
+    __m128d hi = _mm_cvtps_pd( _mm_movehl_ps( v, v ) ); /* re1 im1 */
+
+    lo = _mm_mul_pd( lo, lo );
+    hi = _mm_mul_pd( hi, hi );
+
+    return _mm_add_pd( _mm_unpacklo_pd( lo, hi ), _mm_unpackhi_pd( lo, hi ) );
+}
+
+__attribute__((target("sse2")))
+void fe_magnitude_sse2( const fftwf_complex *dft, float *magnitude, int num )
+{
+    const float *in = (const float*)dft;
+    __m128d     p0, p1;
+    int         i;
+
+    for( i=0; i+4<=num; i+=4 )
+    {
+        p0 = fe_power_sse2( _mm_loadu_ps( in + 2*i ) );
+        p1 = fe_power_sse2( _mm_loadu_ps( in + 2*i + 4 ) );
+        p0 = _mm_sqrt_pd( p0 );
+        p1 = _mm_sqrt_pd( p1 );
+        _mm_storeu_ps( magnitude + i, _mm_movelh_ps( _mm_cvtpd_ps( p0 ), _mm_cvtpd_ps( p1 ) ) );
+    }
+
+    fe_magnitude_scalar( dft + i, magnitude + i, num - i );
+}
+
+/****************** AVX2 kernels ******************/
+
+__attribute__((target("avx2")))
+void fe_downmix_avx2( const float *stereo, const float *window, float *mono, int num )
+{
+    __m256  sum;
+    __m256  half = _mm256_set1_ps( 0.5f );
+    int     i;
+
+    for( i=0; i+8<=num; i+=8 )
+    {
+        /* The pairwise add gives samples 0 1 4 5 2 3 6 7, reorder the 64-bit pairs */
+        sum = _mm256_hadd_ps( _mm256_loadu_ps( stereo + 2*i ), _mm256_loadu_ps( stereo + 2*i + 8 ) );
+        sum = _mm256_castpd_ps( _mm256_permute4x64_pd( _mm256_castps_pd( sum ), _MM_SHUFFLE( 3, 1, 2, 0 ) ) );
+        sum = _mm256_mul_ps( sum, half );
+        if( window != NULL )
+            sum = _mm256_mul_ps( sum, _mm256_loadu_ps( window + i ) );
+        _mm256_storeu_ps( mono + i, sum );
+    }
+
+    fe_downmix_scalar( stereo + 2*i, window == NULL ? NULL : window + i, mono + i, num - i );
+}
+
+/******************************************************/
+
+__attribute__((target("avx2")))
+void fe_window_avx2( float *samples, const float *window, int num )
+{
+    int i;
+
+    for( i=0; i+8<=num; i+=8 )
+        _mm256_storeu_ps( samples + i, _mm256_mul_ps( _mm256_loadu_ps( samples + i ), _mm256_loadu_ps( window + i ) ) );
+
+    fe_window_scalar( samples + i, window + i, num - i );
+}
+
+/******************************************************/
+
+__attribute__((target("avx2")))
+void fe_magnitude_avx2( const fftwf_complex *dft, float *magnitude, int num )
+{
+    const float *in = (const float*)dft;
+    __m256d     lo, hi, power;
+    int         i;
+
+    for( i=0; i+4<=num; i+=4 )
+    {
+        lo = _mm256_cvtps_pd( _mm_loadu_ps( in + 2*i ) );       /* re0 im0 re1 im1 */
+        hi = _mm256_cvtps_pd( _mm_loadu_ps( in + 2*i + 4 ) );   /* re2 im2 re3 im3 */
+        lo = _mm256_mul_pd( lo, lo );
+        hi = _mm256_mul_pd( hi, hi );
+
+        /* The pairwise add gives bins 0 2 1 3 */
+        power = _mm256_permute4x64_pd( _mm256_hadd_pd( lo, hi ), _MM_SHUFFLE( 3, 1, 2, 0 ) );
+        power = _mm256_sqrt_pd( power );
+        _mm_storeu_ps( magnitude + i, _mm256_cvtpd_ps( power ) );
+    }
+
+    fe_magnitude_scalar( dft + i, magnitude + i, num - i );
+}
+
+/***************** AVX-512 kernels *****************/
+
+__attribute__((target("avx512f")))
+void fe_downmix_avx512( const float *stereo, const float *window, float *mono, int num )
+{
+    __m512  a, b, sum;
+    __m512i even = _mm512_set_epi32( 30, 28, 26, 24, 22, 20, 18, 16, 14, 12, 10, 8, 6, 4, 2, 0 );
+    __m512i odd =  _mm512_set_epi32( 31, 29, 27, 25, 23, 21, 19, 17, 15, 13, 11, 9, 7, 5, 3, 1 );
+    __m512  half = _mm512_set1_ps( 0.5f );
+    int     i;
+
+    for( i=0; i+16<=num; i+=16 )
+    {
+        a = _mm512_loadu_ps( stereo + 2*i );
+        b = _mm512_loadu_ps( stereo + 2*i + 16 );
+        sum = _mm512_add_ps( _mm512_permutex2var_ps( a, even, b ), _mm512_permutex2var_ps( a, odd, b ) );
+        sum = _mm512_mul_ps( sum, half );
+        if( window != NULL )
+            sum = _mm512_mul_ps( sum, _mm512_loadu_ps( window + i ) );
+        _mm512_storeu_ps( mono + i, sum );
+    }
+
+    fe_downmix_scalar( stereo + 2*i, window == NULL ? NULL : window + i, mono + i, num - i );
+}
+
+/******************************************************/
+
+__attribute__((target("avx512f")))
+void fe_window_avx512( float *samples, const float *window, int num )
+{
+    int i;
+
+    for( i=0; i+16<=num; i+=16 )
+        _mm512_storeu_ps( samples + i, _mm512_mul_ps( _mm512_loadu_ps( samples + i ), _mm512_loadu_ps( window + i ) ) );
+
+    fe_window_scalar( samples + i, window + i, num - i );
+}
+
+/******************************************************/
+
+__attribute__((target("avx512f")))
+void fe_magnitude_avx512( const fftwf_complex *dft, float *magnitude, int num )
+{
+    const float *in = (const float*)dft;
+    __m512d     lo, hi, power;
+    __m512i     even = _mm512_set_epi64( 14, 12, 10, 8, 6, 4, 2, 0 );
+    __m512i     odd =  _mm512_set_epi64( 15, 13, 11, 9, 7, 5, 3, 1 );
+    int         i;
+
+    for( i=0; i+8<=num; i+=8 )
+    {
+        lo = _mm512_cvtps_pd( _mm256_loadu_ps( in + 2*i ) );
+        hi = _mm512_cvtps_pd( _mm256_loadu_ps( in + 2*i + 8 ) );
+        lo = _mm512_mul_pd( lo, lo );
+        hi = _mm512_mul_pd( hi, hi );
+
+        /* Real squares plus imaginary squares, in bin order */
+        power = _mm512_add_pd( _mm512_permutex2var_pd( lo, even, hi ), _mm512_permutex2var_pd( lo, odd, hi ) );
+        power = _mm512_sqrt_pd( power );
+        _mm256_storeu_ps( magnitude + i, _mm512_cvtpd_ps( power ) );
+    }
+
+    fe_magnitude_scalar( dft + i, magnitude + i, num - i );
+}
+
+/******************** Selection ********************/
+
+int fe_simd_level( void )
+{
+    __builtin_cpu_init();
+
+    if( __builtin_cpu_supports( "avx512f" ) )
+        return 3;
+    if( __builtin_cpu_supports( "avx2" ) )
+        return 2;
+    if( __builtin_cpu_supports( "sse2" ) )
+        return 1;
+
+    return 0;
+}
+
+/******************************************************/
+
+fe_downmix_kernel fe_select_downmix_kernel( const char **name )
+{
+    const char          *names[4] = { "scalar", "SSE2", "AVX2", "AVX-512" };
+    fe_downmix_kernel   kernels[4] = { fe_downmix_scalar, fe_downmix_sse2, fe_downmix_avx2, fe_downmix_avx512 };
+    int                 level = fe_simd_level();
+
+    if( name != NULL )
+        *name = names[level];
+
+    return kernels[level];
+}
+
+/******************************************************/
+
+fe_window_kernel fe_select_window_kernel( void )
+{
+    fe_window_kernel    kernels[4] = { fe_window_scalar, fe_window_sse2, fe_window_avx2, fe_window_avx512 };
+
+    return kernels[fe_simd_level()];
+}
+
+/******************************************************/
+
+fe_magnitude_kernel fe_select_magnitude_kernel( void )
+{
+    fe_magnitude_kernel kernels[4] = { fe_magnitude_scalar, fe_magnitude_sse2, fe_magnitude_avx2, fe_magnitude_avx512 };
+
+    return kernels[fe_simd_level()];
+}
@@ -30,6 +30,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <malloc.h>
 #include <process.h>
 #include <math.h>
 #include <SDL.h>
@@ -47,12 +48,18 @@ id_imageDisplay_data id_initialize_imageDisplay_data( void )
     SDL_Surface         *convertedSurface = NULL;  /* The surface converted to the window's pixel format */
     SDL_Surface         *BMPSurface = NULL;        /* Loaded BMP image */
     SDL_Renderer        *renderer = NULL;          /* Texture Renderer */
-    id_hsvPixel         *hsvPixelData = NULL;      /* Points to image's original pixels converted to HSV color space */
+    id_hsv_planes       hsvPixelData;              /* Image's original pixels converted to HSV color space */
+    id_pixel_packer     packer;                    /* Converts pixels into the textures' format */
+    id_tile_pool        *pool = NULL;              /* Worker threads for the HSV conversion and texture updates */
+    id_texture_mailbox  mailbox;                   /* Hands updated textures to the main thread */
+    SYSTEM_INFO         systemInfo;
+    const char          *kernelName;
     id_texture_info     texture_updating;          /* Four textures used in updating and image display */
     id_texture_info     texture_waiting;
     id_texture_info     texture_foreground;
     id_texture_info     texture_background;
 
+    hsvPixelData.memory =           NULL;
     texture_updating.texture =      NULL;
     texture_updating.pixels =       NULL;
     texture_waiting.texture =       NULL;
@@ -61,17 +68,17 @@ id_imageDisplay_data id_initialize_imageDisplay_data( void )
     texture_foreground.pixels =     NULL;
     texture_background.texture =    NULL;
     texture_background.pixels =     NULL;
+    packer.format =                 NULL;
+    mailbox.published =             NULL;
+    mailbox.taken =                 NULL;
 
     Uint32      *surfacePtr =           NULL;
     Uint32      *textureUpdatingPtr =   NULL;
     Uint32      *textureWaitingPtr =    NULL;
     Uint32      *textureBackgroundPtr = NULL;
     Uint32      *textureForegroundPtr = NULL;
-    id_hsvPixel *hsvPtr =               NULL;
 
     int         i, j;                       /* Counters */
-    Uint8       r, g, b;                    /* Values for RGB color space */
-    float       h, s, v;                    /* Values for HSV colorspace */
 
     /* Load image as an SDL surface, attempting loads until success or the deafult image fails to load */
     while( 1 )
@@ -220,12 +227,54 @@ id_imageDisplay_data id_initialize_imageDisplay_data( void )
     if( SDL_SetTextureBlendMode( texture_foreground.texture, SDL_BLENDMODE_BLEND ) < 0 )
         printf( " WARNING: Error setting texture blend mode\n" );
 
+    /* Pixels are packed straight into the textures' format when it is a 32-bit RGB layout */
+    if( !id_initialize_pixel_packer( &packer, texture_updating.format, &kernelName ) )
+    {
+        fprintf( stderr, "ERROR: Unable to allocate the texture pixel format! SDL Error: %s\n", SDL_GetError() );
+
+        imageDisplay_data.init_success = 0;
+        goto exit;
+    }
+
+    /* One tile worker per processor */
+    pool = (id_tile_pool*)malloc( sizeof(id_tile_pool) );
+    if( pool == NULL )
+    {
+        fprintf( stderr, "ERROR: Not enough memory for the tile pool\n" );
+
+        imageDisplay_data.init_success = 0;
+        goto exit;
+    }
+    GetSystemInfo( &systemInfo );
+    id_initialize_tile_pool( pool, ( systemInfo.dwNumberOfProcessors < ID_MAX_THREADS ) ? (int)systemInfo.dwNumberOfProcessors : ID_MAX_THREADS );
+    if( !pool->init_success )
+    {
+        fprintf( stderr, "ERROR: Unable to start the tile worker threads\n" );
+
+        imageDisplay_data.init_success = 0;
+        goto exit;
+    }
+
+    if( !id_initialize_texture_mailbox( &mailbox ) )
+    {
+        fprintf( stderr, "ERROR: Unable to create the texture mailbox events\n" );
+
+        imageDisplay_data.init_success = 0;
+        goto exit;
+    }
+
+    if( packer.convert != NULL )
+        printf( "\n Texture updates converted by the %s kernel on %d threads\n", kernelName, pool->num_threads );
+    else
+        printf( "\n Texture updates converted with SDL_MapRGB (texture format %s) on %d threads\n",
+                SDL_GetPixelFormatName( texture_updating.format ), pool->num_threads );
+
     /* Copy pixel data from converted surface to all textures */
-    /* Convert to HSV color space and save in array for future use */
-    hsvPixelData = (id_hsvPixel*)malloc( sizeof(id_hsvPixel) * convertedSurface->w * convertedSurface->h );
-    if( hsvPixelData == NULL )
+    /* Convert to HSV color space and save in planes for future use.  The planes are not touched before the tile
+       workers convert the image, so their pages are placed near the worker that updates them */
+    if( !id_allocate_hsv_planes( &hsvPixelData, convertedSurface->w, convertedSurface->h ) )
     {
-        fprintf( stderr, "ERROR: Not enough memory for HSV pixel array\n" );
+        fprintf( stderr, "ERROR: Not enough memory for HSV pixel planes\n" );
 
         imageDisplay_data.init_success = 0;
         goto exit;
@@ -243,7 +292,6 @@ id_imageDisplay_data id_initialize_imageDisplay_data( void )
     textureWaitingPtr =     (Uint32*)texture_waiting.pixels;
     textureBackgroundPtr =  (Uint32*)texture_background.pixels;
     textureForegroundPtr =  (Uint32*)texture_foreground.pixels;
-    hsvPtr =                hsvPixelData;
 
     for( i=0; i<convertedSurface->h; i++ )
     {
@@ -255,22 +303,12 @@ id_imageDisplay_data id_initialize_imageDisplay_data( void )
             *( textureWaitingPtr + (i*(texture_waiting.pitch / 4)) + j ) = *( surfacePtr + (i*(convertedSurface->pitch / 4)) + j );
             *( textureBackgroundPtr + (i*(texture_background.pitch / 4)) + j ) = *( surfacePtr + (i*(convertedSurface->pitch / 4)) + j );
             *( textureForegroundPtr + (i*(texture_foreground.pitch / 4)) + j ) = *( surfacePtr + (i*(convertedSurface->pitch / 4)) + j );
-
-            /* Copy and convert RGB data to HSV array */
-            SDL_GetRGB( *( surfacePtr + (i*(convertedSurface->pitch / 4)) + j ),
-                        convertedSurface->format,
-                        &r,
-                        &g,
-                        &b );
-            RGBtoHSV( (int)r, (int)g, (int)b, &h, &s, &v );
-            hsvPtr->h = h;
-            hsvPtr->s = s;
-            hsvPtr->v = v;
-
-            hsvPtr++;
         }
     }
 
+    /* Convert RGB data to HSV planes */
+    id_convert_to_hsv_tiled( pool, surfacePtr, convertedSurface->pitch, convertedSurface->format, &hsvPixelData );
+
     /* Unlock textures after accessing pixel information and reset pixels and pitch values when not in use */
     SDL_UnlockTexture( texture_updating.texture );
     texture_updating.pixels = NULL;
@@ -313,7 +351,12 @@ exit:
         SDL_DestroyWindow( window );
         SDL_FreeSurface( convertedSurface );
         SDL_FreeSurface( BMPSurface );
-        free( hsvPixelData );
+        id_free_hsv_planes( &hsvPixelData );
+        id_clean_pixel_packer( &packer );
+        if( pool != NULL )
+            id_clean_tile_pool( pool );
+        free( pool );
+        id_clean_texture_mailbox( &mailbox );
 
         imageDisplay_data.window =                      NULL;
         imageDisplay_data.texture_updating.texture =    NULL;
@@ -324,7 +367,11 @@ exit:
         imageDisplay_data.texture_foreground.pixels =   NULL;
         imageDisplay_data.texture_background.texture =  NULL;
         imageDisplay_data.texture_background.pixels =   NULL;
-        imageDisplay_data.hsvPixelData =                NULL;
+        imageDisplay_data.hsvPixelData.memory =         NULL;
+        imageDisplay_data.packer.format =               NULL;
+        imageDisplay_data.pool =                        NULL;
+        imageDisplay_data.mailbox.published =           NULL;
+        imageDisplay_data.mailbox.taken =               NULL;
     }
     else
     {
@@ -335,6 +382,9 @@ exit:
         imageDisplay_data.texture_background =  texture_background;
         imageDisplay_data.texture_foreground =  texture_foreground;
         imageDisplay_data.hsvPixelData =        hsvPixelData;
+        imageDisplay_data.packer =              packer;
+        imageDisplay_data.pool =                pool;
+        imageDisplay_data.mailbox =             mailbox;
 
         /* Free original BMP and converted surfaces, no longer need them */
         SDL_FreeSurface( convertedSurface );
@@ -363,8 +413,13 @@ void id_clean_imageDisplay_data( id_imageDisplay_data *display_data )
     display_data->window = NULL;
 
     /* Free memory */
-    free( display_data->hsvPixelData );
-    display_data->hsvPixelData = NULL;
+    id_free_hsv_planes( &(display_data->hsvPixelData) );
+    id_clean_pixel_packer( &(display_data->packer) );
+    if( display_data->pool != NULL )
+        id_clean_tile_pool( display_data->pool );
+    free( display_data->pool );
+    display_data->pool = NULL;
+    id_clean_texture_mailbox( &(display_data->mailbox) );
 
     return;
 }
@@ -372,63 +427,497 @@ void id_clean_imageDisplay_data( id_imageDisplay_data *display_data )
 /*******************************************************************/
 
 void id_updateTexture( id_texture_info *texture,
-                       const struct SDL_PixelFormat *format,
-                       id_hsvPixel *hsvPtr,
+                       const id_pixel_packer *packer,
+                       id_tile_pool *pool,
+                       const id_hsv_planes *planes,
                        float arousal,
                        float valence )
 {
-    Uint32  *pixelPtr;
-    Uint32  rgbPixel;
-    float   beta, gamma;      /* Saturation and value modifiers */
-    float   s_temp, v_temp;
-    int     r, g, b;
-    int     i, j;
+    id_transfer_lut lut;
+    float           beta, gamma;      /* Saturation and value modifiers */
+
+    /* Raise every saturation and value level once instead of every pixel */
+    id_modulation_exponents( arousal, valence, &beta, &gamma );
+    id_build_transfer_lut( &lut, beta, gamma );
 
+    /* Lock texture to acces pixel information and update */
+    if( SDL_LockTexture( texture->texture, NULL, &(texture->pixels), &(texture->pitch) ) < 0 )
+    {
+        fprintf( stderr, "Unable to lock texture!\n" );
+        return;
+    }
+
+    id_modulate_pixels_tiled( pool, (Uint32*)texture->pixels, texture->pitch, packer, planes, &lut );
+
+    /* Unlock texture */
+    SDL_UnlockTexture( texture->texture );
+    texture->pixels = NULL;
+    texture->pitch = 0;
+
+    return;
+}
+
+/******************************************************************/
+
+void id_modulation_exponents( float arousal, float valence, float *beta, float *gamma )
+{
     /* Saturation modifier */
     if( arousal > 0 )
-        beta = 1 - arousal;
+        *beta = 1 - arousal;
     else
-        beta = 1 / (1 + arousal);
+        *beta = 1 / (1 + arousal);
 
     /* Value (brightness) modifier */
     if( valence > 0 )
-        gamma = 1 - valence;
+        *gamma = 1 - valence;
     else
-        gamma = 1 / (1 + valence);
+        *gamma = 1 / (1 + valence);
 
-    /* Lock texture to acces pixel information and update */
-    if( SDL_LockTexture( texture->texture, NULL, &(texture->pixels), &(texture->pitch) ) < 0 )
+    return;
+}
+
+/******************************************************************/
+
+void id_build_transfer_lut( id_transfer_lut *lut, float beta, float gamma )
+{
+    int i;
+
+    /* Same float levels as id_quantize_hsv() stores, and the same double precision pow() as per pixel */
+    for( i=0; i<ID_SATURATION_LEVELS; i++ )
+        *(lut->s + i) = (float)pow( (double)( (float)i / (ID_SATURATION_LEVELS - 1) ), (double)beta );
+    for( i=0; i<ID_VALUE_LEVELS; i++ )
+        *(lut->v + i) = (float)pow( (double)( (float)i / (ID_VALUE_LEVELS - 1) ), (double)gamma );
+
+    return;
+}
+
+/******************************************************************/
+
+int id_allocate_hsv_planes( id_hsv_planes *planes, int w, int h )
+{
+    /* Each row starts on an ID_HSV_ALIGNMENT boundary in all three planes */
+    planes->stride = ( w + ID_HSV_ALIGNMENT - 1 ) / ID_HSV_ALIGNMENT * ID_HSV_ALIGNMENT;
+    planes->width = w;
+    planes->height = h;
+
+    planes->memory = _aligned_malloc( (size_t)planes->stride * h * ( 2*sizeof(Uint16) + sizeof(Uint8) ),
+                                      ID_HSV_ALIGNMENT );
+    if( planes->memory == NULL )
+        return 0;
+
+    planes->hue =           (Uint16*)planes->memory;
+    planes->saturation =    planes->hue + (size_t)planes->stride * h;
+    planes->value =         (Uint8*)( planes->saturation + (size_t)planes->stride * h );
+
+    return 1;
+}
+
+/******************************************************************/
+
+void id_free_hsv_planes( id_hsv_planes *planes )
+{
+    if( planes->memory != NULL )
+        _aligned_free( planes->memory );
+    planes->memory = NULL;
+    planes->hue = NULL;
+    planes->saturation = NULL;
+    planes->value = NULL;
+
+    return;
+}
+
+/******************************************************************/
+
+void id_quantize_hsv( id_hsv_planes *planes, int index, float h, float s, float v )
+{
+    /* The undefined hue of a grey pixel is stored as 0, which converts the same when s == 0 */
+    *(planes->hue + index) =        ( h < 0 ) ? 0 : (Uint16)( h / 60 * ID_HUE_STEPS + 0.5f );
+    *(planes->saturation + index) = (Uint16)( s * (ID_SATURATION_LEVELS - 1) + 0.5f );
+    *(planes->value + index) =      (Uint8)( v * (ID_VALUE_LEVELS - 1) + 0.5f );
+
+    return;
+}
+
+/******************************************************************/
+
+void id_modulate_pixels( Uint32 *pixels,
+                         int pitch,
+                         const id_pixel_packer *packer,
+                         const id_hsv_planes *planes,
+                         int first_row,
+                         int num_rows,
+                         const id_transfer_lut *lut )
+{
+    int     r, g, b;
+    int     i, j, k;
+
+    /* Note: pitch is in bytes and is not always four times the width */
+    if( packer->convert != NULL )
     {
-        fprintf( stderr, "Unable to lock texture!\n" );
+        for( i=first_row; i<first_row+num_rows; i++ )
+        {
+            k = i*planes->stride;
+            packer->convert( pixels + i*(pitch / 4), planes->hue + k, planes->saturation + k, planes->value + k,
+                             lut, &(packer->layout), planes->width );
+        }
+
         return;
     }
-    pixelPtr = (Uint32*)texture->pixels;
 
-    for( i=0; i<texture->h; i++ )
+    for( i=first_row; i<first_row+num_rows; i++ )
     {
-        for( j=0; j<texture->w; j++ )
+        for( j=0; j<planes->width; j++ )
         {
-            /* Modify the saturation and brightness values of the original pixel and convert to RGB values */
-            s_temp = (float)pow( (double)hsvPtr->s, (double)beta );
-            v_temp = (float)pow( (double)hsvPtr->v, (double)gamma );
+            k = i*planes->stride + j;
+
+            /* Modify the saturation and brightness values of the original pixel and convert to RGB values.  The hue
+               steps are powers of two of a degree times 60, so HSVtoRGB() divides them back exactly */
+            HSVtoRGB( &r, &g, &b, *(planes->hue + k) * ( 60.0f / ID_HUE_STEPS ),
+                      *(lut->s + *(planes->saturation + k)), *(lut->v + *(planes->value + k)) );
+
+            /* Clamp as the conversion kernels do */
+            r = (r < 0) ? 0 : ( (r > 255) ? 255 : r );
+            g = (g < 0) ? 0 : ( (g > 255) ? 255 : g );
+            b = (b < 0) ? 0 : ( (b > 255) ? 255 : b );
+
+            *( pixels + i*(pitch / 4) + j ) = SDL_MapRGB( packer->format, (Uint8)r, (Uint8)g, (Uint8)b );
+        }
+    }
+
+    return;
+}
+
+/******************************************************************/
+
+int id_initialize_pixel_packer( id_pixel_packer *packer, Uint32 format, const char **name )
+{
+    packer->format = SDL_AllocFormat( format );
+    if( packer->format == NULL )
+        return 0;
+
+    if( id_pixel_layout_of( format, &(packer->layout) ) )
+        packer->convert = id_select_convert_kernel( name );
+    else
+    {
+        packer->convert = NULL;
+        if( name != NULL )
+            *name = "SDL_MapRGB";
+    }
+
+    return 1;
+}
+
+/******************************************************************/
+
+void id_clean_pixel_packer( id_pixel_packer *packer )
+{
+    if( packer->format != NULL )
+        SDL_FreeFormat( packer->format );
+    packer->format = NULL;
+    packer->convert = NULL;
+
+    return;
+}
+
+/******************************************************************/
 
-            HSVtoRGB( &r, &g, &b, hsvPtr->h, s_temp, v_temp );
+/* Tiles of id_modulate_pixels_tiled() */
+typedef struct
+{
+    Uint32                  *pixels;
+    int                     pitch;
+    const id_pixel_packer   *packer;
+    const id_hsv_planes     *planes;
+    const id_transfer_lut   *lut;
+}
+id_modulate_job;
+
+static void id_modulate_tile( void *job, int first_row, int num_rows )
+{
+    id_modulate_job *m = (id_modulate_job*)job;
+
+    id_modulate_pixels( m->pixels, m->pitch, m->packer, m->planes, first_row, num_rows, m->lut );
+}
+
+void id_modulate_pixels_tiled( id_tile_pool *pool,
+                               Uint32 *pixels,
+                               int pitch,
+                               const id_pixel_packer *packer,
+                               const id_hsv_planes *planes,
+                               const id_transfer_lut *lut )
+{
+    id_modulate_job job;
 
-            r = (r > 255) ? 255 : r;
-            g = (g > 255) ? 255 : g;
-            b = (b > 255) ? 255 : b;
+    job.pixels =    pixels;
+    job.pitch =     pitch;
+    job.packer =    packer;
+    job.planes =    planes;
+    job.lut =       lut;
 
-            rgbPixel = SDL_MapRGB( format, (Uint8)r, (Uint8)g, (Uint8)b );
-            *( pixelPtr + i*(texture->pitch / 4) + j ) = rgbPixel;
+    id_run_tiles( pool, id_modulate_tile, &job, planes->height );
 
-            hsvPtr++;
+    return;
+}
+
+/******************************************************************/
+
+/* Tiles of id_convert_to_hsv_tiled() */
+typedef struct
+{
+    const Uint32                    *pixels;
+    int                             pitch;
+    const struct SDL_PixelFormat    *format;
+    id_hsv_planes                   *planes;
+}
+id_convert_job;
+
+static void id_convert_tile( void *job, int first_row, int num_rows )
+{
+    id_convert_job  *c = (id_convert_job*)job;
+    Uint8           r, g, b;                    /* Values for RGB color space */
+    float           h, s, v;                    /* Values for HSV colorspace */
+    int             i, j;
+
+    for( i=first_row; i<first_row+num_rows; i++ )
+    {
+        for( j=0; j<c->planes->width; j++ )
+        {
+            SDL_GetRGB( *( c->pixels + i*(c->pitch / 4) + j ), c->format, &r, &g, &b );
+            RGBtoHSV( (int)r, (int)g, (int)b, &h, &s, &v );
+            id_quantize_hsv( c->planes, i*c->planes->stride + j, h, s, v );
         }
     }
+}
 
-    /* Unlock texture */
-    SDL_UnlockTexture( texture->texture );
-    texture->pixels = NULL;
-    texture->pitch = 0;
+void id_convert_to_hsv_tiled( id_tile_pool *pool,
+                              const Uint32 *pixels,
+                              int pitch,
+                              const struct SDL_PixelFormat *format,
+                              id_hsv_planes *planes )
+{
+    id_convert_job job;
+
+    job.pixels =    pixels;
+    job.pitch =     pitch;
+    job.format =    format;
+    job.planes =    planes;
+
+    id_run_tiles( pool, id_convert_tile, &job, planes->height );
+
+    return;
+}
+
+/******************************************************************/
+
+void id_initialize_tile_pool( id_tile_pool *pool, int num_threads )
+{
+    id_tile_worker  *worker;
+    unsigned        threadId;
+    int             i;
+
+    pool->init_success =        0;
+    pool->num_threads =         0;
+    pool->workers_remaining =   0;
+    pool->terminate_threads =   0;
+    pool->function =            NULL;
+    pool->job =                 NULL;
+    pool->num_rows =            0;
+
+    pool->done = CreateEvent( NULL, FALSE, FALSE, NULL );   /* Auto-reset, initially not signaled */
+    if( pool->done == NULL || num_threads < 1 || num_threads > ID_MAX_THREADS )
+        return;
+
+    for( i=0; i<num_threads; i++ )
+    {
+        worker = pool->workers + i;
+        worker->pool =  pool;
+        worker->index = i;
+        worker->start = CreateEvent( NULL, FALSE, FALSE, NULL );
+        if( worker->start == NULL )
+            return;
+
+        worker->thread = (HANDLE)_beginthreadex( NULL, 0, id_tileWorkerRoutine, worker, 0, &threadId );
+        if( worker->thread == 0 )
+        {
+            CloseHandle( worker->start );
+            return;
+        }
+
+        /* Keep each worker on one processor where possible, so the memory it first touched stays local */
+        SetThreadIdealProcessor( worker->thread, (DWORD)i );
+        pool->num_threads++;
+    }
+
+    pool->init_success = 1;
+}
+
+/******************************************************************/
+
+void id_clean_tile_pool( id_tile_pool *pool )
+{
+    int i;
+
+    pool->terminate_threads = 1;
+    for( i=0; i<pool->num_threads; i++ )
+        SetEvent( ( pool->workers + i )->start );   /* Wake every worker to see the flag */
+
+    for( i=0; i<pool->num_threads; i++ )
+    {
+        WaitForSingleObject( ( pool->workers + i )->thread, INFINITE );
+        CloseHandle( ( pool->workers + i )->thread );
+        CloseHandle( ( pool->workers + i )->start );
+    }
+    if( pool->done != NULL )
+        CloseHandle( pool->done );
+
+    pool->num_threads = 0;
+    pool->done = NULL;
+    pool->init_success = 0;
+
+    return;
+}
+
+/******************************************************************/
+
+void id_run_tiles( id_tile_pool *pool, id_tile_function function, void *job, int num_rows )
+{
+    int i;
+
+    pool->function =    function;
+    pool->job =         job;
+    pool->num_rows =    num_rows;
+    InterlockedExchange( &pool->workers_remaining, pool->num_threads );    /* Also orders the job before the events */
+
+    for( i=0; i<pool->num_threads; i++ )
+        SetEvent( ( pool->workers + i )->start );
+
+    WaitForSingleObject( pool->done, INFINITE );
+
+    return;
+}
+
+/******************************************************************/
+
+unsigned int __stdcall id_tileWorkerRoutine( void *lpArg )
+{
+    id_tile_worker  *worker = (id_tile_worker*)lpArg;
+    id_tile_pool    *pool = worker->pool;
+    int             first_row, num_rows;
+
+    while( 1 )
+    {
+        WaitForSingleObject( worker->start, INFINITE );
+        if( pool->terminate_threads )
+            break;
+
+        /* The same tiles every job, see ID_TILE_ROWS */
+        for( first_row = worker->index * ID_TILE_ROWS; first_row < pool->num_rows; first_row += pool->num_threads * ID_TILE_ROWS )
+        {
+            num_rows = ( pool->num_rows - first_row < ID_TILE_ROWS ) ? pool->num_rows - first_row : ID_TILE_ROWS;
+            pool->function( pool->job, first_row, num_rows );
+        }
+
+        if( InterlockedDecrement( &pool->workers_remaining ) == 0 )
+            SetEvent( pool->done );
+    }
+
+    _endthreadex( 0 );
+    return 0;
+}
+
+/******************************************************************/
+
+int id_initialize_texture_mailbox( id_texture_mailbox *mailbox )
+{
+    mailbox->full =     0;
+    mailbox->stopped =  0;
+
+    /* Auto-reset, initially not signaled.  A set that no one waits for yet stays set, so no wakeup is lost */
+    mailbox->published =    CreateEvent( NULL, FALSE, FALSE, NULL );
+    mailbox->taken =        CreateEvent( NULL, FALSE, FALSE, NULL );
+    if( mailbox->published == NULL || mailbox->taken == NULL )
+    {
+        id_clean_texture_mailbox( mailbox );
+        return 0;
+    }
+
+    return 1;
+}
+
+/******************************************************************/
+
+void id_clean_texture_mailbox( id_texture_mailbox *mailbox )
+{
+    if( mailbox->published != NULL )
+        CloseHandle( mailbox->published );
+    if( mailbox->taken != NULL )
+        CloseHandle( mailbox->taken );
+    mailbox->published = NULL;
+    mailbox->taken = NULL;
+
+    return;
+}
+
+/******************************************************************/
+
+void id_publish_texture( id_texture_mailbox *mailbox )
+{
+    /* The exchange orders the writes to texture_waiting before full */
+    InterlockedExchange( &mailbox->full, 1 );
+    SetEvent( mailbox->published );
+
+    return;
+}
+
+/******************************************************************/
+
+int id_wait_until_taken( id_texture_mailbox *mailbox )
+{
+    /* A stale set of taken only costs one more look at full */
+    while( InterlockedCompareExchange( &mailbox->full, 0, 0 ) )
+    {
+        if( mailbox->stopped )
+            return 0;
+        WaitForSingleObject( mailbox->taken, INFINITE );
+    }
+
+    return !mailbox->stopped;
+}
+
+/******************************************************************/
+
+int id_texture_published( id_texture_mailbox *mailbox )
+{
+    return InterlockedCompareExchange( &mailbox->full, 0, 0 ) != 0;
+}
+
+/******************************************************************/
+
+void id_take_texture( id_texture_mailbox *mailbox )
+{
+    /* The exchange orders the main thread's swap of texture_waiting before full */
+    InterlockedExchange( &mailbox->full, 0 );
+    SetEvent( mailbox->taken );
+
+    return;
+}
+
+/******************************************************************/
+
+void id_wait_for_texture( id_texture_mailbox *mailbox )
+{
+    /* Input already seen by SDL_PollEvent() is removed from the queue, so only new messages end the wait */
+    MsgWaitForMultipleObjectsEx( 1, &mailbox->published, INFINITE, QS_ALLINPUT, MWMO_INPUTAVAILABLE );
+
+    return;
+}
+
+/******************************************************************/
+
+void id_stop_texture_mailbox( id_texture_mailbox *mailbox )
+{
+    InterlockedExchange( &mailbox->stopped, 1 );
+    SetEvent( mailbox->taken );
 
     return;
 }
@@ -600,19 +1089,21 @@ unsigned int __stdcall id_textureUpdateRoutine(void *lpArg)
 
         /* Update a third texture not currently being used as the fore/background textures */
         id_updateTexture( &(threadData->imageDisplayData->texture_updating),
-                          SDL_GetWindowSurface( threadData->imageDisplayData->window )->format,
-                          threadData->imageDisplayData->hsvPixelData,
+                          &(threadData->imageDisplayData->packer),
+                          threadData->imageDisplayData->pool,
+                          &(threadData->imageDisplayData->hsvPixelData),
                           cur_arousal,
                           cur_valence );
 
-        /* Wait until foreground texture has reached complete transparency to swap */
-        while( threadData->updatedTexture );
+        /* Sleep until the main thread has taken the last texture, once the foreground has faded out */
+        if( !id_wait_until_taken( &(threadData->imageDisplayData->mailbox) ) )
+            break;
 
         swapTexture = threadData->imageDisplayData->texture_waiting;
         threadData->imageDisplayData->texture_waiting = threadData->imageDisplayData->texture_updating;
         threadData->imageDisplayData->texture_updating = swapTexture;
 
-        threadData->updatedTexture = 1;
+        id_publish_texture( &(threadData->imageDisplayData->mailbox) );
     }
 
     _endthreadex( 0 );
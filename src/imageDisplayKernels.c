@@ -0,0 +1,335 @@
+/* imageDisplayKernels.c Contains the SIMD kernels used to convert the displayed image to RGB
+ * Copyright (c) 2017 Jay Biernat
+ * Copyright (c) 2017 University of Rochester
+ *
+ * This file is part of Musical Mood Detector and Visualizer
+ *
+ * Musical Mood Detector and Visualizer is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Musical Mood Detector and Visualizer is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even
+ * the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Musical Mood Detector and Visualizer.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/* As in featureExtractionKernels.c, each instruction set has its own function compiled with a target attribute and
+ * the choice between them is made at run time by id_select_convert_kernel().  Every kernel finishes the pixels that
+ * do not fill a register with the scalar code, so no alignment or length is required.
+ *
+ * The sectors of HSVtoRGB() take their red, green and blue from v, p, q and t as follows:
+ *
+ *   sector    0  1  2  3  4  5
+ *   red       v  q  p  p  t  v
+ *   green     t  v  v  q  p  p
+ *   blue      p  p  t  v  v  q
+ *
+ * The stored hue is a fixed point number of sectors (see ID_HUE_BITS): its integer part is the sector and its
+ * fractional part f.  A hue of exactly 360 gives sector 6, which HSVtoRGB() treats as sector 5, with f = 0.
+ *
+ * GCC may fuse a multiply and the subtraction that uses it into an FMA instruction when the target has one (AVX-512
+ * does), and its single rounding can move a channel by one, so the products of s are passed through ID_NO_CONTRACT.
+ */
+
+#include <immintrin.h>
+#include "featureExtractionKernels.h"
+#include "imageDisplayKernels.h"
+
+/* An empty statement that GCC must assume changes x, so the operation producing x cannot be fused with the next */
+#define ID_NO_CONTRACT( x ) __asm__( "" : "+v"( x ) )
+
+/**************** Scalar kernel ****************/
+
+void id_convert_scalar( Uint32 *pixels, const Uint16 *hue, const Uint16 *saturation, const Uint8 *value,
+                        const id_transfer_lut *lut, const id_pixel_layout *layout, int num )
+{
+    /* Index into { v, p, q, t } of the red, green and blue of each sector */
+    static const int select[6][3] = { { 0, 3, 1 }, { 2, 0, 1 }, { 1, 0, 3 }, { 1, 2, 0 }, { 3, 1, 0 }, { 0, 1, 2 } };
+    float   c[4];
+    float   s, f;
+    int     rgb[3];
+    int     sector;
+    int     i, k;
+
+    for( i=0; i<num; i++ )
+    {
+        s =     *(lut->s + *(saturation + i));
+        c[0] =  *(lut->v + *(value + i));
+
+        sector = *(hue + i) >> ID_HUE_BITS;
+        f = (float)( *(hue + i) & ( ID_HUE_STEPS - 1 ) ) * ( 1.0f / ID_HUE_STEPS );
+        c[1] = c[0] * ( 1 - s );
+        c[2] = c[0] * ( 1 - s * f );
+        c[3] = c[0] * ( 1 - s * ( 1 - f ) );
+        sector = ( sector > 5 ) ? 5 : sector;
+
+        for( k=0; k<3; k++ )
+        {
+            rgb[k] = (int)( c[select[sector][k]] * 255 );
+            rgb[k] = ( rgb[k] < 0 ) ? 0 : ( ( rgb[k] > 255 ) ? 255 : rgb[k] );
+        }
+
+        *(pixels + i) = ( (Uint32)rgb[0] << layout->r_shift ) | ( (Uint32)rgb[1] << layout->g_shift ) |
+                        ( (Uint32)rgb[2] << layout->b_shift ) | layout->alpha;
+    }
+}
+
+/****************** SSE2 kernel ******************/
+
+/* Where mask is set b, elsewhere a */
+__attribute__((target("sse2")))
+static inline __m128 id_select_sse2( __m128 mask, __m128 a, __m128 b )
+{
+    return _mm_or_ps( _mm_and_ps( mask, b ), _mm_andnot_ps( mask, a ) );
+}
+
+/* Truncates a channel to an integer and clamps it to [0,255] */
+__attribute__((target("sse2")))
+static inline __m128i id_channel_sse2( __m128 c )
+{
+    __m128i x = _mm_cvttps_epi32( _mm_mul_ps( c, _mm_set1_ps( 255.0f ) ) );
+    __m128i over;
+
+    x = _mm_and_si128( x, _mm_cmpgt_epi32( x, _mm_setzero_si128() ) );
+    over = _mm_cmpgt_epi32( x, _mm_set1_epi32( 255 ) );
+
+    return _mm_or_si128( _mm_and_si128( over, _mm_set1_epi32( 255 ) ), _mm_andnot_si128( over, x ) );
+}
+
+__attribute__((target("sse2")))
+void id_convert_sse2( Uint32 *pixels, const Uint16 *hue, const Uint16 *saturation, const Uint8 *value,
+                      const id_transfer_lut *lut, const id_pixel_layout *layout, int num )
+{
+    __m128      one = _mm_set1_ps( 1.0f );
+    __m128      s, v, f, p, q, t, r, g, b;
+    __m128      m[6];
+    __m128i     h, sector, rgb;
+    int         i, k;
+
+    for( i=0; i+4<=num; i+=4 )
+    {
+        /* There is no gather for the table lookups */
+        h = _mm_unpacklo_epi16( _mm_loadl_epi64( (const __m128i*)( hue + i ) ), _mm_setzero_si128() );
+        s = _mm_setr_ps( *(lut->s + *(saturation + i)), *(lut->s + *(saturation + i+1)),
+                         *(lut->s + *(saturation + i+2)), *(lut->s + *(saturation + i+3)) );
+        v = _mm_setr_ps( *(lut->v + *(value + i)), *(lut->v + *(value + i+1)),
+                         *(lut->v + *(value + i+2)), *(lut->v + *(value + i+3)) );
+
+        sector = _mm_srli_epi32( h, ID_HUE_BITS );
+        f = _mm_mul_ps( _mm_cvtepi32_ps( _mm_and_si128( h, _mm_set1_epi32( ID_HUE_STEPS - 1 ) ) ),
+                        _mm_set1_ps( 1.0f / ID_HUE_STEPS ) );
+        p = _mm_mul_ps( v, _mm_sub_ps( one, s ) );
+        q = _mm_mul_ps( s, f );
+        t = _mm_mul_ps( s, _mm_sub_ps( one, f ) );
+        ID_NO_CONTRACT( q );
+        ID_NO_CONTRACT( t );
+        q = _mm_mul_ps( v, _mm_sub_ps( one, q ) );
+        t = _mm_mul_ps( v, _mm_sub_ps( one, t ) );
+
+        for( k=0; k<5; k++ )
+            m[k] = _mm_castsi128_ps( _mm_cmpeq_epi32( sector, _mm_set1_epi32( k ) ) );
+        m[5] = _mm_castsi128_ps( _mm_cmpgt_epi32( sector, _mm_set1_epi32( 4 ) ) );
+
+        r = id_select_sse2( m[1], v, q );
+        r = id_select_sse2( _mm_or_ps( m[2], m[3] ), r, p );
+        r = id_select_sse2( m[4], r, t );
+        g = id_select_sse2( m[0], p, t );
+        g = id_select_sse2( _mm_or_ps( m[1], m[2] ), g, v );
+        g = id_select_sse2( m[3], g, q );
+        b = id_select_sse2( _mm_or_ps( m[0], m[1] ), v, p );
+        b = id_select_sse2( m[2], b, t );
+        b = id_select_sse2( m[5], b, q );
+
+        rgb = _mm_or_si128( _mm_sll_epi32( id_channel_sse2( r ), _mm_cvtsi32_si128( layout->r_shift ) ),
+                            _mm_sll_epi32( id_channel_sse2( g ), _mm_cvtsi32_si128( layout->g_shift ) ) );
+        rgb = _mm_or_si128( rgb, _mm_sll_epi32( id_channel_sse2( b ), _mm_cvtsi32_si128( layout->b_shift ) ) );
+        rgb = _mm_or_si128( rgb, _mm_set1_epi32( (int)layout->alpha ) );
+        _mm_storeu_si128( (__m128i*)( pixels + i ), rgb );
+    }
+
+    id_convert_scalar( pixels + i, hue + i, saturation + i, value + i, lut, layout, num - i );
+}
+
+/****************** AVX2 kernel ******************/
+
+/* Truncates a channel to an integer and clamps it to [0,255] */
+__attribute__((target("avx2")))
+static inline __m256i id_channel_avx2( __m256 c )
+{
+    __m256i x = _mm256_cvttps_epi32( _mm256_mul_ps( c, _mm256_set1_ps( 255.0f ) ) );
+
+    return _mm256_min_epi32( _mm256_max_epi32( x, _mm256_setzero_si256() ), _mm256_set1_epi32( 255 ) );
+}
+
+__attribute__((target("avx2")))
+void id_convert_avx2( Uint32 *pixels, const Uint16 *hue, const Uint16 *saturation, const Uint8 *value,
+                      const id_transfer_lut *lut, const id_pixel_layout *layout, int num )
+{
+    __m256      one = _mm256_set1_ps( 1.0f );
+    __m256      s, v, f, p, q, t, r, g, b;
+    __m256      m[6];
+    __m256i     h, sector, rgb;
+    int         i, k;
+
+    for( i=0; i+8<=num; i+=8 )
+    {
+        h = _mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i*)( hue + i ) ) );
+        s = _mm256_i32gather_ps( lut->s, _mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i*)( saturation + i ) ) ), 4 );
+        v = _mm256_i32gather_ps( lut->v, _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*)( value + i ) ) ), 4 );
+
+        sector = _mm256_srli_epi32( h, ID_HUE_BITS );
+        f = _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_and_si256( h, _mm256_set1_epi32( ID_HUE_STEPS - 1 ) ) ),
+                           _mm256_set1_ps( 1.0f / ID_HUE_STEPS ) );
+        p = _mm256_mul_ps( v, _mm256_sub_ps( one, s ) );
+        q = _mm256_mul_ps( s, f );
+        t = _mm256_mul_ps( s, _mm256_sub_ps( one, f ) );
+        ID_NO_CONTRACT( q );
+        ID_NO_CONTRACT( t );
+        q = _mm256_mul_ps( v, _mm256_sub_ps( one, q ) );
+        t = _mm256_mul_ps( v, _mm256_sub_ps( one, t ) );
+
+        sector = _mm256_min_epi32( sector, _mm256_set1_epi32( 5 ) );
+        for( k=0; k<6; k++ )
+            m[k] = _mm256_castsi256_ps( _mm256_cmpeq_epi32( sector, _mm256_set1_epi32( k ) ) );
+
+        r = _mm256_blendv_ps( v, q, m[1] );
+        r = _mm256_blendv_ps( r, p, _mm256_or_ps( m[2], m[3] ) );
+        r = _mm256_blendv_ps( r, t, m[4] );
+        g = _mm256_blendv_ps( p, t, m[0] );
+        g = _mm256_blendv_ps( g, v, _mm256_or_ps( m[1], m[2] ) );
+        g = _mm256_blendv_ps( g, q, m[3] );
+        b = _mm256_blendv_ps( v, p, _mm256_or_ps( m[0], m[1] ) );
+        b = _mm256_blendv_ps( b, t, m[2] );
+        b = _mm256_blendv_ps( b, q, m[5] );
+
+        rgb = _mm256_or_si256( _mm256_sll_epi32( id_channel_avx2( r ), _mm_cvtsi32_si128( layout->r_shift ) ),
+                               _mm256_sll_epi32( id_channel_avx2( g ), _mm_cvtsi32_si128( layout->g_shift ) ) );
+        rgb = _mm256_or_si256( rgb, _mm256_sll_epi32( id_channel_avx2( b ), _mm_cvtsi32_si128( layout->b_shift ) ) );
+        rgb = _mm256_or_si256( rgb, _mm256_set1_epi32( (int)layout->alpha ) );
+        _mm256_storeu_si256( (__m256i*)( pixels + i ), rgb );
+    }
+
+    /* GCC leaves the upper halves of the registers dirty around the ID_NO_CONTRACT statements, which would slow the
+       SSE code that runs after the kernel */
+    _mm256_zeroupper();
+
+    id_convert_scalar( pixels + i, hue + i, saturation + i, value + i, lut, layout, num - i );
+}
+
+/***************** AVX-512 kernel *****************/
+
+/* Truncates a channel to an integer and clamps it to [0,255] */
+__attribute__((target("avx512f")))
+static inline __m512i id_channel_avx512( __m512 c )
+{
+    __m512i x = _mm512_cvttps_epi32( _mm512_mul_ps( c, _mm512_set1_ps( 255.0f ) ) );
+
+    return _mm512_min_epi32( _mm512_max_epi32( x, _mm512_setzero_si512() ), _mm512_set1_epi32( 255 ) );
+}
+
+__attribute__((target("avx512f")))
+void id_convert_avx512( Uint32 *pixels, const Uint16 *hue, const Uint16 *saturation, const Uint8 *value,
+                        const id_transfer_lut *lut, const id_pixel_layout *layout, int num )
+{
+    __m512      one = _mm512_set1_ps( 1.0f );
+    __m512      s, v, f, p, q, t, r, g, b;
+    __mmask16   m[6];
+    __m512i     h, sector, rgb;
+    int         i, k;
+
+    for( i=0; i+16<=num; i+=16 )
+    {
+        h = _mm512_cvtepu16_epi32( _mm256_loadu_si256( (const __m256i*)( hue + i ) ) );
+        s = _mm512_i32gather_ps( _mm512_cvtepu16_epi32( _mm256_loadu_si256( (const __m256i*)( saturation + i ) ) ), lut->s, 4 );
+        v = _mm512_i32gather_ps( _mm512_cvtepu8_epi32( _mm_loadu_si128( (const __m128i*)( value + i ) ) ), lut->v, 4 );
+
+        sector = _mm512_srli_epi32( h, ID_HUE_BITS );
+        f = _mm512_mul_ps( _mm512_cvtepi32_ps( _mm512_and_si512( h, _mm512_set1_epi32( ID_HUE_STEPS - 1 ) ) ),
+                           _mm512_set1_ps( 1.0f / ID_HUE_STEPS ) );
+        p = _mm512_mul_ps( v, _mm512_sub_ps( one, s ) );
+        q = _mm512_mul_ps( s, f );
+        t = _mm512_mul_ps( s, _mm512_sub_ps( one, f ) );
+        ID_NO_CONTRACT( q );
+        ID_NO_CONTRACT( t );
+        q = _mm512_mul_ps( v, _mm512_sub_ps( one, q ) );
+        t = _mm512_mul_ps( v, _mm512_sub_ps( one, t ) );
+
+        sector = _mm512_min_epi32( sector, _mm512_set1_epi32( 5 ) );
+        for( k=0; k<6; k++ )
+            m[k] = _mm512_cmpeq_epi32_mask( sector, _mm512_set1_epi32( k ) );
+
+        r = _mm512_mask_blend_ps( m[1], v, q );
+        r = _mm512_mask_blend_ps( m[2] | m[3], r, p );
+        r = _mm512_mask_blend_ps( m[4], r, t );
+        g = _mm512_mask_blend_ps( m[0], p, t );
+        g = _mm512_mask_blend_ps( m[1] | m[2], g, v );
+        g = _mm512_mask_blend_ps( m[3], g, q );
+        b = _mm512_mask_blend_ps( m[0] | m[1], v, p );
+        b = _mm512_mask_blend_ps( m[2], b, t );
+        b = _mm512_mask_blend_ps( m[5], b, q );
+
+        rgb = _mm512_or_si512( _mm512_sll_epi32( id_channel_avx512( r ), _mm_cvtsi32_si128( layout->r_shift ) ),
+                               _mm512_sll_epi32( id_channel_avx512( g ), _mm_cvtsi32_si128( layout->g_shift ) ) );
+        rgb = _mm512_or_si512( rgb, _mm512_sll_epi32( id_channel_avx512( b ), _mm_cvtsi32_si128( layout->b_shift ) ) );
+        rgb = _mm512_or_si512( rgb, _mm512_set1_epi32( (int)layout->alpha ) );
+        _mm512_storeu_si512( pixels + i, rgb );
+    }
+
+    /* GCC leaves the upper halves of the registers dirty around the ID_NO_CONTRACT statements, which would slow the
+       SSE code that runs after the kernel */
+    _mm256_zeroupper();
+
+    id_convert_scalar( pixels + i, hue + i, saturation + i, value + i, lut, layout, num - i );
+}
+
+/******************** Selection ********************/
+
+id_convert_kernel id_select_convert_kernel( const char **name )
+{
+    const char          *names[4] = { "scalar", "SSE2", "AVX2", "AVX-512" };
+    id_convert_kernel   kernels[4] = { id_convert_scalar, id_convert_sse2, id_convert_avx2, id_convert_avx512 };
+    int                 level = fe_simd_level();
+
+    if( name != NULL )
+        *name = names[level];
+
+    return kernels[level];
+}
+
+/******************************************************/
+
+int id_pixel_layout_of( Uint32 format, id_pixel_layout *layout )
+{
+    switch( format )
+    {
+        case SDL_PIXELFORMAT_ARGB8888:
+            layout->r_shift = 16;
+            layout->g_shift = 8;
+            layout->b_shift = 0;
+            layout->alpha = 0xFF000000;
+            return 1;
+        case SDL_PIXELFORMAT_RGB888:        /* XRGB8888, SDL_MapRGB() leaves the unused byte zero */
+            layout->r_shift = 16;
+            layout->g_shift = 8;
+            layout->b_shift = 0;
+            layout->alpha = 0;
+            return 1;
+        case SDL_PIXELFORMAT_ABGR8888:
+            layout->r_shift = 0;
+            layout->g_shift = 8;
+            layout->b_shift = 16;
+            layout->alpha = 0xFF000000;
+            return 1;
+        default:
+            return 0;
+    }
+}
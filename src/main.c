@@ -37,6 +37,11 @@
 #include <SDL.h>
 #include "imageDisplay.h"
 
+#include "benchmark.h"
+#include "modelReduction.h"
+#include "batchAnalysis.h"
+#include "multiStream.h"
+
 int getuint( void );    /* Input retrieval and validation */
 void printInfo( void ); /* Prints license and explanation of program */
 
@@ -67,56 +72,118 @@ int main( int argc, char* argv[] )
 
     id_textureThreadStruct              textureUpdateData;
     textureUpdateData.terminate_thread  = 0;
-    textureUpdateData.updatedTexture    = 0;
     textureUpdateData.imageDisplayData  = &displayData;
     textureUpdateData.arousal           = &moodDetectionData.arousal_prediction;
     textureUpdateData.valence           = &moodDetectionData.valence_prediction;
 
+    HANDLE      handle_analysis = 0;
+	unsigned    threadId_analysis;
+
     HANDLE      handle_mood;
 	unsigned    threadId_mood;
 
 	HANDLE      handle_textureUpdate;
 	unsigned    threadId_textureUpdate;
 
+	LARGE_INTEGER   counterFrequency;
+	LARGE_INTEGER   t_start, t_end;
+	double          t_info, t_planning, t_models, t_sdl, t_portaudio, t_display;
+	unsigned int    planner_effort = FE_PLANNER_EFFORT;
+	int             hop_length = HOP_LENGTH;
+	int             buffer_length = BUFFER_LENGTH;
 	int     i;
 
+	/* Command line modes that do not use the audio devices or display */
+	if( argc > 1 && strcmp( argv[1], "-bench" ) == 0 )
+        return bm_run( argc-2, argv+2 );
+	if( argc > 1 && strcmp( argv[1], "-batch" ) == 0 )
+        return ba_run( argc-2, argv+2 );
+	if( argc > 1 && strcmp( argv[1], "-convert" ) == 0 )
+        return mr_run_convert( argc-2, argv+2 );
+	if( argc > 1 && strcmp( argv[1], "-reduce" ) == 0 )
+        return rd_run( argc-2, argv+2 );
+	if( argc > 1 && strcmp( argv[1], "-streams" ) == 0 )
+        return ms_run( argc-2, argv+2 );
+	/* Options of the live mode */
+	for( i=1; i<argc; i++ )
+	{
+	    if( strcmp( argv[i], "-planner" ) == 0 && i+1 < argc && fe_parse_planner_effort( argv[i+1], &planner_effort ) )
+            i++;
+        else if( strcmp( argv[i], "-hop" ) == 0 && i+1 < argc )
+            hop_length = atoi( argv[++i] );
+        else if( strcmp( argv[i], "-buffer" ) == 0 && i+1 < argc && atoi( argv[i+1] ) > 0 )
+            buffer_length = atoi( argv[++i] );
+        else
+        {
+            fprintf( stderr, "Usage: MMDaV [-planner estimate|measure|patient] [-hop samples] [-buffer samples]\n"
+                             "       MMDaV -bench | -batch | -streams | -convert | -reduce ...\n" );
+            return -1;
+        }
+	}
+
 	printInfo();
 
-    /* Initialize feature extraction information */
+    /* Initialize feature extraction information, reading the FFTW wisdom saved by an earlier start */
     printf( "Initializing Feature extraction ...\n" );
+    QueryPerformanceCounter( &t_start );
     fe_initialize_extraction_info( &extraction_info );
+    extraction_info.planner_effort = planner_effort;
+    extraction_info.buffer_length = buffer_length;
+    if( extraction_info.init_success && !fe_set_hop_length( &extraction_info, hop_length ) )
+    {
+        fprintf( stderr, "Hop length must be between 1 and %d samples\n", extraction_info.frame_length );
+        fe_clean_extraction_info( &extraction_info );
+        return -1;
+    }
+    QueryPerformanceCounter( &t_end );
+    t_info = bm_seconds( t_start, t_end );
 
-    /* Initialize arrays for feature extraction */
+    /* Initialize arrays and FFTW plans for feature extraction */
+    QueryPerformanceCounter( &t_start );
     portAudioData = fe_initialize_extraction_thread_data( &extraction_info );
+    QueryPerformanceCounter( &t_end );
+    t_planning = bm_seconds( t_start, t_end );
     if( !portAudioData.init_success )
     {
         fprintf( stderr, "There was a problem initializing the feature extraction process\n  Exiting...\n" );
+        fe_clean_extraction_info( &extraction_info );
         return -1;
     }
 
     /* Initialize models for mood prediction and set up thread data */
     printf( "Initializing Mood detection models ...\n" );
-    moodDetectionData = mr_initialize_mood_detection_data( &extraction_info, portAudioData );
+    QueryPerformanceCounter( &t_start );
+    moodDetectionData = mr_initialize_mood_detection_data( &extraction_info, &portAudioData );
+    QueryPerformanceCounter( &t_end );
+    t_models = bm_seconds( t_start, t_end );
     if( moodDetectionData.init_success == 0 )
     {
         fprintf( stderr, "There was a problem initializing the mood detection models\n  Exiting...\n" );
         fe_clean_extraction_thread_data( &portAudioData );
+        fe_clean_extraction_info( &extraction_info );
         return -1;
     }
 
     /* Initialize SDL */
+    QueryPerformanceCounter( &t_start );
     if( SDL_Init( SDL_INIT_VIDEO ) < 0 )
 	{
 		fprintf( stderr, "SDL could not initialize! SDL Error: %s\n", SDL_GetError() );
 		fe_clean_extraction_thread_data( &portAudioData );
+		fe_clean_extraction_info( &extraction_info );
 		mr_clean_mood_detection_data( &moodDetectionData );
 		return -1;
 	}
 
     /* Initialize portaudio and set device information */
+    QueryPerformanceCounter( &t_end );
+    t_sdl = bm_seconds( t_start, t_end );
     printf( "Initializing PortAudio ...\n" );
 
+    QueryPerformanceCounter( &t_start );
     err = Pa_Initialize();
+    QueryPerformanceCounter( &t_end );
+    t_portaudio = bm_seconds( t_start, t_end );
     if( err != paNoError )
     {
         fprintf( stderr, "An error occured while initializing PortAudio\n" );
@@ -125,6 +192,7 @@ int main( int argc, char* argv[] )
 
         SDL_Quit();
         fe_clean_extraction_thread_data( &portAudioData );
+        fe_clean_extraction_info( &extraction_info );
 		mr_clean_mood_detection_data( &moodDetectionData );
 		return -1;
     }
@@ -214,13 +282,30 @@ int main( int argc, char* argv[] )
 
     /* Initialize image display */
     printf( "\nInitalizing image display ...\n" );
+    QueryPerformanceCounter( &t_start );
     displayData = id_initialize_imageDisplay_data();
+    QueryPerformanceCounter( &t_end );
+    t_display = bm_seconds( t_start, t_end );
     if( displayData.init_success == 0 )
     {
         fprintf( stderr, "There was a problem initializing the image display\n" );
         goto error;
     }
 
+    /* Startup time by stage, leaving out the device prompts */
+    printf( "\nFrames of %d samples every %d samples, device buffers of %d samples\n",
+            extraction_info.frame_length, extraction_info.hop_length, extraction_info.buffer_length );
+    printf( "Startup: %.1f ms\n", 1e3 * ( t_info + t_planning + t_models + t_sdl + t_portaudio + t_display ) );
+    printf( "  extraction info  %8.1f ms   (wisdom %s: %s)\n", 1e3 * t_info,
+            extraction_info.wisdom_loaded ? "read" : "not found", extraction_info.wisdom_path );
+    printf( "  FFTW planning    %8.1f ms   (%s, %d of %d plans from wisdom, wisdom file %.1f ms)\n", 1e3 * t_planning,
+            fe_planner_effort_name( extraction_info.planner_effort ), extraction_info.num_plans_from_wisdom,
+            extraction_info.num_plans, 1e3 * extraction_info.wisdom_seconds );
+    printf( "  mood models      %8.1f ms\n", 1e3 * t_models );
+    printf( "  SDL              %8.1f ms\n", 1e3 * t_sdl );
+    printf( "  PortAudio        %8.1f ms\n", 1e3 * t_portaudio );
+    printf( "  image display    %8.1f ms\n", 1e3 * t_display );
+
     /* Open PortAudio stream */
     if( chosenDeviceNum == 0 )  /* User chose not to use an output device */
     {
@@ -228,7 +313,7 @@ int main( int argc, char* argv[] )
                             &inputParameters,
                             NULL,
                             extraction_info.fs,
-                            extraction_info.frame_length,
+                            extraction_info.buffer_length,
                             paClipOff,
                             paCallBack,
                             &portAudioData);
@@ -241,7 +326,7 @@ int main( int argc, char* argv[] )
                             &inputParameters,
                             &outputParameters,
                             extraction_info.fs,
-                            extraction_info.frame_length,
+                            extraction_info.buffer_length,
                             paClipOff,
                             paCallBack,
                             &portAudioData);
@@ -249,6 +334,19 @@ int main( int argc, char* argv[] )
             goto error;
     }
 
+    /* Start analysis thread before the stream so the ring buffer is drained from the first callback */
+    handle_analysis = (HANDLE)_beginthreadex( NULL,
+                                              0,
+                                              fe_analysisRoutine,
+                                              &portAudioData,
+                                              0,
+                                              &threadId_analysis );
+    if( handle_analysis == 0 )
+    {
+        fprintf( stderr, "Error starting analysis thread\n" );
+        goto error;
+    }
+
     /* Start stream */
     printf( "\nStarting stream ...\n" );
     err = Pa_StartStream( stream );
@@ -299,10 +397,17 @@ int main( int argc, char* argv[] )
 
             /* Update transparency and/or background and foreground images */
             /* Set new transparency */
-            alpha -= 4;
-            if( alpha < 4 )
+            if( alpha >= 8 )
+                alpha -= 4;
+            else if( !id_texture_published( &displayData.mailbox ) )
+            {
+                /* The foreground has faded out and the next texture is not ready: the screen is up to date, so sleep
+                   until the image display thread publishes it or a window message arrives */
+                id_wait_for_texture( &displayData.mailbox );
+                continue;
+            }
+            else
             {
-                while( !textureUpdateData.updatedTexture ); /* Wait until texture has been updated in image display thread to swap */
                 alpha = 255;
                 swapTexture = displayData.texture_foreground;
                 displayData.texture_foreground = displayData.texture_background;
@@ -313,7 +418,7 @@ int main( int argc, char* argv[] )
                 if( SDL_SetTextureAlphaMod( displayData.texture_waiting.texture, (Uint8)255 ) < 0 )
                     printf( " Error setting texture mod\n" );
 
-                textureUpdateData.updatedTexture = 0;       /* Lets thread continue texture updating after swap is complete */
+                id_take_texture( &displayData.mailbox );    /* Lets thread continue texture updating after swap is complete */
             }
 
             if( SDL_SetTextureAlphaMod( displayData.texture_foreground.texture, alpha ) < 0 )
@@ -343,11 +448,26 @@ int main( int argc, char* argv[] )
         printf( "\n\nExiting...\n" );
 
         moodDetectionData.terminate_thread = 1;
+        SetEvent( portAudioData.frame_ready );      /* Wakes the mood thread if it is waiting for a frame */
         textureUpdateData.terminate_thread = 1;
-        textureUpdateData.updatedTexture = 0;       /* Set to zero so texture updating thread does not hang */
+        id_stop_texture_mailbox( &displayData.mailbox );    /* Wakes the texture updating thread if it is waiting */
 
         WaitForSingleObject( handle_mood, 10000 );
         WaitForSingleObject( handle_textureUpdate, 10000 );
+        CloseHandle( handle_mood );
+        CloseHandle( handle_textureUpdate );
+
+        QueryPerformanceFrequency( &counterFrequency );
+        printf( "Mood predictions: %lu (every %d frames, %lu frames skipped)   compute: %.1f us   latency: %.1f us mean, %.1f us max\n",
+                moodDetectionData.num_predictions, moodDetectionData.prediction_cadence, moodDetectionData.frames_skipped,
+                ( moodDetectionData.num_predictions > 0 ) ?
+                    1e6 * (double)moodDetectionData.predict_ticks / moodDetectionData.num_predictions / counterFrequency.QuadPart : 0.0,
+                ( moodDetectionData.num_predictions > 0 ) ?
+                    1e6 * (double)moodDetectionData.latency_ticks / moodDetectionData.num_predictions / counterFrequency.QuadPart : 0.0,
+                1e6 * (double)moodDetectionData.latency_max_ticks / counterFrequency.QuadPart );
+        printf( "Mood thread CPU: %.2f%% of one core, %.1f us per prediction\n",
+                ( moodDetectionData.run_seconds > 0 ) ? 100 * moodDetectionData.cpu_seconds / moodDetectionData.run_seconds : 0.0,
+                ( moodDetectionData.num_predictions > 0 ) ? 1e6 * moodDetectionData.cpu_seconds / moodDetectionData.num_predictions : 0.0 );
     }
 
     /* Clean up */
@@ -355,6 +475,20 @@ int main( int argc, char* argv[] )
     if( err != paNoError )
         goto error;
 
+    portAudioData.terminate_thread = 1;
+    SetEvent( portAudioData.samples_ready );
+    WaitForSingleObject( handle_analysis, 10000 );
+    CloseHandle( handle_analysis );
+    handle_analysis = 0;
+
+    QueryPerformanceFrequency( &counterFrequency );
+    printf( "Audio callbacks: %lu   mean cost: %.1f us   max cost: %.1f us\n",
+            portAudioData.callback_count,
+            ( portAudioData.callback_count > 0 ) ?
+                1e6 * (double)portAudioData.callback_ticks / portAudioData.callback_count / counterFrequency.QuadPart : 0.0,
+            1e6 * (double)portAudioData.callback_max_ticks / counterFrequency.QuadPart );
+    printf( "Ring buffer overruns: %lu   Input overflows: %lu\n", portAudioData.overruns, portAudioData.input_overflows );
+
     err = Pa_CloseStream( stream );
     if( err != paNoError )
         goto error;
@@ -367,6 +501,7 @@ int main( int argc, char* argv[] )
     SDL_Quit();
     mr_clean_mood_detection_data( &moodDetectionData );
     fe_clean_extraction_thread_data( &portAudioData );
+    fe_clean_extraction_info( &extraction_info );
     free(input_list_num);
     free(output_list_num);
 
@@ -381,12 +516,21 @@ error:
         fprintf( stderr, "Error message: %s\n", Pa_GetErrorText( err ) );
     }
 
+    if( handle_analysis != 0 )
+    {
+        portAudioData.terminate_thread = 1;
+        SetEvent( portAudioData.samples_ready );
+        WaitForSingleObject( handle_analysis, 10000 );
+        CloseHandle( handle_analysis );
+    }
+
     Pa_Terminate();
     if( displayData.init_success == 1)
         id_clean_imageDisplay_data( &displayData );
     SDL_Quit();
     mr_clean_mood_detection_data( &moodDetectionData );
     fe_clean_extraction_thread_data( &portAudioData );
+    fe_clean_extraction_info( &extraction_info );
     free(input_list_num);
     free(output_list_num);
 
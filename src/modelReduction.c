@@ -0,0 +1,502 @@
+/* modelReduction.c Offline tool that removes support vectors from a trained SVR model within an error budget
+ * Copyright (c) 2017 Jay Biernat
+ * Copyright (c) 2017 University of Rochester
+ *
+ * This file is part of Musical Mood Detector and Visualizer
+ *
+ * Musical Mood Detector and Visualizer is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Musical Mood Detector and Visualizer is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even
+ * the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Musical Mood Detector and Visualizer.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <windows.h>
+#include "moodRecognition.h"
+#include "modelReduction.h"
+#include "benchmark.h"
+
+/* Importance of one support vector, sorted by rd_compare_rank() */
+typedef struct
+{
+    double  importance;
+    int     index;
+}
+rd_rank;
+
+/* Kernel values of the calibration set and the full model's predictions on it, shared by the helpers below */
+typedef struct
+{
+    float   *kernel;        /* num_vectors x num_sv, kernel of calibration vector c and support vector i */
+    double  *target;        /* num_vectors predictions of the full model, without the bias */
+    int     num_vectors;
+    int     num_sv;
+}
+rd_calibration;
+
+/***************************************************/
+
+/* qsort() comparison putting the most important support vectors first */
+static int rd_compare_rank( const void *a, const void *b )
+{
+    double difference = ((const rd_rank*)b)->importance - ((const rd_rank*)a)->importance;
+
+    return ( difference > 0 ) - ( difference < 0 );
+}
+
+/***************************************************/
+
+/* Largest error over the calibration set of the model made of the first num_kept support vectors in kept */
+static double rd_max_error( const rd_calibration *cal, const int *kept, const double *alpha, int num_kept )
+{
+    const float *row;
+    double      prediction, error;
+    double      max_error = 0;
+    int         c, j;
+
+    for( c=0; c<cal->num_vectors; c++ )
+    {
+        row = cal->kernel + (size_t)c * cal->num_sv;
+        prediction = 0;
+        for( j=0; j<num_kept; j++ )
+            prediction += *(alpha+j) * *( row + *(kept+j) );
+
+        error = fabs( prediction - *( cal->target + c ) );
+        if( error > max_error )
+            max_error = error;
+    }
+
+    return max_error;
+}
+
+/***************************************************/
+
+/* Least squares weights of the first num_kept support vectors in kept, fit to the full model on the even calibration
+   vectors (the odd ones are left out so the budget check sees vectors the fit has not).  Solves the ridge
+   regularized normal equations by Cholesky decomposition in the num_kept x num_kept array normal.  Returns 0 if the
+   system is not positive definite */
+static int rd_refit( const rd_calibration *cal, const int *kept, int num_kept, double *normal, double *alpha )
+{
+    const float *row;
+    double      ridge = 0;
+    double      sum;
+    int         c, i, j, k;
+
+    memset( normal, 0, sizeof(double) * num_kept * num_kept );
+    memset( alpha, 0, sizeof(double) * num_kept );
+
+    /* Lower triangle of K'K and K'target */
+    for( c=0; c<cal->num_vectors; c+=2 )
+    {
+        row = cal->kernel + (size_t)c * cal->num_sv;
+        for( i=0; i<num_kept; i++ )
+        {
+            for( j=0; j<=i; j++ )
+                *( normal + i*num_kept + j ) += (double)*( row + *(kept+i) ) * *( row + *(kept+j) );
+            *(alpha+i) += *( row + *(kept+i) ) * *( cal->target + c );
+        }
+    }
+    for( i=0; i<num_kept; i++ )
+        ridge += *( normal + i*num_kept + i );
+    ridge = RD_RIDGE * ridge / num_kept + 1e-300;
+    for( i=0; i<num_kept; i++ )
+        *( normal + i*num_kept + i ) += ridge;
+
+    /* Cholesky decomposition in place, L in the lower triangle */
+    for( j=0; j<num_kept; j++ )
+    {
+        sum = *( normal + j*num_kept + j );
+        for( k=0; k<j; k++ )
+            sum -= *( normal + j*num_kept + k ) * *( normal + j*num_kept + k );
+        if( sum <= 0 )
+            return 0;
+        *( normal + j*num_kept + j ) = sqrt( sum );
+
+        for( i=j+1; i<num_kept; i++ )
+        {
+            sum = *( normal + i*num_kept + j );
+            for( k=0; k<j; k++ )
+                sum -= *( normal + i*num_kept + k ) * *( normal + j*num_kept + k );
+            *( normal + i*num_kept + j ) = sum / *( normal + j*num_kept + j );
+        }
+    }
+
+    /* Forward then back substitution */
+    for( i=0; i<num_kept; i++ )
+    {
+        sum = *(alpha+i);
+        for( k=0; k<i; k++ )
+            sum -= *( normal + i*num_kept + k ) * *(alpha+k);
+        *(alpha+i) = sum / *( normal + i*num_kept + i );
+    }
+    for( i=num_kept-1; i>=0; i-- )
+    {
+        sum = *(alpha+i);
+        for( k=i+1; k<num_kept; k++ )
+            sum -= *( normal + k*num_kept + i ) * *(alpha+k);
+        *(alpha+i) = sum / *( normal + i*num_kept + i );
+    }
+
+    return 1;
+}
+
+/***************************************************/
+
+/* Best weights for the first num_kept support vectors in kept: the refit weights or the original ones, whichever has
+   the smaller error.  Stores them in alpha and returns the error, setting *refit to 1 if the refit weights won */
+static double rd_best_weights( const rd_calibration *cal, const mr_model *mdl, const int *kept, int num_kept,
+                               double *normal, double *alpha, int *refit )
+{
+    double  pruned_error, refit_error;
+    int     j;
+
+    for( j=0; j<num_kept; j++ )
+        *(alpha+j) = *( mdl->alpha + *(kept+j) );
+    pruned_error = rd_max_error( cal, kept, alpha, num_kept );
+    *refit = 0;
+
+    if( num_kept == mdl->num_sv || !rd_refit( cal, kept, num_kept, normal, alpha ) )
+    {
+        for( j=0; j<num_kept; j++ )
+            *(alpha+j) = *( mdl->alpha + *(kept+j) );
+        return pruned_error;
+    }
+
+    refit_error = rd_max_error( cal, kept, alpha, num_kept );
+    if( refit_error < pruned_error )
+    {
+        *refit = 1;
+        return refit_error;
+    }
+
+    for( j=0; j<num_kept; j++ )
+        *(alpha+j) = *( mdl->alpha + *(kept+j) );
+
+    return pruned_error;
+}
+
+/***************************************************/
+
+int rd_reduce_model( const mr_model *mdl, const float *x, int num_vectors, double budget, rd_reduction *reduction )
+{
+    rd_calibration  cal;
+    rd_rank         *rank = NULL;
+    double          *x_scaled = NULL;
+    double          *normal = NULL;
+    double          distance, difference, error;
+    int             lo, hi, mid, refit;
+    int             c, i, j;
+    int             success = 0;
+
+    reduction->kept =   NULL;
+    reduction->alpha =  NULL;
+    cal.num_vectors =   num_vectors;
+    cal.num_sv =        mdl->num_sv;
+    cal.kernel =        (float*)malloc( sizeof(float) * (size_t)num_vectors * mdl->num_sv );
+    cal.target =        (double*)malloc( sizeof(double) * num_vectors );
+    x_scaled =          (double*)malloc( sizeof(double) * mdl->num_features );
+    rank =              (rd_rank*)malloc( sizeof(rd_rank) * mdl->num_sv );
+    normal =            (double*)malloc( sizeof(double) * mdl->num_sv * mdl->num_sv );
+    reduction->kept =   (int*)malloc( sizeof(int) * mdl->num_sv );
+    reduction->alpha =  (double*)malloc( sizeof(double) * mdl->num_sv );
+    if( cal.kernel == NULL || cal.target == NULL || x_scaled == NULL || rank == NULL || normal == NULL ||
+        reduction->kept == NULL || reduction->alpha == NULL )
+        goto exit;
+
+    /* Kernel of every calibration vector with every support vector, in double precision as in mr_predict_scalar() */
+    for( i=0; i<mdl->num_sv; i++ )
+        ( rank + i )->importance = 0;
+    for( c=0; c<num_vectors; c++ )
+    {
+        for( j=0; j<mdl->num_features; j++ )
+            *(x_scaled+j) = ( *( x + (size_t)c*mdl->num_features + j ) - *( mdl->mu + j ) ) / *( mdl->sigma + j );
+
+        *( cal.target + c ) = 0;
+        for( i=0; i<mdl->num_sv; i++ )
+        {
+            distance = 0;
+            for( j=0; j<mdl->num_features; j++ )
+            {
+                difference = *(x_scaled+j) - *( mdl->support_vectors + i*mdl->num_features + j );
+                distance += difference * difference;
+            }
+            *( cal.kernel + (size_t)c*mdl->num_sv + i ) = (float)exp( -distance / ( (double)mdl->scale * mdl->scale ) );
+
+            *( cal.target + c ) += *( mdl->alpha + i ) * *( cal.kernel + (size_t)c*mdl->num_sv + i );
+            ( rank + i )->importance += (double)*( cal.kernel + (size_t)c*mdl->num_sv + i ) * *( cal.kernel + (size_t)c*mdl->num_sv + i );
+        }
+    }
+
+    /* Rank by the RMS contribution of each support vector to the predictions */
+    for( i=0; i<mdl->num_sv; i++ )
+    {
+        ( rank + i )->importance = fabs( *( mdl->alpha + i ) ) * sqrt( ( rank + i )->importance / num_vectors );
+        ( rank + i )->index = i;
+    }
+    qsort( rank, mdl->num_sv, sizeof(rd_rank), rd_compare_rank );
+    for( i=0; i<mdl->num_sv; i++ )
+        *( reduction->kept + i ) = ( rank + i )->index;
+
+    /* Fewest support vectors within budget, by bisection (keeping all of them is always within budget) */
+    lo = 1;
+    hi = mdl->num_sv;
+    while( lo < hi )
+    {
+        mid = ( lo + hi ) / 2;
+        error = rd_best_weights( &cal, mdl, reduction->kept, mid, normal, reduction->alpha, &refit );
+        if( error <= budget )
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    reduction->num_kept =   hi;
+    reduction->max_error =  rd_best_weights( &cal, mdl, reduction->kept, hi, normal, reduction->alpha, &refit );
+    reduction->refit =      refit;
+
+    /* The error is not strictly monotonic in the number kept, fall back to the whole model if bisection missed */
+    if( reduction->max_error > budget )
+    {
+        reduction->num_kept =   mdl->num_sv;
+        reduction->max_error =  rd_best_weights( &cal, mdl, reduction->kept, mdl->num_sv, normal, reduction->alpha, &refit );
+        reduction->refit =      refit;
+    }
+
+    success = 1;
+
+exit:
+    free( cal.kernel );
+    free( cal.target );
+    free( x_scaled );
+    free( rank );
+    free( normal );
+    if( !success )
+        rd_free_reduction( reduction );
+
+    return success;
+}
+
+/***************************************************/
+
+void rd_free_reduction( rd_reduction *reduction )
+{
+    free( reduction->kept );
+    free( reduction->alpha );
+    reduction->kept =       NULL;
+    reduction->alpha =      NULL;
+    reduction->num_kept =   0;
+}
+
+/***************************************************/
+
+/* Writes a cols x rows array in the format read by mr_fill_array(), or a single float when rows is 0 */
+static int rd_write_array( const char *directory, const char *name, const float *data, int cols, int rows )
+{
+    FILE    *filePtr;
+    char    path[MAX_PATH];
+    int     i;
+    int     success = 1;
+
+    sprintf( path, "%.*s\\%s", MAX_PATH - 32, directory, name );
+    filePtr = fopen( path, "w" );
+    if( filePtr == NULL )
+    {
+        printf( "Error: Could not open file %s\n", path );
+        return 0;
+    }
+
+    if( rows == 0 )
+        fprintf( filePtr, "%.9g\n", *data );
+    else
+    {
+        fprintf( filePtr, "COLS %d\nROWS %d\nDATA\n", cols, rows );
+        for( i=0; i<cols*rows; i++ )
+            fprintf( filePtr, "%.9g\n", *(data+i) );
+    }
+
+    if( ferror( filePtr ) )
+        success = 0;
+    if( fclose( filePtr ) )
+        success = 0;
+    if( !success )
+        printf( "Error: Could not write file %s\n", path );
+
+    return success;
+}
+
+/***************************************************/
+
+int rd_write_model( const mr_model *mdl, const rd_reduction *reduction, const char *directory )
+{
+    float   *alpha;
+    float   *support_vectors;
+    int     i;
+    int     success = 0;
+
+    if( !CreateDirectory( directory, NULL ) && GetLastError() != ERROR_ALREADY_EXISTS )
+    {
+        printf( "Error: Could not create directory %s\n", directory );
+        return 0;
+    }
+
+    alpha =             (float*)malloc( sizeof(float) * reduction->num_kept );
+    support_vectors =   (float*)malloc( sizeof(float) * reduction->num_kept * mdl->num_features );
+    if( alpha == NULL || support_vectors == NULL )
+        goto exit;
+
+    for( i=0; i<reduction->num_kept; i++ )
+    {
+        *(alpha+i) = (float)*( reduction->alpha + i );
+        memcpy( support_vectors + i*mdl->num_features, mdl->support_vectors + *( reduction->kept + i ) * mdl->num_features,
+                sizeof(float) * mdl->num_features );
+    }
+
+    success = rd_write_array( directory, "bias.txt", &mdl->bias, 1, 0 ) &&
+              rd_write_array( directory, "scale.txt", &mdl->scale, 1, 0 ) &&
+              rd_write_array( directory, "mu.txt", mdl->mu, mdl->num_features, 1 ) &&
+              rd_write_array( directory, "sigma.txt", mdl->sigma, mdl->num_features, 1 ) &&
+              rd_write_array( directory, "alpha.txt", alpha, reduction->num_kept, 1 ) &&
+              rd_write_array( directory, "support_vectors.txt", support_vectors, mdl->num_features, reduction->num_kept );
+
+exit:
+    free( alpha );
+    free( support_vectors );
+
+    return success;
+}
+
+/***************************************************/
+
+int rd_run( int argc, char *argv[] )
+{
+    mr_model        mdl, reduced_mdl;
+    mr_array        features;
+    rd_reduction    reduction;
+    LARGE_INTEGER   t_start, t_end;
+    float           *x = NULL;
+    double          budget, error, fit_error, held_out_error, sum_error;
+    double          seconds, reduced_seconds;
+    volatile float  sink = 0;
+    int             num_vectors, passes;
+    int             k, v;
+    int             status = -1;
+
+    if( argc < 3 || atof( argv[2] ) <= 0 )
+    {
+        fprintf( stderr, "Usage: MMDaV -reduce <model directory> <output directory> <error budget> [calibration feature file]\n"
+                         "  Writes a model with the fewest support vectors whose predictions stay within the error\n"
+                         "  budget of the original on the calibration feature vectors (one per row, in the format of\n"
+                         "  the model files; default %d vectors drawn around the training distribution)\n", RD_CALIBRATION_VECTORS );
+        return -1;
+    }
+    budget = atof( argv[2] );
+
+    /* A model that failed to load has nothing to free, so every exit path can destroy both */
+    features.data_ptr =         NULL;
+    reduction.kept =            NULL;
+    reduction.alpha =           NULL;
+    reduced_mdl.init_success =  0;
+    mdl = mr_create_model( argv[0] );
+    if( !mdl.init_success )
+    {
+        fprintf( stderr, "Error: Could not read the model in %s\n", argv[0] );
+        goto exit;
+    }
+
+    if( argc > 3 )
+    {
+        features = mr_fill_array( argv[3] );
+        if( features.data_ptr == NULL || features.N != mdl.num_features || features.M < 2 )
+        {
+            fprintf( stderr, "Error: %s is not a set of feature vectors of length %d\n", argv[3], mdl.num_features );
+            goto exit;
+        }
+        x = features.data_ptr;
+        features.data_ptr = NULL;
+        num_vectors = features.M;
+    }
+    else
+    {
+        num_vectors = RD_CALIBRATION_VECTORS;
+        x = mr_reference_features( &mdl, num_vectors );
+        if( x == NULL )
+            goto exit;
+    }
+
+    if( !rd_reduce_model( &mdl, x, num_vectors, budget, &reduction ) )
+    {
+        fprintf( stderr, "Error: Could not allocate memory for the reduction\n" );
+        goto exit;
+    }
+    if( !rd_write_model( &mdl, &reduction, argv[1] ) )
+        goto exit;
+
+    /* Read the written model back and measure it like the live thread would use it */
+    reduced_mdl = mr_create_model( argv[1] );
+    if( !reduced_mdl.init_success )
+    {
+        fprintf( stderr, "Error: Could not read back the reduced model in %s\n", argv[1] );
+        goto exit;
+    }
+
+    fit_error = 0;
+    held_out_error = 0;
+    sum_error = 0;
+    for( v=0; v<num_vectors; v++ )
+    {
+        error = fabs( mr_predict( x + v*mdl.num_features, &reduced_mdl ) - mr_predict( x + v*mdl.num_features, &mdl ) );
+        sum_error += error;
+        if( v % 2 == 0 && error > fit_error )
+            fit_error = error;
+        if( v % 2 == 1 && error > held_out_error )
+            held_out_error = error;
+    }
+
+    passes = 200000 / num_vectors > 0 ? 200000 / num_vectors : 1;
+    QueryPerformanceCounter( &t_start );
+    for( k=0; k<passes; k++ )
+        for( v=0; v<num_vectors; v++ )
+            sink += mr_predict( x + v*mdl.num_features, &mdl );
+    QueryPerformanceCounter( &t_end );
+    seconds = bm_seconds( t_start, t_end ) / ( (double)passes * num_vectors );
+    QueryPerformanceCounter( &t_start );
+    for( k=0; k<passes; k++ )
+        for( v=0; v<num_vectors; v++ )
+            sink += mr_predict( x + v*mdl.num_features, &reduced_mdl );
+    QueryPerformanceCounter( &t_end );
+    reduced_seconds = bm_seconds( t_start, t_end ) / ( (double)passes * num_vectors );
+
+    printf( "%s -> %s\n", argv[0], argv[1] );
+    printf( "  support vectors: %d -> %d (%s alpha)\n", mdl.num_sv, reduced_mdl.num_sv, reduction.refit ? "refit" : "original" );
+    printf( "  max error: %.3g on the fit half, %.3g on the held out half of %d calibration vectors (budget %g), mean %.3g\n",
+            fit_error, held_out_error, num_vectors, budget, sum_error / num_vectors );
+    printf( "  mr_predict: %.2f us -> %.2f us per prediction, %.2fx\n", 1e6 * seconds, 1e6 * reduced_seconds, seconds / reduced_seconds );
+    if( held_out_error > budget )
+        printf( "  Warning: the held out error is over budget, use a larger calibration set\n" );
+
+    status = 0;
+
+exit:
+    free( x );
+    mr_free_array( &features );
+    rd_free_reduction( &reduction );
+    mr_destroy( &mdl );
+    if( reduced_mdl.init_success )
+        mr_destroy( &reduced_mdl );
+
+    return status;
+}
@@ -27,33 +27,51 @@
 #include <process.h>
 #include <math.h>
 #include <string.h>
+#include <malloc.h>
 #include "moodRecognition.h"
 #include "featureExtraction.h"
+#include "benchmark.h"
 
-mr_detection_thread_data mr_initialize_mood_detection_data( fe_extraction_info *extractionInfo , fe_extraction_thread_data portAudioData )
+mr_detection_thread_data mr_initialize_mood_detection_data( fe_extraction_info *extractionInfo , fe_extraction_thread_data *portAudioData )
 {
-    const char                  arousalDirectory[] = "..\\assets\\arousal.info";
-    const char                  valenceDirectory[] = "..\\assets\\valence.info";
     mr_detection_thread_data    moodDetectionData;
 
     moodDetectionData.init_success = 0;
 
-    moodDetectionData.arousal_mdl = mr_create_model( arousalDirectory );
-    moodDetectionData.valence_mdl = mr_create_model( valenceDirectory );
+    mr_load_live_models( &moodDetectionData.arousal_mdl, &moodDetectionData.valence_mdl );
 
     /* Mood detection features are the mean and std deviation of each timbre feature and the onset features */
     moodDetectionData.features = (float*)malloc( sizeof(float) * ( extractionInfo->num_timbre_features * 2 + extractionInfo->num_onset_features ) );
+    /* The running sums, flux buffer and lags are copied from the analysis thread for each prediction, see
+       fe_read_window_stats() */
+    moodDetectionData.timbre_sum =      (double*)malloc( sizeof(double) * extractionInfo->num_timbre_features );
+    moodDetectionData.timbre_sum_sq =   (double*)malloc( sizeof(double) * extractionInfo->num_timbre_features );
+    moodDetectionData.rec_flux_buffer = (float*)malloc( sizeof(float) * extractionInfo->frames_in_window );
+    moodDetectionData.autocorrelation.result = NULL;
 
     /* If there was a problem creating a model or allocating feature memory, free resources and return */
     if( moodDetectionData.features == NULL ||
+        moodDetectionData.timbre_sum == NULL ||
+        moodDetectionData.timbre_sum_sq == NULL ||
+        moodDetectionData.rec_flux_buffer == NULL ||
+        !fe_autocorrelation_init( &moodDetectionData.autocorrelation, extractionInfo->frames_in_window,
+                                  portAudioData->autocorrelation.method, extractionInfo ) ||
         !moodDetectionData.valence_mdl.init_success ||
         !moodDetectionData.arousal_mdl.init_success )
     {
         mr_destroy( &moodDetectionData.arousal_mdl );
         mr_destroy( &moodDetectionData.valence_mdl );
         free( moodDetectionData.features );
+        free( moodDetectionData.timbre_sum );
+        free( moodDetectionData.timbre_sum_sq );
+        free( moodDetectionData.rec_flux_buffer );
+        if( moodDetectionData.autocorrelation.result != NULL )
+            fe_autocorrelation_free( &moodDetectionData.autocorrelation );
 
         moodDetectionData.features = NULL;
+        moodDetectionData.timbre_sum = NULL;
+        moodDetectionData.timbre_sum_sq = NULL;
+        moodDetectionData.rec_flux_buffer = NULL;
 
         return moodDetectionData;
     }
@@ -61,9 +79,17 @@ mr_detection_thread_data mr_initialize_mood_detection_data( fe_extraction_info *
     moodDetectionData.arousal_prediction =  0;
     moodDetectionData.valence_prediction =  0;
     moodDetectionData.terminate_thread =    0;
-    moodDetectionData.timbre_matrix =       portAudioData.timbre_matrix;
-    moodDetectionData.rec_flux_buffer =     portAudioData.rectified_flux_buffer;
     moodDetectionData.extraction_info =     extractionInfo;
+    moodDetectionData.extraction_data =     portAudioData;
+    moodDetectionData.prediction_cadence =  MR_PREDICTION_CADENCE;
+
+    moodDetectionData.num_predictions =     0;
+    moodDetectionData.frames_skipped =      0;
+    moodDetectionData.predict_ticks =       0;
+    moodDetectionData.latency_ticks =       0;
+    moodDetectionData.latency_max_ticks =   0;
+    moodDetectionData.cpu_seconds =         0;
+    moodDetectionData.run_seconds =         0;
 
     moodDetectionData.init_success =        1;
 
@@ -72,13 +98,110 @@ mr_detection_thread_data mr_initialize_mood_detection_data( fe_extraction_info *
 
 /************************************************************/
 
+float *mr_reference_features( const mr_model *mdl, int num_vectors )
+{
+    float   *x;
+    int     i, v;
+
+    x = (float*)malloc( sizeof(float) * num_vectors * mdl->num_features );
+    if( x == NULL )
+        return NULL;
+
+    srand( 1 );
+    for( v=0; v<num_vectors; v++ )
+        for( i=0; i<mdl->num_features; i++ )
+            *(x + v*mdl->num_features + i) = *(mdl->mu + i) + *(mdl->sigma + i) * 4 * ( (float)rand()/RAND_MAX - 0.5f );
+
+    return x;
+}
+
+/************************************************************/
+
+/* Switches a live model to MR_SV_PRECISION and MR_RFF_COMPONENTS, and back to fp32 if that fails or moves a
+   prediction of the reference vectors by more than BM_PRECISION_TOLERANCE.  Returns 1 if the reduction was kept */
+static int mr_reduce_live_model( mr_model *mdl, const char *name )
+{
+    float   *x;
+    float   *reference = NULL;
+    float   error, max_error = 0;
+    int     v;
+    int     success = 0;
+
+    if( mdl->init_success != 1 )
+        return 0;
+
+    x = mr_reference_features( mdl, MR_REFERENCE_VECTORS );
+    reference = (float*)malloc( sizeof(float) * MR_REFERENCE_VECTORS );
+    if( x == NULL || reference == NULL )
+    {
+        fprintf( stderr, "Warning: Not enough memory to check the reduced %s model, using fp32\n", name );
+        goto exit;
+    }
+    for( v=0; v<MR_REFERENCE_VECTORS; v++ )
+        *(reference + v) = mr_predict( x + v*mdl->num_features, mdl );
+
+    if( !mr_quantize_model( mdl, MR_SV_PRECISION ) || !mr_approximate_model( mdl, MR_RFF_COMPONENTS, MR_RFF_SEED ) )
+    {
+        fprintf( stderr, "Warning: Could not reduce the %s model, using fp32\n", name );
+        goto exit;
+    }
+    for( v=0; v<MR_REFERENCE_VECTORS; v++ )
+    {
+        error = fabsf( mr_predict( x + v*mdl->num_features, mdl ) - *(reference + v) );
+        if( error > max_error )
+            max_error = error;
+    }
+    if( max_error > BM_PRECISION_TOLERANCE )
+    {
+        fprintf( stderr, "Warning: The reduced %s model deviates from fp32 by up to %g (tolerance %g), using fp32\n",
+                 name, max_error, BM_PRECISION_TOLERANCE );
+        goto exit;
+    }
+    success = 1;
+
+exit:
+    if( !success )
+    {
+        mr_quantize_model( mdl, MR_PRECISION_FP32 );
+        mr_approximate_model( mdl, 0, MR_RFF_SEED );
+    }
+    free( x );
+    free( reference );
+
+    return success;
+}
+
+/************************************************************/
+
+int mr_load_live_models( mr_model *arousal_mdl, mr_model *valence_mdl )
+{
+    *arousal_mdl = mr_load_model( MR_AROUSAL_MODEL_FILE, MR_AROUSAL_MODEL_DIRECTORY );
+    *valence_mdl = mr_load_model( MR_VALENCE_MODEL_FILE, MR_VALENCE_MODEL_DIRECTORY );
+    if( MR_SV_PRECISION != MR_PRECISION_FP32 || MR_RFF_COMPONENTS > 0 )
+    {
+        mr_reduce_live_model( arousal_mdl, "arousal" );
+        mr_reduce_live_model( valence_mdl, "valence" );
+    }
+
+    return arousal_mdl->init_success && valence_mdl->init_success;
+}
+
+/************************************************************/
+
 void mr_clean_mood_detection_data( mr_detection_thread_data *thread_data )
 {
     mr_destroy( &thread_data->valence_mdl );
     mr_destroy( &thread_data->arousal_mdl );
     free( thread_data->features );
+    free( thread_data->timbre_sum );
+    free( thread_data->timbre_sum_sq );
+    free( thread_data->rec_flux_buffer );
+    fe_autocorrelation_free( &thread_data->autocorrelation );
 
     thread_data->features = NULL;
+    thread_data->timbre_sum = NULL;
+    thread_data->timbre_sum_sq = NULL;
+    thread_data->rec_flux_buffer = NULL;
 }
 
 /************************************************************/
@@ -100,7 +223,7 @@ mr_array mr_fill_array( const char *path )
     }
 
     /* Check header for COLS and get data */
-    fscanf( filePtr, "%s", header );
+    fscanf( filePtr, "%9s", header );
     if( strcmp( header, "COLS" ) )          /* strcmp() will return 0 if the strings are equal */
     {
         printf(" Error: Problem in data file %s", path );
@@ -115,7 +238,7 @@ mr_array mr_fill_array( const char *path )
     }
 
     /* Check header for ROWS and get data */
-    fscanf( filePtr, "%s", header );
+    fscanf( filePtr, "%9s", header );
     if( strcmp( header, "ROWS" ) )          /* strcmp() will return 0 if the strings are equal */
     {
         printf(" Error: Problem in data file %s", path );
@@ -130,7 +253,7 @@ mr_array mr_fill_array( const char *path )
     }
 
     /* Check header for DATA and then allocate memory for array */
-    fscanf( filePtr, "%s", header );
+    fscanf( filePtr, "%9s", header );
     if( strcmp( header, "DATA" ) )          /* strcmp() will return 0 if the strings are equal */
     {
         printf(" Error: Problem in data file %s", path );
@@ -171,7 +294,7 @@ mr_array mr_fill_array( const char *path )
     }
 
 exit:
-    if( fclose(filePtr) )
+    if( filePtr != NULL && fclose(filePtr) )
         printf( "Error:  Could not close file %s\n", path );
 
     return array_struct;
@@ -189,243 +312,906 @@ void mr_free_array( mr_array *thisArray )
 
 /***************************************************/
 
-mr_model mr_create_model( const char *directory )
+/* Reads the single float stored in a text file, returns 1 on success and 0 on failure */
+static int mr_read_float( const char *path, float *value )
 {
-    mr_model    mdl;
-    mr_array    returned_array;
-    char        path[200];
-    FILE        *filePtr;
+    FILE    *filePtr;
+    int     success;
 
-    mdl.mu = NULL;
-    mdl.sigma = NULL;
-    mdl.alpha = NULL;
-    mdl.support_vectors = NULL;
-
-    /* Fill in scale and bias by reading single float entry from the respective text files */
-
-    /* Bias */
-    strcpy( path, directory );
-    strcat( path, "\\bias.txt" );
     filePtr = fopen( path, "r" );
     if( filePtr == NULL )
     {
-        mdl.init_success = 0;
-        goto exit;
-    }
-    if( fscanf( filePtr, "%f", &mdl.bias ) != 1 )
-    {
-        mdl.init_success = 0;
-        goto exit;
+        printf( "Error: Could not open file %s\n", path );
+        return 0;
     }
+    success = ( fscanf( filePtr, "%f", value ) == 1 );
     if( fclose(filePtr) )
         printf( "Error:  Could not close file %s\n", path );
 
-    /* Scale */
-    strcpy( path, directory );
-    strcat( path, "\\scale.txt" );
-    filePtr = fopen( path, "r" );
-    if( filePtr == NULL )
+    return success;
+}
+
+/***************************************************/
+
+/* Sets the model's pointers and handles to their empty values so mr_destroy() can be called at any point */
+static void mr_clear_model( mr_model *mdl )
+{
+    mdl->init_success = 0;
+
+    mdl->mu =               NULL;
+    mdl->sigma =            NULL;
+    mdl->alpha =            NULL;
+    mdl->support_vectors =  NULL;
+    mdl->x_scale =          NULL;
+    mdl->x_offset =         NULL;
+    mdl->sv_compiled =      NULL;
+    mdl->sv_bias =          NULL;
+    mdl->alpha_padded =     NULL;
+    mdl->precision =        MR_PRECISION_FP32;
+    mdl->sv_quantized =     NULL;
+    mdl->sv_dequant =       NULL;
+    mdl->sv_bias_quantized = NULL;
+    mdl->rff_components =   0;
+    mdl->rff_weights =      NULL;
+    mdl->rff_phase =        NULL;
+    mdl->rff_beta =         NULL;
+
+    mdl->file =             INVALID_HANDLE_VALUE;
+    mdl->mapping =          NULL;
+    mdl->view =             NULL;
+}
+
+/***************************************************/
+
+/* Builds the compiled arrays of a model whose text arrays have been read (see moodRecognitionKernels.h), returns
+   1 on success and 0 if memory could not be allocated */
+static int mr_compile_model( mr_model *mdl )
+{
+    double  weight, sv, norm;
+    int     i, j;
+
+    mdl->padded_features =  ( (mdl->num_features + MR_PAD_FLOATS - 1) / MR_PAD_FLOATS ) * MR_PAD_FLOATS;
+    mdl->padded_sv =        ( (mdl->num_sv + MR_TILE_SV - 1) / MR_TILE_SV ) * MR_TILE_SV;
+
+    mdl->x_scale =      _aligned_malloc( sizeof(float) * mdl->padded_features, MR_ALIGNMENT );
+    mdl->x_offset =     _aligned_malloc( sizeof(float) * mdl->padded_features, MR_ALIGNMENT );
+    mdl->sv_compiled =  _aligned_malloc( sizeof(float) * mdl->padded_features * mdl->padded_sv, MR_ALIGNMENT );
+    mdl->sv_bias =      _aligned_malloc( sizeof(float) * mdl->padded_sv, MR_ALIGNMENT );
+    mdl->alpha_padded = _aligned_malloc( sizeof(float) * mdl->padded_sv, MR_ALIGNMENT );
+    if( mdl->x_scale == NULL || mdl->x_offset == NULL || mdl->sv_compiled == NULL ||
+        mdl->sv_bias == NULL || mdl->alpha_padded == NULL )
+        return 0;
+
+    /* Zero padding everywhere: padded features add nothing to a distance and padded support vectors have no weight */
+    memset( mdl->x_scale, 0, sizeof(float) * mdl->padded_features );
+    memset( mdl->x_offset, 0, sizeof(float) * mdl->padded_features );
+    memset( mdl->sv_compiled, 0, sizeof(float) * mdl->padded_features * mdl->padded_sv );
+    memset( mdl->sv_bias, 0, sizeof(float) * mdl->padded_sv );
+    memset( mdl->alpha_padded, 0, sizeof(float) * mdl->padded_sv );
+
+    /* Normalization and kernel scale as one multiply-add per feature, computed in double precision */
+    for( j=0; j<mdl->num_features; j++ )
     {
-        mdl.init_success = 0;
-        goto exit;
+        weight = 1.0 / ( (double)*( mdl->sigma + j ) * mdl->scale );
+        *( mdl->x_scale + j ) =     (float)weight;
+        *( mdl->x_offset + j ) =    (float)( -*( mdl->mu + j ) * weight );
     }
-    if( fscanf( filePtr, "%f", &mdl.scale )!= 1 )
+
+    /* Support vectors scaled by 2 / scale in feature-major order, so x'.sv gives twice the dot product */
+    for( i=0; i<mdl->num_sv; i++ )
     {
-        mdl.init_success = 0;
-        goto exit;
+        norm = 0;
+        for( j=0; j<mdl->num_features; j++ )
+        {
+            sv = *( mdl->support_vectors + i*mdl->num_features + j ) / (double)mdl->scale;
+            *( mdl->sv_compiled + j*mdl->padded_sv + i ) = (float)( 2 * sv );
+            norm += sv * sv;
+        }
+        *( mdl->sv_bias + i ) =         (float)( -norm );
+        *( mdl->alpha_padded + i ) =    *( mdl->alpha + i );
     }
-    if( fclose(filePtr) )
-        printf( "Error:  Could not close file %s\n", path );
 
-    /*Fill in other arrays using mr_array_fill */
+    mdl->kernel =       mr_select_rbf_kernel( MR_PRECISION_FP32, NULL );
+    mdl->tile_kernel =  mr_select_rbf_tile_kernel();
 
-    /* Send path to mu data file to mr_fill_array */
-    strcpy( path, directory );
-    strcat( path, "\\mu.txt" );
-    filePtr = fopen( path, "r" );
-    if( filePtr == NULL )
-    {
-        mdl.init_success = 0;
+    return 1;
+}
+
+/***************************************************/
+
+/* Fills in the number of floats in each section of a binary model file and the address of the mr_model
+   pointer to each section */
+static void mr_section_table( mr_model *mdl, unsigned long long counts[MR_NUM_SECTIONS], float **arrays[MR_NUM_SECTIONS] )
+{
+    counts[MR_SECTION_MU] =                 (unsigned long long)mdl->num_features;
+    counts[MR_SECTION_SIGMA] =              (unsigned long long)mdl->num_features;
+    counts[MR_SECTION_ALPHA] =              (unsigned long long)mdl->num_sv;
+    counts[MR_SECTION_SUPPORT_VECTORS] =    (unsigned long long)mdl->num_sv * mdl->num_features;
+    counts[MR_SECTION_X_SCALE] =            (unsigned long long)mdl->padded_features;
+    counts[MR_SECTION_X_OFFSET] =           (unsigned long long)mdl->padded_features;
+    counts[MR_SECTION_ALPHA_PADDED] =       (unsigned long long)mdl->padded_sv;
+    counts[MR_SECTION_SV_BIAS] =            (unsigned long long)mdl->padded_sv;
+    counts[MR_SECTION_SV_COMPILED] =        (unsigned long long)mdl->padded_features * mdl->padded_sv;
+
+    arrays[MR_SECTION_MU] =                 &mdl->mu;
+    arrays[MR_SECTION_SIGMA] =              &mdl->sigma;
+    arrays[MR_SECTION_ALPHA] =              &mdl->alpha;
+    arrays[MR_SECTION_SUPPORT_VECTORS] =    &mdl->support_vectors;
+    arrays[MR_SECTION_X_SCALE] =            &mdl->x_scale;
+    arrays[MR_SECTION_X_OFFSET] =           &mdl->x_offset;
+    arrays[MR_SECTION_ALPHA_PADDED] =       &mdl->alpha_padded;
+    arrays[MR_SECTION_SV_BIAS] =            &mdl->sv_bias;
+    arrays[MR_SECTION_SV_COMPILED] =        &mdl->sv_compiled;
+}
+
+/***************************************************/
+
+mr_model mr_create_model( const char *directory )
+{
+    mr_model    mdl;
+    mr_array    returned_array;
+    char        path[MAX_PATH];
+
+    mr_clear_model( &mdl );
+
+    /* Fill in scale and bias by reading single float entry from the respective text files */
+
+    /* Bias */
+    sprintf( path, "%.*s\\bias.txt", MAX_PATH - 32, directory );
+    if( !mr_read_float( path, &mdl.bias ) )
         goto exit;
-    }
+
+    /* Scale */
+    sprintf( path, "%.*s\\scale.txt", MAX_PATH - 32, directory );
+    if( !mr_read_float( path, &mdl.scale ) )
+        goto exit;
+
+    /*Fill in other arrays using mr_array_fill, which opens and closes the files itself */
+
+    /* Send path to mu data file to mr_fill_array */
+    sprintf( path, "%.*s\\mu.txt", MAX_PATH - 32, directory );
     returned_array = mr_fill_array( path );
     if( returned_array.data_ptr == NULL )       /* Make sure data was read in correctly */
-    {
-        mdl.init_success = 0;
         goto exit;
-    }
     if( returned_array.M != 1 )                 /* Numbers of rows must be 1 */
     {
-        mdl.init_success = 0;
-        mr_free_array( &returned_array );       /* Only free array memory on this type of error */
+        mr_free_array( &returned_array );
         goto exit;
     }
     mdl.num_features = returned_array.N;
     mdl.mu = returned_array.data_ptr;
-    if( fclose(filePtr) )
-        printf( "Error:  Could not close file %s\n", path );
 
     /* Send path to sigma data file to mr_fill_array */
-    strcpy( path, directory );
-    strcat( path, "\\sigma.txt" );
-    filePtr = fopen( path, "r" );
-    if( filePtr == NULL )
-    {
-        mdl.init_success = 0;
-        goto exit;
-    }
+    sprintf( path, "%.*s\\sigma.txt", MAX_PATH - 32, directory );
     returned_array = mr_fill_array( path );
     if( returned_array.data_ptr == NULL )
-    {
-        mdl.init_success = 0;
         goto exit;
-    }
     if( (returned_array.M != 1) || (returned_array.N != mdl.num_features) )
     {
-        mdl.init_success = 0;
         mr_free_array( &returned_array );
         goto exit;
     }
     mdl.sigma = returned_array.data_ptr;
-    if( fclose(filePtr) )
-        printf( "Error:  Could not close file %s\n", path );
 
     /* Send path to alpha data file to mr_fill_array */
-    strcpy( path, directory );
-    strcat( path, "\\alpha.txt" );
-    filePtr = fopen( path, "r" );
-    if( filePtr == NULL )
-    {
-        mdl.init_success = 0;
-        goto exit;
-    }
+    sprintf( path, "%.*s\\alpha.txt", MAX_PATH - 32, directory );
     returned_array = mr_fill_array( path );
     if( returned_array.data_ptr == NULL )
-    {
-        mdl.init_success = 0;
         goto exit;
-    }
     if( (returned_array.M != 1) )
     {
-        mdl.init_success = 0;
         mr_free_array( &returned_array );
         goto exit;
     }
     mdl.num_sv = returned_array.N;
     mdl.alpha = returned_array.data_ptr;
-    if( fclose(filePtr) )
-        printf( "Error:  Could not close file %s\n", path );
 
     /* Send path to support_vectors data file to mr_fill_array */
-    strcpy( path, directory );
-    strcat( path, "\\support_vectors.txt" );
-    filePtr = fopen( path, "r" );
-    if( filePtr == NULL )
-    {
-        mdl.init_success = 0;
-        goto exit;
-    }
+    sprintf( path, "%.*s\\support_vectors.txt", MAX_PATH - 32, directory );
     returned_array = mr_fill_array( path );
     if( returned_array.data_ptr == NULL )
-    {
-        mdl.init_success = 0;
         goto exit;
-    }
     if( (returned_array.N != mdl.num_features) || (returned_array.M != mdl.num_sv) )
     {
-        mdl.init_success = 0;
         mr_free_array( &returned_array );
         goto exit;
     }
     mdl.support_vectors = returned_array.data_ptr;
 
+    if( !mr_compile_model( &mdl ) )
+        goto exit;
+
     mdl.init_success = 1;
 
 exit:
     if( mdl.init_success == 0 )
+        mr_destroy( &mdl );
+
+    return mdl;
+}
+
+/***************************************************/
+
+/* FNV-1a hash taken over 32-bit words rather than bytes, continuing from hash (2166136261 to start a new one).  length
+   is a multiple of 4 because the header and every section are whole numbers of 32-bit fields */
+static unsigned int mr_checksum( unsigned int hash, const void *data, size_t length )
+{
+    const unsigned int  *words = (const unsigned int*)data;
+    size_t              i;
+
+    for( i=0; i<length/4; i++ )
     {
-        free(mdl.mu);
-        free(mdl.sigma);
-        free(mdl.alpha);
-        mdl.mu = NULL;
-        mdl.sigma = NULL;
-        mdl.alpha = NULL;
+        hash ^= *(words+i);
+        hash *= 16777619u;
     }
-    if( fclose(filePtr) )
-        printf( "Error:  Could not close file %s\n", path );
+
+    return hash;
+}
+
+/* Checksum of a binary model file: its header with the checksum field read as 0, then everything after the header */
+static unsigned int mr_file_checksum( const mr_binary_header *header, const unsigned char *file_data )
+{
+    mr_binary_header    zeroed = *header;
+
+    zeroed.checksum = 0;
+
+    return mr_checksum( mr_checksum( 2166136261u, &zeroed, sizeof(zeroed) ),
+                        file_data + sizeof(zeroed), header->file_size - sizeof(zeroed) );
+}
+
+/***************************************************/
+
+mr_model mr_map_model( const char *path )
+{
+    mr_model                mdl;
+    const mr_binary_header  *header;
+    const unsigned char     *view;
+    LARGE_INTEGER           fileSize;
+    unsigned long long      counts[MR_NUM_SECTIONS];
+    float                   **arrays[MR_NUM_SECTIONS];
+    int                     valid, i;
+
+    mr_clear_model( &mdl );
+
+    mdl.file = CreateFile( path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+    if( mdl.file == INVALID_HANDLE_VALUE )
+        goto exit;
+    if( !GetFileSizeEx( mdl.file, &fileSize ) || fileSize.QuadPart < (LONGLONG)sizeof(mr_binary_header) )
+    {
+        printf( "Error: %s is not a binary model file\n", path );
+        goto exit;
+    }
+    mdl.mapping = CreateFileMapping( mdl.file, NULL, PAGE_READONLY, 0, 0, NULL );
+    if( mdl.mapping == NULL )
+        goto exit;
+    mdl.view = MapViewOfFile( mdl.mapping, FILE_MAP_READ, 0, 0, 0 );
+    if( mdl.view == NULL )
+        goto exit;
+    view = (const unsigned char*)mdl.view;
+    header = (const mr_binary_header*)view;
+
+    /* Validate the header before trusting any of its sizes */
+    if( memcmp( header->magic, MR_BINARY_MAGIC, sizeof(header->magic) ) ||
+        header->header_size != sizeof(mr_binary_header) )
+    {
+        printf( "Error: %s is not a binary model file\n", path );
+        goto exit;
+    }
+    if( header->version != MR_BINARY_VERSION )
+    {
+        printf( "Error: %s is version %u of the binary model format, expected version %d\n", path, header->version, MR_BINARY_VERSION );
+        goto exit;
+    }
+    mdl.num_features =      header->num_features;
+    mdl.padded_features =   header->padded_features;
+    mdl.num_sv =            header->num_sv;
+    mdl.padded_sv =         header->padded_sv;
+    mdl.scale =             header->scale;
+    mdl.bias =              header->bias;
+    mr_section_table( &mdl, counts, arrays );
+
+    /* The dimensions are bounded first, then every section end is computed in 64 bits so none can wrap */
+    valid = header->file_size == fileSize.QuadPart &&
+            mdl.num_features > 0 && mdl.num_features <= MR_MAX_FEATURES &&
+            mdl.num_sv > 0 && mdl.num_sv <= MR_MAX_SV &&
+            mdl.padded_features == ( (mdl.num_features + MR_PAD_FLOATS - 1) / MR_PAD_FLOATS ) * MR_PAD_FLOATS &&
+            mdl.padded_sv == ( (mdl.num_sv + MR_TILE_SV - 1) / MR_TILE_SV ) * MR_TILE_SV;
+    for( i=0; i<MR_NUM_SECTIONS && valid; i++ )
+        valid = ( header->section_offset[i] % MR_ALIGNMENT == 0 ) &&
+                ( header->section_offset[i] >= header->header_size ) &&
+                ( (unsigned long long)header->section_offset[i] + sizeof(float) * counts[i] <= header->file_size );
+    if( !valid )
+    {
+        printf( "Error: Binary model file %s is truncated or corrupt\n", path );
+        goto exit;
+    }
+    if( mr_file_checksum( header, view ) != header->checksum )
+    {
+        printf( "Error: Checksum mismatch in binary model file %s\n", path );
+        goto exit;
+    }
+
+    /* Use the sections in place */
+    for( i=0; i<MR_NUM_SECTIONS; i++ )
+        *arrays[i] = (float*)( view + header->section_offset[i] );
+    mdl.kernel =        mr_select_rbf_kernel( MR_PRECISION_FP32, NULL );
+    mdl.tile_kernel =   mr_select_rbf_tile_kernel();
+
+    mdl.init_success = 1;
+
+exit:
+    if( mdl.init_success == 0 )
+        mr_destroy( &mdl );
 
     return mdl;
 }
 
 /***************************************************/
 
+mr_model mr_load_model( const char *path, const char *directory )
+{
+    if( GetFileAttributes( path ) != INVALID_FILE_ATTRIBUTES )
+        return mr_map_model( path );
+
+    return mr_create_model( directory );
+}
+
+/***************************************************/
+
+/* Writes one section of a binary model file and pads it with zeros to the next multiple of MR_ALIGNMENT */
+static void mr_write_section( unsigned char *file_data, unsigned int *offset, unsigned int *section_offset, const float *data, unsigned long long count )
+{
+    *section_offset = *offset;
+    memcpy( file_data + *offset, data, (size_t)( sizeof(float) * count ) );
+    *offset += (unsigned int)( ( (sizeof(float) * count + MR_ALIGNMENT - 1) / MR_ALIGNMENT ) * MR_ALIGNMENT );
+}
+
+int mr_write_binary_model( const mr_model *mdl, const char *path )
+{
+    mr_binary_header    header;
+    mr_model            sections = *mdl;
+    unsigned long long  counts[MR_NUM_SECTIONS];
+    float               **arrays[MR_NUM_SECTIONS];
+    unsigned char       *file_data;
+    unsigned long long  total;
+    unsigned int        size, offset;
+    FILE                *filePtr;
+    int                 i;
+    int                 success = 0;
+
+    if( mdl->init_success != 1 )
+        return 0;
+
+    /* Header, then each section starting on an MR_ALIGNMENT boundary */
+    mr_section_table( &sections, counts, arrays );
+    total = ( (sizeof(header) + MR_ALIGNMENT - 1) / MR_ALIGNMENT ) * MR_ALIGNMENT;
+    for( i=0; i<MR_NUM_SECTIONS; i++ )
+        total += ( (sizeof(float) * counts[i] + MR_ALIGNMENT - 1) / MR_ALIGNMENT ) * MR_ALIGNMENT;
+    if( mdl->num_features > MR_MAX_FEATURES || mdl->num_sv > MR_MAX_SV || total > 0xFFFFFFFFull )
+    {
+        printf( "Error: The model is too large for a binary model file\n" );
+        return 0;
+    }
+    size = (unsigned int)total;
+
+    file_data = (unsigned char*)calloc( size, 1 );
+    if( file_data == NULL )
+    {
+        printf( "Error: Not enough memory to write %s\n", path );
+        return 0;
+    }
+
+    memset( &header, 0, sizeof(header) );
+    memcpy( header.magic, MR_BINARY_MAGIC, sizeof(header.magic) );
+    header.version =            MR_BINARY_VERSION;
+    header.header_size =        sizeof(header);
+    header.file_size =          size;
+    header.num_features =       mdl->num_features;
+    header.padded_features =    mdl->padded_features;
+    header.num_sv =             mdl->num_sv;
+    header.padded_sv =          mdl->padded_sv;
+    header.scale =              mdl->scale;
+    header.bias =               mdl->bias;
+
+    offset = ( (sizeof(header) + MR_ALIGNMENT - 1) / MR_ALIGNMENT ) * MR_ALIGNMENT;
+    for( i=0; i<MR_NUM_SECTIONS; i++ )
+        mr_write_section( file_data, &offset, &header.section_offset[i], *arrays[i], counts[i] );
+
+    header.checksum = mr_file_checksum( &header, file_data );
+    memcpy( file_data, &header, sizeof(header) );
+
+    filePtr = fopen( path, "wb" );
+    if( filePtr == NULL )
+    {
+        printf( "Error: Could not open file %s\n", path );
+        goto exit;
+    }
+    success = ( fwrite( file_data, 1, size, filePtr ) == size );
+    if( fclose(filePtr) )
+        success = 0;
+    if( !success )
+        printf( "Error: Could not write file %s\n", path );
+
+exit:
+    free( file_data );
+
+    return success;
+}
+
+/***************************************************/
+
+int mr_run_convert( int argc, char *argv[] )
+{
+    mr_model    mdl;
+    const char  *directories[2] = { MR_AROUSAL_MODEL_DIRECTORY, MR_VALENCE_MODEL_DIRECTORY };
+    const char  *paths[2] = { MR_AROUSAL_MODEL_FILE, MR_VALENCE_MODEL_FILE };
+    int         num_models = 2;
+    int         i;
+
+    /* "-convert <model directory> <binary file>" converts one model, "-convert" alone converts both default models */
+    if( argc == 2 )
+    {
+        directories[0] = argv[0];
+        paths[0] = argv[1];
+        num_models = 1;
+    }
+    else if( argc != 0 )
+    {
+        fprintf( stderr, "Usage: MMDaV -convert [<model directory> <binary model file>]\n"
+                         "  Without arguments converts %s and %s\n", MR_AROUSAL_MODEL_DIRECTORY, MR_VALENCE_MODEL_DIRECTORY );
+        return -1;
+    }
+
+    for( i=0; i<num_models; i++ )
+    {
+        mdl = mr_create_model( directories[i] );
+        if( !mdl.init_success )
+        {
+            fprintf( stderr, "Error: Could not read the model in %s\n", directories[i] );
+            return -1;
+        }
+        if( !mr_write_binary_model( &mdl, paths[i] ) )
+        {
+            mr_destroy( &mdl );
+            return -1;
+        }
+        printf( "%s -> %s (%d support vectors, %d features)\n", directories[i], paths[i], mdl.num_sv, mdl.num_features );
+        mr_destroy( &mdl );
+
+        /* Make sure the file maps back */
+        mdl = mr_map_model( paths[i] );
+        if( !mdl.init_success )
+        {
+            fprintf( stderr, "Error: Could not map %s after writing it\n", paths[i] );
+            return -1;
+        }
+        mr_destroy( &mdl );
+    }
+
+    return 0;
+}
+
+/***************************************************/
+
+int mr_quantize_model( mr_model *mdl, int precision )
+{
+    unsigned short  *half_sv;
+    signed char     *int8_sv;
+    double          stored, norm;
+    float           value, max_abs;
+    int             i, j;
+
+    if( mdl->init_success != 1 )
+        return 0;
+
+    _aligned_free( mdl->sv_quantized );
+    _aligned_free( mdl->sv_dequant );
+    _aligned_free( mdl->sv_bias_quantized );
+    mdl->sv_quantized =         NULL;
+    mdl->sv_dequant =           NULL;
+    mdl->sv_bias_quantized =    NULL;
+    mdl->precision =            MR_PRECISION_FP32;
+    mdl->kernel =               mr_select_rbf_kernel( MR_PRECISION_FP32, NULL );
+
+    if( precision == MR_PRECISION_FP32 )
+        return 1;
+
+    mdl->sv_quantized =         _aligned_malloc( ( precision == MR_PRECISION_FP16 ? sizeof(unsigned short) : sizeof(signed char) ) *
+                                                 mdl->padded_features * mdl->padded_sv, MR_ALIGNMENT );
+    mdl->sv_dequant =           _aligned_malloc( sizeof(float) * mdl->padded_features, MR_ALIGNMENT );
+    mdl->sv_bias_quantized =    _aligned_malloc( sizeof(float) * mdl->padded_sv, MR_ALIGNMENT );
+    if( mdl->sv_quantized == NULL || mdl->sv_dequant == NULL || mdl->sv_bias_quantized == NULL )
+    {
+        _aligned_free( mdl->sv_quantized );
+        _aligned_free( mdl->sv_dequant );
+        _aligned_free( mdl->sv_bias_quantized );
+        mdl->sv_quantized =         NULL;
+        mdl->sv_dequant =           NULL;
+        mdl->sv_bias_quantized =    NULL;
+        return 0;
+    }
+    half_sv = (unsigned short*)mdl->sv_quantized;
+    int8_sv = (signed char*)mdl->sv_quantized;
+
+    /* int8 scales each feature so its largest magnitude maps to 127.  Padding and constant zero features get a
+       scale of zero, which also zeroes those features of the scaled feature vector */
+    for( j=0; j<mdl->padded_features; j++ )
+    {
+        max_abs = 0;
+        for( i=0; i<mdl->padded_sv; i++ )
+        {
+            value = fabsf( *( mdl->sv_compiled + j*mdl->padded_sv + i ) );
+            if( value > max_abs )
+                max_abs = value;
+        }
+        *( mdl->sv_dequant + j ) = max_abs / 127;
+    }
+
+    /* Store every element and recompute the bias from the stored value, so the kernel is the exact Gaussian of
+       the stored support vector (sv_compiled holds twice the support vector) */
+    for( i=0; i<mdl->padded_sv; i++ )
+    {
+        norm = 0;
+        for( j=0; j<mdl->padded_features; j++ )
+        {
+            value = *( mdl->sv_compiled + j*mdl->padded_sv + i );
+            if( precision == MR_PRECISION_FP16 )
+            {
+                *( half_sv + j*mdl->padded_sv + i ) = mr_float_to_half( value );
+                stored = mr_half_to_float( *( half_sv + j*mdl->padded_sv + i ) );
+            }
+            else if( *( mdl->sv_dequant + j ) > 0 )
+            {
+                *( int8_sv + j*mdl->padded_sv + i ) = (signed char)lrintf( value / *( mdl->sv_dequant + j ) );
+                stored = (double)*( int8_sv + j*mdl->padded_sv + i ) * *( mdl->sv_dequant + j );
+            }
+            else
+            {
+                *( int8_sv + j*mdl->padded_sv + i ) = 0;
+                stored = 0;
+            }
+            norm += stored * stored / 4;
+        }
+        *( mdl->sv_bias_quantized + i ) = ( i < mdl->num_sv ) ? (float)( -norm ) : 0;
+    }
+
+    mdl->precision =    precision;
+    mdl->kernel =       mr_select_rbf_kernel( precision, NULL );
+
+    return 1;
+}
+
+/***************************************************/
+
+/* Uniform random number in (0, 1) from a 64-bit linear congruential generator, so the approximation does not depend
+   on the C library's rand() */
+static double mr_random_uniform( unsigned long long *state )
+{
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+
+    return ( (double)( *state >> 11 ) + 0.5 ) / 9007199254740992.0;
+}
+
+/***************************************************/
+
+int mr_approximate_model( mr_model *mdl, int num_components, unsigned int seed )
+{
+    unsigned long long  state = seed;
+    double              radius, angle, projection, beta;
+    double              two_pi = 6.283185307179586;
+    int                 d, i, j;
+
+    if( mdl->init_success != 1 )
+        return 0;
+
+    _aligned_free( mdl->rff_weights );
+    _aligned_free( mdl->rff_phase );
+    _aligned_free( mdl->rff_beta );
+    mdl->rff_components =   0;
+    mdl->rff_weights =      NULL;
+    mdl->rff_phase =        NULL;
+    mdl->rff_beta =         NULL;
+
+    if( num_components <= 0 )
+        return 1;
+
+    num_components = ( (num_components + MR_TILE_SV - 1) / MR_TILE_SV ) * MR_TILE_SV;
+    mdl->rff_weights =  _aligned_malloc( sizeof(float) * mdl->padded_features * num_components, MR_ALIGNMENT );
+    mdl->rff_phase =    _aligned_malloc( sizeof(float) * num_components, MR_ALIGNMENT );
+    mdl->rff_beta =     _aligned_malloc( sizeof(float) * num_components, MR_ALIGNMENT );
+    if( mdl->rff_weights == NULL || mdl->rff_phase == NULL || mdl->rff_beta == NULL )
+    {
+        _aligned_free( mdl->rff_weights );
+        _aligned_free( mdl->rff_phase );
+        _aligned_free( mdl->rff_beta );
+        mdl->rff_weights =  NULL;
+        mdl->rff_phase =    NULL;
+        mdl->rff_beta =     NULL;
+        return 0;
+    }
+
+    /* Frequencies from N(0, 2) by Box-Muller, zero in the padding features */
+    memset( mdl->rff_weights, 0, sizeof(float) * mdl->padded_features * num_components );
+    for( j=0; j<mdl->num_features; j++ )
+        for( d=0; d<num_components; d+=2 )
+        {
+            radius = sqrt( -4 * log( mr_random_uniform( &state ) ) );
+            angle = two_pi * mr_random_uniform( &state );
+            *( mdl->rff_weights + j*num_components + d ) =      (float)( radius * cos( angle ) );
+            *( mdl->rff_weights + j*num_components + d + 1 ) = (float)( radius * sin( angle ) );
+        }
+    for( d=0; d<num_components; d++ )
+        *( mdl->rff_phase + d ) = (float)( two_pi * mr_random_uniform( &state ) );
+
+    /* Project the support vectors once, in double precision, with the stored frequencies and phases */
+    for( d=0; d<num_components; d++ )
+    {
+        beta = 0;
+        for( i=0; i<mdl->num_sv; i++ )
+        {
+            projection = *( mdl->rff_phase + d );
+            for( j=0; j<mdl->num_features; j++ )
+                projection += *( mdl->rff_weights + j*num_components + d ) *
+                              ( *( mdl->support_vectors + i*mdl->num_features + j ) / (double)mdl->scale );
+            beta += *( mdl->alpha + i ) * cos( projection );
+        }
+        *( mdl->rff_beta + d ) = (float)( 2 * beta / num_components );
+    }
+
+    mdl->rff_components =   num_components;
+    mdl->rff_kernel =       mr_select_rff_kernel();
+
+    return 1;
+}
+
+/***************************************************/
+
 void mr_destroy( mr_model *mdl )
 {
-    free(mdl->mu);
-    free(mdl->sigma);
-    free(mdl->alpha);
-    free(mdl->support_vectors);
+    /* A mapped binary model points into the view, anything else was allocated */
+    if( mdl->view != NULL )
+        UnmapViewOfFile( mdl->view );
+    else
+    {
+        free(mdl->mu);
+        free(mdl->sigma);
+        free(mdl->alpha);
+        free(mdl->support_vectors);
+        _aligned_free(mdl->x_scale);
+        _aligned_free(mdl->x_offset);
+        _aligned_free(mdl->sv_compiled);
+        _aligned_free(mdl->sv_bias);
+        _aligned_free(mdl->alpha_padded);
+    }
+    _aligned_free(mdl->sv_quantized);
+    _aligned_free(mdl->sv_dequant);
+    _aligned_free(mdl->sv_bias_quantized);
+    _aligned_free(mdl->rff_weights);
+    _aligned_free(mdl->rff_phase);
+    _aligned_free(mdl->rff_beta);
+    if( mdl->mapping != NULL )
+        CloseHandle( mdl->mapping );
+    if( mdl->file != INVALID_HANDLE_VALUE )
+        CloseHandle( mdl->file );
 
-    mdl->mu =               NULL;
-    mdl->sigma =            NULL;
-    mdl->alpha =            NULL;
-    mdl->support_vectors =  NULL;
+    mr_clear_model( mdl );
 
     return;
 }
 
 /***************************************************/
 
-float mr_predict( float *x, mr_model mdl )
+float mr_predict( float *x, const mr_model *mdl )
+{
+    int     i;
+    float   x_norm = 0;
+    float   x_compiled[mdl->padded_features] __attribute__((aligned(MR_ALIGNMENT)));
+
+    if( mdl->init_success != 1 )
+        return 0;
+
+    /* Normalize and scale the features with one multiply-add each, the padding must be zero */
+    for( i=0; i<mdl->num_features; i++ )
+    {
+        x_compiled[i] = *(x+i) * *( mdl->x_scale + i ) + *( mdl->x_offset + i );
+        x_norm += x_compiled[i] * x_compiled[i];
+    }
+    for( ; i<mdl->padded_features; i++ )
+        x_compiled[i] = 0;
+
+    if( mdl->rff_components > 0 )
+        return mdl->rff_kernel( x_compiled, mdl->rff_weights, mdl->rff_phase, mdl->rff_beta, mdl->rff_components, mdl->padded_features ) + mdl->bias;
+    if( mdl->precision == MR_PRECISION_FP32 )
+        return mdl->kernel( x_compiled, x_norm, mdl->sv_compiled, mdl->sv_bias, mdl->alpha_padded, mdl->padded_sv, mdl->padded_features ) + mdl->bias;
+
+    /* int8 support vectors are stored divided by their feature's scale, which moves to the feature vector */
+    if( mdl->precision == MR_PRECISION_INT8 )
+        for( i=0; i<mdl->padded_features; i++ )
+            x_compiled[i] *= *( mdl->sv_dequant + i );
+
+    return mdl->kernel( x_compiled, x_norm, mdl->sv_quantized, mdl->sv_bias_quantized, mdl->alpha_padded, mdl->padded_sv, mdl->padded_features ) + mdl->bias;
+}
+
+/***************************************************/
+
+float mr_predict_scalar( float *x, const mr_model *mdl )
 {
     int     i, j;
     float   sum = 0;
     float   norm_sum = 0;
     float   x_transformed;
-    float   x_normed[mdl.num_features];
+    float   x_normed[mdl->num_features];
 
-    if( mdl.init_success != 1 )
+    if( mdl->init_success != 1 )
         return 0;
 
-    float varience = (float)pow( (double)mdl.scale, 2 );
+    float varience = (float)pow( (double)mdl->scale, 2 );
 
     /* Normalize features */
-    for( i=0; i<mdl.num_features; i++ )
-        x_normed[i] = ( *(x+i) - *( mdl.mu + i ) ) / *( mdl.sigma + i );
+    for( i=0; i<mdl->num_features; i++ )
+        x_normed[i] = ( *(x+i) - *( mdl->mu + i ) ) / *( mdl->sigma + i );
 
     /* For each support vector */
-    for( i=0; i<mdl.num_sv; i++ )
+    for( i=0; i<mdl->num_sv; i++ )
     {
         norm_sum = 0;
         /* Transform with Gaussian kernel */
-        for( j=0; j<mdl.num_features; j++ )
-            norm_sum += (float)pow( (double)( *( mdl.support_vectors + i*mdl.num_features + j ) - x_normed[j] ) , 2 );
+        for( j=0; j<mdl->num_features; j++ )
+            norm_sum += (float)pow( (double)( *( mdl->support_vectors + i*mdl->num_features + j ) - x_normed[j] ) , 2 );
         x_transformed = (float)exp( (double)( -norm_sum / varience ) );
 
-        sum += ( *( mdl.alpha + i ) * x_transformed );
+        sum += ( *( mdl->alpha + i ) * x_transformed );
+    }
+
+    return sum + mdl->bias;
+}
+
+/***************************************************/
+
+/* Predictions of one model for a block of feature vectors, see mr_predict_batch() */
+static void mr_predict_batch_model( const float *x, int num_vectors, const mr_model *mdl, float *predictions )
+{
+    float   x_block[MR_BATCH_ROWS * mdl->padded_features] __attribute__((aligned(MR_ALIGNMENT)));
+    float   x_norms[MR_BATCH_ROWS];
+    float   sums[MR_BATCH_ROWS];
+    float   *row;
+    int     first, rows, tile_rows, block_sv;
+    int     r, n, j;
+
+    if( mdl->init_success != 1 )
+    {
+        memset( predictions, 0, sizeof(float) * num_vectors );
+        return;
+    }
+
+    /* The tile kernels only read fp32 support vectors, reduced models predict exactly as mr_predict() does */
+    if( mdl->rff_components > 0 || mdl->precision != MR_PRECISION_FP32 )
+    {
+        for( r=0; r<num_vectors; r++ )
+            *(predictions + r) = mr_predict( (float*)( x + r*mdl->num_features ), mdl );
+        return;
+    }
+
+    for( first=0; first<num_vectors; first+=MR_BATCH_ROWS )
+    {
+        rows = ( num_vectors - first < MR_BATCH_ROWS ) ? num_vectors - first : MR_BATCH_ROWS;
+        tile_rows = ( (rows + MR_TILE_ROWS - 1) / MR_TILE_ROWS ) * MR_TILE_ROWS;
+
+        /* Compile the block into padded rows; rows past the end of the input are zero so whole tiles can be used */
+        for( r=0; r<tile_rows; r++ )
+        {
+            row = x_block + r*mdl->padded_features;
+            x_norms[r] = 0;
+            sums[r] = 0;
+            for( j=0; j<mdl->padded_features; j++ )
+            {
+                if( r < rows && j < mdl->num_features )
+                    *(row+j) = *(x + (first+r)*mdl->num_features + j) * *( mdl->x_scale + j ) + *( mdl->x_offset + j );
+                else
+                    *(row+j) = 0;
+                x_norms[r] += *(row+j) * *(row+j);
+            }
+        }
+
+        for( n=0; n<mdl->padded_sv; n+=MR_BATCH_SV )
+        {
+            block_sv = ( mdl->padded_sv - n < MR_BATCH_SV ) ? mdl->padded_sv - n : MR_BATCH_SV;
+            for( r=0; r<tile_rows; r+=MR_TILE_ROWS )
+                mdl->tile_kernel( x_block + r*mdl->padded_features, x_norms + r, mdl->sv_compiled + n, mdl->padded_sv,
+                                  mdl->sv_bias + n, mdl->alpha_padded + n, block_sv, mdl->padded_features, sums + r );
+        }
+
+        for( r=0; r<rows; r++ )
+            *(predictions + first + r) = sums[r] + mdl->bias;
     }
 
-    return sum + mdl.bias;
+    return;
+}
+
+/***************************************************/
+
+void mr_predict_batch( const float *x,
+                       int num_vectors,
+                       const mr_model *arousal_mdl,
+                       const mr_model *valence_mdl,
+                       float *arousal,
+                       float *valence )
+{
+    mr_predict_batch_model( x, num_vectors, arousal_mdl, arousal );
+    mr_predict_batch_model( x, num_vectors, valence_mdl, valence );
+
+    return;
+}
+
+/********************************************************/
+
+void mr_compute_features( float *features, const double *timbre_sum, const double *timbre_sum_sq, float *rec_flux_buffer,
+                          fe_autocorrelation *autocorrelation, fe_extraction_info *info )
+{
+    fe_timbre_stats_running( timbre_sum, timbre_sum_sq, features, info );
+    /* Arithmetic in second argument calculates the starting point of the rhythmic features in the features array */
+    fe_rhythmic_features( rec_flux_buffer, autocorrelation, (features + info->num_timbre_features * 2), info );
 }
 
 /********************************************************/
 
 unsigned int __stdcall MoodDetectionRoutine(void *lpArg)
 {
-    mr_detection_thread_data *threadData = (mr_detection_thread_data*)lpArg;
+    mr_detection_thread_data    *threadData = (mr_detection_thread_data*)lpArg;
+    fe_extraction_thread_data   *frames = threadData->extraction_data;
+    LARGE_INTEGER   t_begin, t_start, t_end, frequency;
+    FILETIME        creation_time, exit_time, kernel_time, user_time;
+    LONG            completed, frame_ticks;
+    LONG            next_frame;
+    LONGLONG        latency;
+
+    QueryPerformanceCounter( &t_begin );
 
-    Sleep( 3500 );
+    /* The first prediction waits until the timbre matrix holds a whole window of frames */
+    next_frame = threadData->extraction_info->frames_in_window;
 
     while( !(threadData->terminate_thread) )
     {
-        fe_timbre_stats( threadData->timbre_matrix, threadData->features, threadData->extraction_info );
-        /* Arithmetic in second argument calculates the starting point of the rhythmic features in the features array */
-        fe_rhythmic_features( threadData->rec_flux_buffer, (threadData->features + threadData->extraction_info->num_timbre_features * 2), threadData->extraction_info );
+        /* Frame counts are compared by difference so they may wrap.  The timeout only bounds how long termination
+           can go unnoticed if the stream stops */
+        completed = frames->frames_completed;
+        if( (LONG)( completed - next_frame ) < 0 )
+        {
+            WaitForSingleObject( frames->frame_ready, 100 );
+            continue;
+        }
+        frame_ticks = frames->frame_ticks;
+
+        /* One consistent window of the running sums, flux and lags, the analysis thread goes on updating them */
+        QueryPerformanceCounter( &t_start );
+        fe_read_window_stats( frames, threadData->timbre_sum, threadData->timbre_sum_sq, threadData->rec_flux_buffer,
+                              &threadData->autocorrelation );
+        mr_compute_features( threadData->features, threadData->timbre_sum, threadData->timbre_sum_sq, threadData->rec_flux_buffer,
+                             &threadData->autocorrelation, threadData->extraction_info );
+
+        threadData->arousal_prediction = mr_predict( threadData->features, &threadData->arousal_mdl );
+        threadData->valence_prediction = mr_predict( threadData->features, &threadData->valence_mdl );
+        QueryPerformanceCounter( &t_end );
 
-        threadData->arousal_prediction = mr_predict( threadData->features, threadData->arousal_mdl );
-        threadData->valence_prediction = mr_predict( threadData->features, threadData->valence_mdl );
+        /* Only the low 32 bits of the frame's counter reading are published, the difference is exact below 2^31 ticks */
+        latency = (LONG)( (LONG)t_end.QuadPart - frame_ticks );
+        threadData->num_predictions++;
+        threadData->frames_skipped +=   completed - next_frame;
+        threadData->predict_ticks +=    t_end.QuadPart - t_start.QuadPart;
+        threadData->latency_ticks +=    latency;
+        if( latency > threadData->latency_max_ticks )
+            threadData->latency_max_ticks = latency;
+
+        next_frame = completed + threadData->prediction_cadence;
     }
 
+    QueryPerformanceCounter( &t_end );
+    QueryPerformanceFrequency( &frequency );
+    threadData->run_seconds = (double)( t_end.QuadPart - t_begin.QuadPart ) / frequency.QuadPart;
+    if( GetThreadTimes( GetCurrentThread(), &creation_time, &exit_time, &kernel_time, &user_time ) )
+        threadData->cpu_seconds = 1e-7 * ( ( (double)kernel_time.dwHighDateTime + user_time.dwHighDateTime ) * 4294967296.0 +
+                                           (double)kernel_time.dwLowDateTime + user_time.dwLowDateTime );
+
     _endthreadex( 0 );
 	return 0;
 }
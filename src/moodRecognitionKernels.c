@@ -0,0 +1,1143 @@
+/* moodRecognitionKernels.c Contains the SIMD kernels used in SVR prediction
+ * Copyright (c) 2017 Jay Biernat
+ * Copyright (c) 2017 University of Rochester
+ *
+ * This file is part of Musical Mood Detector and Visualizer
+ *
+ * Musical Mood Detector and Visualizer is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Musical Mood Detector and Visualizer is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even
+ * the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Musical Mood Detector and Visualizer.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Each instruction set has its own function compiled with a target attribute, so the file builds without any
+ * -m flags and the choice between them is made at run time by mr_select_rbf_kernel().  The layout of the
+ * compiled model the kernels work on is described in moodRecognitionKernels.h.
+ *
+ * The vectorized exp follows the Cephes expf: exp(x) = 2^n * exp(r) with n = round(x / ln2) and
+ * |r| <= ln2/2, exp(r) from a degree 6 polynomial.  The kernels clamp the argument to x <= 0, so only the
+ * lower clamp is needed.
+ *
+ * The vectorized cos used by the Random Fourier Features kernels reduces the argument to a = x - 2pi * round(x / 2pi)
+ * in [-pi, pi] and evaluates the Taylor series of cos(a) up to a^16.
+ */
+
+#include <math.h>
+#include <immintrin.h>
+#include "moodRecognitionKernels.h"
+
+#define MR_EXP_LOWER    -87.3f          /* expf underflows to denormals below this */
+#define MR_LOG2E        1.44269504088896341f
+#define MR_LN2_HI       0.693359375f    /* ln2 split into an exact high part and a correction */
+#define MR_LN2_LO       -2.12194440e-4f
+#define MR_EXP_P0       1.9875691500e-4f
+#define MR_EXP_P1       1.3981999507e-3f
+#define MR_EXP_P2       8.3334519073e-3f
+#define MR_EXP_P3       4.1665795894e-2f
+#define MR_EXP_P4       1.6666665459e-1f
+#define MR_EXP_P5       5.0000001201e-1f
+#define MR_INV_2PI      0.159154943091895336f
+#define MR_2PI_HI       6.28125f        /* 2pi split the same way */
+#define MR_2PI_LO       1.93530717958647692e-3f
+#define MR_COS_C1       -5.0000000000e-1f   /* Taylor coefficients of cos in a^2, accurate to 2e-7 on [-pi, pi] */
+#define MR_COS_C2       4.1666666667e-2f
+#define MR_COS_C3       -1.3888888889e-3f
+#define MR_COS_C4       2.4801587302e-5f
+#define MR_COS_C5       -2.7557319224e-7f
+#define MR_COS_C6       2.0876756988e-9f
+#define MR_COS_C7       -1.1470745597e-11f
+#define MR_COS_C8       4.7794773324e-14f
+
+float mr_rbf_kernel_scalar( const float *x, float x_norm, const void *sv, const float *sv_bias, const float *alpha, int num_sv, int padded_features )
+{
+    float   acc[MR_TILE_SV];
+    float   arg, x_k;
+    float   sum = 0;
+    int     n, k, c;
+
+    for( n=0; n<num_sv; n+=MR_TILE_SV )
+    {
+        for( c=0; c<MR_TILE_SV; c++ )
+            acc[c] = *(sv_bias + n + c);
+
+        /* One feature of MR_TILE_SV support vectors at a time, the inner loop is contiguous */
+        for( k=0; k<padded_features; k++ )
+        {
+            x_k = *(x+k);
+            for( c=0; c<MR_TILE_SV; c++ )
+                acc[c] += x_k * *((const float*)sv + k*num_sv + n + c);
+        }
+
+        for( c=0; c<MR_TILE_SV; c++ )
+        {
+            arg = acc[c] - x_norm;
+            if( arg > 0 )
+                arg = 0;
+            sum += *(alpha + n + c) * expf( arg );
+        }
+    }
+
+    return sum;
+}
+
+void mr_rbf_tile_scalar( const float *x, const float *x_norms, const float *sv, int ld_sv, const float *sv_bias,
+                         const float *alpha, int num_sv, int padded_features, float *sums )
+{
+    float   dot[MR_TILE_ROWS][MR_TILE_SV];
+    float   arg, x_k;
+    int     r, n, k, c;
+
+    for( n=0; n<num_sv; n+=MR_TILE_SV )
+    {
+        for( r=0; r<MR_TILE_ROWS; r++ )
+            for( c=0; c<MR_TILE_SV; c++ )
+                dot[r][c] = 0;
+
+        for( k=0; k<padded_features; k++ )
+            for( r=0; r<MR_TILE_ROWS; r++ )
+            {
+                x_k = *(x + r*padded_features + k);
+                for( c=0; c<MR_TILE_SV; c++ )
+                    dot[r][c] += x_k * *(sv + k*ld_sv + n + c);
+            }
+
+        for( r=0; r<MR_TILE_ROWS; r++ )
+            for( c=0; c<MR_TILE_SV; c++ )
+            {
+                arg = dot[r][c] + *(sv_bias + n + c) - *(x_norms + r);
+                if( arg > 0 )
+                    arg = 0;
+                *(sums + r) += *(alpha + n + c) * expf( arg );
+            }
+    }
+
+    return;
+}
+
+unsigned short mr_float_to_half( float value )
+{
+    union { float f; unsigned int u; } bits;
+    unsigned int    sign, mantissa;
+    int             exponent;
+
+    bits.f = value;
+    sign =      ( bits.u >> 16 ) & 0x8000;
+    exponent =  (int)( ( bits.u >> 23 ) & 0xFF ) - 127 + 15;
+    mantissa =  bits.u & 0x7FFFFF;
+
+    if( exponent >= 31 )                    /* Too large (or inf/nan): saturate to infinity */
+        return (unsigned short)( sign | 0x7C00 );
+    if( exponent <= 0 )                     /* Denormal or zero */
+    {
+        if( exponent < -10 )
+            return (unsigned short)sign;
+        mantissa |= 0x800000;
+        return (unsigned short)( sign | ( ( mantissa + ( 1u << ( 13 - exponent ) ) ) >> ( 14 - exponent ) ) );
+    }
+
+    /* Round to nearest even on the 13 dropped bits, a carry into the exponent is correct */
+    mantissa += 0xFFF + ( ( mantissa >> 13 ) & 1 );
+    return (unsigned short)( sign + ( (unsigned int)exponent << 10 ) + ( mantissa >> 13 ) );
+}
+
+float mr_half_to_float( unsigned short value )
+{
+    union { float f; unsigned int u; } bits;
+    unsigned int    sign = ( (unsigned int)value & 0x8000 ) << 16;
+    unsigned int    exponent = ( value >> 10 ) & 0x1F;
+    unsigned int    mantissa = value & 0x3FF;
+
+    if( exponent == 0 )                     /* Zero or denormal: mantissa * 2^-24 */
+    {
+        bits.f = (float)mantissa * 5.9604644775390625e-8f;
+        bits.u |= sign;
+        return bits.f;
+    }
+    if( exponent == 31 )
+        bits.u = sign | 0x7F800000 | ( mantissa << 13 );
+    else
+        bits.u = sign | ( ( exponent + 127 - 15 ) << 23 ) | ( mantissa << 13 );
+
+    return bits.f;
+}
+
+float mr_rbf_kernel_scalar_fp16( const float *x, float x_norm, const void *sv, const float *sv_bias, const float *alpha, int num_sv, int padded_features )
+{
+    const unsigned short    *half_sv = (const unsigned short*)sv;
+    float                   acc[MR_TILE_SV];
+    float                   arg, x_k;
+    float                   sum = 0;
+    int                     n, k, c;
+
+    for( n=0; n<num_sv; n+=MR_TILE_SV )
+    {
+        for( c=0; c<MR_TILE_SV; c++ )
+            acc[c] = *(sv_bias + n + c);
+
+        for( k=0; k<padded_features; k++ )
+        {
+            x_k = *(x+k);
+            for( c=0; c<MR_TILE_SV; c++ )
+                acc[c] += x_k * mr_half_to_float( *(half_sv + k*num_sv + n + c) );
+        }
+
+        for( c=0; c<MR_TILE_SV; c++ )
+        {
+            arg = acc[c] - x_norm;
+            if( arg > 0 )
+                arg = 0;
+            sum += *(alpha + n + c) * expf( arg );
+        }
+    }
+
+    return sum;
+}
+
+float mr_rbf_kernel_scalar_int8( const float *x, float x_norm, const void *sv, const float *sv_bias, const float *alpha, int num_sv, int padded_features )
+{
+    const signed char   *int8_sv = (const signed char*)sv;
+    float               acc[MR_TILE_SV];
+    float               arg, x_k;
+    float               sum = 0;
+    int                 n, k, c;
+
+    for( n=0; n<num_sv; n+=MR_TILE_SV )
+    {
+        for( c=0; c<MR_TILE_SV; c++ )
+            acc[c] = *(sv_bias + n + c);
+
+        /* x has already been multiplied by the per-feature scale of the quantized support vectors */
+        for( k=0; k<padded_features; k++ )
+        {
+            x_k = *(x+k);
+            for( c=0; c<MR_TILE_SV; c++ )
+                acc[c] += x_k * (float)*(int8_sv + k*num_sv + n + c);
+        }
+
+        for( c=0; c<MR_TILE_SV; c++ )
+        {
+            arg = acc[c] - x_norm;
+            if( arg > 0 )
+                arg = 0;
+            sum += *(alpha + n + c) * expf( arg );
+        }
+    }
+
+    return sum;
+}
+
+float mr_rff_kernel_scalar( const float *x, const float *weights, const float *phase, const float *beta, int num_components, int padded_features )
+{
+    float   acc[MR_TILE_SV];
+    float   x_k;
+    float   sum = 0;
+    int     n, k, c;
+
+    for( n=0; n<num_components; n+=MR_TILE_SV )
+    {
+        for( c=0; c<MR_TILE_SV; c++ )
+            acc[c] = *(phase + n + c);
+
+        for( k=0; k<padded_features; k++ )
+        {
+            x_k = *(x+k);
+            for( c=0; c<MR_TILE_SV; c++ )
+                acc[c] += x_k * *(weights + k*num_components + n + c);
+        }
+
+        for( c=0; c<MR_TILE_SV; c++ )
+            sum += *(beta + n + c) * cosf( acc[c] );
+    }
+
+    return sum;
+}
+
+/******************************************************/
+
+__attribute__((target("sse2")))
+static __m128 mr_exp_sse2( __m128 x )
+{
+    __m128  fx, floor_fx, y, z;
+    __m128i n;
+
+    x = _mm_max_ps( x, _mm_set1_ps( MR_EXP_LOWER ) );
+
+    /* n = floor( x*log2(e) + 0.5 ), SSE2 has no floor so truncate and correct negative values */
+    fx = _mm_add_ps( _mm_mul_ps( x, _mm_set1_ps( MR_LOG2E ) ), _mm_set1_ps( 0.5f ) );
+    floor_fx = _mm_cvtepi32_ps( _mm_cvttps_epi32( fx ) );
+    floor_fx = _mm_sub_ps( floor_fx, _mm_and_ps( _mm_cmpgt_ps( floor_fx, fx ), _mm_set1_ps( 1.0f ) ) );
+
+    x = _mm_sub_ps( x, _mm_mul_ps( floor_fx, _mm_set1_ps( MR_LN2_HI ) ) );
+    x = _mm_sub_ps( x, _mm_mul_ps( floor_fx, _mm_set1_ps( MR_LN2_LO ) ) );
+
+    z = _mm_mul_ps( x, x );
+    y = _mm_set1_ps( MR_EXP_P0 );
+    y = _mm_add_ps( _mm_mul_ps( y, x ), _mm_set1_ps( MR_EXP_P1 ) );
+    y = _mm_add_ps( _mm_mul_ps( y, x ), _mm_set1_ps( MR_EXP_P2 ) );
+    y = _mm_add_ps( _mm_mul_ps( y, x ), _mm_set1_ps( MR_EXP_P3 ) );
+    y = _mm_add_ps( _mm_mul_ps( y, x ), _mm_set1_ps( MR_EXP_P4 ) );
+    y = _mm_add_ps( _mm_mul_ps( y, x ), _mm_set1_ps( MR_EXP_P5 ) );
+    y = _mm_add_ps( _mm_add_ps( _mm_mul_ps( y, z ), x ), _mm_set1_ps( 1.0f ) );
+
+    /* Build 2^n in the exponent field */
+    n = _mm_cvttps_epi32( floor_fx );
+    n = _mm_slli_epi32( _mm_add_epi32( n, _mm_set1_epi32( 127 ) ), 23 );
+
+    return _mm_mul_ps( y, _mm_castsi128_ps( n ) );
+}
+
+/* Sum of the four elements of a vector */
+__attribute__((target("sse2")))
+static inline float mr_hsum_sse2( __m128 v )
+{
+    v = _mm_add_ps( v, _mm_movehl_ps( v, v ) );
+    v = _mm_add_ss( v, _mm_shuffle_ps( v, v, 1 ) );
+
+    return _mm_cvtss_f32( v );
+}
+
+/* alpha * exp( min( 0, dot + bias - x_norm ) ) added to total */
+__attribute__((target("sse2")))
+static inline __m128 mr_kernel_term_sse2( __m128 total, __m128 dot, __m128 neg_x_norm, const float *alpha )
+{
+    __m128 arg;
+
+    arg = _mm_min_ps( _mm_add_ps( dot, neg_x_norm ), _mm_setzero_ps() );
+
+    return _mm_add_ps( total, _mm_mul_ps( mr_exp_sse2( arg ), _mm_load_ps( alpha ) ) );
+}
+
+__attribute__((target("sse2")))
+float mr_rbf_kernel_sse2( const float *x, float x_norm, const void *sv, const float *sv_bias, const float *alpha, int num_sv, int padded_features )
+{
+    const float *row;
+    __m128  a0, a1, a2, a3, a4, a5, a6, a7;
+    __m128  xb;
+    __m128  neg_x_norm = _mm_set1_ps( -x_norm );
+    __m128  total = _mm_setzero_ps();
+    int     n, k;
+
+    for( n=0; n<num_sv; n+=32 )
+    {
+        a0 = _mm_load_ps( sv_bias + n );
+        a1 = _mm_load_ps( sv_bias + n+4 );
+        a2 = _mm_load_ps( sv_bias + n+8 );
+        a3 = _mm_load_ps( sv_bias + n+12 );
+        a4 = _mm_load_ps( sv_bias + n+16 );
+        a5 = _mm_load_ps( sv_bias + n+20 );
+        a6 = _mm_load_ps( sv_bias + n+24 );
+        a7 = _mm_load_ps( sv_bias + n+28 );
+
+        /* One feature of 32 support vectors per step: broadcast the feature, one multiply-add per register */
+        row = (const float*)sv + n;
+        for( k=0; k<padded_features; k++ )
+        {
+            xb = _mm_set1_ps( *(x+k) );
+            a0 = _mm_add_ps( a0, _mm_mul_ps( xb, _mm_load_ps( row ) ) );
+            a1 = _mm_add_ps( a1, _mm_mul_ps( xb, _mm_load_ps( row+4 ) ) );
+            a2 = _mm_add_ps( a2, _mm_mul_ps( xb, _mm_load_ps( row+8 ) ) );
+            a3 = _mm_add_ps( a3, _mm_mul_ps( xb, _mm_load_ps( row+12 ) ) );
+            a4 = _mm_add_ps( a4, _mm_mul_ps( xb, _mm_load_ps( row+16 ) ) );
+            a5 = _mm_add_ps( a5, _mm_mul_ps( xb, _mm_load_ps( row+20 ) ) );
+            a6 = _mm_add_ps( a6, _mm_mul_ps( xb, _mm_load_ps( row+24 ) ) );
+            a7 = _mm_add_ps( a7, _mm_mul_ps( xb, _mm_load_ps( row+28 ) ) );
+            row += num_sv;
+        }
+
+        total = mr_kernel_term_sse2( total, a0, neg_x_norm, alpha + n );
+        total = mr_kernel_term_sse2( total, a1, neg_x_norm, alpha + n+4 );
+        total = mr_kernel_term_sse2( total, a2, neg_x_norm, alpha + n+8 );
+        total = mr_kernel_term_sse2( total, a3, neg_x_norm, alpha + n+12 );
+        total = mr_kernel_term_sse2( total, a4, neg_x_norm, alpha + n+16 );
+        total = mr_kernel_term_sse2( total, a5, neg_x_norm, alpha + n+20 );
+        total = mr_kernel_term_sse2( total, a6, neg_x_norm, alpha + n+24 );
+        total = mr_kernel_term_sse2( total, a7, neg_x_norm, alpha + n+28 );
+    }
+
+    return mr_hsum_sse2( total );
+}
+
+__attribute__((target("sse2")))
+void mr_rbf_tile_sse2( const float *x, const float *x_norms, const float *sv, int ld_sv, const float *sv_bias,
+                       const float *alpha, int num_sv, int padded_features, float *sums )
+{
+    const float *col;
+    __m128      a00, a01, a10, a11, a20, a21, a30, a31;     /* Dot products, row r and half h in a<r><h> */
+    __m128      t0, t1, t2, t3;
+    __m128      s0, s1, xb;
+    __m128      neg_norm0 = _mm_set1_ps( -*(x_norms) );
+    __m128      neg_norm1 = _mm_set1_ps( -*(x_norms+1) );
+    __m128      neg_norm2 = _mm_set1_ps( -*(x_norms+2) );
+    __m128      neg_norm3 = _mm_set1_ps( -*(x_norms+3) );
+    int         n, k;
+
+    t0 = t1 = t2 = t3 = _mm_setzero_ps();
+
+    for( n=0; n<num_sv; n+=8 )
+    {
+        a00 = a01 = a10 = a11 = a20 = a21 = a30 = a31 = _mm_setzero_ps();
+
+        /* Rank one updates of the 4 x 8 tile: one row of the compiled support vectors times one feature of
+           each row of x, the accumulators stay in registers */
+        col = sv + n;
+        for( k=0; k<padded_features; k++ )
+        {
+            s0 = _mm_load_ps( col );
+            s1 = _mm_load_ps( col+4 );
+            xb = _mm_set1_ps( *(x + k) );
+            a00 = _mm_add_ps( a00, _mm_mul_ps( xb, s0 ) );
+            a01 = _mm_add_ps( a01, _mm_mul_ps( xb, s1 ) );
+            xb = _mm_set1_ps( *(x + padded_features + k) );
+            a10 = _mm_add_ps( a10, _mm_mul_ps( xb, s0 ) );
+            a11 = _mm_add_ps( a11, _mm_mul_ps( xb, s1 ) );
+            xb = _mm_set1_ps( *(x + 2*padded_features + k) );
+            a20 = _mm_add_ps( a20, _mm_mul_ps( xb, s0 ) );
+            a21 = _mm_add_ps( a21, _mm_mul_ps( xb, s1 ) );
+            xb = _mm_set1_ps( *(x + 3*padded_features + k) );
+            a30 = _mm_add_ps( a30, _mm_mul_ps( xb, s0 ) );
+            a31 = _mm_add_ps( a31, _mm_mul_ps( xb, s1 ) );
+            col += ld_sv;
+        }
+
+        t0 = mr_kernel_term_sse2( t0, _mm_add_ps( a00, _mm_load_ps( sv_bias+n ) ), neg_norm0, alpha+n );
+        t0 = mr_kernel_term_sse2( t0, _mm_add_ps( a01, _mm_load_ps( sv_bias+n+4 ) ), neg_norm0, alpha+n+4 );
+        t1 = mr_kernel_term_sse2( t1, _mm_add_ps( a10, _mm_load_ps( sv_bias+n ) ), neg_norm1, alpha+n );
+        t1 = mr_kernel_term_sse2( t1, _mm_add_ps( a11, _mm_load_ps( sv_bias+n+4 ) ), neg_norm1, alpha+n+4 );
+        t2 = mr_kernel_term_sse2( t2, _mm_add_ps( a20, _mm_load_ps( sv_bias+n ) ), neg_norm2, alpha+n );
+        t2 = mr_kernel_term_sse2( t2, _mm_add_ps( a21, _mm_load_ps( sv_bias+n+4 ) ), neg_norm2, alpha+n+4 );
+        t3 = mr_kernel_term_sse2( t3, _mm_add_ps( a30, _mm_load_ps( sv_bias+n ) ), neg_norm3, alpha+n );
+        t3 = mr_kernel_term_sse2( t3, _mm_add_ps( a31, _mm_load_ps( sv_bias+n+4 ) ), neg_norm3, alpha+n+4 );
+    }
+
+    *(sums)   += mr_hsum_sse2( t0 );
+    *(sums+1) += mr_hsum_sse2( t1 );
+    *(sums+2) += mr_hsum_sse2( t2 );
+    *(sums+3) += mr_hsum_sse2( t3 );
+
+    return;
+}
+
+/******************************************************/
+
+__attribute__((target("avx2,fma")))
+static __m256 mr_exp_avx2( __m256 x )
+{
+    __m256  fx, y, z;
+    __m256i n;
+
+    x = _mm256_max_ps( x, _mm256_set1_ps( MR_EXP_LOWER ) );
+
+    fx = _mm256_floor_ps( _mm256_fmadd_ps( x, _mm256_set1_ps( MR_LOG2E ), _mm256_set1_ps( 0.5f ) ) );
+
+    x = _mm256_fnmadd_ps( fx, _mm256_set1_ps( MR_LN2_HI ), x );
+    x = _mm256_fnmadd_ps( fx, _mm256_set1_ps( MR_LN2_LO ), x );
+
+    z = _mm256_mul_ps( x, x );
+    y = _mm256_set1_ps( MR_EXP_P0 );
+    y = _mm256_fmadd_ps( y, x, _mm256_set1_ps( MR_EXP_P1 ) );
+    y = _mm256_fmadd_ps( y, x, _mm256_set1_ps( MR_EXP_P2 ) );
+    y = _mm256_fmadd_ps( y, x, _mm256_set1_ps( MR_EXP_P3 ) );
+    y = _mm256_fmadd_ps( y, x, _mm256_set1_ps( MR_EXP_P4 ) );
+    y = _mm256_fmadd_ps( y, x, _mm256_set1_ps( MR_EXP_P5 ) );
+    y = _mm256_add_ps( _mm256_fmadd_ps( y, z, x ), _mm256_set1_ps( 1.0f ) );
+
+    n = _mm256_cvttps_epi32( fx );
+    n = _mm256_slli_epi32( _mm256_add_epi32( n, _mm256_set1_epi32( 127 ) ), 23 );
+
+    return _mm256_mul_ps( y, _mm256_castsi256_ps( n ) );
+}
+
+/* Sum of the eight elements of a vector */
+__attribute__((target("avx2,fma")))
+static inline float mr_hsum_avx2( __m256 v )
+{
+    __m128 half;
+
+    half = _mm_add_ps( _mm256_castps256_ps128( v ), _mm256_extractf128_ps( v, 1 ) );
+    half = _mm_add_ps( half, _mm_movehl_ps( half, half ) );
+    half = _mm_add_ss( half, _mm_shuffle_ps( half, half, 1 ) );
+
+    return _mm_cvtss_f32( half );
+}
+
+/* alpha * exp( min( 0, dot + bias - x_norm ) ) added to total */
+__attribute__((target("avx2,fma")))
+static inline __m256 mr_kernel_term_avx2( __m256 total, __m256 dot, __m256 neg_x_norm, const float *alpha )
+{
+    __m256 arg;
+
+    arg = _mm256_min_ps( _mm256_add_ps( dot, neg_x_norm ), _mm256_setzero_ps() );
+
+    return _mm256_fmadd_ps( mr_exp_avx2( arg ), _mm256_load_ps( alpha ), total );
+}
+
+__attribute__((target("avx2,fma")))
+float mr_rbf_kernel_avx2( const float *x, float x_norm, const void *sv, const float *sv_bias, const float *alpha, int num_sv, int padded_features )
+{
+    const float *row;
+    __m256  a0, a1, a2, a3, a4, a5, a6, a7;
+    __m256  xb;
+    __m256  neg_x_norm = _mm256_set1_ps( -x_norm );
+    __m256  total = _mm256_setzero_ps();
+    int     n, k;
+
+    for( n=0; n<num_sv; n+=64 )
+    {
+        a0 = _mm256_load_ps( sv_bias + n );
+        a1 = _mm256_load_ps( sv_bias + n+8 );
+        a2 = _mm256_load_ps( sv_bias + n+16 );
+        a3 = _mm256_load_ps( sv_bias + n+24 );
+        a4 = _mm256_load_ps( sv_bias + n+32 );
+        a5 = _mm256_load_ps( sv_bias + n+40 );
+        a6 = _mm256_load_ps( sv_bias + n+48 );
+        a7 = _mm256_load_ps( sv_bias + n+56 );
+
+        /* One feature of 64 support vectors per step: broadcast the feature, one multiply-add per register */
+        row = (const float*)sv + n;
+        for( k=0; k<padded_features; k++ )
+        {
+            xb = _mm256_set1_ps( *(x+k) );
+            a0 = _mm256_fmadd_ps( xb, _mm256_load_ps( row ), a0 );
+            a1 = _mm256_fmadd_ps( xb, _mm256_load_ps( row+8 ), a1 );
+            a2 = _mm256_fmadd_ps( xb, _mm256_load_ps( row+16 ), a2 );
+            a3 = _mm256_fmadd_ps( xb, _mm256_load_ps( row+24 ), a3 );
+            a4 = _mm256_fmadd_ps( xb, _mm256_load_ps( row+32 ), a4 );
+            a5 = _mm256_fmadd_ps( xb, _mm256_load_ps( row+40 ), a5 );
+            a6 = _mm256_fmadd_ps( xb, _mm256_load_ps( row+48 ), a6 );
+            a7 = _mm256_fmadd_ps( xb, _mm256_load_ps( row+56 ), a7 );
+            row += num_sv;
+        }
+
+        total = mr_kernel_term_avx2( total, a0, neg_x_norm, alpha + n );
+        total = mr_kernel_term_avx2( total, a1, neg_x_norm, alpha + n+8 );
+        total = mr_kernel_term_avx2( total, a2, neg_x_norm, alpha + n+16 );
+        total = mr_kernel_term_avx2( total, a3, neg_x_norm, alpha + n+24 );
+        total = mr_kernel_term_avx2( total, a4, neg_x_norm, alpha + n+32 );
+        total = mr_kernel_term_avx2( total, a5, neg_x_norm, alpha + n+40 );
+        total = mr_kernel_term_avx2( total, a6, neg_x_norm, alpha + n+48 );
+        total = mr_kernel_term_avx2( total, a7, neg_x_norm, alpha + n+56 );
+    }
+
+    return mr_hsum_avx2( total );
+}
+
+__attribute__((target("avx2,fma")))
+void mr_rbf_tile_avx2( const float *x, const float *x_norms, const float *sv, int ld_sv, const float *sv_bias,
+                       const float *alpha, int num_sv, int padded_features, float *sums )
+{
+    const float *col;
+    __m256      a00, a01, a10, a11, a20, a21, a30, a31;     /* Dot products, row r and half h in a<r><h> */
+    __m256      t0, t1, t2, t3;
+    __m256      s0, s1, xb;
+    __m256      neg_norm0 = _mm256_set1_ps( -*(x_norms) );
+    __m256      neg_norm1 = _mm256_set1_ps( -*(x_norms+1) );
+    __m256      neg_norm2 = _mm256_set1_ps( -*(x_norms+2) );
+    __m256      neg_norm3 = _mm256_set1_ps( -*(x_norms+3) );
+    int         n, k;
+
+    t0 = t1 = t2 = t3 = _mm256_setzero_ps();
+
+    for( n=0; n<num_sv; n+=16 )
+    {
+        a00 = a01 = a10 = a11 = a20 = a21 = a30 = a31 = _mm256_setzero_ps();
+
+        /* Rank one updates of the 4 x 16 tile: one row of the compiled support vectors times one feature of
+           each row of x, the accumulators stay in registers */
+        col = sv + n;
+        for( k=0; k<padded_features; k++ )
+        {
+            s0 = _mm256_load_ps( col );
+            s1 = _mm256_load_ps( col+8 );
+            xb = _mm256_set1_ps( *(x + k) );
+            a00 = _mm256_fmadd_ps( xb, s0, a00 );
+            a01 = _mm256_fmadd_ps( xb, s1, a01 );
+            xb = _mm256_set1_ps( *(x + padded_features + k) );
+            a10 = _mm256_fmadd_ps( xb, s0, a10 );
+            a11 = _mm256_fmadd_ps( xb, s1, a11 );
+            xb = _mm256_set1_ps( *(x + 2*padded_features + k) );
+            a20 = _mm256_fmadd_ps( xb, s0, a20 );
+            a21 = _mm256_fmadd_ps( xb, s1, a21 );
+            xb = _mm256_set1_ps( *(x + 3*padded_features + k) );
+            a30 = _mm256_fmadd_ps( xb, s0, a30 );
+            a31 = _mm256_fmadd_ps( xb, s1, a31 );
+            col += ld_sv;
+        }
+
+        t0 = mr_kernel_term_avx2( t0, _mm256_add_ps( a00, _mm256_load_ps( sv_bias+n ) ), neg_norm0, alpha+n );
+        t0 = mr_kernel_term_avx2( t0, _mm256_add_ps( a01, _mm256_load_ps( sv_bias+n+8 ) ), neg_norm0, alpha+n+8 );
+        t1 = mr_kernel_term_avx2( t1, _mm256_add_ps( a10, _mm256_load_ps( sv_bias+n ) ), neg_norm1, alpha+n );
+        t1 = mr_kernel_term_avx2( t1, _mm256_add_ps( a11, _mm256_load_ps( sv_bias+n+8 ) ), neg_norm1, alpha+n+8 );
+        t2 = mr_kernel_term_avx2( t2, _mm256_add_ps( a20, _mm256_load_ps( sv_bias+n ) ), neg_norm2, alpha+n );
+        t2 = mr_kernel_term_avx2( t2, _mm256_add_ps( a21, _mm256_load_ps( sv_bias+n+8 ) ), neg_norm2, alpha+n+8 );
+        t3 = mr_kernel_term_avx2( t3, _mm256_add_ps( a30, _mm256_load_ps( sv_bias+n ) ), neg_norm3, alpha+n );
+        t3 = mr_kernel_term_avx2( t3, _mm256_add_ps( a31, _mm256_load_ps( sv_bias+n+8 ) ), neg_norm3, alpha+n+8 );
+    }
+
+    *(sums)   += mr_hsum_avx2( t0 );
+    *(sums+1) += mr_hsum_avx2( t1 );
+    *(sums+2) += mr_hsum_avx2( t2 );
+    *(sums+3) += mr_hsum_avx2( t3 );
+
+    return;
+}
+
+__attribute__((target("avx2,fma,f16c")))
+float mr_rbf_kernel_avx2_fp16( const float *x, float x_norm, const void *sv, const float *sv_bias, const float *alpha, int num_sv, int padded_features )
+{
+    const unsigned short *row;
+    __m256  a0, a1, a2, a3, a4, a5, a6, a7;
+    __m256  xb;
+    __m256  neg_x_norm = _mm256_set1_ps( -x_norm );
+    __m256  total = _mm256_setzero_ps();
+    int     n, k;
+
+    for( n=0; n<num_sv; n+=64 )
+    {
+        a0 = _mm256_load_ps( sv_bias + n );
+        a1 = _mm256_load_ps( sv_bias + n+8 );
+        a2 = _mm256_load_ps( sv_bias + n+16 );
+        a3 = _mm256_load_ps( sv_bias + n+24 );
+        a4 = _mm256_load_ps( sv_bias + n+32 );
+        a5 = _mm256_load_ps( sv_bias + n+40 );
+        a6 = _mm256_load_ps( sv_bias + n+48 );
+        a7 = _mm256_load_ps( sv_bias + n+56 );
+
+        /* Same as the fp32 kernel, with the support vectors converted to fp32 as they are loaded */
+        row = (const unsigned short*)sv + n;
+        for( k=0; k<padded_features; k+=1 )
+        {
+            xb = _mm256_set1_ps( *(x+k) );
+            a0 = _mm256_fmadd_ps( xb, _mm256_cvtph_ps( _mm_load_si128( (const __m128i*)( row ) ) ), a0 );
+            a1 = _mm256_fmadd_ps( xb, _mm256_cvtph_ps( _mm_load_si128( (const __m128i*)( row+8 ) ) ), a1 );
+            a2 = _mm256_fmadd_ps( xb, _mm256_cvtph_ps( _mm_load_si128( (const __m128i*)( row+16 ) ) ), a2 );
+            a3 = _mm256_fmadd_ps( xb, _mm256_cvtph_ps( _mm_load_si128( (const __m128i*)( row+24 ) ) ), a3 );
+            a4 = _mm256_fmadd_ps( xb, _mm256_cvtph_ps( _mm_load_si128( (const __m128i*)( row+32 ) ) ), a4 );
+            a5 = _mm256_fmadd_ps( xb, _mm256_cvtph_ps( _mm_load_si128( (const __m128i*)( row+40 ) ) ), a5 );
+            a6 = _mm256_fmadd_ps( xb, _mm256_cvtph_ps( _mm_load_si128( (const __m128i*)( row+48 ) ) ), a6 );
+            a7 = _mm256_fmadd_ps( xb, _mm256_cvtph_ps( _mm_load_si128( (const __m128i*)( row+56 ) ) ), a7 );
+            row += num_sv;
+        }
+
+        total = mr_kernel_term_avx2( total, a0, neg_x_norm, alpha + n );
+        total = mr_kernel_term_avx2( total, a1, neg_x_norm, alpha + n+8 );
+        total = mr_kernel_term_avx2( total, a2, neg_x_norm, alpha + n+16 );
+        total = mr_kernel_term_avx2( total, a3, neg_x_norm, alpha + n+24 );
+        total = mr_kernel_term_avx2( total, a4, neg_x_norm, alpha + n+32 );
+        total = mr_kernel_term_avx2( total, a5, neg_x_norm, alpha + n+40 );
+        total = mr_kernel_term_avx2( total, a6, neg_x_norm, alpha + n+48 );
+        total = mr_kernel_term_avx2( total, a7, neg_x_norm, alpha + n+56 );
+    }
+
+    return mr_hsum_avx2( total );
+}
+
+__attribute__((target("avx2,fma")))
+float mr_rbf_kernel_avx2_int8( const float *x, float x_norm, const void *sv, const float *sv_bias, const float *alpha, int num_sv, int padded_features )
+{
+    const signed char *row;
+    __m256  a0, a1, a2, a3, a4, a5, a6, a7;
+    __m256  xb;
+    __m256  neg_x_norm = _mm256_set1_ps( -x_norm );
+    __m256  total = _mm256_setzero_ps();
+    int     n, k;
+
+    for( n=0; n<num_sv; n+=64 )
+    {
+        a0 = _mm256_load_ps( sv_bias + n );
+        a1 = _mm256_load_ps( sv_bias + n+8 );
+        a2 = _mm256_load_ps( sv_bias + n+16 );
+        a3 = _mm256_load_ps( sv_bias + n+24 );
+        a4 = _mm256_load_ps( sv_bias + n+32 );
+        a5 = _mm256_load_ps( sv_bias + n+40 );
+        a6 = _mm256_load_ps( sv_bias + n+48 );
+        a7 = _mm256_load_ps( sv_bias + n+56 );
+
+        /* Same as the fp32 kernel, with the support vectors converted to fp32 as they are loaded */
+        row = (const signed char*)sv + n;
+        for( k=0; k<padded_features; k+=1 )
+        {
+            xb = _mm256_set1_ps( *(x+k) );
+            a0 = _mm256_fmadd_ps( xb, _mm256_cvtepi32_ps( _mm256_cvtepi8_epi32( _mm_loadl_epi64( (const __m128i*)( row ) ) ) ), a0 );
+            a1 = _mm256_fmadd_ps( xb, _mm256_cvtepi32_ps( _mm256_cvtepi8_epi32( _mm_loadl_epi64( (const __m128i*)( row+8 ) ) ) ), a1 );
+            a2 = _mm256_fmadd_ps( xb, _mm256_cvtepi32_ps( _mm256_cvtepi8_epi32( _mm_loadl_epi64( (const __m128i*)( row+16 ) ) ) ), a2 );
+            a3 = _mm256_fmadd_ps( xb, _mm256_cvtepi32_ps( _mm256_cvtepi8_epi32( _mm_loadl_epi64( (const __m128i*)( row+24 ) ) ) ), a3 );
+            a4 = _mm256_fmadd_ps( xb, _mm256_cvtepi32_ps( _mm256_cvtepi8_epi32( _mm_loadl_epi64( (const __m128i*)( row+32 ) ) ) ), a4 );
+            a5 = _mm256_fmadd_ps( xb, _mm256_cvtepi32_ps( _mm256_cvtepi8_epi32( _mm_loadl_epi64( (const __m128i*)( row+40 ) ) ) ), a5 );
+            a6 = _mm256_fmadd_ps( xb, _mm256_cvtepi32_ps( _mm256_cvtepi8_epi32( _mm_loadl_epi64( (const __m128i*)( row+48 ) ) ) ), a6 );
+            a7 = _mm256_fmadd_ps( xb, _mm256_cvtepi32_ps( _mm256_cvtepi8_epi32( _mm_loadl_epi64( (const __m128i*)( row+56 ) ) ) ), a7 );
+            row += num_sv;
+        }
+
+        total = mr_kernel_term_avx2( total, a0, neg_x_norm, alpha + n );
+        total = mr_kernel_term_avx2( total, a1, neg_x_norm, alpha + n+8 );
+        total = mr_kernel_term_avx2( total, a2, neg_x_norm, alpha + n+16 );
+        total = mr_kernel_term_avx2( total, a3, neg_x_norm, alpha + n+24 );
+        total = mr_kernel_term_avx2( total, a4, neg_x_norm, alpha + n+32 );
+        total = mr_kernel_term_avx2( total, a5, neg_x_norm, alpha + n+40 );
+        total = mr_kernel_term_avx2( total, a6, neg_x_norm, alpha + n+48 );
+        total = mr_kernel_term_avx2( total, a7, neg_x_norm, alpha + n+56 );
+    }
+
+    return mr_hsum_avx2( total );
+}
+
+/* cos(x) for any x of moderate size, to about 1e-6 */
+__attribute__((target("avx2,fma")))
+static inline __m256 mr_cos_avx2( __m256 x )
+{
+    __m256  turns, z, y;
+
+    turns = _mm256_round_ps( _mm256_mul_ps( x, _mm256_set1_ps( MR_INV_2PI ) ), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC );
+    x = _mm256_fnmadd_ps( turns, _mm256_set1_ps( MR_2PI_HI ), x );
+    x = _mm256_fnmadd_ps( turns, _mm256_set1_ps( MR_2PI_LO ), x );
+
+    z = _mm256_mul_ps( x, x );
+    y = _mm256_set1_ps( MR_COS_C8 );
+    y = _mm256_fmadd_ps( y, z, _mm256_set1_ps( MR_COS_C7 ) );
+    y = _mm256_fmadd_ps( y, z, _mm256_set1_ps( MR_COS_C6 ) );
+    y = _mm256_fmadd_ps( y, z, _mm256_set1_ps( MR_COS_C5 ) );
+    y = _mm256_fmadd_ps( y, z, _mm256_set1_ps( MR_COS_C4 ) );
+    y = _mm256_fmadd_ps( y, z, _mm256_set1_ps( MR_COS_C3 ) );
+    y = _mm256_fmadd_ps( y, z, _mm256_set1_ps( MR_COS_C2 ) );
+    y = _mm256_fmadd_ps( y, z, _mm256_set1_ps( MR_COS_C1 ) );
+
+    return _mm256_fmadd_ps( y, z, _mm256_set1_ps( 1.0f ) );
+}
+
+__attribute__((target("avx2,fma")))
+float mr_rff_kernel_avx2( const float *x, const float *weights, const float *phase, const float *beta, int num_components, int padded_features )
+{
+    const float *row;
+    __m256  a0, a1, a2, a3, a4, a5, a6, a7;
+    __m256  xb;
+    __m256  total = _mm256_setzero_ps();
+    int     n, k;
+
+    for( n=0; n<num_components; n+=64 )
+    {
+        a0 = _mm256_load_ps( phase + n );
+        a1 = _mm256_load_ps( phase + n+8 );
+        a2 = _mm256_load_ps( phase + n+16 );
+        a3 = _mm256_load_ps( phase + n+24 );
+        a4 = _mm256_load_ps( phase + n+32 );
+        a5 = _mm256_load_ps( phase + n+40 );
+        a6 = _mm256_load_ps( phase + n+48 );
+        a7 = _mm256_load_ps( phase + n+56 );
+
+        /* The projections of x on 64 random frequencies, in the same order as the support vector kernels */
+        row = weights + n;
+        for( k=0; k<padded_features; k+=1 )
+        {
+            xb = _mm256_set1_ps( *(x+k) );
+            a0 = _mm256_fmadd_ps( xb, _mm256_load_ps( row ), a0 );
+            a1 = _mm256_fmadd_ps( xb, _mm256_load_ps( row+8 ), a1 );
+            a2 = _mm256_fmadd_ps( xb, _mm256_load_ps( row+16 ), a2 );
+            a3 = _mm256_fmadd_ps( xb, _mm256_load_ps( row+24 ), a3 );
+            a4 = _mm256_fmadd_ps( xb, _mm256_load_ps( row+32 ), a4 );
+            a5 = _mm256_fmadd_ps( xb, _mm256_load_ps( row+40 ), a5 );
+            a6 = _mm256_fmadd_ps( xb, _mm256_load_ps( row+48 ), a6 );
+            a7 = _mm256_fmadd_ps( xb, _mm256_load_ps( row+56 ), a7 );
+            row += num_components;
+        }
+
+        total = _mm256_fmadd_ps( mr_cos_avx2( a0 ), _mm256_load_ps( beta + n ), total );
+        total = _mm256_fmadd_ps( mr_cos_avx2( a1 ), _mm256_load_ps( beta + n+8 ), total );
+        total = _mm256_fmadd_ps( mr_cos_avx2( a2 ), _mm256_load_ps( beta + n+16 ), total );
+        total = _mm256_fmadd_ps( mr_cos_avx2( a3 ), _mm256_load_ps( beta + n+24 ), total );
+        total = _mm256_fmadd_ps( mr_cos_avx2( a4 ), _mm256_load_ps( beta + n+32 ), total );
+        total = _mm256_fmadd_ps( mr_cos_avx2( a5 ), _mm256_load_ps( beta + n+40 ), total );
+        total = _mm256_fmadd_ps( mr_cos_avx2( a6 ), _mm256_load_ps( beta + n+48 ), total );
+        total = _mm256_fmadd_ps( mr_cos_avx2( a7 ), _mm256_load_ps( beta + n+56 ), total );
+    }
+
+    return mr_hsum_avx2( total );
+}
+
+/******************************************************/
+
+__attribute__((target("avx512f")))
+static __m512 mr_exp_avx512( __m512 x )
+{
+    __m512  fx, y, z;
+    __m512i n;
+
+    x = _mm512_max_ps( x, _mm512_set1_ps( MR_EXP_LOWER ) );
+
+    fx = _mm512_roundscale_ps( _mm512_fmadd_ps( x, _mm512_set1_ps( MR_LOG2E ), _mm512_set1_ps( 0.5f ) ), _MM_FROUND_TO_NEG_INF );
+
+    x = _mm512_fnmadd_ps( fx, _mm512_set1_ps( MR_LN2_HI ), x );
+    x = _mm512_fnmadd_ps( fx, _mm512_set1_ps( MR_LN2_LO ), x );
+
+    z = _mm512_mul_ps( x, x );
+    y = _mm512_set1_ps( MR_EXP_P0 );
+    y = _mm512_fmadd_ps( y, x, _mm512_set1_ps( MR_EXP_P1 ) );
+    y = _mm512_fmadd_ps( y, x, _mm512_set1_ps( MR_EXP_P2 ) );
+    y = _mm512_fmadd_ps( y, x, _mm512_set1_ps( MR_EXP_P3 ) );
+    y = _mm512_fmadd_ps( y, x, _mm512_set1_ps( MR_EXP_P4 ) );
+    y = _mm512_fmadd_ps( y, x, _mm512_set1_ps( MR_EXP_P5 ) );
+    y = _mm512_add_ps( _mm512_fmadd_ps( y, z, x ), _mm512_set1_ps( 1.0f ) );
+
+    n = _mm512_cvttps_epi32( fx );
+    n = _mm512_slli_epi32( _mm512_add_epi32( n, _mm512_set1_epi32( 127 ) ), 23 );
+
+    return _mm512_mul_ps( y, _mm512_castsi512_ps( n ) );
+}
+
+/* Sum of the sixteen elements of a vector, without the reduce intrinsics that older compilers lack */
+__attribute__((target("avx512f")))
+static float mr_hsum_avx512( __m512 v )
+{
+    __m256 quarter;
+    __m128 half;
+
+    quarter = _mm256_add_ps( _mm512_castps512_ps256( v ),
+                             _mm256_castpd_ps( _mm512_extractf64x4_pd( _mm512_castps_pd( v ), 1 ) ) );
+    half = _mm_add_ps( _mm256_castps256_ps128( quarter ), _mm256_extractf128_ps( quarter, 1 ) );
+    half = _mm_add_ps( half, _mm_movehl_ps( half, half ) );
+    half = _mm_add_ss( half, _mm_shuffle_ps( half, half, 1 ) );
+
+    return _mm_cvtss_f32( half );
+}
+
+/* alpha * exp( min( 0, dot + bias - x_norm ) ) added to total */
+__attribute__((target("avx512f")))
+static inline __m512 mr_kernel_term_avx512( __m512 total, __m512 dot, __m512 neg_x_norm, const float *alpha )
+{
+    __m512 arg;
+
+    arg = _mm512_min_ps( _mm512_add_ps( dot, neg_x_norm ), _mm512_setzero_ps() );
+
+    return _mm512_fmadd_ps( mr_exp_avx512( arg ), _mm512_load_ps( alpha ), total );
+}
+
+__attribute__((target("avx512f")))
+float mr_rbf_kernel_avx512( const float *x, float x_norm, const void *sv, const float *sv_bias, const float *alpha, int num_sv, int padded_features )
+{
+    const float *row;
+    __m512  a0, a1, a2, a3, b0, b1, b2, b3;    /* Even (a) and odd (b) features, to double the independent chains */
+    __m512  xb;
+    __m512  neg_x_norm = _mm512_set1_ps( -x_norm );
+    __m512  total = _mm512_setzero_ps();
+    int     n, k;
+
+    for( n=0; n<num_sv; n+=64 )
+    {
+        a0 = _mm512_load_ps( sv_bias + n );
+        a1 = _mm512_load_ps( sv_bias + n+16 );
+        a2 = _mm512_load_ps( sv_bias + n+32 );
+        a3 = _mm512_load_ps( sv_bias + n+48 );
+        b0 = b1 = b2 = b3 = _mm512_setzero_ps();
+
+        /* One feature of 64 support vectors per step: broadcast the feature, one multiply-add per register */
+        row = (const float*)sv + n;
+        for( k=0; k<padded_features; k+=2 )
+        {
+            xb = _mm512_set1_ps( *(x+k) );
+            a0 = _mm512_fmadd_ps( xb, _mm512_load_ps( row ), a0 );
+            a1 = _mm512_fmadd_ps( xb, _mm512_load_ps( row+16 ), a1 );
+            a2 = _mm512_fmadd_ps( xb, _mm512_load_ps( row+32 ), a2 );
+            a3 = _mm512_fmadd_ps( xb, _mm512_load_ps( row+48 ), a3 );
+            row += num_sv;
+            xb = _mm512_set1_ps( *(x+k+1) );
+            b0 = _mm512_fmadd_ps( xb, _mm512_load_ps( row ), b0 );
+            b1 = _mm512_fmadd_ps( xb, _mm512_load_ps( row+16 ), b1 );
+            b2 = _mm512_fmadd_ps( xb, _mm512_load_ps( row+32 ), b2 );
+            b3 = _mm512_fmadd_ps( xb, _mm512_load_ps( row+48 ), b3 );
+            row += num_sv;
+        }
+
+        total = mr_kernel_term_avx512( total, _mm512_add_ps( a0, b0 ), neg_x_norm, alpha + n );
+        total = mr_kernel_term_avx512( total, _mm512_add_ps( a1, b1 ), neg_x_norm, alpha + n+16 );
+        total = mr_kernel_term_avx512( total, _mm512_add_ps( a2, b2 ), neg_x_norm, alpha + n+32 );
+        total = mr_kernel_term_avx512( total, _mm512_add_ps( a3, b3 ), neg_x_norm, alpha + n+48 );
+    }
+
+    return mr_hsum_avx512( total );
+}
+
+__attribute__((target("avx512f")))
+void mr_rbf_tile_avx512( const float *x, const float *x_norms, const float *sv, int ld_sv, const float *sv_bias,
+                         const float *alpha, int num_sv, int padded_features, float *sums )
+{
+    const float *col;
+    __m512      a00, a01, a10, a11, a20, a21, a30, a31;     /* Dot products, row r and half h in a<r><h> */
+    __m512      t0, t1, t2, t3;
+    __m512      s0, s1, xb;
+    __m512      neg_norm0 = _mm512_set1_ps( -*(x_norms) );
+    __m512      neg_norm1 = _mm512_set1_ps( -*(x_norms+1) );
+    __m512      neg_norm2 = _mm512_set1_ps( -*(x_norms+2) );
+    __m512      neg_norm3 = _mm512_set1_ps( -*(x_norms+3) );
+    int         n, k;
+
+    t0 = t1 = t2 = t3 = _mm512_setzero_ps();
+
+    for( n=0; n<num_sv; n+=32 )
+    {
+        a00 = a01 = a10 = a11 = a20 = a21 = a30 = a31 = _mm512_setzero_ps();
+
+        /* Rank one updates of the 4 x 32 tile: one row of the compiled support vectors times one feature of
+           each row of x, the accumulators stay in registers */
+        col = sv + n;
+        for( k=0; k<padded_features; k++ )
+        {
+            s0 = _mm512_load_ps( col );
+            s1 = _mm512_load_ps( col+16 );
+            xb = _mm512_set1_ps( *(x + k) );
+            a00 = _mm512_fmadd_ps( xb, s0, a00 );
+            a01 = _mm512_fmadd_ps( xb, s1, a01 );
+            xb = _mm512_set1_ps( *(x + padded_features + k) );
+            a10 = _mm512_fmadd_ps( xb, s0, a10 );
+            a11 = _mm512_fmadd_ps( xb, s1, a11 );
+            xb = _mm512_set1_ps( *(x + 2*padded_features + k) );
+            a20 = _mm512_fmadd_ps( xb, s0, a20 );
+            a21 = _mm512_fmadd_ps( xb, s1, a21 );
+            xb = _mm512_set1_ps( *(x + 3*padded_features + k) );
+            a30 = _mm512_fmadd_ps( xb, s0, a30 );
+            a31 = _mm512_fmadd_ps( xb, s1, a31 );
+            col += ld_sv;
+        }
+
+        t0 = mr_kernel_term_avx512( t0, _mm512_add_ps( a00, _mm512_load_ps( sv_bias+n ) ), neg_norm0, alpha+n );
+        t0 = mr_kernel_term_avx512( t0, _mm512_add_ps( a01, _mm512_load_ps( sv_bias+n+16 ) ), neg_norm0, alpha+n+16 );
+        t1 = mr_kernel_term_avx512( t1, _mm512_add_ps( a10, _mm512_load_ps( sv_bias+n ) ), neg_norm1, alpha+n );
+        t1 = mr_kernel_term_avx512( t1, _mm512_add_ps( a11, _mm512_load_ps( sv_bias+n+16 ) ), neg_norm1, alpha+n+16 );
+        t2 = mr_kernel_term_avx512( t2, _mm512_add_ps( a20, _mm512_load_ps( sv_bias+n ) ), neg_norm2, alpha+n );
+        t2 = mr_kernel_term_avx512( t2, _mm512_add_ps( a21, _mm512_load_ps( sv_bias+n+16 ) ), neg_norm2, alpha+n+16 );
+        t3 = mr_kernel_term_avx512( t3, _mm512_add_ps( a30, _mm512_load_ps( sv_bias+n ) ), neg_norm3, alpha+n );
+        t3 = mr_kernel_term_avx512( t3, _mm512_add_ps( a31, _mm512_load_ps( sv_bias+n+16 ) ), neg_norm3, alpha+n+16 );
+    }
+
+    *(sums)   += mr_hsum_avx512( t0 );
+    *(sums+1) += mr_hsum_avx512( t1 );
+    *(sums+2) += mr_hsum_avx512( t2 );
+    *(sums+3) += mr_hsum_avx512( t3 );
+
+    return;
+}
+
+__attribute__((target("avx512f")))
+float mr_rbf_kernel_avx512_fp16( const float *x, float x_norm, const void *sv, const float *sv_bias, const float *alpha, int num_sv, int padded_features )
+{
+    const unsigned short *row;
+    __m512  a0, a1, a2, a3, b0, b1, b2, b3;
+    __m512  xb;
+    __m512  neg_x_norm = _mm512_set1_ps( -x_norm );
+    __m512  total = _mm512_setzero_ps();
+    int     n, k;
+
+    for( n=0; n<num_sv; n+=64 )
+    {
+        a0 = _mm512_load_ps( sv_bias + n );
+        a1 = _mm512_load_ps( sv_bias + n+16 );
+        a2 = _mm512_load_ps( sv_bias + n+32 );
+        a3 = _mm512_load_ps( sv_bias + n+48 );
+        b0 = b1 = b2 = b3 = _mm512_setzero_ps();
+
+        /* Same as the fp32 kernel, with the support vectors converted to fp32 as they are loaded */
+        row = (const unsigned short*)sv + n;
+        for( k=0; k<padded_features; k+=2 )
+        {
+            xb = _mm512_set1_ps( *(x+k) );
+            a0 = _mm512_fmadd_ps( xb, _mm512_cvtph_ps( _mm256_load_si256( (const __m256i*)( row ) ) ), a0 );
+            a1 = _mm512_fmadd_ps( xb, _mm512_cvtph_ps( _mm256_load_si256( (const __m256i*)( row+16 ) ) ), a1 );
+            a2 = _mm512_fmadd_ps( xb, _mm512_cvtph_ps( _mm256_load_si256( (const __m256i*)( row+32 ) ) ), a2 );
+            a3 = _mm512_fmadd_ps( xb, _mm512_cvtph_ps( _mm256_load_si256( (const __m256i*)( row+48 ) ) ), a3 );
+            row += num_sv;
+            xb = _mm512_set1_ps( *(x+k+1) );
+            b0 = _mm512_fmadd_ps( xb, _mm512_cvtph_ps( _mm256_load_si256( (const __m256i*)( row ) ) ), b0 );
+            b1 = _mm512_fmadd_ps( xb, _mm512_cvtph_ps( _mm256_load_si256( (const __m256i*)( row+16 ) ) ), b1 );
+            b2 = _mm512_fmadd_ps( xb, _mm512_cvtph_ps( _mm256_load_si256( (const __m256i*)( row+32 ) ) ), b2 );
+            b3 = _mm512_fmadd_ps( xb, _mm512_cvtph_ps( _mm256_load_si256( (const __m256i*)( row+48 ) ) ), b3 );
+            row += num_sv;
+        }
+
+        total = mr_kernel_term_avx512( total, _mm512_add_ps( a0, b0 ), neg_x_norm, alpha + n );
+        total = mr_kernel_term_avx512( total, _mm512_add_ps( a1, b1 ), neg_x_norm, alpha + n+16 );
+        total = mr_kernel_term_avx512( total, _mm512_add_ps( a2, b2 ), neg_x_norm, alpha + n+32 );
+        total = mr_kernel_term_avx512( total, _mm512_add_ps( a3, b3 ), neg_x_norm, alpha + n+48 );
+    }
+
+    return mr_hsum_avx512( total );
+}
+
+__attribute__((target("avx512f")))
+float mr_rbf_kernel_avx512_int8( const float *x, float x_norm, const void *sv, const float *sv_bias, const float *alpha, int num_sv, int padded_features )
+{
+    const signed char *row;
+    __m512  a0, a1, a2, a3, b0, b1, b2, b3;
+    __m512  xb;
+    __m512  neg_x_norm = _mm512_set1_ps( -x_norm );
+    __m512  total = _mm512_setzero_ps();
+    int     n, k;
+
+    for( n=0; n<num_sv; n+=64 )
+    {
+        a0 = _mm512_load_ps( sv_bias + n );
+        a1 = _mm512_load_ps( sv_bias + n+16 );
+        a2 = _mm512_load_ps( sv_bias + n+32 );
+        a3 = _mm512_load_ps( sv_bias + n+48 );
+        b0 = b1 = b2 = b3 = _mm512_setzero_ps();
+
+        /* Same as the fp32 kernel, with the support vectors converted to fp32 as they are loaded */
+        row = (const signed char*)sv + n;
+        for( k=0; k<padded_features; k+=2 )
+        {
+            xb = _mm512_set1_ps( *(x+k) );
+            a0 = _mm512_fmadd_ps( xb, _mm512_cvtepi32_ps( _mm512_cvtepi8_epi32( _mm_load_si128( (const __m128i*)( row ) ) ) ), a0 );
+            a1 = _mm512_fmadd_ps( xb, _mm512_cvtepi32_ps( _mm512_cvtepi8_epi32( _mm_load_si128( (const __m128i*)( row+16 ) ) ) ), a1 );
+            a2 = _mm512_fmadd_ps( xb, _mm512_cvtepi32_ps( _mm512_cvtepi8_epi32( _mm_load_si128( (const __m128i*)( row+32 ) ) ) ), a2 );
+            a3 = _mm512_fmadd_ps( xb, _mm512_cvtepi32_ps( _mm512_cvtepi8_epi32( _mm_load_si128( (const __m128i*)( row+48 ) ) ) ), a3 );
+            row += num_sv;
+            xb = _mm512_set1_ps( *(x+k+1) );
+            b0 = _mm512_fmadd_ps( xb, _mm512_cvtepi32_ps( _mm512_cvtepi8_epi32( _mm_load_si128( (const __m128i*)( row ) ) ) ), b0 );
+            b1 = _mm512_fmadd_ps( xb, _mm512_cvtepi32_ps( _mm512_cvtepi8_epi32( _mm_load_si128( (const __m128i*)( row+16 ) ) ) ), b1 );
+            b2 = _mm512_fmadd_ps( xb, _mm512_cvtepi32_ps( _mm512_cvtepi8_epi32( _mm_load_si128( (const __m128i*)( row+32 ) ) ) ), b2 );
+            b3 = _mm512_fmadd_ps( xb, _mm512_cvtepi32_ps( _mm512_cvtepi8_epi32( _mm_load_si128( (const __m128i*)( row+48 ) ) ) ), b3 );
+            row += num_sv;
+        }
+
+        total = mr_kernel_term_avx512( total, _mm512_add_ps( a0, b0 ), neg_x_norm, alpha + n );
+        total = mr_kernel_term_avx512( total, _mm512_add_ps( a1, b1 ), neg_x_norm, alpha + n+16 );
+        total = mr_kernel_term_avx512( total, _mm512_add_ps( a2, b2 ), neg_x_norm, alpha + n+32 );
+        total = mr_kernel_term_avx512( total, _mm512_add_ps( a3, b3 ), neg_x_norm, alpha + n+48 );
+    }
+
+    return mr_hsum_avx512( total );
+}
+
+/* cos(x) for any x of moderate size, to about 1e-6 */
+__attribute__((target("avx512f")))
+static inline __m512 mr_cos_avx512( __m512 x )
+{
+    __m512  turns, z, y;
+
+    turns = _mm512_roundscale_ps( _mm512_mul_ps( x, _mm512_set1_ps( MR_INV_2PI ) ), _MM_FROUND_TO_NEAREST_INT );
+    x = _mm512_fnmadd_ps( turns, _mm512_set1_ps( MR_2PI_HI ), x );
+    x = _mm512_fnmadd_ps( turns, _mm512_set1_ps( MR_2PI_LO ), x );
+
+    z = _mm512_mul_ps( x, x );
+    y = _mm512_set1_ps( MR_COS_C8 );
+    y = _mm512_fmadd_ps( y, z, _mm512_set1_ps( MR_COS_C7 ) );
+    y = _mm512_fmadd_ps( y, z, _mm512_set1_ps( MR_COS_C6 ) );
+    y = _mm512_fmadd_ps( y, z, _mm512_set1_ps( MR_COS_C5 ) );
+    y = _mm512_fmadd_ps( y, z, _mm512_set1_ps( MR_COS_C4 ) );
+    y = _mm512_fmadd_ps( y, z, _mm512_set1_ps( MR_COS_C3 ) );
+    y = _mm512_fmadd_ps( y, z, _mm512_set1_ps( MR_COS_C2 ) );
+    y = _mm512_fmadd_ps( y, z, _mm512_set1_ps( MR_COS_C1 ) );
+
+    return _mm512_fmadd_ps( y, z, _mm512_set1_ps( 1.0f ) );
+}
+
+__attribute__((target("avx512f")))
+float mr_rff_kernel_avx512( const float *x, const float *weights, const float *phase, const float *beta, int num_components, int padded_features )
+{
+    const float *row;
+    __m512  a0, a1, a2, a3, b0, b1, b2, b3;
+    __m512  xb;
+    __m512  total = _mm512_setzero_ps();
+    int     n, k;
+
+    for( n=0; n<num_components; n+=64 )
+    {
+        a0 = _mm512_load_ps( phase + n );
+        a1 = _mm512_load_ps( phase + n+16 );
+        a2 = _mm512_load_ps( phase + n+32 );
+        a3 = _mm512_load_ps( phase + n+48 );
+        b0 = b1 = b2 = b3 = _mm512_setzero_ps();
+
+        /* The projections of x on 64 random frequencies, in the same order as the support vector kernels */
+        row = weights + n;
+        for( k=0; k<padded_features; k+=2 )
+        {
+            xb = _mm512_set1_ps( *(x+k) );
+            a0 = _mm512_fmadd_ps( xb, _mm512_load_ps( row ), a0 );
+            a1 = _mm512_fmadd_ps( xb, _mm512_load_ps( row+16 ), a1 );
+            a2 = _mm512_fmadd_ps( xb, _mm512_load_ps( row+32 ), a2 );
+            a3 = _mm512_fmadd_ps( xb, _mm512_load_ps( row+48 ), a3 );
+            row += num_components;
+            xb = _mm512_set1_ps( *(x+k+1) );
+            b0 = _mm512_fmadd_ps( xb, _mm512_load_ps( row ), b0 );
+            b1 = _mm512_fmadd_ps( xb, _mm512_load_ps( row+16 ), b1 );
+            b2 = _mm512_fmadd_ps( xb, _mm512_load_ps( row+32 ), b2 );
+            b3 = _mm512_fmadd_ps( xb, _mm512_load_ps( row+48 ), b3 );
+            row += num_components;
+        }
+
+        total = _mm512_fmadd_ps( mr_cos_avx512( _mm512_add_ps( a0, b0 ) ), _mm512_load_ps( beta + n ), total );
+        total = _mm512_fmadd_ps( mr_cos_avx512( _mm512_add_ps( a1, b1 ) ), _mm512_load_ps( beta + n+16 ), total );
+        total = _mm512_fmadd_ps( mr_cos_avx512( _mm512_add_ps( a2, b2 ) ), _mm512_load_ps( beta + n+32 ), total );
+        total = _mm512_fmadd_ps( mr_cos_avx512( _mm512_add_ps( a3, b3 ) ), _mm512_load_ps( beta + n+48 ), total );
+    }
+
+    return mr_hsum_avx512( total );
+}
+
+/******************************************************/
+
+/* 3 for AVX-512F, 2 for AVX2 with FMA, 1 for SSE2 and 0 for none of them.  __builtin_cpu_supports() also
+   checks that the operating system saves the wider registers */
+static int mr_simd_level( void )
+{
+    __builtin_cpu_init();
+
+    if( __builtin_cpu_supports( "avx512f" ) )
+        return 3;
+    if( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) )
+        return 2;
+    if( __builtin_cpu_supports( "sse2" ) )
+        return 1;
+
+    return 0;
+}
+
+/******************************************************/
+
+mr_rbf_kernel mr_select_rbf_kernel( int precision, const char **name )
+{
+    const char      *names[4] = { "scalar", "SSE2", "AVX2", "AVX-512" };
+    mr_rbf_kernel   kernels[3][4] = { { mr_rbf_kernel_scalar, mr_rbf_kernel_sse2, mr_rbf_kernel_avx2, mr_rbf_kernel_avx512 },
+                                      { mr_rbf_kernel_scalar_fp16, mr_rbf_kernel_scalar_fp16, mr_rbf_kernel_avx2_fp16, mr_rbf_kernel_avx512_fp16 },
+                                      { mr_rbf_kernel_scalar_int8, mr_rbf_kernel_scalar_int8, mr_rbf_kernel_avx2_int8, mr_rbf_kernel_avx512_int8 } };
+    int             level = mr_simd_level();
+
+    /* There are no SSE2 kernels for the quantized formats, SSE2 has no half conversion or byte widening */
+    if( precision != MR_PRECISION_FP32 && level == 1 )
+        level = 0;
+    /* F16C is a separate CPUID bit from AVX2 and FMA, the AVX2 half float kernel needs all three */
+    if( precision == MR_PRECISION_FP16 && level == 2 && !__builtin_cpu_supports( "f16c" ) )
+        level = 0;
+
+    if( name != NULL )
+        *name = names[level];
+
+    return kernels[precision][level];
+}
+
+/******************************************************/
+
+mr_rbf_tile_kernel mr_select_rbf_tile_kernel( void )
+{
+    mr_rbf_tile_kernel  kernels[4] = { mr_rbf_tile_scalar, mr_rbf_tile_sse2, mr_rbf_tile_avx2, mr_rbf_tile_avx512 };
+
+    return kernels[mr_simd_level()];
+}
+
+/******************************************************/
+
+mr_rff_kernel mr_select_rff_kernel( void )
+{
+    mr_rff_kernel   kernels[4] = { mr_rff_kernel_scalar, mr_rff_kernel_scalar, mr_rff_kernel_avx2, mr_rff_kernel_avx512 };
+
+    return kernels[mr_simd_level()];
+}
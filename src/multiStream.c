@@ -0,0 +1,419 @@
+/* multiStream.c Contains definitions of functions used to analyse several audio inputs in one process
+ * Copyright (c) 2017 Jay Biernat
+ * Copyright (c) 2017 University of Rochester
+ *
+ * This file is part of Musical Mood Detector and Visualizer
+ *
+ * Musical Mood Detector and Visualizer is free software: you can
+ * redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Musical Mood Detector and Visualizer is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even
+ * the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Musical Mood Detector and Visualizer.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+#include <process.h>
+#include <conio.h>
+#include <portaudio.h>
+#include "featureExtraction.h"
+#include "moodRecognition.h"
+#include "multiStream.h"
+
+void ms_initialize_engine( ms_engine *engine, int num_streams, int num_threads )
+{
+    ms_stream   *stream;
+    int         num_features;
+    int         k;
+
+    engine->init_success =          0;
+    engine->num_streams =           0;
+    engine->streams =               NULL;
+    engine->num_threads =           0;
+    engine->work =                  NULL;
+    engine->next_stream =           0;
+    engine->terminate_threads =     0;
+    engine->prediction_cadence =    MR_PREDICTION_CADENCE;
+
+    /* Cleaning frees the plan tables and models, so they must be NULL if initialization stops before them */
+    engine->info.plan.bin_frequency =       NULL;
+    engine->info.plan.window =              NULL;
+    engine->info.plan.band_boundary =       NULL;
+    engine->info.plan.band_neighborhood =   NULL;
+    mr_load_live_models( &engine->arousal_mdl, &engine->valence_mdl );
+    if( !engine->arousal_mdl.init_success || !engine->valence_mdl.init_success )
+        return;
+
+    if( num_streams < 1 || num_streams > MS_MAX_STREAMS || num_threads < 1 || num_threads > MS_MAX_THREADS )
+        return;
+
+    fe_initialize_extraction_info( &engine->info );
+    if( !engine->info.init_success )
+        return;
+
+    engine->streams = (ms_stream*)malloc( sizeof(ms_stream) * num_streams );
+    engine->work = CreateSemaphore( NULL, 0, 0x7FFFFFFF, NULL );
+    if( engine->streams == NULL || engine->work == NULL )
+        return;
+
+    /* Every stream after the first executes the first stream's plans */
+    num_features = engine->info.num_timbre_features * 2 + engine->info.num_onset_features;
+    for( k=0; k<num_streams; k++ )
+    {
+        stream = engine->streams + k;
+        stream->extraction = fe_initialize_extraction_thread_data_shared( &engine->info,
+                                                                          ( k == 0 ) ? NULL : &engine->streams->extraction );
+        if( !stream->extraction.init_success )
+            return;
+
+        stream->features = (float*)malloc( sizeof(float) * num_features );
+        if( stream->features == NULL )
+        {
+            fe_clean_extraction_thread_data( &stream->extraction );
+            return;
+        }
+
+        stream->next_frame =            engine->info.frames_in_window;
+        stream->busy =                  0;
+        stream->prediction.sequence =   0;
+        stream->prediction.arousal =    0;
+        stream->prediction.valence =    0;
+        stream->prediction.frame =      0;
+        stream->engine =                engine;
+        engine->num_streams++;
+    }
+
+    engine->num_threads = num_threads;
+    engine->init_success = 1;
+}
+
+/******************************************************/
+
+int ms_start_engine( ms_engine *engine )
+{
+    unsigned    threadId;
+    int         i;
+
+    engine->terminate_threads = 0;
+    for( i=0; i<engine->num_threads; i++ )
+    {
+        engine->threads[i] = (HANDLE)_beginthreadex( NULL, 0, ms_workerRoutine, engine, 0, &threadId );
+        if( engine->threads[i] == 0 )
+        {
+            engine->num_threads = i;
+            ms_stop_engine( engine );
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/******************************************************/
+
+void ms_stop_engine( ms_engine *engine )
+{
+    int i;
+
+    engine->terminate_threads = 1;
+    ReleaseSemaphore( engine->work, engine->num_threads, NULL );    /* Wake every worker to see the flag */
+
+    WaitForMultipleObjects( engine->num_threads, engine->threads, TRUE, INFINITE );
+    for( i=0; i<engine->num_threads; i++ )
+        CloseHandle( engine->threads[i] );
+}
+
+/******************************************************/
+
+void ms_clean_engine( ms_engine *engine )
+{
+    int k;
+
+    /* The first stream owns the plans the others borrow, so it is cleaned last */
+    for( k=engine->num_streams-1; k>=0; k-- )
+    {
+        fe_clean_extraction_thread_data( &( engine->streams + k )->extraction );
+        free( ( engine->streams + k )->features );
+    }
+    free( engine->streams );
+    if( engine->work != NULL )
+        CloseHandle( engine->work );
+
+    mr_destroy( &engine->arousal_mdl );
+    mr_destroy( &engine->valence_mdl );
+    fe_clean_extraction_info( &engine->info );
+
+    engine->streams = NULL;
+    engine->work = NULL;
+    engine->num_streams = 0;
+}
+
+/******************************************************/
+
+LONG ms_read_prediction( ms_stream *stream, float *arousal, float *valence )
+{
+    LONG before, after;
+
+    do
+    {
+        before = __atomic_load_n( &stream->prediction.sequence, __ATOMIC_ACQUIRE );
+        *arousal = stream->prediction.arousal;
+        *valence = stream->prediction.valence;
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );     /* The copies finish before the sequence is read again */
+        after = stream->prediction.sequence;
+    }
+    while( ( before & 1 ) || before != after );
+
+    return before / 2;
+}
+
+/******************************************************/
+
+/** @brief Analyses one batch of a claimed stream's pending frames and makes its prediction if one is due
+
+    @return Number of frames analysed
+*/
+static int ms_analyse_stream( ms_engine *engine, ms_stream *stream )
+{
+    fe_extraction_thread_data   *data = &stream->extraction;
+    float                       arousal, valence;
+    LONG                        completed;
+    int                         num;
+
+    num = fe_analyse_pending( data, FE_FFT_BATCH );
+    completed = data->frames_completed;
+    if( num == 0 || (LONG)( completed - stream->next_frame ) < 0 )
+        return num;
+
+    mr_compute_features( stream->features, data->timbre_sum, data->timbre_sum_sq, data->rectified_flux_buffer,
+                         &data->autocorrelation, &engine->info );
+    arousal = mr_predict( stream->features, &engine->arousal_mdl );
+    valence = mr_predict( stream->features, &engine->valence_mdl );
+
+    /* The interlocked increments are full barriers around the writes, see ms_read_prediction() */
+    InterlockedIncrement( &stream->prediction.sequence );
+    stream->prediction.arousal =    arousal;
+    stream->prediction.valence =    valence;
+    stream->prediction.frame =      completed;
+    InterlockedIncrement( &stream->prediction.sequence );
+
+    stream->next_frame = completed + engine->prediction_cadence;
+
+    return num;
+}
+
+/******************************************************/
+
+unsigned int __stdcall ms_workerRoutine( void *lpArg )
+{
+    ms_engine   *engine = (ms_engine*)lpArg;
+    ms_stream   *stream;
+    int         found;
+    LONG        start;
+    int         k;
+
+    while( !(engine->terminate_threads) )
+    {
+        /* Timeout only bounds how long termination can go unnoticed */
+        WaitForSingleObject( engine->work, 100 );
+
+        /* One batch per stream per pass, so a stream with a long backlog does not hold a worker from the others */
+        do
+        {
+            found = 0;
+            start = InterlockedIncrement( &engine->next_stream );
+            for( k=0; k<engine->num_streams && !(engine->terminate_threads); k++ )
+            {
+                stream = engine->streams + (unsigned long)( start + k ) % engine->num_streams;
+                if( InterlockedCompareExchange( &stream->busy, 1, 0 ) != 0 )
+                    continue;
+
+                found += ms_analyse_stream( engine, stream );
+                InterlockedExchange( &stream->busy, 0 );
+
+                /* A worker woken for this stream while it was claimed has skipped it, so check again after releasing */
+                if( fe_ring_read_available( &stream->extraction.ring ) >= (unsigned int)engine->info.frame_length )
+                    found++;
+            }
+        }
+        while( found > 0 && !(engine->terminate_threads) );
+    }
+
+    _endthreadex( 0 );
+    return 0;
+}
+
+/******************************************************/
+
+int ms_callback( const void                        *inputBuffer,
+                 void                              *outputBuffer,
+                 unsigned long                     framesPerBuffer,
+                 const PaStreamCallbackTimeInfo*   timeInfo,
+                 PaStreamCallbackFlags             statusFlags,
+                 void                              *userData )
+{
+    ms_stream *stream = (ms_stream*)userData;
+
+    paCallBack( inputBuffer, outputBuffer, framesPerBuffer, timeInfo, statusFlags, &stream->extraction );
+    ReleaseSemaphore( stream->engine->work, 1, NULL );     /* Does not block, so it is safe to call from the callback */
+
+    return 0;
+}
+
+/******************************************************/
+
+int ms_run( int argc, char *argv[] )
+{
+    ms_engine           engine;
+    PaStream            *streams[MS_MAX_STREAMS];
+    PaStreamParameters  inputParameters;
+    PaError             err;
+    SYSTEM_INFO         systemInfo;
+    const PaDeviceInfo  *deviceInfo;
+    int                 devices[MS_MAX_STREAMS];
+    int                 num_devices = 0;
+    int                 num_open = 0;
+    int                 num_threads;
+    int                 seconds = 0;
+    int                 elapsed;
+    float               arousal, valence;
+    int                 status = -1;
+    int                 i;
+
+    GetSystemInfo( &systemInfo );
+    num_threads = ( systemInfo.dwNumberOfProcessors < MS_MAX_THREADS ) ? (int)systemInfo.dwNumberOfProcessors : MS_MAX_THREADS;
+
+    for( i=0; i<argc; i++ )
+    {
+        if( strcmp( argv[i], "-threads" ) == 0 && i+1 < argc )
+            num_threads = atoi( argv[++i] );
+        else if( strcmp( argv[i], "-seconds" ) == 0 && i+1 < argc )
+            seconds = atoi( argv[++i] );
+        else if( argv[i][0] != '-' && num_devices < MS_MAX_STREAMS )
+            devices[num_devices++] = atoi( argv[i] );
+        else
+        {
+            num_devices = 0;
+            break;
+        }
+    }
+
+    err = Pa_Initialize();
+    if( err != paNoError )
+    {
+        fprintf( stderr, "An error occured while initializing PortAudio: %s\n", Pa_GetErrorText( err ) );
+        return -1;
+    }
+
+    if( num_devices == 0 )
+    {
+        fprintf( stderr, "Usage: MMDaV -streams [-threads N] [-seconds N] device...\n"
+                         "  -threads    Number of worker threads shared by the streams (default: one per processor)\n"
+                         "  -seconds    Stop after this many seconds (default: when a key is pressed)\n"
+                         "  device      Number of an input device, one stream is analysed per device:\n" );
+        for( i=0; i<Pa_GetDeviceCount(); i++ )
+        {
+            deviceInfo = Pa_GetDeviceInfo( i );
+            if( deviceInfo != NULL && deviceInfo->maxInputChannels >= NUM_CHANNELS )
+                fprintf( stderr, "\t%d: %s\n", i, deviceInfo->name );
+        }
+        Pa_Terminate();
+        return -1;
+    }
+
+    ms_initialize_engine( &engine, num_devices, num_threads );
+    if( !engine.init_success )
+    {
+        fprintf( stderr, "There was a problem initializing the analysis of %d streams with %d threads\n", num_devices, num_threads );
+        goto exit;
+    }
+
+    for( num_open=0; num_open<num_devices; num_open++ )
+    {
+        deviceInfo = Pa_GetDeviceInfo( devices[num_open] );
+        if( deviceInfo == NULL || deviceInfo->maxInputChannels < NUM_CHANNELS )
+        {
+            fprintf( stderr, "Device %d is not a stereo input device\n", devices[num_open] );
+            goto exit;
+        }
+
+        inputParameters.device = devices[num_open];
+        inputParameters.channelCount = NUM_CHANNELS;
+        inputParameters.sampleFormat = paFloat32;
+        inputParameters.hostApiSpecificStreamInfo = NULL;
+        inputParameters.suggestedLatency = deviceInfo->defaultLowInputLatency;
+
+        err = Pa_OpenStream( &streams[num_open], &inputParameters, NULL, engine.info.fs, engine.info.buffer_length,
+                             paClipOff, ms_callback, engine.streams + num_open );
+        if( err != paNoError )
+        {
+            fprintf( stderr, "Could not open device %d: %s\n", devices[num_open], Pa_GetErrorText( err ) );
+            goto exit;
+        }
+    }
+
+    if( !ms_start_engine( &engine ) )
+    {
+        fprintf( stderr, "Error starting worker threads\n" );
+        goto exit;
+    }
+
+    for( i=0; i<num_open; i++ )
+    {
+        err = Pa_StartStream( streams[i] );
+        if( err != paNoError )
+        {
+            fprintf( stderr, "Could not start device %d: %s\n", devices[i], Pa_GetErrorText( err ) );
+            break;
+        }
+    }
+
+    if( i == num_open )
+    {
+        printf( "Analysing %d streams with %d threads, %s\n", num_open, engine.num_threads,
+                seconds > 0 ? "" : "press a key to stop" );
+        for( elapsed=0; ( seconds <= 0 || elapsed < seconds ) && !_kbhit(); elapsed++ )
+        {
+            Sleep( 1000 );
+            printf( "%5d s", elapsed+1 );
+            for( i=0; i<num_open; i++ )
+            {
+                if( ms_read_prediction( engine.streams + i, &arousal, &valence ) > 0 )
+                    printf( "   %d: %6.3f %6.3f", devices[i], arousal, valence );
+                else
+                    printf( "   %d:   ----   ----", devices[i] );
+            }
+            printf( "\n" );
+        }
+        status = 0;
+    }
+
+    for( i=0; i<num_open; i++ )
+        Pa_StopStream( streams[i] );
+    ms_stop_engine( &engine );
+
+    for( i=0; i<num_open; i++ )
+        printf( "Device %d: %ld predictions, %lu buffers dropped, %lu input overflows\n", devices[i],
+                ms_read_prediction( engine.streams + i, &arousal, &valence ),
+                engine.streams[i].extraction.overruns, engine.streams[i].extraction.input_overflows );
+
+exit:
+    for( i=0; i<num_open; i++ )
+        Pa_CloseStream( streams[i] );
+    ms_clean_engine( &engine );
+    Pa_Terminate();
+
+    return status;
+}